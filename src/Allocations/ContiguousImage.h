@@ -12,6 +12,7 @@ class ContiguousImage {
  public:
   typedef typename Directory<Offset>::AllocationIndex Index;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   ContiguousImage(const VirtualAddressMap<Offset> &addressMap,
                   const Directory<Offset> &directory)
@@ -42,7 +43,7 @@ class ContiguousImage {
       _pFirstChar = _bufferAsChars;
       _pFirstOffset = _bufferAsOffsets;
       _pPastOffsets = _bufferAsOffsets;
-      const Allocation *allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation != nullptr) {
         Offset address = allocation->Address();
         Offset size = allocation->Size();
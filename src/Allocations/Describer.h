@@ -19,6 +19,7 @@ class Describer : public chap::Describer<Offset> {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
   Describer(const InModuleDescriber<Offset>& inModuleDescriber,
             const StackDescriber<Offset>& stackDescriber,
             const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
@@ -47,7 +48,7 @@ class Describer : public chap::Describer<Offset> {
     if (index == _directory.NumAllocations()) {
       return false;
     }
-    const Allocation* allocation = _directory.AllocationAt(index);
+    AllocationPointer allocation = _directory.AllocationAt(index);
     if (allocation == 0) {
       abort();
     }
@@ -6,6 +6,7 @@
 #include <functional>
 #include <set>
 #include <vector>
+#include "../MappedVector.h"
 namespace chap {
 namespace Allocations {
 template <class Offset>
@@ -55,7 +56,7 @@ class Directory {
      */
     void MarkAsThreadCached() {
       _sizeAndBits |= THREAD_CACHED_BIT;
-      _sizeAndBits &= USED_BIT;
+      _sizeAndBits &= ~USED_BIT;
     }
 
     Offset Address() const { return _address; }
@@ -95,6 +96,15 @@ class Directory {
         WRAPPED_BIT >> NUM_FINDER_INDEX_BITS;
     static constexpr Offset SIZE_MASK = LOW_FINDER_INDEX_BIT - 1;
 
+    /*
+     * This is used by the directory to reassemble an allocation from the
+     * address and the size and status bits, which it keeps in separate
+     * columns.
+     */
+    Allocation(Offset address, Offset sizeAndBits)
+        : _address(address), _sizeAndBits(sizeAndBits) {}
+    friend class Directory;
+
     Offset _address;
     Offset _sizeAndBits;
 
@@ -102,43 +112,64 @@ class Directory {
     static constexpr Offset MAX_FINDERS = 1 << NUM_FINDER_INDEX_BITS;
   };
 
+  /*
+   * AllocationAt returns one of these, which acts as a pointer to a copy of
+   * the allocation at the given index, or as a null pointer if the index is
+   * not valid.  The copy is made because the directory keeps the addresses
+   * and the sizes in separate columns rather than keeping Allocation
+   * objects.  Comparison is supported only against a null pointer.
+   */
+  class AllocationPointer {
+   public:
+    AllocationPointer() : _allocation(0, 0), _isNull(true) {}
+    AllocationPointer(const Allocation* allocation)
+        : _allocation(allocation == (const Allocation*)(0) ? Allocation(0, 0)
+                                                           : *allocation),
+          _isNull(allocation == (const Allocation*)(0)) {}
+    const Allocation* operator->() const { return &_allocation; }
+    Allocation operator*() const { return _allocation; }
+    bool operator==(const Allocation* allocation) const {
+      return _isNull && allocation == (const Allocation*)(0);
+    }
+    bool operator!=(const Allocation* allocation) const {
+      return !(*this == allocation);
+    }
+
+   private:
+    friend class Directory;
+    AllocationPointer(Offset address, Offset sizeAndBits)
+        : _allocation(address, sizeAndBits), _isNull(false) {}
+    Allocation _allocation;
+    bool _isNull;
+  };
+
   /*
    * This class is used to report a sequence of allocations just once, so
    * that information can be cached in a Directory.
    */
 
+  /*
+   * This describes one allocation as reported by a Finder.
+   */
+  struct Record {
+    Record(Offset address, Offset size, bool isUsed)
+        : _address(address), _size(size), _isUsed(isUsed) {}
+    Offset _address;
+    Offset _size;
+    bool _isUsed;
+  };
+
   class Finder {
    public:
     /*
-     * Return true if there are no more allocations available.
+     * Return the next block of allocations to be reported by this finder,
+     * setting numRecords to the number of allocations in the block, or
+     * return null with numRecords set to 0 if there are no more allocations.
+     * The allocations in each block must be in increasing order of address,
+     * and must follow any allocations in the previous block.  The block must
+     * remain valid until the next call.
      */
-    virtual bool Finished() = 0;
-    /*
-     * Return the address of the next allocation (in increasing order of
-     * address) to be reported by this finder, without advancing to the next
-     * allocation.  The return value is undefined if there are no more
-     * allocations available.  Note that at the time this function is called
-     * any allocations already reported by this allocation finder have already
-     * been assigned allocation indices in the Directory.
-     */
-    virtual Offset NextAddress() = 0;
-    /*
-     * Return the size of the next allocation (in increasing order of
-     * address) to be reported by this finder, without advancing to the next
-     * allocation.  The return value is undefined if there are no more
-     * allocations available.
-     */
-    virtual Offset NextSize() = 0;
-    /*
-     * Return true if the next allocation (in increasing order of address) to
-     * address) to be reported by this finder is considered used, without
-     * advancing to the next allocation.
-     */
-    virtual bool NextIsUsed() = 0;
-    /*
-     * Advance to the next allocation.
-     */
-    virtual void Advance() = 0;
+    virtual const Record* NextBlock(size_t& numRecords) = 0;
     /*
      * Return the smallest request size that might reasonably have resulted
      * in an allocation of the given size.
@@ -187,27 +218,7 @@ class Directory {
     if (_allocationBoundariesResolved) {
       abort();
     }
-    std::vector<size_t> activeFinders;
-    size_t numFinders = _indexToFinder.size();
-    activeFinders.reserve(numFinders);
-    for (size_t i = 0; i < numFinders; i++) {
-      Finder* finder = _indexToFinder[i];
-      if (!(finder->Finished())) {
-        activeFinders.push_back(i);
-      }
-    }
-
-    if (!activeFinders.empty()) {
-      Offset numActiveFinders = activeFinders.size();
-      if (numActiveFinders == 1) {
-        AppendRemainingAllocationsFromFinder(activeFinders[0]);
-      } else if (numActiveFinders == 2) {
-        AppendRemainingAllocationsFromFinders(activeFinders[0],
-                                              activeFinders[1]);
-      } else {
-        AppendRemainingAllocationsFromFinders(activeFinders);
-      }
-    }
+    AppendAllocationsFromFinders();
 
     _allocationBoundariesResolved = true;
     for (auto& callback : _resolutionDoneCallbacks) {
@@ -232,23 +243,29 @@ class Directory {
 
   // index is same as NumAllocations() if offset is not in any range.
   AllocationIndex AllocationIndexOf(Offset addr) const {
-    size_t limit = _allocations.size();
+    /*
+     * The search uses only the dense column of addresses, to avoid bringing
+     * the sizes and status bits of the probed allocations into the cache.
+     * Allocations that are not wrappers never overlap, so the only one that
+     * might contain the address is the last one that starts at or before it.
+     */
+    size_t limit = _addresses.size();
     size_t base = 0;
     while (base < limit) {
       size_t mid = (base + limit) / 2;
-      const Allocation& allocation = _allocations[mid];
-      Offset allocationAddress = allocation.Address();
-      Offset allocationLimit = allocationAddress + allocation.Size();
-      if (addr >= allocationAddress) {
-        if (addr < allocationLimit && !allocation.IsWrapper()) {
-          return (AllocationIndex)(mid);
-        } else {
-          base = mid + 1;
-        }
+      if (addr >= _addresses[mid]) {
+        base = mid + 1;
       } else {
         limit = mid;
       }
     }
+    if (base > 0) {
+      Allocation allocation = At(base - 1);
+      if (!allocation.IsWrapper() &&
+          addr < allocation.Address() + allocation.Size()) {
+        return (AllocationIndex)(base - 1);
+      }
+    }
     for (const std::vector<AllocationIndex>& level : _wrappers) {
       /*
        * If there are any wrappers, the address might be in one of them but
@@ -264,7 +281,7 @@ class Directory {
       while (base < limit) {
         size_t mid = (base + limit) / 2;
         size_t allocationIndex = level[mid];
-        const Allocation& allocation = _allocations[allocationIndex];
+        Allocation allocation = At(allocationIndex);
         Offset allocationAddress = allocation.Address();
         Offset allocationLimit = allocationAddress + allocation.Size();
         if (addr >= allocationAddress) {
@@ -278,22 +295,22 @@ class Directory {
         }
       }
     }
-    return _allocations.size();
+    return _addresses.size();
   }
 
   // null if index is not valid.
-  const Allocation* AllocationAt(AllocationIndex index) const {
-    if (index < _allocations.size()) {
-      return &_allocations[index];
+  AllocationPointer AllocationAt(AllocationIndex index) const {
+    if (index < _addresses.size()) {
+      return AllocationPointer(_addresses[index], _sizesAndBits[index]);
     }
-    return (const Allocation*)0;
+    return AllocationPointer();
   }
   // 0 If index is not valid, otherwise somewhere <= the size of the
   // allocation.
   Offset MinRequestSize(AllocationIndex index) const {
     Offset minRequestSize = 0;
-    if (index < _allocations.size()) {
-      const Allocation& allocation = _allocations[index];
+    if (index < _addresses.size()) {
+      Allocation allocation = At(index);
       minRequestSize = _indexToFinder[allocation.FinderIndex()]->MinRequestSize(
           allocation.Size());
     }
@@ -304,7 +321,7 @@ class Directory {
    * Return the number of allocations.  This returns 0 before Resolve() has
    * been called.
    */
-  AllocationIndex NumAllocations() const { return _allocations.size(); }
+  AllocationIndex NumAllocations() const { return _addresses.size(); }
 
   /*
    * Return the maximum size of any allocation in the directory.  This returns
@@ -317,8 +334,10 @@ class Directory {
    * isn't valid.
    */
   void MarkAsFree(AllocationIndex index) {
-    if (index < _allocations.size()) {
-      _allocations[index].MarkAsFree();
+    if (index < _addresses.size()) {
+      Allocation allocation = At(index);
+      allocation.MarkAsFree();
+      _sizesAndBits[index] = allocation._sizeAndBits;
     }
   }
 
@@ -328,8 +347,10 @@ class Directory {
    * thread cached also marks it s free.
    */
   void MarkAsThreadCached(AllocationIndex index) {
-    if (index < _allocations.size()) {
-      _allocations[index].MarkAsThreadCached();
+    if (index < _addresses.size()) {
+      Allocation allocation = At(index);
+      allocation.MarkAsThreadCached();
+      _sizesAndBits[index] = allocation._sizeAndBits;
       _hasThreadCached = true;
     }
   }
@@ -339,8 +360,7 @@ class Directory {
    * the corresponding allocation has been marked as thread-cached.
    */
   bool IsThreadCached(AllocationIndex index) const {
-    return (index < _allocations.size()) &&
-           _allocations[index].IsThreadCached();
+    return (index < _addresses.size()) && At(index).IsThreadCached();
   }
 
   /*
@@ -357,7 +377,13 @@ class Directory {
   }
 
  private:
-  std::vector<Allocation> _allocations;
+  /*
+   * The addresses of the allocations are kept in a column of their own, so
+   * that searches by address touch only the addresses, and the sizes and
+   * status bits are kept in a parallel column.
+   */
+  MappedVector<Offset> _addresses;
+  MappedVector<Offset> _sizesAndBits;
   bool _allocationBoundariesResolved;
   bool _freeStatusFinalized;
   bool _hasThreadCached;
@@ -368,19 +394,118 @@ class Directory {
   std::vector<std::vector<AllocationIndex> > _wrappers;
   mutable std::vector<ResolutionDoneCallback> _resolutionDoneCallbacks;
 
-  void ConsumeCurrentAllocation(size_t finderIndex, Finder* finder) {
-    Offset address = finder->NextAddress();
-    Offset size = finder->NextSize();
+  Allocation At(size_t index) const {
+    return Allocation(_addresses[index], _sizesAndBits[index]);
+  }
+
+  /*
+   * This is the position of the merge in the current block for one finder.
+   */
+  struct Cursor {
+    Cursor(size_t finderIndex)
+        : _finderIndex(finderIndex),
+          _next((const Record*)(0)),
+          _limit((const Record*)(0)) {}
+    size_t _finderIndex;
+    const Record* _next;
+    const Record* _limit;
+  };
+
+  /*
+   * Return true if the first record should be placed in the directory
+   * before the second, which is the case if it starts first or, in the case
+   * that both start at the same address, if it is larger and so contains
+   * the other.
+   */
+  static bool Precedes(const Record& first, const Record& second) {
+    return (first._address < second._address) ||
+           (first._address == second._address && first._size > second._size);
+  }
+
+  /*
+   * Fetch the next non-empty block for the given cursor, returning false if
+   * the finder has no more allocations.
+   */
+  bool FetchBlock(Cursor& cursor) {
+    Finder* finder = _indexToFinder[cursor._finderIndex];
+    size_t numRecords = 0;
+    do {
+      cursor._next = finder->NextBlock(numRecords);
+      if (cursor._next == (const Record*)(0)) {
+        return false;
+      }
+    } while (numRecords == 0);
+    cursor._limit = cursor._next + numRecords;
+    return true;
+  }
+
+  void AppendAllocationsFromFinders() {
+    std::vector<Cursor> cursors;
+    size_t numFinders = _indexToFinder.size();
+    cursors.reserve(numFinders);
+    for (size_t i = 0; i < numFinders; i++) {
+      cursors.emplace_back(i);
+      if (!FetchBlock(cursors.back())) {
+        cursors.pop_back();
+      }
+    }
+    while (!cursors.empty()) {
+      /*
+       * Find the cursor with the first allocation and, if there is more than
+       * one cursor, the first allocation among the remaining cursors.
+       */
+      size_t first = 0;
+      const Record* second = (const Record*)(0);
+      for (size_t i = 1; i < cursors.size(); i++) {
+        const Record* candidate = cursors[i]._next;
+        if (Precedes(*candidate, *(cursors[first]._next))) {
+          second = cursors[first]._next;
+          first = i;
+        } else if (second == (const Record*)(0) ||
+                   Precedes(*candidate, *second)) {
+          second = candidate;
+        }
+      }
+      Cursor& cursor = cursors[first];
+      /*
+       * Take every allocation from the current block of the first cursor
+       * that precedes the first allocation from any other cursor, which in
+       * the common case that the finders cover disjoint ranges is the whole
+       * rest of the block.
+       */
+      const Record* runLimit = cursor._limit;
+      if (second != (const Record*)(0) &&
+          !Precedes(*(runLimit - 1), *second)) {
+        runLimit = std::partition_point(
+            cursor._next, runLimit,
+            [second](const Record& record) {
+              return Precedes(record, *second);
+            });
+        if (runLimit == cursor._next) {
+          ++runLimit;
+        }
+      }
+      for (; cursor._next != runLimit; ++cursor._next) {
+        ConsumeAllocation(cursor._finderIndex, *(cursor._next));
+      }
+      if (cursor._next == cursor._limit && !FetchBlock(cursor)) {
+        cursors.erase(cursors.begin() + first);
+      }
+    }
+  }
+
+  void ConsumeAllocation(size_t finderIndex, const Record& record) {
+    Offset address = record._address;
+    Offset size = record._size;
     Offset limit = address + size;
-    bool isUsed = finder->NextIsUsed();
+    bool isUsed = record._isUsed;
     bool isWrapped = false;
-    finder->Advance();
     while (!_limits.empty() && limit > _limits.back().second) {
       if (address < _limits.back().second) {
         std::cerr << "Discarding allocation at [0x" << std::hex << address
                   << ", 0x" << limit
                   << ")\n... due to overlap with allocation at [0x" << std::hex
-                  << _allocations[_limits.back().first].Address() << ", 0x"
+                  << _addresses[_limits.back().first] << ", 0x"
                   << _limits.back().second << ")\n";
         return;
       }
@@ -393,11 +518,13 @@ class Directory {
        */
       isWrapped = true;
       AllocationIndex wrapperIndex = _limits.back().first;
-      if (!(_allocations[wrapperIndex].IsWrapper())) {
+      Allocation wrapper = At(wrapperIndex);
+      if (!(wrapper.IsWrapper())) {
         /*
          * The wrapping allocation was not previously known to be a wrapper.
          */
-        _allocations[wrapperIndex].MarkAsWrapper();
+        wrapper.MarkAsWrapper();
+        _sizesAndBits[wrapperIndex] = wrapper._sizeAndBits;
         /*
          * Main the invariant that each wrapper is placed according to the
          * maximum level of nesting in that wrapper.  For example, _wrappers[0]
@@ -407,7 +534,7 @@ class Directory {
         bool needNewLevel = true;
         for (std::vector<AllocationIndex>& level : _wrappers) {
           wrapperIndex = level.back();
-          Allocation& allocation = _allocations[wrapperIndex];
+          Allocation allocation = At(wrapperIndex);
           if (allocation.Size() + allocation.Address() < limit) {
             level.push_back(toPlace);
             needNewLevel = false;
@@ -422,181 +549,14 @@ class Directory {
         }
       }
     }
-    _limits.emplace_back(_allocations.size(), limit);
-    _allocations.emplace_back(address, size, isUsed, finderIndex, isWrapped);
+    _limits.emplace_back(_addresses.size(), limit);
+    _addresses.push_back(address);
+    _sizesAndBits.push_back(
+        Allocation(address, size, isUsed, finderIndex, isWrapped)._sizeAndBits);
     if (_maxAllocationSize < size) {
       _maxAllocationSize = size;
     }
   }
-  void AppendRemainingAllocationsFromFinder(size_t finderIndex) {
-    Finder* finder = _indexToFinder[finderIndex];
-    while (!(finder->Finished())) {
-      ConsumeCurrentAllocation(finderIndex, finder);
-    }
-  }
-  void AppendRemainingAllocationsFromFinders(size_t finderIndex0,
-                                             size_t finderIndex1) {
-    Finder* finder0 = _indexToFinder[finderIndex0];
-    Offset address0 = finder0->NextAddress();
-    Offset size0 = finder0->NextSize();
-
-    Finder* finder1 = _indexToFinder[finderIndex1];
-    Offset address1 = finder1->NextAddress();
-    Offset size1 = finder1->NextSize();
-
-    while (true) {
-      if (address0 < address1 || (address0 == address1 && size0 > size1)) {
-        ConsumeCurrentAllocation(finderIndex0, finder0);
-        if (finder0->Finished()) {
-          AppendRemainingAllocationsFromFinder(finderIndex1);
-          return;
-        }
-        address0 = finder0->NextAddress();
-        size0 = finder0->NextSize();
-      } else {
-        ConsumeCurrentAllocation(finderIndex1, finder1);
-        if (finder1->Finished()) {
-          AppendRemainingAllocationsFromFinder(finderIndex0);
-          return;
-        }
-        address1 = finder1->NextAddress();
-        size1 = finder1->NextSize();
-      }
-    }
-  }
-
-  void Place(Offset address, Offset size, size_t finderIndex,
-             std::vector<size_t>& activeFinders, size_t heapIndex) {
-    Offset heapSize = activeFinders.size();
-    Offset leftChild = 2 * heapIndex + 1;
-    Offset rightChild = leftChild + 1;
-    while (rightChild < heapSize) {
-      size_t leftFinderIndex = activeFinders[leftChild];
-      Finder* leftFinder = _indexToFinder[leftFinderIndex];
-      Offset leftAddress = leftFinder->NextAddress();
-      Offset leftSize = leftFinder->NextSize();
-      size_t rightFinderIndex = activeFinders[rightChild];
-      Finder* rightFinder = _indexToFinder[rightFinderIndex];
-      Offset rightAddress = rightFinder->NextAddress();
-      Offset rightSize = rightFinder->NextSize();
-      if (leftAddress < rightAddress ||
-          (leftAddress == rightAddress && leftSize > rightSize)) {
-        if (address < leftAddress ||
-            (address == leftAddress && address >= leftSize)) {
-          activeFinders[heapIndex] = finderIndex;
-          return;
-        }
-        activeFinders[heapIndex] = leftFinderIndex;
-        heapIndex = leftChild;
-      } else {
-        if (address < rightAddress ||
-            (address == rightAddress && address >= rightSize)) {
-          activeFinders[heapIndex] = finderIndex;
-          return;
-        }
-        activeFinders[heapIndex] = rightFinderIndex;
-        heapIndex = rightChild;
-      }
-    }
-    if (leftChild < heapSize) {
-      size_t leftFinderIndex = activeFinders[leftChild];
-      Finder* leftFinder = _indexToFinder[leftFinderIndex];
-      Offset leftAddress = leftFinder->NextAddress();
-      if ((address < leftAddress ||
-           (address == leftAddress && size > leftFinder->NextSize()))) {
-        activeFinders[heapIndex] = finderIndex;
-      } else {
-        activeFinders[heapIndex] = leftFinderIndex;
-        activeFinders[leftChild] = finderIndex;
-      }
-    } else {
-      activeFinders[heapIndex] = finderIndex;
-    }
-  }
-
-  void AppendRemainingAllocationsFromFinders(
-      std::vector<size_t>& activeFinders) {
-    size_t numActiveFinders = activeFinders.size();
-    std::make_heap(activeFinders.begin(), activeFinders.end(),
-                   [this](const size_t left, const size_t right) {
-                     Finder* leftFinder = this->_indexToFinder[left];
-                     Finder* rightFinder = this->_indexToFinder[right];
-                     Offset leftAddress = leftFinder->NextAddress();
-                     Offset rightAddress = rightFinder->NextAddress();
-                     return (leftAddress > rightAddress) ||
-                            ((leftAddress == rightAddress) &&
-                             leftFinder->NextSize() < rightFinder->NextSize());
-                   });
-    size_t topFinderIndex = activeFinders[0];
-    Finder* topFinder = _indexToFinder[topFinderIndex];
-    Offset topAddress = topFinder->NextAddress();
-    Offset topSize = topFinder->NextSize();
-
-    Finder* leftFinder = _indexToFinder[activeFinders[1]];
-    Offset leftAddress = leftFinder->NextAddress();
-    Offset leftSize = leftFinder->NextSize();
-
-    Finder* rightFinder = _indexToFinder[activeFinders[2]];
-    Offset rightAddress = rightFinder->NextAddress();
-    Offset rightSize = rightFinder->NextSize();
-
-    bool leftIsNext = (leftAddress < rightAddress) ||
-                      (leftAddress == rightAddress && leftSize >= rightSize);
-    Offset nextAddress = leftIsNext ? leftAddress : rightAddress;
-    Offset nextSize = leftIsNext ? leftSize : rightSize;
-
-    while (true) {
-      ConsumeCurrentAllocation(topFinderIndex, topFinder);
-      if (topFinder->Finished()) {
-        size_t lastFinderIndex = activeFinders[numActiveFinders - 1];
-        activeFinders.pop_back();
-        if (--numActiveFinders == 2) {
-          AppendRemainingAllocationsFromFinders(lastFinderIndex,
-                                                activeFinders[1]);
-          return;
-        }
-        activeFinders[0] = lastFinderIndex;
-        topFinderIndex = lastFinderIndex;
-        topFinder = _indexToFinder[topFinderIndex];
-      }
-      topAddress = topFinder->NextAddress();
-      topSize = topFinder->NextSize();
-      if (nextAddress < topAddress ||
-          (nextAddress == topAddress && nextSize > topSize)) {
-        /*
-         * The top finder is no longer in the correct place.  This is expected
-         * not to happen all that often because many consecutive allocations
-         * will be from the same finder.
-         */
-        Offset address = topAddress;
-        Offset size = topSize;
-        Offset finderIndex = topFinderIndex;
-        topAddress = nextAddress;
-        topSize = nextSize;
-        if (leftIsNext) {
-          topFinderIndex = activeFinders[1];
-          activeFinders[0] = topFinderIndex;
-          topFinder = leftFinder;
-          Place(address, size, finderIndex, activeFinders, 1);
-          leftFinder = _indexToFinder[activeFinders[1]];
-          leftAddress = leftFinder->NextAddress();
-          leftSize = leftFinder->NextSize();
-        } else {
-          topFinderIndex = activeFinders[2];
-          activeFinders[0] = topFinderIndex;
-          topFinder = rightFinder;
-          Place(address, size, finderIndex, activeFinders, 2);
-          rightFinder = _indexToFinder[activeFinders[2]];
-          rightAddress = rightFinder->NextAddress();
-          rightSize = rightFinder->NextSize();
-        }
-        leftIsNext = (leftAddress < rightAddress) ||
-                     (leftAddress == rightAddress && leftSize >= rightSize);
-        nextAddress = leftIsNext ? leftAddress : rightAddress;
-        nextSize = leftIsNext ? leftSize : rightSize;
-      }
-    }
-  }
 };
 }  // namespace Allocations
 }  // namespace chap
@@ -0,0 +1,284 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "Directory.h"
+#include "Graph.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * This is the dominator tree for the anchored part of the allocation graph,
+ * rooted at a virtual node that references every anchor point.  An anchored
+ * allocation A dominates an allocation B if every path from any anchor point
+ * to B goes through A, so the retained size of A, which is the total size of
+ * all the allocations A dominates, including A itself, is the number of bytes
+ * that would no longer be anchored if A were freed.
+ *
+ * The tree is calculated with the semi-NCA variant of the Lengauer-Tarjan
+ * algorithm, which is near linear in the number of edges.
+ */
+template <class Offset>
+class DominatorTree {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex Index;
+  typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
+
+  DominatorTree(const Graph<Offset>& graph)
+      : _graph(graph),
+        _directory(graph.GetAllocationDirectory()),
+        _numAllocations(_directory.NumAllocations()) {
+    _immediateDominator.resize(_numAllocations, _numAllocations);
+    _retainedBytes.resize(_numAllocations, 0);
+    _treeStart.resize(_numAllocations, 0);
+    _treeSize.resize(_numAllocations, 0);
+    Resolve();
+  }
+
+  /*
+   * Return true if the given allocation is anchored and so is in the tree.
+   */
+  bool IsInTree(Index index) const {
+    return index < _numAllocations && _treeSize[index] != 0;
+  }
+
+  /*
+   * Return the index of the immediate dominator of the given allocation,
+   * or the number of allocations if the allocation is not in the tree or
+   * is dominated only by the virtual root (as is the case for any anchor
+   * point).
+   */
+  Index ImmediateDominator(Index index) const {
+    return (index < _numAllocations) ? _immediateDominator[index]
+                                     : _numAllocations;
+  }
+
+  /*
+   * Return the total size of all allocations dominated by the given
+   * allocation, including the allocation itself, or 0 if the allocation
+   * is not in the tree.
+   */
+  Offset RetainedBytes(Index index) const {
+    return (index < _numAllocations) ? _retainedBytes[index] : 0;
+  }
+
+  /*
+   * Return true if the first allocation dominates the second.  Every
+   * allocation in the tree dominates itself.
+   */
+  bool Dominates(Index dominator, Index dominated) const {
+    return IsInTree(dominator) && IsInTree(dominated) &&
+           _treeStart[dominated] >= _treeStart[dominator] &&
+           _treeStart[dominated] - _treeStart[dominator] <
+               _treeSize[dominator];
+  }
+
+  /*
+   * For each group, add to its entry in retainedBytes the number of bytes
+   * that would no longer be anchored if all the given allocations of that
+   * group were freed, counting each dominated allocation just once even if
+   * several allocations of the group dominate it.  Each of the given pairs
+   * holds an allocation index and the group of that allocation, which must
+   * be less than the size of retainedBytes.  The pairs are reordered as a
+   * side effect.
+   */
+  void AddRetainedBytes(std::vector<std::pair<Index, size_t> >& members,
+                        std::vector<Offset>& retainedBytes) const {
+    std::sort(members.begin(), members.end(),
+              [this](const std::pair<Index, size_t>& left,
+                     const std::pair<Index, size_t>& right) {
+                return RetainedSortKey(left.first) <
+                       RetainedSortKey(right.first);
+              });
+    std::vector<Index> coveredLimit(retainedBytes.size(), 0);
+    for (const auto& member : members) {
+      Index index = member.first;
+      size_t group = member.second;
+      if (!IsInTree(index) || _treeStart[index] < coveredLimit[group]) {
+        // Either not anchored or dominated by an index already counted.
+        continue;
+      }
+      retainedBytes[group] += _retainedBytes[index];
+      coveredLimit[group] = _treeStart[index] + _treeSize[index];
+    }
+  }
+
+ private:
+  const Graph<Offset>& _graph;
+  const Directory<Offset>& _directory;
+  const Index _numAllocations;
+  std::vector<Index> _immediateDominator;
+  std::vector<Offset> _retainedBytes;
+  /*
+   * The allocations dominated by a given allocation occupy the range
+   * [_treeStart[i], _treeStart[i] + _treeSize[i]) in a preorder numbering
+   * of the dominator tree, with a size of 0 for allocations not in the tree.
+   */
+  std::vector<Index> _treeStart;
+  std::vector<Index> _treeSize;
+
+  Index RetainedSortKey(Index index) const {
+    return IsInTree(index) ? _treeStart[index] : 0;
+  }
+
+  void Resolve() {
+    /*
+     * Vertices are numbered in depth-first order, with vertex 0 being the
+     * virtual root, so the depth-first number of every allocation reached
+     * is at least 1 and a number of 0 means that the allocation was not
+     * reached.
+     */
+    std::vector<Index> dfsNumber(_numAllocations, 0);
+    std::vector<Index> vertex;
+    std::vector<Index> parent;
+    vertex.reserve(_numAllocations + 1);
+    parent.reserve(_numAllocations + 1);
+    vertex.push_back(_numAllocations);
+    parent.push_back(0);
+
+    std::vector<std::pair<Index, EdgeIterator> > toVisit;
+    for (Index root = 0; root < _numAllocations; root++) {
+      if (!_graph.IsAnchorPoint(root) || dfsNumber[root] != 0) {
+        continue;
+      }
+      dfsNumber[root] = vertex.size();
+      vertex.push_back(root);
+      parent.push_back(0);
+      EdgeIterator pNextOutgoing;
+      EdgeIterator pPastOutgoing;
+      _graph.GetOutgoing(root, &pNextOutgoing, &pPastOutgoing);
+      toVisit.emplace_back(root, pNextOutgoing);
+      while (!toVisit.empty()) {
+        Index source = toVisit.back().first;
+        EdgeIterator& pOutgoing = toVisit.back().second;
+        _graph.GetOutgoing(source, &pNextOutgoing, &pPastOutgoing);
+        if (pOutgoing == pPastOutgoing) {
+          toVisit.pop_back();
+          continue;
+        }
+        Index target = *(pOutgoing++);
+        if (dfsNumber[target] != 0 ||
+            !_directory.AllocationAt(target)->IsUsed()) {
+          continue;
+        }
+        dfsNumber[target] = vertex.size();
+        vertex.push_back(target);
+        parent.push_back(dfsNumber[source]);
+        _graph.GetOutgoing(target, &pNextOutgoing, &pPastOutgoing);
+        toVisit.emplace_back(target, pNextOutgoing);
+      }
+    }
+
+    Index numVertices = vertex.size();
+    const Index NO_ANCESTOR = numVertices;
+    std::vector<Index> semi(numVertices);
+    std::vector<Index> label(numVertices);
+    std::vector<Index> ancestor(numVertices, NO_ANCESTOR);
+    for (Index v = 0; v < numVertices; v++) {
+      semi[v] = v;
+      label[v] = v;
+    }
+
+    std::vector<Index> path;
+    for (Index w = numVertices - 1; w > 0; w--) {
+      Index index = vertex[w];
+      if (_graph.IsAnchorPoint(index)) {
+        // The virtual root references every anchor point.
+        semi[w] = 0;
+      }
+      EdgeIterator pFirstIncoming;
+      EdgeIterator pPastIncoming;
+      _graph.GetIncoming(index, &pFirstIncoming, &pPastIncoming);
+      for (EdgeIterator pIncoming = pFirstIncoming; pIncoming != pPastIncoming;
+           ++pIncoming) {
+        Index v = dfsNumber[*pIncoming];
+        if (v == 0) {
+          // The source is free or leaked.
+          continue;
+        }
+        Index u = v;
+        if (ancestor[v] != NO_ANCESTOR) {
+          /*
+           * Compress the path from v towards the root of the forest of
+           * processed vertices, keeping for each vertex on the path the
+           * label with the minimum semidominator.
+           */
+          path.clear();
+          for (Index x = v; ancestor[ancestor[x]] != NO_ANCESTOR;
+               x = ancestor[x]) {
+            path.push_back(x);
+          }
+          for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            Index x = *it;
+            Index a = ancestor[x];
+            if (semi[label[a]] < semi[label[x]]) {
+              label[x] = label[a];
+            }
+            ancestor[x] = ancestor[a];
+          }
+          u = label[v];
+        }
+        if (semi[u] < semi[w]) {
+          semi[w] = semi[u];
+        }
+      }
+      ancestor[w] = parent[w];
+    }
+
+    /*
+     * The immediate dominator of each vertex is the nearest common ancestor
+     * in the depth-first tree of its parent and its semidominator, which
+     * can be found by walking up from the parent because all the vertices
+     * with smaller depth-first numbers have already been resolved.
+     */
+    std::vector<Index>& idom = parent;
+    for (Index w = 1; w < numVertices; w++) {
+      while (idom[w] > semi[w]) {
+        idom[w] = idom[idom[w]];
+      }
+    }
+    std::vector<Index>().swap(semi);
+    std::vector<Index>().swap(label);
+    std::vector<Index>().swap(ancestor);
+    std::vector<Index>().swap(path);
+
+    /*
+     * Accumulate the retained sizes and the subtree sizes from the leaves
+     * up, which works because every vertex has a larger depth-first number
+     * than its immediate dominator.
+     */
+    std::vector<Offset> retained(numVertices, 0);
+    std::vector<Index> treeSize(numVertices, 0);
+    for (Index w = numVertices - 1; w > 0; w--) {
+      retained[w] += _directory.AllocationAt(vertex[w])->Size();
+      treeSize[w]++;
+      retained[idom[w]] += retained[w];
+      treeSize[idom[w]] += treeSize[w];
+    }
+
+    /*
+     * Assign a preorder numbering of the dominator tree so that dominance
+     * can be checked by comparing ranges.
+     */
+    std::vector<Index>& nextChildStart = dfsNumber;
+    nextChildStart.assign(numVertices, 0);
+    nextChildStart[0] = 1;
+    for (Index w = 1; w < numVertices; w++) {
+      Index index = vertex[w];
+      Index treeStart = nextChildStart[idom[w]];
+      nextChildStart[idom[w]] += treeSize[w];
+      nextChildStart[w] = treeStart + 1;
+      _treeStart[index] = treeStart;
+      _treeSize[index] = treeSize[w];
+      _retainedBytes[index] = retained[w];
+      if (idom[w] != 0) {
+        _immediateDominator[index] = vertex[idom[w]];
+      }
+    }
+  }
+};
+}  // namespace Allocations
+}  // namespace chap
@@ -0,0 +1,359 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "../MappedVector.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * This holds, for each node of a graph, the sorted list of neighbors in one
+ * direction, such as the targets of the outgoing edges.  The lists are kept
+ * either as plain arrays of indices or, to reduce the footprint of very large
+ * graphs, compressed, in which case each non-empty list is stored as the
+ * number of neighbors, the first neighbor and then the gap before each
+ * subsequent neighbor, each as a varint.  Either way the lists are visited
+ * with the same Iterator.  Each long compressed list also gets a sparse
+ * skip index, with the position of every SKIP_INTERVAL-th neighbor, so that
+ * a search of the list need decode only a short stretch of it.
+ *
+ * The lists are built in two passes.  In the first, CountEdge is called for
+ * every edge, and in the second, after a call to StartFilling, FillEdge is
+ * called for the same edges in the same order, followed by a call to
+ * FinishFilling.  For any one node the neighbors must be given in strictly
+ * increasing order, but calls for different nodes can be interleaved.
+ */
+template <typename Index, typename EdgeIndex>
+class EdgeList {
+ public:
+  class Iterator {
+   public:
+    Iterator()
+        : _plain((const Index*)(0)),
+          _packed((const uint8_t*)(0)),
+          _value(0),
+          _remaining(0) {}
+    Iterator(const Index* plain, EdgeIndex numEdges)
+        : _plain(plain),
+          _packed((const uint8_t*)(0)),
+          _value(0),
+          _remaining(numEdges) {}
+    Iterator(const uint8_t* packed)
+        : _plain((const Index*)(0)), _packed(packed), _value(0) {
+      _remaining = DecodeVarint(_packed);
+      _value = DecodeVarint(_packed);
+    }
+    Iterator(const uint8_t* packed, Index value, EdgeIndex remaining)
+        : _plain((const Index*)(0)),
+          _packed(packed),
+          _value(value),
+          _remaining(remaining) {}
+
+    Index operator*() const {
+      return (_plain != (const Index*)(0)) ? *_plain : _value;
+    }
+    Iterator& operator++() {
+      if (--_remaining != 0) {
+        if (_plain != (const Index*)(0)) {
+          ++_plain;
+        } else {
+          _value += DecodeVarint(_packed) + 1;
+        }
+      }
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator current = *this;
+      ++(*this);
+      return current;
+    }
+
+    /*
+     * Iterators are compared only with other iterators for the same list, so
+     * the number of edges left identifies the position.
+     */
+    bool operator==(const Iterator& other) const {
+      return _remaining == other._remaining;
+    }
+    bool operator!=(const Iterator& other) const {
+      return _remaining != other._remaining;
+    }
+    bool operator<(const Iterator& other) const {
+      return _remaining > other._remaining;
+    }
+    EdgeIndex operator-(const Iterator& other) const {
+      return other._remaining - _remaining;
+    }
+
+   private:
+    friend class EdgeList;
+    const Index* _plain;
+    const uint8_t* _packed;
+    Index _value;
+    EdgeIndex _remaining;
+  };
+
+  EdgeList() : _numNodes(0), _totalEdges(0), _isCompressed(false) {}
+
+  void StartCounting(Index numNodes) {
+    _numNodes = numNodes;
+    _totalEdges = 0;
+    _first.assign(_numNodes + 1, 0);
+    _numEdges.assign(_numNodes, 0);
+    _last.assign(_numNodes, _numNodes);
+  }
+
+  /*
+   * Count the given edge, keeping track of both the number of edges and the
+   * compressed size of the neighbors for the node, so that the choice of
+   * representation can be made after all the edges have been counted.
+   */
+  void CountEdge(Index node, Index neighbor) {
+    _first[node] += VarintSize(
+        (_last[node] == _numNodes) ? neighbor : (neighbor - _last[node] - 1));
+    _last[node] = neighbor;
+    _numEdges[node]++;
+    _totalEdges++;
+  }
+
+  EdgeIndex TotalEdges() const { return _totalEdges; }
+
+  /*
+   * Return the number of bytes that would be needed for the neighbors of
+   * all the nodes in the plain and compressed representations.
+   */
+  size_t PlainSize() const { return _totalEdges * sizeof(Index); }
+  size_t CompressedSize() const {
+    size_t size = 0;
+    for (Index node = 0; node < _numNodes; node++) {
+      if (_numEdges[node] != 0) {
+        size += VarintSize(_numEdges[node]) + _first[node];
+      }
+    }
+    return size;
+  }
+
+  /*
+   * Allocate the space for the neighbors, in the compressed representation
+   * if so requested.
+   */
+  void StartFilling(bool compress) {
+    _isCompressed = compress;
+    EdgeIndex start = 0;
+    for (Index node = 0; node < _numNodes; node++) {
+      EdgeIndex size = _numEdges[node];
+      if (_isCompressed && size != 0) {
+        size = VarintSize(_numEdges[node]) + _first[node];
+      }
+      _first[node] = start;
+      start += size;
+    }
+    _first[_numNodes] = start;
+    _next.assign(_first.begin(), _first.end() - 1);
+    if (_isCompressed) {
+      _packed.resize(start, 0);
+      _last.assign(_numNodes, _numNodes);
+    } else {
+      _plain.resize(start, 0);
+    }
+  }
+
+  void FillEdge(Index node, Index neighbor) {
+    if (_isCompressed) {
+      uint8_t* next = _packed.data() + _next[node];
+      if (_last[node] == _numNodes) {
+        EncodeVarint(_numEdges[node], next);
+        EncodeVarint(neighbor, next);
+      } else {
+        EncodeVarint(neighbor - _last[node] - 1, next);
+      }
+      _next[node] = next - _packed.data();
+      _last[node] = neighbor;
+    } else {
+      _plain[_next[node]++] = neighbor;
+    }
+  }
+
+  void FinishFilling() {
+    if (_isCompressed) {
+      BuildSkipIndex();
+    }
+    std::vector<Index>().swap(_numEdges);
+    std::vector<Index>().swap(_last);
+    std::vector<EdgeIndex>().swap(_next);
+  }
+
+  bool IsCompressed() const { return _isCompressed; }
+
+  Iterator Begin(Index node) const {
+    if (_first[node] == _first[node + 1]) {
+      return Iterator();
+    }
+    if (_isCompressed) {
+      return Iterator(_packed.data() + _first[node]);
+    }
+    return Iterator(_plain.data() + _first[node],
+                    _first[node + 1] - _first[node]);
+  }
+
+  Iterator End(Index) const { return Iterator(); }
+
+  EdgeIndex NumEdges(Index node) const {
+    if (_first[node] == _first[node + 1]) {
+      return 0;
+    }
+    if (_isCompressed) {
+      const uint8_t* packed = _packed.data() + _first[node];
+      return DecodeVarint(packed);
+    }
+    return _first[node + 1] - _first[node];
+  }
+
+  /*
+   * Return an iterator to the first neighbor of the given node for which
+   * isBefore returns false, given that isBefore is true for some prefix of
+   * the sorted neighbors and false for the rest.  This is a binary search
+   * for plain lists.  For compressed lists it is a binary search of the
+   * skip index, if the list has one, followed by a linear search of at most
+   * SKIP_INTERVAL neighbors.
+   */
+  template <typename IsBefore>
+  Iterator PartitionPoint(Index node, IsBefore isBefore) const {
+    Iterator it = Begin(node);
+    if (_isCompressed) {
+      typename std::vector<Index>::const_iterator itNode =
+          std::lower_bound(_skipNodes.begin(), _skipNodes.end(), node);
+      if (itNode != _skipNodes.end() && *itNode == node) {
+        size_t skipNodeIndex = itNode - _skipNodes.begin();
+        const Skip* skipsBegin =
+            _skips.data() + _firstSkip[skipNodeIndex];
+        const Skip* skipsEnd =
+            _skips.data() + _firstSkip[skipNodeIndex + 1];
+        const Skip* skip = std::partition_point(
+            skipsBegin, skipsEnd,
+            [&isBefore](const Skip& skip) { return isBefore(skip._value); });
+        if (skip != skipsBegin) {
+          --skip;
+          it = Iterator(_packed.data() + skip->_offset, skip->_value,
+                        skip->_remaining);
+        }
+      }
+      for (Iterator itEnd = End(node); it != itEnd && isBefore(*it); ++it) {
+      }
+      return it;
+    }
+    EdgeIndex base = _first[node];
+    EdgeIndex limit = _first[node + 1];
+    while (base < limit) {
+      EdgeIndex mid = base + (limit - base) / 2;
+      if (isBefore(_plain[mid])) {
+        base = mid + 1;
+      } else {
+        limit = mid;
+      }
+    }
+    if (base == _first[node + 1]) {
+      return End(node);
+    }
+    return Iterator(_plain.data() + base, _first[node + 1] - base);
+  }
+
+ private:
+  Index _numNodes;
+  EdgeIndex _totalEdges;
+  bool _isCompressed;
+  /*
+   * _first[node] is the offset of the neighbors of the given node, in
+   * indices for plain lists or bytes for compressed ones.  While the edges
+   * are being counted, it is instead the compressed size of the neighbors,
+   * not counting the number of neighbors.
+   */
+  MappedVector<EdgeIndex> _first;
+  MappedVector<Index> _plain;
+  MappedVector<uint8_t> _packed;
+  /*
+   * These are used only while building the lists.
+   */
+  std::vector<Index> _numEdges;
+  std::vector<Index> _last;
+  std::vector<EdgeIndex> _next;
+
+  /*
+   * The skip index for compressed lists with more than SKIP_INTERVAL
+   * neighbors.  _skipNodes holds those nodes in increasing order, and the
+   * skips for _skipNodes[i] are in [_firstSkip[i], _firstSkip[i + 1]).  Each
+   * skip gives a neighbor, the offset just past its encoding and the number
+   * of neighbors from it to the end of the list, which is enough to resume
+   * decoding there.
+   */
+  static constexpr EdgeIndex SKIP_INTERVAL = 0x40;
+  struct Skip {
+    Skip(EdgeIndex offset, EdgeIndex remaining, Index value)
+        : _offset(offset), _remaining(remaining), _value(value) {}
+    EdgeIndex _offset;
+    EdgeIndex _remaining;
+    Index _value;
+  };
+  std::vector<Index> _skipNodes;
+  std::vector<EdgeIndex> _firstSkip;
+  MappedVector<Skip> _skips;
+
+  void BuildSkipIndex() {
+    _skipNodes.clear();
+    _firstSkip.clear();
+    _skips.clear();
+    for (Index node = 0; node < _numNodes; node++) {
+      if (_numEdges[node] <= SKIP_INTERVAL) {
+        continue;
+      }
+      _skipNodes.push_back(node);
+      _firstSkip.push_back(_skips.size());
+      EdgeIndex remaining = _numEdges[node];
+      Iterator it(_packed.data() + _first[node]);
+      for (EdgeIndex i = 0; i < remaining; i++, ++it) {
+        if ((i % SKIP_INTERVAL) == 0) {
+          _skips.emplace_back(it._packed - _packed.data(), remaining - i,
+                              it._value);
+        }
+      }
+    }
+    _firstSkip.push_back(_skips.size());
+  }
+
+  static size_t VarintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+      value >>= 7;
+      size++;
+    }
+    return size;
+  }
+
+  static void EncodeVarint(uint64_t value, uint8_t*& next) {
+    while (value >= 0x80) {
+      *(next++) = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+    *(next++) = (uint8_t)value;
+  }
+
+  static uint64_t DecodeVarint(const uint8_t*& next) {
+    uint64_t value = *(next++);
+    if (value < 0x80) {
+      return value;
+    }
+    value &= 0x7f;
+    for (size_t shift = 7;; shift += 7) {
+      uint64_t byte = *(next++);
+      value |= (byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        return value;
+      }
+    }
+  }
+};
+}  // namespace Allocations
+}  // namespace chap
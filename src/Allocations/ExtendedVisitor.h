@@ -25,7 +25,9 @@ template <class Offset, class Visitor>
 class ExtendedVisitor {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
   ExtendedVisitor(
       Commands::Context& context, const ProcessImage<Offset>& processImage,
       const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
@@ -237,7 +239,7 @@ class ExtendedVisitor {
     ExtensionContext(AllocationIndex memberIndex, size_t ruleIndex,
                      size_t numCandidatesLeft,
                      RuleCheckProgress ruleCheckProgress,
-                     const AllocationIndex* pNextCandidate)
+                     EdgeIterator pNextCandidate)
         : _memberIndex(memberIndex),
           _ruleIndex(ruleIndex),
           _numCandidatesLeft(numCandidatesLeft),
@@ -247,7 +249,7 @@ class ExtendedVisitor {
     size_t _ruleIndex;
     size_t _numCandidatesLeft;
     RuleCheckProgress _ruleCheckProgress;
-    const AllocationIndex* _pNextCandidate;
+    EdgeIterator _pNextCandidate;
   };
 
  public:
@@ -288,9 +290,9 @@ class ExtendedVisitor {
     size_t ruleIndex = _stateToBase[state];
     size_t numCandidatesLeft = 0;
     size_t ruleIndexLimit = _stateToBase[state + 1];
-    const Allocation* memberAllocation = &allocation;
-    const AllocationIndex* pNextCandidate = 0;
-    const AllocationIndex* pPastCandidates = 0;
+    AllocationPointer memberAllocation(&allocation);
+    EdgeIterator pNextCandidate;
+    EdgeIterator pPastCandidates;
     RuleCheckProgress ruleCheckProgress = RuleCheckProgress::NEW_RULE;
 
     while (true) {
@@ -317,7 +319,7 @@ class ExtendedVisitor {
       }
       Rule& rule = _rules[ruleIndex];
       AllocationIndex candidateIndex = _numAllocations;
-      const Allocation* candidateAllocation = 0;
+      AllocationPointer candidateAllocation;
       if (ruleCheckProgress == RuleCheckProgress::NEW_RULE) {
         if (!rule._memberSignatureChecker.Check(memberIndex,
                                                 *memberAllocation) ||
@@ -403,7 +405,7 @@ class ExtendedVisitor {
            */
           if (!rule._useOffsetInMember &&
               !AllocationHasAlignedPointer(
-                  *memberAllocation,
+                  memberIndex, *memberAllocation,
                   candidateAllocation->Address() + rule._offsetInExtension)) {
             continue;
           }
@@ -423,7 +425,7 @@ class ExtendedVisitor {
       } else {
         if (rule._useOffsetInMember && !rule._referenceIsOutgoing) {
           if (!AllocationHasAlignedPointer(
-                  *candidateAllocation,
+                  candidateIndex, *candidateAllocation,
                   memberAllocation->Address() + rule._offsetInMember)) {
             continue;
           }
@@ -543,13 +545,33 @@ class ExtendedVisitor {
     size_t _baseState;
     size_t _newState;
   };
-  bool AllocationHasAlignedPointer(const Allocation& allocation,
+  /*
+   * Return true if the given allocation contains a pointer to the given
+   * address, which is expected to be in some other allocation.  If the
+   * graph kept the offsets of the references, only the words known to
+   * reference allocations need be checked.
+   */
+  bool AllocationHasAlignedPointer(AllocationIndex index,
+                                   const Allocation& allocation,
                                    Offset address) {
     Offset base = allocation.Address();
     const char* image;
     Offset numBytesFound = _addressMap.FindMappedMemoryImage(base, &image);
     Offset size = allocation.Size();
     Offset bytesToCheck = (numBytesFound < size) ? numBytesFound : size;
+    if (_graph->HasReferences()) {
+      typename Graph<Offset>::References references =
+          _graph->GetReferences(index);
+      for (typename Graph<Offset>::EdgeIndex r = 0; r < references.Size();
+           r++) {
+        Offset offset = references.OffsetAt(r);
+        if (offset + sizeof(Offset) <= bytesToCheck &&
+            *((const Offset*)(image + offset)) == address) {
+          return true;
+        }
+      }
+      return false;
+    }
     // TODO: This is not correct in at least one non-linux case where
     // 0-filled pages may be omitted and thus the allocation image may
     // be non-contiguous in the core image.
@@ -2,12 +2,18 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
-#include <deque>
+#include <atomic>
+#include <unordered_set>
+#include "../Parallel.h"
+#include "../StackRegistry.h"
 #include "../ThreadMap.h"
 #include "../VirtualAddressMap.h"
 #include "ContiguousImage.h"
 #include "Directory.h"
+#include "EdgeList.h"
 #include "ExternalAnchorPointChecker.h"
 #include "IndexedDistances.h"
 #include "ObscuredReferenceChecker.h"
@@ -19,11 +25,39 @@ class Graph {
  public:
   typedef VirtualAddressMap<Offset> AddressMap;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
   typedef typename Directory<Offset>::AllocationIndex Index;
   typedef Offset EdgeIndex;
+  typedef typename EdgeList<Index, EdgeIndex>::Iterator EdgeIterator;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
 
+  /*
+   * This provides the references from one allocation to other allocations,
+   * in increasing order of the offset of the reference within the source.
+   * Unlike the outgoing edges, a target appears once for each word of the
+   * source that references it.
+   */
+  class References {
+   public:
+    References() : _wordIndices(0), _targets(0), _numReferences(0) {}
+    References(const uint32_t *wordIndices, const Index *targets,
+               EdgeIndex numReferences)
+        : _wordIndices(wordIndices),
+          _targets(targets),
+          _numReferences(numReferences) {}
+    EdgeIndex Size() const { return _numReferences; }
+    Offset OffsetAt(EdgeIndex i) const {
+      return ((Offset)(_wordIndices[i])) * sizeof(Offset);
+    }
+    Index TargetAt(EdgeIndex i) const { return _targets[i]; }
+
+   private:
+    const uint32_t *_wordIndices;
+    const Index *_targets;
+    EdgeIndex _numReferences;
+  };
+
   class AnchorChainVisitor {
    public:
     virtual bool VisitStaticAnchorChainHeader(
@@ -41,6 +75,7 @@ class Graph {
 
   Graph(const VirtualAddressMap<Offset> &addressMap,
         const Directory<Offset> &directory, const ThreadMap<Offset> &threadMap,
+        const StackRegistry<Offset> &stackRegistry,
         const std::map<Offset, Offset> &staticAnchorLimits,
         const ExternalAnchorPointChecker<Offset> *externalAnchorPointChecker,
         const ObscuredReferenceChecker<Offset> *obscuredReferenceChecker)
@@ -51,6 +86,7 @@ class Graph {
         _obscuredReferenceChecker(obscuredReferenceChecker),
         _numAllocations(directory.NumAllocations()),
         _totalEdges(0),
+        _hasReferences(false),
         _staticAnchorDistances(_numAllocations),
         _stackAnchorDistances(_numAllocations),
         _registerAnchorDistances(_numAllocations),
@@ -58,6 +94,7 @@ class Graph {
     FindEdges();
     FindStaticAnchorPoints(staticAnchorLimits);
     FindStackAndRegisterAnchorPoints(threadMap);
+    FindRegisteredStackAnchorPoints(stackRegistry);
     FindExternalAnchorPoints();
     MarkLeakedChunks();
   }
@@ -66,49 +103,80 @@ class Graph {
 
   const VirtualAddressMap<Offset> &GetAddressMap() const { return _addressMap; }
 
-  void GetIncoming(Index target, const Index **pFirstIncoming,
-                   const Index **pPastIncoming) const {
+  void GetIncoming(Index target, EdgeIterator *pFirstIncoming,
+                   EdgeIterator *pPastIncoming) const {
     if (target < _numAllocations) {
-      *pFirstIncoming = &(_incoming[_firstIncoming[target]]);
-      *pPastIncoming = &(_incoming[_firstIncoming[target + 1]]);
+      *pFirstIncoming = _incoming.Begin(target);
+      *pPastIncoming = _incoming.End(target);
     } else {
-      *pFirstIncoming = (const Index *)(0);
-      *pPastIncoming = (const Index *)(0);
+      *pFirstIncoming = EdgeIterator();
+      *pPastIncoming = EdgeIterator();
     }
   }
 
-  void GetOutgoing(Index source, const Index **pFirstOutgoing,
-                   const Index **pPastOutgoing) const {
+  void GetOutgoing(Index source, EdgeIterator *pFirstOutgoing,
+                   EdgeIterator *pPastOutgoing) const {
     if (source < _numAllocations) {
-      *pFirstOutgoing = &(_outgoing[_firstOutgoing[source]]);
-      *pPastOutgoing = &(_outgoing[_firstOutgoing[source + 1]]);
+      *pFirstOutgoing = _outgoing.Begin(source);
+      *pPastOutgoing = _outgoing.End(source);
     } else {
-      *pFirstOutgoing = (const Index *)(0);
-      *pPastOutgoing = (const Index *)(0);
+      *pFirstOutgoing = EdgeIterator();
+      *pPastOutgoing = EdgeIterator();
     }
   }
 
+  EdgeIndex NumIncoming(Index target) const {
+    return (target < _numAllocations) ? _incoming.NumEdges(target) : 0;
+  }
+
+  EdgeIndex NumOutgoing(Index source) const {
+    return (source < _numAllocations) ? _outgoing.NumEdges(source) : 0;
+  }
+
   bool HasNoOutgoing(Index source) {
     return (source >= _numAllocations) ||
-           (_firstOutgoing[source] == _firstOutgoing[source + 1]);
+           (_outgoing.Begin(source) == _outgoing.End(source));
+  }
+
+  /*
+   * Return true if the edges are kept in compressed form to reduce the
+   * footprint of the graph.
+   */
+  bool EdgesAreCompressed() const { return _outgoing.IsCompressed(); }
+
+  /*
+   * Return true if the offset of each reference within its source was kept
+   * when the graph was built, which is done only if those offsets fit
+   * comfortably within the memory budget.  If not, code that needs to know
+   * where a reference is must scan the image of the source.
+   */
+  bool HasReferences() const { return _hasReferences; }
+
+  /*
+   * Return the references from the given source, which are empty if the
+   * offsets of the references were not kept.
+   */
+  References GetReferences(Index source) const {
+    if (!_hasReferences || source >= _numAllocations) {
+      return References();
+    }
+    EdgeIndex first = _firstReference[source];
+    return References(_referenceWordIndices.data() + first,
+                      _referenceTargets.data() + first,
+                      _firstReference[source + 1] - first);
   }
 
   Index TargetAllocationIndex(Index source, Offset addr) const {
     if (source < _numAllocations) {
-      EdgeIndex base = _firstOutgoing[source];
-      EdgeIndex limit = _firstOutgoing[source + 1];
-      while (base < limit) {
-        size_t mid = (base + limit) / 2;
-        Index target = _outgoing[mid];
-        const Allocation &allocation = *(_directory.AllocationAt(target));
-        if (addr >= allocation.Address()) {
-          if (addr < allocation.Address() + allocation.Size()) {
-            return target;
-          } else {
-            base = mid + 1;
-          }
-        } else {
-          limit = mid;
+      EdgeIterator it =
+          _outgoing.PartitionPoint(source, [this, addr](Index target) {
+            const Allocation &allocation = *(_directory.AllocationAt(target));
+            return addr >= allocation.Address() + allocation.Size();
+          });
+      if (it != _outgoing.End(source)) {
+        Index target = *it;
+        if (addr >= _directory.AllocationAt(target)->Address()) {
+          return target;
         }
       }
     }
@@ -330,7 +398,7 @@ class Graph {
 
   bool CallAnchorChainVisitor(Index index, AnchorChainVisitor &visitor,
                               LocalVisitor anchorPointVisitor) const {
-    const Allocation *allocation = _directory.AllocationAt(index);
+    AllocationPointer allocation = _directory.AllocationAt(index);
     if (allocation == 0 || !allocation->IsUsed()) {
       return false;
     }
@@ -355,7 +423,7 @@ class Graph {
       // It is not anchored in this way.
       return false;
     }
-    const Allocation *allocation = _directory.AllocationAt(index);
+    AllocationPointer allocation = _directory.AllocationAt(index);
     if (allocation == 0 || !allocation->IsUsed()) {
       return false;
     }
@@ -369,27 +437,26 @@ class Graph {
     // At this point the starting allocation is not directly anchored under
     // the given anchor type so we are interested in whether there is any
     // indirect anchoring.
-    EdgeIndex edgeIndex = _firstIncoming[index];
-    if (edgeIndex != _firstIncoming[index + 1]) {
-      // There is at least one incoming edge.
-      std::vector<bool> visited;
-      visited.reserve(_numAllocations);
-      visited.resize(_numAllocations, false);
-      for (Index freeIndex = 0; freeIndex < _numAllocations; freeIndex++) {
-        if (!_directory.AllocationAt(freeIndex)->IsUsed()) {
-          visited[freeIndex] = true;
-        }
-      }
+    if (_incoming.Begin(index) != _incoming.End(index)) {
+      // There is at least one incoming edge.  The anchor distances already
+      // calculated for this anchor type are exact shortest distances, so a
+      // used source can be the parent of a target on a shortest anchor chain
+      // only if its distance is exactly one less than that of the target.
+      // Only edges that satisfy that are followed, so the walk stays within
+      // the shortest chains leading to the starting allocation, and only the
+      // used sources of edges to allocations on those chains are tracked as
+      // visited.
+      std::unordered_set<Index> visited;
 
       // The edge target is already considered visited.
-      visited[index] = true;
-      std::vector<std::pair<Index, EdgeIndex> > edgesToVisit;
-      edgesToVisit.push_back(std::make_pair(index, edgeIndex - 1));
+      visited.insert(index);
+      std::vector<std::pair<Index, EdgeIterator> > edgesToVisit;
+      edgesToVisit.push_back(std::make_pair(index, _incoming.Begin(index)));
       while (!edgesToVisit.empty()) {
-        edgeIndex = ++(edgesToVisit.back().second);
         Index targetIndex = edgesToVisit.back().first;
+        EdgeIterator &nextIncoming = edgesToVisit.back().second;
 
-        if (edgeIndex >= _firstIncoming[targetIndex + 1]) {
+        if (nextIncoming == _incoming.End(targetIndex)) {
           // We have checked for any anchor paths that involve the
           // allocation corresponding to the target index as the target
           // of an edge.
@@ -397,25 +464,20 @@ class Graph {
           continue;
         }
 
-        Index sourceIndex = _incoming[edgeIndex];
-        if (visited[sourceIndex]) {
+        Index sourceIndex = *(nextIncoming++);
+        // The graph has both used and free nodes but here we are only
+        // interested in paths involving used nodes.
+        AllocationPointer allocation = _directory.AllocationAt(sourceIndex);
+        if (allocation == 0 || !allocation->IsUsed()) {
+          continue;
+        }
+        if (!visited.insert(sourceIndex).second) {
           continue;
-        } else {
-          // The graph has both used and free nodes but here we are only
-          // interested in paths involving used nodes.
-          visited[sourceIndex] = true;
-          const Allocation *allocation = _directory.AllocationAt(sourceIndex);
-          if (allocation == 0 || !allocation->IsUsed()) {
-            continue;
-          }
         }
 
         Index sourceAnchorDistance = distances.GetDistance(sourceIndex);
-        Index targetAnchorDistance = distances.GetDistance(targetIndex);
-        if ((sourceAnchorDistance == 0) ||                    // leaked
-            (sourceAnchorDistance > targetAnchorDistance) ||  // wrong way
-            ((sourceAnchorDistance == targetAnchorDistance) &&
-             (targetAnchorDistance != 0xFF))) {
+        if (sourceAnchorDistance == 0 ||  // not anchored this way
+            sourceAnchorDistance + 1 != distances.GetDistance(targetIndex)) {
           continue;
         }
         if (sourceAnchorDistance == 1) {
@@ -427,11 +489,11 @@ class Graph {
           }
 
           for (typename std::vector<
-                   std::pair<Index, EdgeIndex> >::const_reverse_iterator it =
+                   std::pair<Index, EdgeIterator> >::const_reverse_iterator it =
                    edgesToVisit.rbegin();
                it != edgesToVisit.rend(); ++it) {
             Offset linkIndex = it->first;
-            const Allocation *allocation = _directory.AllocationAt(linkIndex);
+            AllocationPointer allocation = _directory.AllocationAt(linkIndex);
             if (allocation == 0 || !allocation->IsUsed()) {
               break;
             }
@@ -448,8 +510,8 @@ class Graph {
           }
         }
 
-        edgeIndex = _firstIncoming[sourceIndex];
-        edgesToVisit.push_back(std::make_pair(sourceIndex, edgeIndex - 1));
+        edgesToVisit.push_back(
+            std::make_pair(sourceIndex, _incoming.Begin(sourceIndex)));
       }
     }
     return false;
@@ -458,10 +520,10 @@ class Graph {
   bool IsUnreferenced(Index index) const {
     bool isUnreferenced = false;
     if (index < _numAllocations && _leaked[index]) {
-      const Index *pFirstIncomingIndex = &(_incoming[_firstIncoming[index]]);
-      const Index *pPastIncomingIndex = &(_incoming[_firstIncoming[index + 1]]);
+      EdgeIterator pFirstIncomingIndex = _incoming.Begin(index);
+      EdgeIterator pPastIncomingIndex = _incoming.End(index);
       isUnreferenced = true;
-      for (const Index *pIncomingIndex = pFirstIncomingIndex;
+      for (EdgeIterator pIncomingIndex = pFirstIncomingIndex;
            pIncomingIndex != pPastIncomingIndex; pIncomingIndex++) {
         if (_directory.AllocationAt((*pIncomingIndex))->IsUsed()) {
           isUnreferenced = false;
@@ -486,10 +548,12 @@ class Graph {
   const ObscuredReferenceChecker<Offset> *_obscuredReferenceChecker;
   Index _numAllocations;
   EdgeIndex _totalEdges;
-  std::vector<Index> _outgoing;
-  std::vector<Index> _incoming;
-  std::vector<EdgeIndex> _firstOutgoing;
-  std::vector<EdgeIndex> _firstIncoming;
+  EdgeList<Index, EdgeIndex> _outgoing;
+  EdgeList<Index, EdgeIndex> _incoming;
+  bool _hasReferences;
+  MappedVector<EdgeIndex> _firstReference;
+  MappedVector<uint32_t> _referenceWordIndices;
+  MappedVector<Index> _referenceTargets;
   IndexedDistances<Index> _staticAnchorDistances;
   IndexedDistances<Index> _stackAnchorDistances;
   IndexedDistances<Index> _registerAnchorDistances;
@@ -514,202 +578,151 @@ class Graph {
     return targetIndex;
   }
 
+  /*
+   * Find the targets of all the edges from the given allocation, in
+   * increasing order and without duplicates.  If references is not null,
+   * also append, for each word of the allocation that references some
+   * other allocation, the index of the word and the index of the target.
+   */
+  void FindTargets(Index source, ContiguousImage<Offset> &contiguousImage,
+                   std::vector<Index> &targets,
+                   std::vector<std::pair<uint32_t, Index> > *references) {
+    contiguousImage.SetIndex(source);
+    targets.clear();
+    if (references != nullptr) {
+      references->clear();
+    }
+    Index prevTarget = _numAllocations;
+    const Offset *firstOffset = contiguousImage.FirstOffset();
+    const Offset *offsetLimit = contiguousImage.OffsetLimit();
+    for (const Offset *check = firstOffset; check < offsetLimit; check++) {
+      Index target = EdgeTargetIndex(*check);
+      if (target == _numAllocations || target == source) {
+        continue;
+      }
+      if (references != nullptr) {
+        references->emplace_back((uint32_t)(check - firstOffset), target);
+      }
+      if (target != prevTarget) {
+        targets.push_back(target);
+        prevTarget = target;
+      }
+    }
+    if (targets.size() > 1) {
+      std::sort(targets.begin(), targets.end());
+      targets.erase(std::unique(targets.begin(), targets.end()),
+                    targets.end());
+    }
+  }
+
+  /*
+   * Decide whether to keep the edges compressed.  This is done only if the
+   * plain edge lists would take a significant part of the memory budget,
+   * because there is some cost to decoding the compressed lists.  Setting
+   * the environment variable CHAP_COMPRESS_EDGES to 1 forces compression,
+   * which allows the compressed lists to be tested on small cores.
+   */
+  bool ShouldCompressEdges() const {
+    const char* compressEdges = getenv("CHAP_COMPRESS_EDGES");
+    if (compressEdges != (const char*)(0) && !strcmp(compressEdges, "1")) {
+      return true;
+    }
+    size_t plainSize = _outgoing.PlainSize() + _incoming.PlainSize();
+    size_t compressedSize =
+        _outgoing.CompressedSize() + _incoming.CompressedSize();
+    return compressedSize < plainSize && plainSize > MemoryBudget::Limit() / 2;
+  }
+
+  /*
+   * Decide whether to keep the offsets of the references.  They are kept
+   * only if they take at most a quarter of the memory budget and if every
+   * word index fits in 32 bits.
+   */
+  bool ShouldKeepReferences(EdgeIndex totalReferences) const {
+    size_t bytesPerReference = sizeof(uint32_t) + sizeof(Index);
+    return (_directory.MaxAllocationSize() / sizeof(Offset)) <= 0xffffffff &&
+           totalReferences <= MemoryBudget::Limit() / 4 / bytesPerReference;
+  }
+
   void FindEdges() {
+    _outgoing.StartCounting(_numAllocations);
+    _incoming.StartCounting(_numAllocations);
     if (_numAllocations == 0) {
+      _outgoing.StartFilling(false);
+      _incoming.StartFilling(false);
       return;
     }
 
     Offset maxAllocationSize = _directory.MaxAllocationSize();
     std::vector<Index> targets;
     targets.reserve(maxAllocationSize);
+    std::vector<std::pair<uint32_t, Index> > references;
 
-    _firstIncoming.reserve(_numAllocations + 1);
-    _firstIncoming.resize(_numAllocations + 1, 0);
-    _firstOutgoing.reserve(_numAllocations + 1);
-    _firstOutgoing.resize(_numAllocations + 1, 0);
+    /*
+     * During the counting pass, the start of the references for each source
+     * is recorded, in case the references are kept.
+     */
+    _firstReference.resize(_numAllocations + 1);
 
     /*
-     * Count all the edges, but don't store them yet.  At the end of this
-     * first pass, _firstOutgoing[i] will be set correctly to the index of
-     * the first outgoing edge for allocation i in the array _outgoing,
-     * but _firstIncoming[i] will have a temporary value of the number
-     * of incoming edges for allocation i, rather than the correct index
-     * into _incoming.
+     * Count all the edges, but don't store them yet, so that the space for
+     * the edges can be allocated just once.  Note that we find all the
+     * edges, regardless of whether the source or target is used or free.
+     * Code that uses the graph is expected to check the source and/or the
+     * target when one particular usage status is required.  The sources are
+     * visited in increasing order, so the incoming edges for each target are
+     * in increasing order of source.
      */
     ContiguousImage<Offset> contiguousImage(_addressMap, _directory);
-    Reader reader(_addressMap);
+    EdgeIndex totalReferences = 0;
     for (Index i = 0; i < _numAllocations; i++) {
-      contiguousImage.SetIndex(i);
-      _firstOutgoing[i] = _totalEdges;
-      // const Allocation *allocation = _directory.AllocationAt(i);
-
-      /*
-       * Note that we find all the edges, regardless of whether the source
-       * or target is used or free.  Code that uses the graph is expected to
-       * check the source and/or the target when one particular usage status
-       * is required.
-       */
-      targets.clear();
-      Index prevTarget = _numAllocations;
-      const Offset *offsetLimit = contiguousImage.OffsetLimit();
-      for (const Offset *check = contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        Index target = EdgeTargetIndex(*check);
-        if (target != _numAllocations && target != i && target != prevTarget) {
-          targets.push_back(target);
-          prevTarget = target;
-        }
-      }
-      if (!targets.empty()) {
-        if (targets.size() > 1) {
-          std::sort(targets.begin(), targets.end());
-        }
-        Index prevTarget = _numAllocations;
-        for (Offset target : targets) {
-          if (target != prevTarget) {
-            _firstIncoming[target]++;
-            _totalEdges++;
-            prevTarget = target;
-          }
-        }
+      FindTargets(i, contiguousImage, targets, &references);
+      for (Index target : targets) {
+        _outgoing.CountEdge(i, target);
+        _incoming.CountEdge(target, i);
       }
+      _firstReference[i] = totalReferences;
+      totalReferences += references.size();
     }
-    _firstOutgoing[_numAllocations] = _totalEdges;
-
-    /*
-     * Convert values in _firstIncoming from incoming edge counts to offsets
-     * just after incoming edges.
-     */
+    _firstReference[_numAllocations] = totalReferences;
+    _totalEdges = _outgoing.TotalEdges();
 
-    for (Index i = 0; i < _numAllocations; i++) {
-      _firstIncoming[i + 1] = _firstIncoming[i] + _firstIncoming[i + 1];
+    _hasReferences = ShouldKeepReferences(totalReferences);
+    if (_hasReferences) {
+      _referenceWordIndices.resize(totalReferences);
+      _referenceTargets.resize(totalReferences);
+    } else {
+      MappedVector<EdgeIndex>().swap(_firstReference);
     }
-    _outgoing.reserve(_totalEdges);
-    _outgoing.resize(_totalEdges, 0);
-    _incoming.reserve(_totalEdges);
-    _incoming.resize(_totalEdges, 0);
+
+    bool compress = ShouldCompressEdges();
+    _outgoing.StartFilling(compress);
+    _incoming.StartFilling(compress);
 
     /*
-     * Fill in the outgoing and incoming edges and convert values in
-     * _firstIncoming to indicate the index of the first incoming edge
-     * for the corresponding node in _incoming.  Go backwards in the
-     * sources so that the incoming edges in _incoming have subranges
-     * in increasing order of target, where the values in each subrange
-     * are the sources in increasing order.
+     * Fill in the outgoing and incoming edges, visiting the sources in the
+     * same order as for the counting.
      */
-
-    for (Index i = _numAllocations; i > 0;) {
-      contiguousImage.SetIndex(--i);
-      /*
-       * Note that we find all the edges, regardless of whether the source
-       * or target is used or free.  Code that uses the graph is expected to
-       * check the source and/or the target when one particular usage status
-       * is required.
-       */
-      targets.clear();
-      Index prevTarget = _numAllocations;
-      const Offset *offsetLimit = contiguousImage.OffsetLimit();
-      for (const Offset *check = contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        Index target = EdgeTargetIndex(*check);
-        if (target != _numAllocations && target != i && target != prevTarget) {
-          targets.push_back(target);
-          prevTarget = target;
-        }
-      }
-      if (!targets.empty()) {
-        if (targets.size() > 1) {
-          std::sort(targets.begin(), targets.end());
-        }
-        Index prevTarget = _numAllocations;
-        EdgeIndex nextOutgoing = _firstOutgoing[i];
-        for (Offset target : targets) {
-          if (target != prevTarget) {
-            _incoming[--_firstIncoming[target]] = i;
-            _outgoing[nextOutgoing++] = target;
-            prevTarget = target;
-          }
-        }
+    for (Index i = 0; i < _numAllocations; i++) {
+      FindTargets(i, contiguousImage, targets,
+                  _hasReferences ? &references : nullptr);
+      for (Index target : targets) {
+        _outgoing.FillEdge(i, target);
+        _incoming.FillEdge(target, i);
       }
-    }
-  }
-
-  void MarkAnchoredChunks(AnchorPointMap &anchorPoints,
-                          IndexedDistances<Index> &anchorDistance) {
-    std::vector<bool> visited;
-    visited.reserve(_numAllocations);
-    visited.resize(_numAllocations, false);
-    for (Index index = 0; index < _numAllocations; index++) {
-      if (!_directory.AllocationAt(index)->IsUsed()) {
-        visited[index] = true;
-      }
-    }
-    std::deque<Index> toVisit;
-    AnchorPointMapConstIterator itEnd = anchorPoints.end();
-    for (AnchorPointMapConstIterator it = anchorPoints.begin(); it != itEnd;
-         ++it) {
-      Index index = it->first;
-      visited[index] = true;
-      _leaked[index] = false;
-      anchorDistance.SetDistance(index, 1);
-      toVisit.push_back(index);
-    }
-    while (!toVisit.empty()) {
-      Index sourceIndex = toVisit.front();
-      Index newDistance = anchorDistance.GetDistance(sourceIndex) + 1;
-      toVisit.pop_front();
-      EdgeIndex edgeLimit = _firstOutgoing[sourceIndex + 1];
-      for (EdgeIndex edgeIndex = _firstOutgoing[sourceIndex];
-           edgeIndex < edgeLimit; edgeIndex++) {
-        Index targetIndex = _outgoing[edgeIndex];
-        if (!visited[targetIndex]) {
-          visited[targetIndex] = true;
-          _leaked[targetIndex] = false;
-          anchorDistance.SetDistance(targetIndex, newDistance);
-          toVisit.push_back(targetIndex);
+      if (_hasReferences) {
+        EdgeIndex next = _firstReference[i];
+        if (next + references.size() != _firstReference[i + 1]) {
+          abort();
         }
-      }
-    }
-  }
-
-  void MarkAnchoredChunks(std::map<Index, const char *> &anchorPoints,
-                          IndexedDistances<Index> &anchorDistance) {
-    std::vector<bool> visited;
-    visited.reserve(_numAllocations);
-    visited.resize(_numAllocations, false);
-    for (Index index = 0; index < _numAllocations; index++) {
-      if (!_directory.AllocationAt(index)->IsUsed()) {
-        visited[index] = true;
-      }
-    }
-    std::deque<Index> toVisit;
-    typename std::map<Index, const char *>::const_iterator itEnd =
-        anchorPoints.end();
-    for (typename std::map<Index, const char *>::const_iterator it =
-             anchorPoints.begin();
-         it != itEnd; ++it) {
-      Index index = it->first;
-      visited[index] = true;
-      _leaked[index] = false;
-      anchorDistance.SetDistance(index, 1);
-      toVisit.push_back(index);
-    }
-    while (!toVisit.empty()) {
-      Index sourceIndex = toVisit.front();
-      Index newDistance = anchorDistance.GetDistance(sourceIndex) + 1;
-      toVisit.pop_front();
-      EdgeIndex edgeLimit = _firstOutgoing[sourceIndex + 1];
-      for (EdgeIndex edgeIndex = _firstOutgoing[sourceIndex];
-           edgeIndex < edgeLimit; edgeIndex++) {
-        Index targetIndex = _outgoing[edgeIndex];
-        if (!visited[targetIndex]) {
-          visited[targetIndex] = true;
-          _leaked[targetIndex] = false;
-          anchorDistance.SetDistance(targetIndex, newDistance);
-          toVisit.push_back(targetIndex);
+        for (const auto &reference : references) {
+          _referenceWordIndices[next] = reference.first;
+          _referenceTargets[next++] = reference.second;
         }
       }
     }
+    _outgoing.FinishFilling();
+    _incoming.FinishFilling();
   }
 
   void FindAnchorPoints(Offset rangeBase, Offset rangeEnd,
@@ -720,7 +733,7 @@ class Graph {
       try {
         Offset candidateTarget = reader.ReadOffset(anchor);
         Index targetIndex = EdgeTargetIndex(candidateTarget);
-        const Allocation *target = _directory.AllocationAt(targetIndex);
+        AllocationPointer target = _directory.AllocationAt(targetIndex);
         if ((target != 0) && target->IsUsed()) {
           AnchorPointMapIterator it = anchorPoints.find(targetIndex);
           if (it == anchorPoints.end()) {
@@ -759,7 +772,7 @@ class Graph {
         if (candidateTarget != 0 &&
             (candidateTarget & (sizeof(Offset) - 1)) == 0) {
           Index targetIndex = _directory.AllocationIndexOf(candidateTarget);
-          const Allocation *target = _directory.AllocationAt(targetIndex);
+          AllocationPointer target = _directory.AllocationAt(targetIndex);
           if ((target != 0) && target->IsUsed()) {
             AnchorPointMapIterator itAnchor =
                 _registerAnchorPoints.find(targetIndex);
@@ -776,6 +789,17 @@ class Graph {
     }
   }
 
+  /*
+   * Only the live part of each stack that is not a thread stack is used,
+   * because the rest of the stack is not in use by the owner of the stack.
+   */
+  void FindRegisteredStackAnchorPoints(
+      const StackRegistry<Offset> &stackRegistry) {
+    for (const auto &stack : stackRegistry) {
+      FindAnchorPoints(stack._stackPointer, stack._limit, _stackAnchorPoints);
+    }
+  }
+
   void FindExternalAnchorPoints() {
     if (_externalAnchorPointChecker != 0) {
       ContiguousImage<Offset> contiguousImage(_addressMap, _directory);
@@ -793,6 +817,341 @@ class Graph {
     }
   }
 
+  static constexpr size_t NUM_ANCHOR_TYPES = 4;
+  static constexpr size_t BITS_PER_WORD = 64;
+  typedef std::vector<std::atomic<uint64_t> > AtomicBits;
+
+  /*
+   * These are the results of visiting one chunk of work for one level of
+   * the anchor traversal.
+   */
+  struct AnchorLevelChunk {
+    AnchorLevelChunk() {
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        _newIncoming[type] = 0;
+      }
+    }
+    /*
+     * Empty the chunk for reuse by the next level, keeping the capacity of
+     * the vectors.
+     */
+    void Clear() {
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        _reached[type].clear();
+        _newIncoming[type] = 0;
+      }
+    }
+    std::vector<Index> _reached[NUM_ANCHOR_TYPES];
+    EdgeIndex _newIncoming[NUM_ANCHOR_TYPES];
+  };
+
+  /*
+   * Make the first numChunks chunks empty for the next level, growing the
+   * vector as needed but otherwise reusing the chunks from earlier levels.
+   */
+  static void PrepareAnchorLevelChunks(std::vector<AnchorLevelChunk> &chunks,
+                                       size_t numChunks) {
+    if (chunks.size() < numChunks) {
+      chunks.resize(numChunks);
+    }
+    for (size_t chunkNum = 0; chunkNum < numChunks; chunkNum++) {
+      chunks[chunkNum].Clear();
+    }
+  }
+
+  /*
+   * Visit the outgoing edges from one chunk of the current frontier for one
+   * anchor type, claiming any targets not already reached for that anchor
+   * type.
+   */
+  void VisitAnchorLevelTopDown(const std::vector<Index> &frontier,
+                               size_t begin, size_t end, AtomicBits &visited,
+                               IndexedDistances<Index> &distances,
+                               Index distance, std::vector<Index> &reached,
+                               EdgeIndex &newIncoming) {
+    for (size_t i = begin; i < end; i++) {
+      Index sourceIndex = frontier[i];
+      EdgeIterator itEnd = _outgoing.End(sourceIndex);
+      for (EdgeIterator it = _outgoing.Begin(sourceIndex); it != itEnd;
+           ++it) {
+        Index targetIndex = *it;
+        std::atomic<uint64_t> &word = visited[targetIndex / BITS_PER_WORD];
+        uint64_t bit = ((uint64_t)1) << (targetIndex % BITS_PER_WORD);
+        if ((word.load(std::memory_order_relaxed) & bit) != 0 ||
+            (word.fetch_or(bit, std::memory_order_relaxed) & bit) != 0) {
+          continue;
+        }
+        distances.SetDistance(targetIndex, distance);
+        reached.push_back(targetIndex);
+        newIncoming += NumIncoming(targetIndex);
+      }
+    }
+  }
+
+  /*
+   * For each allocation in the given range of words of the visited bits
+   * that has not yet been reached for at least one anchor type with a
+   * non-empty frontier, check whether any incoming edge is from the
+   * frontier for that anchor type.  Only the thread handling a given word
+   * of the visited bits ever changes it in this direction.
+   */
+  void VisitAnchorLevelBottomUp(
+      size_t beginWord, size_t endWord, AtomicBits *visited,
+      const std::vector<uint64_t> *frontierBits,
+      IndexedDistances<Index> **distances, const bool *isActive,
+      Index distance, AnchorLevelChunk &chunk) {
+    for (size_t wordIndex = beginWord; wordIndex < endWord; wordIndex++) {
+      uint64_t unvisited[NUM_ANCHOR_TYPES];
+      uint64_t anyUnvisited = 0;
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        unvisited[type] =
+            isActive[type]
+                ? ~visited[type][wordIndex].load(std::memory_order_relaxed)
+                : 0;
+        anyUnvisited |= unvisited[type];
+      }
+      while (anyUnvisited != 0) {
+        size_t bitNum = __builtin_ctzll(anyUnvisited);
+        uint64_t bit = ((uint64_t)1) << bitNum;
+        anyUnvisited &= ~bit;
+        Index targetIndex = wordIndex * BITS_PER_WORD + bitNum;
+        if (targetIndex >= _numAllocations) {
+          break;
+        }
+        size_t numTypesToFind = 0;
+        bool toFind[NUM_ANCHOR_TYPES];
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          toFind[type] = (unvisited[type] & bit) != 0;
+          if (toFind[type]) {
+            numTypesToFind++;
+          }
+        }
+        EdgeIterator itEnd = _incoming.End(targetIndex);
+        for (EdgeIterator it = _incoming.Begin(targetIndex);
+             it != itEnd && numTypesToFind > 0; ++it) {
+          Index sourceIndex = *it;
+          size_t sourceWord = sourceIndex / BITS_PER_WORD;
+          uint64_t sourceBit = ((uint64_t)1) << (sourceIndex % BITS_PER_WORD);
+          for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+            if (toFind[type] &&
+                (frontierBits[type][sourceWord] & sourceBit) != 0) {
+              toFind[type] = false;
+              numTypesToFind--;
+              visited[type][wordIndex].fetch_or(bit,
+                                                std::memory_order_relaxed);
+              distances[type]->SetDistance(targetIndex, distance);
+              chunk._reached[type].push_back(targetIndex);
+              chunk._newIncoming[type] += NumIncoming(targetIndex);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /*
+   * Calculate the anchor distances for all four types of anchor points, and
+   * the leaked status, in a single level-synchronous breadth-first traversal
+   * that starts from all the anchor points of all the types at once.  Each
+   * level is calculated either top-down, from the outgoing edges of the
+   * frontier, or bottom-up, from the incoming edges of allocations not yet
+   * reached, whichever is expected to check fewer edges, and the work for a
+   * level is split across threads if there is enough of it.  A small
+   * top-down level, such as one step along a long list, is handled on the
+   * calling thread, and the per-level buffers are reused so that a long
+   * chain of small levels stays cheap.  In either case
+   * the distance for each allocation and anchor type is the length of the
+   * shortest anchor chain, so the results don't depend on the direction or
+   * the number of threads.
+   */
+  void MarkAnchoredChunks() {
+    IndexedDistances<Index> *distances[NUM_ANCHOR_TYPES] = {
+        &_staticAnchorDistances, &_stackAnchorDistances,
+        &_registerAnchorDistances, &_externalAnchorDistances};
+    std::vector<Index> frontiers[NUM_ANCHOR_TYPES];
+    for (const auto &anchorPoint : _staticAnchorPoints) {
+      frontiers[0].push_back(anchorPoint.first);
+    }
+    for (const auto &anchorPoint : _stackAnchorPoints) {
+      frontiers[1].push_back(anchorPoint.first);
+    }
+    for (const auto &anchorPoint : _registerAnchorPoints) {
+      frontiers[2].push_back(anchorPoint.first);
+    }
+    for (const auto &anchorPoint : _externalAnchorPoints) {
+      frontiers[3].push_back(anchorPoint.first);
+    }
+
+    /*
+     * Free allocations are treated as already visited for every anchor type
+     * because anchor chains include only used allocations.
+     */
+    const size_t WORDS_PER_CHUNK = 0x400;
+    const size_t FRONTIER_PER_CHUNK = 0x1000;
+    const EdgeIndex MIN_PARALLEL_OUTGOING = 0x10000;
+    size_t numWords = (_numAllocations + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    size_t numWordChunks = (numWords + WORDS_PER_CHUNK - 1) / WORDS_PER_CHUNK;
+    AtomicBits visited[NUM_ANCHOR_TYPES];
+    for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+      AtomicBits(numWords).swap(visited[type]);
+    }
+    std::vector<EdgeIndex> usedIncomingByChunk(numWordChunks, 0);
+    Parallel::VisitChunks(numWordChunks, [&](size_t chunkNum) {
+      size_t beginWord = chunkNum * WORDS_PER_CHUNK;
+      size_t endWord = std::min(beginWord + WORDS_PER_CHUNK, numWords);
+      for (size_t wordIndex = beginWord; wordIndex < endWord; wordIndex++) {
+        uint64_t freeBits = 0;
+        Index base = wordIndex * BITS_PER_WORD;
+        for (size_t bitNum = 0; bitNum < BITS_PER_WORD; bitNum++) {
+          Index index = base + bitNum;
+          if (index >= _numAllocations ||
+              !_directory.AllocationAt(index)->IsUsed()) {
+            freeBits |= ((uint64_t)1) << bitNum;
+          } else {
+            usedIncomingByChunk[chunkNum] += NumIncoming(index);
+          }
+        }
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          visited[type][wordIndex].store(freeBits, std::memory_order_relaxed);
+        }
+      }
+    });
+    EdgeIndex usedIncoming = 0;
+    for (EdgeIndex chunkIncoming : usedIncomingByChunk) {
+      usedIncoming += chunkIncoming;
+    }
+
+    /*
+     * The incoming edges to allocations not yet reached for a given anchor
+     * type are tracked to estimate the cost of a bottom-up level.
+     */
+    EdgeIndex unreachedIncoming[NUM_ANCHOR_TYPES];
+    for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+      unreachedIncoming[type] = usedIncoming;
+      for (Index index : frontiers[type]) {
+        visited[type][index / BITS_PER_WORD].fetch_or(
+            ((uint64_t)1) << (index % BITS_PER_WORD),
+            std::memory_order_relaxed);
+        distances[type]->SetDistance(index, 1);
+        unreachedIncoming[type] -= NumIncoming(index);
+      }
+    }
+
+    std::vector<uint64_t> frontierBits[NUM_ANCHOR_TYPES];
+    std::vector<AnchorLevelChunk> chunks;
+    std::vector<std::pair<size_t, size_t> > chunkStarts;
+    Index distance = 1;
+    while (true) {
+      size_t frontierSize = 0;
+      EdgeIndex frontierOutgoing = 0;
+      EdgeIndex activeUnreachedIncoming = 0;
+      bool isActive[NUM_ANCHOR_TYPES];
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        isActive[type] = !frontiers[type].empty();
+        if (isActive[type]) {
+          frontierSize += frontiers[type].size();
+          activeUnreachedIncoming += unreachedIncoming[type];
+          for (Index index : frontiers[type]) {
+            frontierOutgoing += NumOutgoing(index);
+          }
+        }
+      }
+      if (frontierSize == 0) {
+        break;
+      }
+      distance++;
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        if (isActive[type]) {
+          distances[type]->ReserveDistance(distance);
+        }
+      }
+
+      size_t numChunks;
+      if (frontierOutgoing * 14 > activeUnreachedIncoming &&
+          frontierSize * 24 > _numAllocations) {
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          if (isActive[type]) {
+            frontierBits[type].resize(numWords, 0);
+            for (Index index : frontiers[type]) {
+              frontierBits[type][index / BITS_PER_WORD] |=
+                  ((uint64_t)1) << (index % BITS_PER_WORD);
+            }
+          }
+        }
+        numChunks = numWordChunks;
+        PrepareAnchorLevelChunks(chunks, numChunks);
+        Parallel::VisitChunks(numChunks, [&](size_t chunkNum) {
+          size_t beginWord = chunkNum * WORDS_PER_CHUNK;
+          VisitAnchorLevelBottomUp(
+              beginWord, std::min(beginWord + WORDS_PER_CHUNK, numWords),
+              visited, frontierBits, distances, isActive, distance,
+              chunks[chunkNum]);
+        });
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          for (Index index : frontiers[type]) {
+            frontierBits[type][index / BITS_PER_WORD] = 0;
+          }
+        }
+      } else if (frontierOutgoing < MIN_PARALLEL_OUTGOING) {
+        numChunks = 1;
+        PrepareAnchorLevelChunks(chunks, numChunks);
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          if (isActive[type]) {
+            VisitAnchorLevelTopDown(frontiers[type], 0, frontiers[type].size(),
+                                    visited[type], *distances[type], distance,
+                                    chunks[0]._reached[type],
+                                    chunks[0]._newIncoming[type]);
+          }
+        }
+      } else {
+        chunkStarts.clear();
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          for (size_t begin = 0; begin < frontiers[type].size();
+               begin += FRONTIER_PER_CHUNK) {
+            chunkStarts.emplace_back(type, begin);
+          }
+        }
+        numChunks = chunkStarts.size();
+        PrepareAnchorLevelChunks(chunks, numChunks);
+        Parallel::VisitChunks(numChunks, [&](size_t chunkNum) {
+          size_t type = chunkStarts[chunkNum].first;
+          size_t begin = chunkStarts[chunkNum].second;
+          const std::vector<Index> &frontier = frontiers[type];
+          VisitAnchorLevelTopDown(
+              frontier, begin,
+              std::min(begin + FRONTIER_PER_CHUNK, frontier.size()),
+              visited[type], *distances[type], distance,
+              chunks[chunkNum]._reached[type],
+              chunks[chunkNum]._newIncoming[type]);
+        });
+      }
+
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        frontiers[type].clear();
+        for (size_t chunkNum = 0; chunkNum < numChunks; chunkNum++) {
+          const AnchorLevelChunk &chunk = chunks[chunkNum];
+          frontiers[type].insert(frontiers[type].end(),
+                                 chunk._reached[type].begin(),
+                                 chunk._reached[type].end());
+          unreachedIncoming[type] -= chunk._newIncoming[type];
+        }
+      }
+    }
+
+    for (Index index = 0; index < _numAllocations; index++) {
+      size_t wordIndex = index / BITS_PER_WORD;
+      uint64_t bit = ((uint64_t)1) << (index % BITS_PER_WORD);
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        if ((visited[type][wordIndex].load(std::memory_order_relaxed) &
+             bit) != 0) {
+          // Free allocations were already marked as not leaked.
+          _leaked[index] = false;
+          break;
+        }
+      }
+    }
+  }
+
   void MarkLeakedChunks() {
     _leaked.reserve(_numAllocations);
     _leaked.resize(_numAllocations, true);
@@ -801,10 +1160,7 @@ class Graph {
         _leaked[i] = false;
       }
     }
-    MarkAnchoredChunks(_staticAnchorPoints, _staticAnchorDistances);
-    MarkAnchoredChunks(_stackAnchorPoints, _stackAnchorDistances);
-    MarkAnchoredChunks(_registerAnchorPoints, _registerAnchorDistances);
-    MarkAnchoredChunks(_externalAnchorPoints, _externalAnchorDistances);
+    MarkAnchoredChunks();
   }
 };
 }  // namespace Allocations
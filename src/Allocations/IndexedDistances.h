@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include "../MappedVector.h"
 namespace chap {
 namespace Allocations {
 template <typename Index>
@@ -17,6 +18,22 @@ class IndexedDistances {
   }
 
   void SetDistance(Index index, Index distance) {
+    ReserveDistance(distance);
+    if (_distanceBits == 8) {
+      _distances8[index] = distance & 0xFF;
+    } else if (_distanceBits == 16) {
+      _distances16[index] = distance & 0xFFFF;
+    } else {
+      _distances32[index] = distance & 0xFFFFFFFF;
+    }
+  }
+
+  /*
+   * Make sure that the given distance can be stored.  After this, calls to
+   * SetDistance with distances no larger than the given one, for distinct
+   * indices, are safe to make from multiple threads.
+   */
+  void ReserveDistance(Index distance) {
     while (distance > _maxDistance) {
       if (_distanceBits == _maxDistanceBits) {
         abort();
@@ -29,7 +46,7 @@ class IndexedDistances {
         }
         _distanceBits = 16;
         _maxDistance = 0xFFFF;
-        std::vector<uint8_t> distances8;
+        MappedVector<uint8_t> distances8;
         distances8.swap(_distances8);
       } else if (_distanceBits == 16) {
         _distances32.reserve(_numIndices);
@@ -39,19 +56,12 @@ class IndexedDistances {
         }
         _distanceBits = 32;
         _maxDistance = 0xFFFFFFFF;
-        std::vector<uint16_t> distances16;
+        MappedVector<uint16_t> distances16;
         distances16.swap(_distances16);
       } else {
         abort();
       }
     }
-    if (_distanceBits == 8) {
-      _distances8[index] = distance & 0xFF;
-    } else if (_distanceBits == 16) {
-      _distances16[index] = distance & 0xFFFF;
-    } else {
-      _distances32[index] = distance & 0xFFFFFFFF;
-    }
   }
 
   Index GetDistance(Index index) const {
@@ -69,9 +79,9 @@ class IndexedDistances {
   uint16_t _distanceBits;
   uint16_t _maxDistanceBits;
   Index _maxDistance;
-  std::vector<uint8_t> _distances8;
-  std::vector<uint16_t> _distances16;
-  std::vector<uint32_t> _distances32;
+  MappedVector<uint8_t> _distances8;
+  MappedVector<uint16_t> _distances16;
+  MappedVector<uint32_t> _distances32;
 };
 }  // namespace Allocations
 }  // namespace chap
@@ -68,6 +68,7 @@ class Chain {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   Chain(const Directory<Offset>& directory,
         const VirtualAddressMap<Offset>& addressMap, AllocationIndex index,
@@ -80,7 +81,7 @@ class Chain {
   AllocationIndex Next() {
     AllocationIndex returnValue = _index;
     if (_index != _numAllocations) {
-      const Allocation* allocation = _directory.AllocationAt(_index);
+      AllocationPointer allocation = _directory.AllocationAt(_index);
       if (allocation == 0) {
         abort();
       }
@@ -65,7 +65,9 @@ class ExactIncoming {
     const std::string _setName;
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   ExactIncoming(const Directory<Offset>& directory, const Graph<Offset>& graph,
                 const VirtualAddressMap<Offset>& addressMap,
@@ -82,7 +84,7 @@ class ExactIncoming {
   AllocationIndex Next() {
     while (_pNextIncoming != _pPastIncoming) {
       AllocationIndex index = *(_pNextIncoming++);
-      const Allocation* allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation == ((Allocation*)(0))) {
         abort();
       }
@@ -108,8 +110,8 @@ class ExactIncoming {
   const VirtualAddressMap<Offset>& _addressMap;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextIncoming;
-  const AllocationIndex* _pPastIncoming;
+  EdgeIterator _pNextIncoming;
+  EdgeIterator _pPastIncoming;
   Offset _target;
 };
 }  // namespace Iterators
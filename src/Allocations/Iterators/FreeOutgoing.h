@@ -64,7 +64,9 @@ class FreeOutgoing {
     const std::string _setName;
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   FreeOutgoing(const Directory<Offset>& directory, const Graph<Offset>& graph,
                AllocationIndex index, AllocationIndex numAllocations)
@@ -78,7 +80,7 @@ class FreeOutgoing {
   AllocationIndex Next() {
     while (_pNextOutgoing != _pPastOutgoing) {
       AllocationIndex index = *(_pNextOutgoing++);
-      const Allocation* allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation == ((Allocation*)(0))) {
         abort();
       }
@@ -94,8 +96,8 @@ class FreeOutgoing {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextOutgoing;
-  const AllocationIndex* _pPastOutgoing;
+  EdgeIterator _pNextOutgoing;
+  EdgeIterator _pPastOutgoing;
 };
 }  // namespace Iterators
 }  // namespace Allocations
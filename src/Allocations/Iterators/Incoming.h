@@ -62,7 +62,9 @@ class Incoming {
     const std::string _setName;
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   Incoming(const Directory<Offset>& directory, const Graph<Offset>& graph,
            AllocationIndex index, AllocationIndex numAllocations)
@@ -75,7 +77,7 @@ class Incoming {
   AllocationIndex Next() {
     while (_pNextIncoming != _pPastIncoming) {
       AllocationIndex index = *(_pNextIncoming++);
-      const Allocation* allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation == ((Allocation*)(0))) {
         abort();
       }
@@ -91,8 +93,8 @@ class Incoming {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextIncoming;
-  const AllocationIndex* _pPastIncoming;
+  EdgeIterator _pNextIncoming;
+  EdgeIterator _pPastIncoming;
 };
 }  // namespace Iterators
 }  // namespace Allocations
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../Directory.h"
+#include "../NamedSets.h"
+namespace chap {
+namespace Allocations {
+namespace Iterators {
+template <class Offset>
+class NamedSet {
+ public:
+  typedef typename NamedSets<Offset>::Bits Bits;
+  class Factory {
+   public:
+    Factory(const NamedSets<Offset>& namedSets)
+        : _setName("named set"), _namedSets(namedSets), _numArguments(0) {}
+    NamedSet* MakeIterator(Commands::Context& context,
+                           const ProcessImage<Offset>& /* processImage */,
+                           const Directory<Offset>& directory) {
+      Bits bits;
+      size_t numUsed = _namedSets.Evaluate(context, 1, bits);
+      if (numUsed == 0) {
+        return (NamedSet*)(0);
+      }
+      /*
+       * Anything after the set name that is part of the expression is
+       * treated as arguments to the set.
+       */
+      _numArguments = numUsed - 1;
+      return new NamedSet(directory.NumAllocations(), bits);
+    }
+    // TODO: allow adding taints
+    const std::string& GetSetName() const { return _setName; }
+    size_t GetNumArguments() { return _numArguments; }
+    const std::vector<std::string>& GetTaints() const { return _taints; }
+    void ShowHelpMessage(Commands::Context& context) {
+      Commands::Output& output = context.GetOutput();
+      output << "Use the name given to a set by the \"set\" command to "
+                "specify the allocations\nthat were saved under that name.  "
+                "Named sets and built-in sets that take no\narguments, such "
+                "as \"used\" or \"leaked\", can be combined from left to "
+                "right\nusing \"&\" for intersection, \"|\" for union and "
+                "\"-\" for difference, as in\n\"big & used - unreferenced\".\n";
+    }
+
+   private:
+    const std::vector<std::string> _taints;
+    const std::string _setName;
+    const NamedSets<Offset>& _namedSets;
+    size_t _numArguments;
+  };
+  typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+
+  NamedSet(AllocationIndex numAllocations, Bits& bits)
+      : _index(0), _numAllocations(numAllocations) {
+    _bits.swap(bits);
+  }
+
+  /*
+   * Skip whole words with no members, so that sparse sets are cheap to
+   * visit.
+   */
+  AllocationIndex Next() {
+    while (_index < _numAllocations) {
+      uint64_t word = _bits[_index >> 6] >> (_index & 63);
+      if (word == 0) {
+        _index = (_index | 63) + 1;
+        continue;
+      }
+      _index += __builtin_ctzll(word);
+      if (_index >= _numAllocations) {
+        break;
+      }
+      return _index++;
+    }
+    _index = _numAllocations;
+    return _numAllocations;
+  }
+
+ private:
+  Bits _bits;
+  AllocationIndex _index;
+  AllocationIndex _numAllocations;
+};
+}  // namespace Iterators
+}  // namespace Allocations
+}  // namespace chap
@@ -62,7 +62,9 @@ class Outgoing {
     const std::string _setName;
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   Outgoing(const Directory<Offset>& directory, const Graph<Offset>& graph,
            AllocationIndex index, AllocationIndex numAllocations)
@@ -76,7 +78,7 @@ class Outgoing {
   AllocationIndex Next() {
     while (_pNextOutgoing != _pPastOutgoing) {
       AllocationIndex index = *(_pNextOutgoing++);
-      const Allocation* allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation == ((Allocation*)(0))) {
         abort();
       }
@@ -92,8 +94,8 @@ class Outgoing {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextOutgoing;
-  const AllocationIndex* _pPastOutgoing;
+  EdgeIterator _pNextOutgoing;
+  EdgeIterator _pPastOutgoing;
 };
 }  // namespace Iterators
 }  // namespace Allocations
@@ -87,7 +87,9 @@ class ReverseChain {
     const std::string _setName;
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
 
   ReverseChain(const Directory<Offset>& directory, const Graph<Offset>& graph,
                const VirtualAddressMap<Offset>& addressMap,
@@ -103,14 +105,14 @@ class ReverseChain {
   AllocationIndex Next() {
     AllocationIndex returnValue = _index;
     if (_index != _numAllocations) {
-      const Allocation* target = _directory.AllocationAt(_index);
+      AllocationPointer target = _directory.AllocationAt(_index);
       if (target == 0) {
         abort();
       }
       if (target->Size() >= _targetOffset) {
         Offset targetAddress = target->Address();
-        const AllocationIndex* pNextIncoming;
-        const AllocationIndex* pPastIncoming;
+        EdgeIterator pNextIncoming;
+        EdgeIterator pPastIncoming;
         _graph.GetIncoming(_index, &pNextIncoming, &pPastIncoming);
 
         _index = _numAllocations;
@@ -118,7 +120,7 @@ class ReverseChain {
         typename VirtualAddressMap<Offset>::Reader reader(_addressMap);
         while (pNextIncoming != pPastIncoming) {
           AllocationIndex index = *(pNextIncoming++);
-          const Allocation* source = _directory.AllocationAt(index);
+          AllocationPointer source = _directory.AllocationAt(index);
           if (source == ((Allocation*)(0))) {
             abort();
           }
@@ -0,0 +1,159 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <ctype.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "../Commands/Runner.h"
+#include "Directory.h"
+namespace chap {
+namespace Allocations {
+/*
+ * This holds the sets of allocations that have been saved under a name
+ * with the "set" command, each as a bitset over allocation indices, and
+ * evaluates expressions that combine named sets and built-in sets that
+ * take no arguments, such as "used" or "leaked", using the operators "&"
+ * (intersection), "|" (union) and "-" (difference), applied from left to
+ * right.
+ */
+template <class Offset>
+class NamedSets {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef std::vector<uint64_t> Bits;
+  typedef std::function<bool(Commands::Context&, Bits&)> BuiltInSetEvaluator;
+
+  NamedSets(const Directory<Offset>& directory) : _directory(directory) {}
+
+  /*
+   * Return an empty bitset large enough for all the allocations.
+   */
+  Bits MakeEmptyBits() const {
+    return Bits((_directory.NumAllocations() + 63) / 64, 0);
+  }
+
+  static void Add(Bits& bits, AllocationIndex index) {
+    bits[index >> 6] |= ((uint64_t)(1)) << (index & 63);
+  }
+
+  static bool IsOperator(const std::string& token) {
+    return token == "&" || token == "|" || token == "-";
+  }
+
+  /*
+   * A name for a set must start with a letter or '_' and otherwise contain
+   * only letters, digits and '_'.  It must not consist entirely of hex
+   * digits, because commands such as "describe" accept an address in
+   * place of a set.
+   */
+  static bool IsValidName(const std::string& name) {
+    if (name.empty() || !(isalpha(name[0]) || name[0] == '_')) {
+      return false;
+    }
+    bool allHexDigits = true;
+    for (char c : name) {
+      if (!(isalnum(c) || c == '_')) {
+        return false;
+      }
+      if (!isxdigit(c)) {
+        allHexDigits = false;
+      }
+    }
+    return !allHexDigits;
+  }
+
+  void RegisterBuiltInSet(const std::string& name,
+                          BuiltInSetEvaluator evaluator) {
+    _builtInSets[name] = evaluator;
+  }
+
+  bool IsBuiltInSet(const std::string& name) const {
+    return _builtInSets.find(name) != _builtInSets.end();
+  }
+
+  bool IsDefined(const std::string& name) const {
+    return _sets.find(name) != _sets.end();
+  }
+
+  /*
+   * Save the given bitset under the given name, leaving the given bitset
+   * with whatever the name held before.
+   */
+  void Define(const std::string& name, Bits& bits) { _sets[name].swap(bits); }
+
+  const std::map<std::string, Bits>& GetSets() const { return _sets; }
+
+  /*
+   * The "set" command provides the name before the selection of the new
+   * members is started.
+   */
+  void SetPendingName(const std::string& name) { _pendingName = name; }
+  const std::string& GetPendingName() const { return _pendingName; }
+
+  /*
+   * Evaluate the expression that starts at the given positional argument,
+   * returning the number of positional arguments used, or 0 after reporting
+   * an error.  A "-" that is not followed by another positional argument
+   * is not treated as an operator, so that it can still be used to select
+   * unsigned allocations.
+   */
+  size_t Evaluate(Commands::Context& context, size_t firstPositional,
+                  Bits& result) const {
+    size_t numPositionals = context.GetNumPositionals();
+    if (!EvaluateOperand(context, context.Positional(firstPositional),
+                         result)) {
+      return 0;
+    }
+    size_t next = firstPositional + 1;
+    Bits operand;
+    while (next + 1 < numPositionals &&
+           IsOperator(context.Positional(next))) {
+      if (!EvaluateOperand(context, context.Positional(next + 1), operand)) {
+        return 0;
+      }
+      char op = context.Positional(next)[0];
+      for (size_t i = 0; i < result.size(); i++) {
+        if (op == '&') {
+          result[i] &= operand[i];
+        } else if (op == '|') {
+          result[i] |= operand[i];
+        } else {
+          result[i] &= ~operand[i];
+        }
+      }
+      next += 2;
+    }
+    return next - firstPositional;
+  }
+
+ private:
+  const Directory<Offset>& _directory;
+  std::map<std::string, Bits> _sets;
+  std::map<std::string, BuiltInSetEvaluator> _builtInSets;
+  std::string _pendingName;
+
+  bool EvaluateOperand(Commands::Context& context, const std::string& name,
+                       Bits& bits) const {
+    typename std::map<std::string, Bits>::const_iterator it = _sets.find(name);
+    if (it != _sets.end()) {
+      bits = it->second;
+      return true;
+    }
+    typename std::map<std::string, BuiltInSetEvaluator>::const_iterator
+        itBuiltIn = _builtInSets.find(name);
+    if (itBuiltIn != _builtInSets.end()) {
+      bits = MakeEmptyBits();
+      return itBuiltIn->second(context, bits);
+    }
+    context.GetError() << "Set \"" << name
+                       << "\" is neither a named set nor a built-in set that "
+                          "takes no arguments.\n";
+    return false;
+  }
+};
+}  // namespace Allocations
+}  // namespace chap
@@ -16,6 +16,7 @@ class PatternDescriberRegistry {
   typedef typename Directory<Offset>::Allocation Allocation;
   typedef typename TagHolder<Offset>::TagIndex TagIndex;
   typedef typename TagHolder<Offset>::TagIndices TagIndices;
+  typedef typename TagHolder<Offset>::SubtypeIndex SubtypeIndex;
   typedef typename std::multimap<std::string, PatternDescriber<Offset>*>
       DescriberMap;
   PatternDescriberRegistry(const ProcessImage<Offset>& processImage)
@@ -65,6 +66,18 @@ class PatternDescriberRegistry {
     return _tagHolder.GetTagIndex(index);
   }
 
+  /*
+   * Return the index of the subtype with the given name, such as the name
+   * of a python type, or 0 if no such subtype exists.
+   */
+  SubtypeIndex FindSubtype(const std::string& subtypeName) const {
+    return _tagHolder.FindSubtype(subtypeName);
+  }
+
+  SubtypeIndex GetSubtypeIndex(AllocationIndex index) const {
+    return _tagHolder.GetSubtypeIndex(index);
+  }
+
  private:
   const TagHolder<Offset>& _tagHolder;
   size_t _numTags;
@@ -17,6 +17,7 @@ template <class Offset>
 class ReferenceConstraint {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory<Offset>::Allocation Allocation;
   enum BoundaryType { MINIMUM, MAXIMUM };
   enum ReferenceType { INCOMING, OUTGOING };
@@ -44,14 +45,14 @@ class ReferenceConstraint {
   }
   bool Check(AllocationIndex index) const {
     size_t numMatchingEdges = 0;
-    const AllocationIndex* pFirstEdge;
-    const AllocationIndex* pPastEdge;
+    EdgeIterator pFirstEdge;
+    EdgeIterator pPastEdge;
     if (_referenceType == INCOMING) {
       _graph.GetIncoming(index, &pFirstEdge, &pPastEdge);
     } else {
       _graph.GetOutgoing(index, &pFirstEdge, &pPastEdge);
     }
-    for (const AllocationIndex* pEdge = pFirstEdge; pEdge != pPastEdge;
+    for (EdgeIterator pEdge = pFirstEdge; pEdge != pPastEdge;
          pEdge++) {
       const Allocation& allocation = *(_directory.AllocationAt(*pEdge));
       if ((allocation.IsUsed() == _wantUsed) &&
@@ -35,7 +35,8 @@ class SignatureChecker {
         _addressMap(addressMap),
         _signature((signature[0] != '%') ? signature : ""),
         _patternName((signature[0] == '%') ? signature.substr(1) : ""),
-        _tagIndices(nullptr) {
+        _tagIndices(nullptr),
+        _subtypeIndex(0) {
     if (signature.empty()) {
       return;
     }
@@ -50,7 +51,19 @@ class SignatureChecker {
     }
 
     if (signature[0] == '%') {
-      _tagIndices = _patternDescriberRegistry.GetTagIndices(signature);
+      /*
+       * A pattern may be refined by a subtype, as in %SimplePythonObject:dict
+       */
+      size_t colonPos = signature.find(':');
+      _tagIndices = _patternDescriberRegistry.GetTagIndices(
+          signature.substr(0, colonPos));
+      if (colonPos != std::string::npos) {
+        _subtypeIndex = _patternDescriberRegistry.FindSubtype(
+            signature.substr(colonPos + 1));
+        if (_subtypeIndex == 0) {
+          _tagIndices = nullptr;
+        }
+      }
       if (_tagIndices == nullptr) {
         _checkType = UNRECOGNIZED_PATTERN;
       } else {
@@ -114,7 +127,10 @@ class SignatureChecker {
 
         if (_checkType == PATTERN_CHECK) {
           return _tagIndices->find(_patternDescriberRegistry.GetTagIndex(
-                     index)) != _tagIndices->end();
+                     index)) != _tagIndices->end() &&
+                 (_subtypeIndex == 0 ||
+                  _patternDescriberRegistry.GetSubtypeIndex(index) ==
+                      _subtypeIndex);
         } else if (_checkType == UNSIGNED_ONLY) {
           return ((size < sizeof(Offset)) ||
                   !_directory.IsMapped(*((Offset*)image)));
@@ -139,6 +155,7 @@ class SignatureChecker {
   const std::string _patternName;
   std::set<Offset> _signatures;
   const typename PatternDescriberRegistry<Offset>::TagIndices* _tagIndices;
+  typename PatternDescriberRegistry<Offset>::SubtypeIndex _subtypeIndex;
 };
 }  // namespace Allocations
 }  // namespace chap
@@ -2,8 +2,11 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 /*
  * This keeps mappings from signature to name and name to set of signatures.
@@ -38,6 +41,14 @@ class SignatureDirectory {
   typedef typename NameToSignaturesMap::const_iterator
       NameToSignaturesConstIterator;
 
+  /*
+   * Each signature is also given a small dense id, in order of first
+   * mapping, so that per-signature totals can be kept in arrays.  Ids are
+   * never reused, because signatures are never unmapped.
+   */
+  typedef uint32_t SignatureId;
+  static const SignatureId NO_SIGNATURE_ID = ~((SignatureId)0);
+
   SignatureDirectory() : _multipleSignaturesPerName(false) {}
 
   void MapSignatureNameAndStatus(Offset signature, std::string name,
@@ -67,6 +78,8 @@ class SignatureDirectory {
       knownStatus = status;
     } else {
       _signatureToName[signature] = std::make_pair(name, status);
+      _signatureToId[signature] = (SignatureId)(_idToSignature.size());
+      _idToSignature.push_back(signature);
     }
     if (!name.empty()) {
       std::set<Offset>& signatures = _nameToSignatures[name];
@@ -94,6 +107,16 @@ class SignatureDirectory {
     }
   }
 
+  SignatureId GetSignatureId(Offset signature) const {
+    typename std::unordered_map<Offset, SignatureId>::const_iterator it =
+        _signatureToId.find(signature);
+    return (it == _signatureToId.end()) ? NO_SIGNATURE_ID : it->second;
+  }
+
+  size_t NumSignatureIds() const { return _idToSignature.size(); }
+
+  Offset SignatureOfId(SignatureId id) const { return _idToSignature[id]; }
+
   const std::set<Offset>& Signatures(const std::string& name) const {
     typename NameToSignaturesMap::const_iterator it =
         _nameToSignatures.find(name);
@@ -116,6 +139,8 @@ class SignatureDirectory {
   bool _multipleSignaturesPerName;
   SignatureNameAndStatusMap _signatureToName;
   NameToSignaturesMap _nameToSignatures;
+  std::unordered_map<Offset, SignatureId> _signatureToId;
+  std::vector<Offset> _idToSignature;
   std::string NO_NAME;
   std::set<Offset> NO_SIGNATURES;
 };
@@ -5,7 +5,11 @@
 #include <algorithm>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
+#include "../VirtualAddressMap.h"
 #include "Directory.h"
+#include "DominatorTree.h"
 #include "SignatureDirectory.h"
 #include "TagHolder.h"
 namespace chap {
@@ -24,61 +28,135 @@ class SignatureSummary {
     Offset _count;
     Offset _bytes;
   };
-  typedef std::map<Offset, Offset> SizeToCount;
+  typedef std::unordered_map<Offset, Offset> SizeToCount;
   struct TallyWithSizeSubtotals {
     Tally _tally;
     SizeToCount _sizeToCount;
     void Bump(Offset size) {
       _tally.Bump(size);
-      typename SizeToCount::iterator it = _sizeToCount.find(size);
-      if (it == _sizeToCount.end()) {
-        _sizeToCount[size] = 1;
-      } else {
-        it->second = it->second + 1;
+      _sizeToCount[size]++;
+    }
+    void Merge(const TallyWithSizeSubtotals& other) {
+      _tally._count += other._tally._count;
+      _tally._bytes += other._tally._bytes;
+      for (const auto& sizeAndCount : other._sizeToCount) {
+        _sizeToCount[sizeAndCount.first] += sizeAndCount.second;
       }
     }
   };
-  typedef std::map<Offset, Tally> OffsetToTally;
-  typedef typename OffsetToTally::iterator OffsetToTallyIterator;
-  typedef typename OffsetToTally::const_iterator OffsetToTallyConstIterator;
-  typedef std::map<std::string, Tally> NameToTally;
-  typedef typename NameToTally::iterator NameToTallyIterator;
-  typedef typename NameToTally::const_iterator NameToTallyConstIterator;
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
+  typedef typename TagHolder<Offset>::TagIndex TagIndex;
+  typedef typename TagHolder<Offset>::SubtypeIndex SubtypeIndex;
+  typedef typename SignatureDirectory<Offset>::SignatureId SignatureId;
   struct Item {
+    Item() : _retained(0) {}
     std::string _name;
     Tally _totals;
+    Offset _retained;
     std::vector<std::pair<Offset, Tally> > _subtotals;
     void AddSubtotal(Offset signature, const Tally& tally) {
       _subtotals.push_back(std::make_pair(signature, tally));
     }
   };
 
+  /*
+   * If a dominator tree is supplied, the summarized allocations are marked,
+   * at a cost of one bit per allocation, so that the retained size can be
+   * calculated for each item when the summary is reported.  If bySubtype is
+   * set, tagged allocations that also have a subtype, such as a python type,
+   * are summarized under the tag name followed by ":" and the subtype name.
+   */
   SignatureSummary(const SignatureDirectory<Offset>& directory,
-                   const TagHolder<Offset>& tagHolder)
-      : _directory(directory), _tagHolder(tagHolder) {}
+                   const TagHolder<Offset>& tagHolder,
+                   const Directory<Offset>& allocationDirectory,
+                   const VirtualAddressMap<Offset>& addressMap,
+                   const DominatorTree<Offset>* dominatorTree = nullptr,
+                   bool bySubtype = false)
+      : _directory(directory),
+        _tagHolder(tagHolder),
+        _allocationDirectory(allocationDirectory),
+        _addressMap(addressMap),
+        _dominatorTree(dominatorTree),
+        _bySubtype(bySubtype) {}
+
+  /*
+   * Return an empty summary with the same settings, for use in summarizing
+   * part of a set, possibly on a separate thread, before merging.
+   */
+  SignatureSummary MakeEmptyCopy() const {
+    return SignatureSummary(_directory, _tagHolder, _allocationDirectory,
+                            _addressMap, _dominatorTree, _bySubtype);
+  }
+
+  /*
+   * Add the tallies from the given summary, which must have been made by
+   * MakeEmptyCopy.
+   */
+  void Merge(const SignatureSummary& other) {
+    _unsignedTally.Merge(other._unsignedTally);
+    for (TagIndex tagIndex = 0; tagIndex < other._tagTallies.size();
+         tagIndex++) {
+      const auto& otherTallies = other._tagTallies[tagIndex];
+      for (SubtypeIndex subtypeIndex = 0; subtypeIndex < otherTallies.size();
+           subtypeIndex++) {
+        if (otherTallies[subtypeIndex]._tally._count != 0) {
+          TagTally(tagIndex, subtypeIndex).Merge(otherTallies[subtypeIndex]);
+        }
+      }
+    }
+    if (_signatureTallies.size() < other._signatureTallies.size()) {
+      _signatureTallies.resize(other._signatureTallies.size());
+    }
+    for (SignatureId id = 0; id < other._signatureTallies.size(); id++) {
+      _signatureTallies[id]._count += other._signatureTallies[id]._count;
+      _signatureTallies[id]._bytes += other._signatureTallies[id]._bytes;
+    }
+    if (_isMember.size() < other._isMember.size()) {
+      _isMember.resize(other._isMember.size(), false);
+    }
+    for (AllocationIndex index = 0; index < other._isMember.size(); index++) {
+      if (other._isMember[index]) {
+        _isMember[index] = true;
+      }
+    }
+  }
 
+  /*
+   * Tally the given allocation by tag index and subtype index, if it is
+   * tagged, or otherwise by signature id.  Names are resolved only when
+   * the summary is reported.
+   */
   bool AdjustTally(AllocationIndex index, Offset size, const char* image) {
-    const std::string& tagName = _tagHolder.GetTagName(index);
-    if (!tagName.empty()) {
+    if (_dominatorTree != nullptr) {
+      if (index >= _isMember.size()) {
+        _isMember.resize(index + 1, false);
+      }
+      _isMember[index] = true;
+    }
+    TagIndex tagIndex = _tagHolder.GetTagIndex(index);
+    if (tagIndex != 0) {
       /*
        * Tags take precedent over any signature.
        */
-      _talliesWithSizeSubtotals[tagName].Bump(size);
-    } else {
-      Offset signature = 0;
-      if (size >= sizeof(Offset)) {
-        signature = *((Offset*)image);
-      }
-      if (_directory.IsMapped(signature)) {
-        TallyBySignature(signature, size);
-        std::string name = _directory.Name(signature);
-        if (!name.empty()) {
-          TallyByName(name, size);
-        }
-      } else {
-        _unsignedTallyWithSizeSubtotals.Bump(size);
+      SubtypeIndex subtypeIndex =
+          _bySubtype ? _tagHolder.GetSubtypeIndex(index) : 0;
+      TagTally(tagIndex, subtypeIndex).Bump(size);
+      return false;
+    }
+    Offset signature = 0;
+    if (size >= sizeof(Offset)) {
+      signature = *((Offset*)image);
+    }
+    SignatureId id = _directory.GetSignatureId(signature);
+    if (id != SignatureDirectory<Offset>::NO_SIGNATURE_ID) {
+      if (id >= _signatureTallies.size()) {
+        _signatureTallies.resize(id + 1);
       }
+      _signatureTallies[id].Bump(size);
+    } else {
+      _unsignedTally.Bump(size);
     }
     return false;
   }
@@ -105,95 +183,226 @@ class SignatureSummary {
     std::sort(items.begin(), items.end(), CompareItemsByBytes());
   }
 
+  /*
+   * Sort by retained bytes, which are available only if a dominator tree
+   * was supplied.  Any size subtotals are sorted by bytes.
+   */
+  void SummarizeByRetained(std::vector<Item>& items) const {
+    FillItems(items);
+    for (auto& item : items) {
+      if (item._subtotals.size() > 1) {
+        std::sort(item._subtotals.begin(), item._subtotals.end(),
+                  CompareSubtotalsByBytes());
+      }
+    }
+    std::sort(items.begin(), items.end(), CompareItemsByRetained());
+  }
+
  private:
   const SignatureDirectory<Offset>& _directory;
   const TagHolder<Offset>& _tagHolder;
-  OffsetToTally _signatureToTally;
-  NameToTally _nameToTally;
-  TallyWithSizeSubtotals _unsignedTallyWithSizeSubtotals;
-  std::unordered_map<std::string, TallyWithSizeSubtotals>
-      _talliesWithSizeSubtotals;
-
-  void TallyBySignature(Offset signature, Offset size) {
-    OffsetToTallyIterator it = _signatureToTally.find(signature);
-    if (it != _signatureToTally.end()) {
-      it->second._count++;
-      it->second._bytes += size;
-    } else {
-      _signatureToTally[signature] = Tally(1, size);
+  const Directory<Offset>& _allocationDirectory;
+  const VirtualAddressMap<Offset>& _addressMap;
+  const DominatorTree<Offset>* _dominatorTree;
+  const bool _bySubtype;
+  /*
+   * The per-tag arrays are indexed first by tag index and then by subtype
+   * index, where subtype index 0 is used for allocations without a subtype
+   * and for all tagged allocations if subtypes are not wanted.  The
+   * per-signature arrays are indexed by signature id.  All the arrays grow
+   * only as needed, so that a summary of a small part of a set stays small.
+   */
+  TallyWithSizeSubtotals _unsignedTally;
+  std::vector<std::vector<TallyWithSizeSubtotals> > _tagTallies;
+  std::vector<Tally> _signatureTallies;
+  /*
+   * This is indexed by allocation index and is used only if retained sizes
+   * are wanted.
+   */
+  std::vector<bool> _isMember;
+
+  static const size_t NO_ITEM = ~((size_t)0);
+  /*
+   * This gives the position, in the reported items, of the item for each
+   * unsigned allocation, for each combination of tag index and subtype
+   * index and for each signature id.
+   */
+  struct ItemPositions {
+    ItemPositions() : _unsigned(NO_ITEM) {}
+    size_t _unsigned;
+    std::vector<std::vector<size_t> > _tags;
+    std::vector<size_t> _signatures;
+  };
+
+  TallyWithSizeSubtotals& TagTally(TagIndex tagIndex,
+                                   SubtypeIndex subtypeIndex) {
+    if (tagIndex >= _tagTallies.size()) {
+      _tagTallies.resize(tagIndex + 1);
+    }
+    std::vector<TallyWithSizeSubtotals>& row = _tagTallies[tagIndex];
+    if (subtypeIndex >= row.size()) {
+      row.resize(subtypeIndex + 1);
     }
+    return row[subtypeIndex];
   }
-  void TallyByName(std::string name, Offset size) {
-    NameToTallyIterator it = _nameToTally.find(name);
-    if (it != _nameToTally.end()) {
-      it->second._count++;
-      it->second._bytes += size;
-    } else {
-      _nameToTally[name] = Tally(1, size);
+
+  void AddSizeSubtotals(const TallyWithSizeSubtotals& tallyWithSizeSubtotals,
+                        Item& item) const {
+    item._totals = tallyWithSizeSubtotals._tally;
+    for (const auto& sizeAndCount : tallyWithSizeSubtotals._sizeToCount) {
+      item.AddSubtotal(sizeAndCount.first,
+                       Tally(sizeAndCount.second,
+                             sizeAndCount.first * sizeAndCount.second));
     }
   }
 
   void FillItems(std::vector<Item>& items) const {
     items.clear();
-    if (_unsignedTallyWithSizeSubtotals._tally._count > 0) {
+    ItemPositions positions;
+    if (_unsignedTally._tally._count > 0) {
+      positions._unsigned = items.size();
       items.push_back(Item());
       Item& item = items.back();
       item._name = "?";
-      item._totals = _unsignedTallyWithSizeSubtotals._tally;
-      for (typename std::map<Offset, Offset>::const_iterator it =
-               _unsignedTallyWithSizeSubtotals._sizeToCount.begin();
-           it != _unsignedTallyWithSizeSubtotals._sizeToCount.end(); ++it) {
-        item.AddSubtotal(it->first, Tally(it->second, it->first * it->second));
+      AddSizeSubtotals(_unsignedTally, item);
+    }
+    FillTags(items, positions);
+    FillSignatures(items, positions);
+    if (_dominatorTree != nullptr) {
+      FillRetained(items, positions);
+    }
+  }
+
+  /*
+   * Several tag indices may share a name, so the tallies are combined by
+   * name, which is qualified by the subtype name if there is a subtype.
+   */
+  void FillTags(std::vector<Item>& items, ItemPositions& positions) const {
+    typedef std::vector<std::pair<TagIndex, SubtypeIndex> > Cells;
+    std::map<std::string, std::pair<TallyWithSizeSubtotals, Cells> >
+        nameToTally;
+    for (TagIndex tagIndex = 0; tagIndex < _tagTallies.size(); tagIndex++) {
+      const auto& row = _tagTallies[tagIndex];
+      for (SubtypeIndex subtypeIndex = 0; subtypeIndex < row.size();
+           subtypeIndex++) {
+        if (row[subtypeIndex]._tally._count == 0) {
+          continue;
+        }
+        std::string name = _tagHolder.GetNameOfTag(tagIndex);
+        if (subtypeIndex != 0) {
+          name.append(":");
+          name.append(_tagHolder.GetNameOfSubtype(subtypeIndex));
+        }
+        auto& tallyAndCells = nameToTally[name];
+        tallyAndCells.first.Merge(row[subtypeIndex]);
+        tallyAndCells.second.push_back(std::make_pair(tagIndex, subtypeIndex));
       }
     }
-    for (const auto nameAndTally : _talliesWithSizeSubtotals) {
+    positions._tags.resize(_tagTallies.size());
+    for (auto& nameAndTally : nameToTally) {
+      for (const auto& cell : nameAndTally.second.second) {
+        std::vector<size_t>& row = positions._tags[cell.first];
+        if (cell.second >= row.size()) {
+          row.resize(cell.second + 1, (size_t)(NO_ITEM));
+        }
+        row[cell.second] = items.size();
+      }
       items.push_back(Item());
       Item& item = items.back();
       item._name = nameAndTally.first;
-      TallyWithSizeSubtotals tallyWithSizeSubtotals = nameAndTally.second;
-      item._totals = tallyWithSizeSubtotals._tally;
-      for (typename std::map<Offset, Offset>::const_iterator it =
-               tallyWithSizeSubtotals._sizeToCount.begin();
-           it != tallyWithSizeSubtotals._sizeToCount.end(); ++it) {
-        item.AddSubtotal(it->first, Tally(it->second, it->first * it->second));
-      }
+      AddSizeSubtotals(nameAndTally.second.first, item);
     }
-    FillUnnamedSignatures(items);
-    FillNamedSignatures(items);
   }
 
-  void FillUnnamedSignatures(std::vector<Item>& items) const {
-    for (OffsetToTallyConstIterator it = _signatureToTally.begin();
-         it != _signatureToTally.end(); ++it) {
-      std::string name = _directory.Name(it->first);
+  /*
+   * Each unnamed signature gets its own item, but signatures that share a
+   * name are combined, with a subtotal per signature.
+   */
+  void FillSignatures(std::vector<Item>& items,
+                      ItemPositions& positions) const {
+    std::map<std::string, std::pair<Item, std::vector<SignatureId> > >
+        nameToItem;
+    positions._signatures.resize(_signatureTallies.size(),
+                                 (size_t)(NO_ITEM));
+    for (SignatureId id = 0; id < _signatureTallies.size(); id++) {
+      const Tally& tally = _signatureTallies[id];
+      if (tally._count == 0) {
+        continue;
+      }
+      Offset signature = _directory.SignatureOfId(id);
+      const std::string& name = _directory.Name(signature);
       if (name.empty()) {
+        positions._signatures[id] = items.size();
         items.push_back(Item());
         Item& item = items.back();
-        item._totals = it->second;
-        item.AddSubtotal(it->first, it->second);
+        item._totals = tally;
+        item.AddSubtotal(signature, tally);
+      } else {
+        std::pair<Item, std::vector<SignatureId> >& itemAndIds =
+            nameToItem[name];
+        Item& item = itemAndIds.first;
+        item._totals._count += tally._count;
+        item._totals._bytes += tally._bytes;
+        item.AddSubtotal(signature, tally);
+        itemAndIds.second.push_back(id);
       }
     }
-  }
-  void FillNamedSignatures(std::vector<Item>& items) const {
-    for (NameToTallyConstIterator it = _nameToTally.begin();
-         it != _nameToTally.end(); ++it) {
-      const std::string& name = it->first;
-      items.push_back(Item());
+    for (auto& nameAndItem : nameToItem) {
+      for (SignatureId id : nameAndItem.second.second) {
+        positions._signatures[id] = items.size();
+      }
+      items.push_back(nameAndItem.second.first);
       Item& item = items.back();
-      item._name = name;
-      item._totals = it->second;
-
-      const std::set<Offset>& signatures = _directory.Signatures(name);
-      for (typename std::set<Offset>::const_iterator itSig = signatures.begin();
-           itSig != signatures.end(); ++itSig) {
-        Offset signature = *itSig;
-        OffsetToTallyConstIterator itTally = _signatureToTally.find(signature);
-        if (itTally != _signatureToTally.end()) {
-          item.AddSubtotal(signature, itTally->second);
-        }
+      item._name = nameAndItem.first;
+    }
+  }
+
+  /*
+   * Find the item for the given summarized allocation the same way that
+   * AdjustTally tallied it, reading the signature again if the allocation
+   * is not tagged.
+   */
+  size_t ItemOf(AllocationIndex index, const ItemPositions& positions) const {
+    TagIndex tagIndex = _tagHolder.GetTagIndex(index);
+    if (tagIndex != 0) {
+      SubtypeIndex subtypeIndex =
+          _bySubtype ? _tagHolder.GetSubtypeIndex(index) : 0;
+      return positions._tags[tagIndex][subtypeIndex];
+    }
+    AllocationPointer allocation = _allocationDirectory.AllocationAt(index);
+    Offset size = allocation->Size();
+    const char* image;
+    Offset numBytesFound =
+        _addressMap.FindMappedMemoryImage(allocation->Address(), &image);
+    if (numBytesFound < size) {
+      size = numBytesFound;
+    }
+    Offset signature = 0;
+    if (size >= sizeof(Offset)) {
+      signature = *((Offset*)image);
+    }
+    SignatureId id = _directory.GetSignatureId(signature);
+    if (id != SignatureDirectory<Offset>::NO_SIGNATURE_ID) {
+      return positions._signatures[id];
+    }
+    return positions._unsigned;
+  }
+
+  void FillRetained(std::vector<Item>& items,
+                    const ItemPositions& positions) const {
+    std::vector<std::pair<AllocationIndex, size_t> > members;
+    for (AllocationIndex index = 0; index < _isMember.size(); index++) {
+      if (_isMember[index]) {
+        members.push_back(std::make_pair(index, ItemOf(index, positions)));
       }
     }
+    std::vector<Offset> retainedBytes(items.size(), 0);
+    _dominatorTree->AddRetainedBytes(members, retainedBytes);
+    for (size_t i = 0; i < items.size(); i++) {
+      items[i]._retained = retainedBytes[i];
+    }
   }
+
   struct CompareSubtotalsByCount {
     bool operator()(const std::pair<Offset, Tally>& left,
                     const std::pair<Offset, Tally>& right) {
@@ -223,6 +432,14 @@ class SignatureSummary {
     }
   };
 
+  struct CompareItemsByRetained {
+    bool operator()(const Item& left, const Item& right) {
+      return (left._retained > right._retained) ||
+             (left._retained == right._retained &&
+              CompareItemsByBytes()(left, right));
+    }
+  };
+
   struct CompareItemsByBytes {
     bool operator()(const Item& left, const Item& right) {
       return (left._totals._bytes > right._totals._bytes) ||
@@ -17,6 +17,7 @@
 #include "../Iterators/FreeOutgoing.h"
 #include "../Iterators/Incoming.h"
 #include "../Iterators/Leaked.h"
+#include "../Iterators/NamedSet.h"
 #include "../Iterators/Outgoing.h"
 #include "../Iterators/RegisterAnchorPoints.h"
 #include "../Iterators/RegisterAnchored.h"
@@ -31,6 +32,7 @@
 #include "../Iterators/ThreadOnlyAnchored.h"
 #include "../Iterators/Unreferenced.h"
 #include "../Iterators/Used.h"
+#include "../NamedSets.h"
 #include "../PatternDescriberRegistry.h"
 #include "../Visitors/DefaultVisitorFactories.h"
 #include "SubcommandsForOneIterator.h"
@@ -43,8 +45,15 @@ class DefaultSubcommands {
   DefaultSubcommands(
       const ProcessImage<Offset> &processImage,
       const Describer<Offset> &describer,
-      const PatternDescriberRegistry<Offset> &patternDescriberRegistry)
-      : _defaultVisitorFactories(describer),
+      const PatternDescriberRegistry<Offset> &patternDescriberRegistry,
+      NamedSets<Offset> &namedSets)
+      : _processImage(processImage),
+        _namedSets(namedSets),
+        _defaultVisitorFactories(describer, namedSets),
+        _namedSetIteratorFactory(namedSets),
+        _namedSetSubcommands(processImage, _namedSetIteratorFactory,
+                             _defaultVisitorFactories,
+                             patternDescriberRegistry),
         _singleAllocationSubcommands(
             processImage, _singleAllocationIteratorFactory,
             _defaultVisitorFactories, patternDescriberRegistry),
@@ -118,6 +127,7 @@ class DefaultSubcommands {
                                  patternDescriberRegistry) {}
 
   void RegisterSubcommands(Commands::Runner &runner) {
+    _namedSetSubcommands.RegisterSubcommands(runner, true);
     _singleAllocationSubcommands.RegisterSubcommands(runner);
     _allocationsSubcommands.RegisterSubcommands(runner);
     _usedSubcommands.RegisterSubcommands(runner);
@@ -143,11 +153,44 @@ class DefaultSubcommands {
     _freeOutgoingSubcommands.RegisterSubcommands(runner);
     _chainSubcommands.RegisterSubcommands(runner);
     _reverseChainSubcommands.RegisterSubcommands(runner);
+
+    RegisterBuiltInSet<AllocationsIterator>(_allocationsIteratorFactory);
+    RegisterBuiltInSet<UsedIterator>(_usedIteratorFactory);
+    RegisterBuiltInSet<FreeIterator>(_freeIteratorFactory);
+    RegisterBuiltInSet<ThreadCachedIterator>(_threadCachedIteratorFactory);
+    RegisterBuiltInSet<LeakedIterator>(_leakedIteratorFactory);
+    RegisterBuiltInSet<UnreferencedIterator>(_unreferencedIteratorFactory);
+    RegisterBuiltInSet<AnchoredIterator>(_anchoredIteratorFactory);
+    RegisterBuiltInSet<AnchorPointsIterator>(_anchorPointsIteratorFactory);
+    RegisterBuiltInSet<StaticAnchoredIterator>(_staticAnchoredIteratorFactory);
+    RegisterBuiltInSet<StaticAnchorPointsIterator>(
+        _staticAnchorPointsIteratorFactory);
+    RegisterBuiltInSet<StackAnchoredIterator>(_stackAnchoredIteratorFactory);
+    RegisterBuiltInSet<StackAnchorPointsIterator>(
+        _stackAnchorPointsIteratorFactory);
+    RegisterBuiltInSet<RegisterAnchoredIterator>(
+        _registerAnchoredIteratorFactory);
+    RegisterBuiltInSet<RegisterAnchorPointsIterator>(
+        _registerAnchorPointsIteratorFactory);
+    RegisterBuiltInSet<ExternalAnchoredIterator>(
+        _externalAnchoredIteratorFactory);
+    RegisterBuiltInSet<ExternalAnchorPointsIterator>(
+        _externalAnchorPointsIteratorFactory);
+    RegisterBuiltInSet<ThreadOnlyAnchoredIterator>(
+        _threadOnlyAnchoredIteratorFactory);
+    RegisterBuiltInSet<ThreadOnlyAnchorPointsIterator>(
+        _threadOnlyAnchorPointsIteratorFactory);
   }
 
  private:
+  const ProcessImage<Offset> &_processImage;
+  NamedSets<Offset> &_namedSets;
   typename Visitors::DefaultVisitorFactories<Offset> _defaultVisitorFactories;
 
+  typedef typename Iterators::NamedSet<Offset> NamedSetIterator;
+  typename NamedSetIterator::Factory _namedSetIteratorFactory;
+  SubcommandsForOneIterator<Offset, NamedSetIterator> _namedSetSubcommands;
+
   typedef typename Iterators::SingleAllocation<Offset> SingleAllocationIterator;
   typename SingleAllocationIterator::Factory _singleAllocationIteratorFactory;
   SubcommandsForOneIterator<Offset, SingleAllocationIterator>
@@ -276,6 +319,38 @@ class DefaultSubcommands {
   typename ReverseChainIterator::Factory _reverseChainIteratorFactory;
   SubcommandsForOneIterator<Offset, ReverseChainIterator>
       _reverseChainSubcommands;
+
+  /*
+   * Allow a set that takes no arguments to be used as an operand in an
+   * expression that combines sets, by gathering its members in a bitset.
+   */
+  template <class Iterator>
+  void RegisterBuiltInSet(typename Iterator::Factory &factory) {
+    if (factory.GetNumArguments() != 0) {
+      abort();
+    }
+    const ProcessImage<Offset> &processImage = _processImage;
+    _namedSets.RegisterBuiltInSet(
+        factory.GetSetName(),
+        [&factory, &processImage](Commands::Context &context,
+                                  typename NamedSets<Offset>::Bits &bits) {
+          const Directory<Offset> &directory =
+              processImage.GetAllocationDirectory();
+          std::unique_ptr<Iterator> iterator(
+              factory.MakeIterator(context, processImage, directory));
+          if (iterator.get() == 0) {
+            return false;
+          }
+          typename Directory<Offset>::AllocationIndex numAllocations =
+              directory.NumAllocations();
+          for (typename Directory<Offset>::AllocationIndex index =
+                   iterator->Next();
+               index != numAllocations; index = iterator->Next()) {
+            NamedSets<Offset>::Add(bits, index);
+          }
+          return true;
+        });
+  }
 };
 }  // namespace Subcommands
 }  // namespace Allocations
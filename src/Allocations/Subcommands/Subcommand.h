@@ -2,11 +2,15 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <type_traits>
+#include <vector>
 #include "../../Commands/Runner.h"
 #include "../../Commands/Subcommand.h"
+#include "../../Parallel.h"
 #include "../Directory.h"
 #include "../ExtendedVisitor.h"
 #include "../PatternDescriberRegistry.h"
@@ -15,11 +19,26 @@
 namespace chap {
 namespace Allocations {
 namespace Subcommands {
+/*
+ * A visitor is mergeable if it has a nested Partial class, constructed from
+ * the visitor, that can visit part of a set on a separate thread, and a
+ * Merge method that adds the results of a Partial to the visitor.
+ */
+template <class Visitor>
+struct IsMergeableVisitor {
+  template <class V>
+  static char Test(typename V::Partial*);
+  template <class V>
+  static long Test(...);
+  static const bool value = sizeof(Test<Visitor>(0)) == 1;
+};
+
 template <class Offset, class Visitor, class Iterator>
 class Subcommand : public Commands::Subcommand {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
   Subcommand(const ProcessImage<Offset>& processImage,
 
              typename Visitor::Factory& visitorFactory,
@@ -224,37 +243,77 @@ class Subcommand : public Commands::Subcommand {
         }
       }
     }
-    for (AllocationIndex index = iterator->Next(); index != numAllocations;
-         index = iterator->Next()) {
-      const Allocation* allocation = directory.AllocationAt(index);
-      if (allocation == 0) {
-        abort();
-      }
-      Offset size = allocation->Size();
-
+    auto accepts = [&](AllocationIndex index, const Allocation& allocation) {
+      Offset size = allocation.Size();
       if (size < minSize || size > maxSize) {
-        continue;
+        return false;
       }
-
-      if (!signatureChecker.Check(index, *allocation)) {
-        continue;
+      if (!signatureChecker.Check(index, allocation)) {
+        return false;
       }
-
-      bool unsatisfiedReferenceConstraint = false;
-      for (auto constraint : referenceConstraints) {
+      for (const auto& constraint : referenceConstraints) {
         if (!constraint.Check(index)) {
-          unsatisfiedReferenceConstraint = true;
+          return false;
         }
       }
-      if (unsatisfiedReferenceConstraint) {
-        continue;
+      return true;
+    };
+
+    if (extendedVisitorIsEnabled) {
+      /*
+       * Extensions depend on which allocations have already been visited,
+       * so the whole set is visited on this thread.
+       */
+      for (AllocationIndex index = iterator->Next(); index != numAllocations;
+           index = iterator->Next()) {
+        AllocationPointer allocation = directory.AllocationAt(index);
+        if (allocation == 0) {
+          abort();
+        }
+        if (accepts(index, *allocation)) {
+          extendedVisitor.Visit(index, *allocation, visitorRef);
+        }
       }
+      return;
+    }
 
-      if (extendedVisitorIsEnabled) {
-        extendedVisitor.Visit(index, *allocation, visitorRef);
-      } else {
-        visitorRef.Visit(index, *allocation);
+    std::vector<AllocationIndex> batch;
+    std::vector<size_t> numAccepted;
+    for (bool isDone = false; !isDone;) {
+      batch.clear();
+      while (batch.size() < BATCH_SIZE) {
+        AllocationIndex index = iterator->Next();
+        if (index == numAllocations) {
+          isDone = true;
+          break;
+        }
+        batch.push_back(index);
       }
+      /*
+       * Apply the restrictions in parallel, keeping the accepted members of
+       * each chunk at the start of that chunk, in iteration order.
+       */
+      size_t numChunks = (batch.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      numAccepted.assign(numChunks, 0);
+      Parallel::VisitChunks(numChunks, [&](size_t chunk) {
+        size_t base = chunk * CHUNK_SIZE;
+        size_t limit = std::min(base + CHUNK_SIZE, batch.size());
+        size_t numKept = 0;
+        for (size_t i = base; i < limit; i++) {
+          AllocationIndex index = batch[i];
+          AllocationPointer allocation = directory.AllocationAt(index);
+          if (allocation == 0) {
+            abort();
+          }
+          if (accepts(index, *allocation)) {
+            batch[base + numKept++] = index;
+          }
+        }
+        numAccepted[chunk] = numKept;
+      });
+      VisitAccepted(
+          directory, batch, numAccepted, visitorRef,
+          std::integral_constant<bool, IsMergeableVisitor<Visitor>::value>());
     }
   }
 
@@ -296,11 +355,58 @@ class Subcommand : public Commands::Subcommand {
   }
 
  private:
+  /*
+   * Members of the set are gathered in batches, to bound the memory used,
+   * and each batch is split into chunks that are checked in parallel.
+   */
+  static const size_t BATCH_SIZE = 0x100000;
+  static const size_t CHUNK_SIZE = 0x4000;
+
   typename Visitor::Factory& _visitorFactory;
   typename Iterator::Factory& _iteratorFactory;
   const PatternDescriberRegistry<Offset>& _patternDescriberRegistry;
   const ProcessImage<Offset>& _processImage;
 
+  /*
+   * Visit the accepted members of a batch in order, on this thread, so that
+   * any output is the same as if the batch were not split.
+   */
+  void VisitAccepted(const Directory<Offset>& directory,
+                     const std::vector<AllocationIndex>& batch,
+                     const std::vector<size_t>& numAccepted, Visitor& visitor,
+                     std::false_type /* isMergeable */) {
+    for (size_t chunk = 0; chunk < numAccepted.size(); chunk++) {
+      size_t base = chunk * CHUNK_SIZE;
+      for (size_t i = base; i < base + numAccepted[chunk]; i++) {
+        visitor.Visit(batch[i], *(directory.AllocationAt(batch[i])));
+      }
+    }
+  }
+
+  /*
+   * Visit the accepted members of each chunk of a batch in parallel, using
+   * a separate Partial per chunk, then merge the partials in chunk order so
+   * that the results are the same as if the batch were not split.
+   */
+  void VisitAccepted(const Directory<Offset>& directory,
+                     const std::vector<AllocationIndex>& batch,
+                     const std::vector<size_t>& numAccepted, Visitor& visitor,
+                     std::true_type /* isMergeable */) {
+    typedef typename Visitor::Partial Partial;
+    std::vector<std::unique_ptr<Partial> > partials(numAccepted.size());
+    Parallel::VisitChunks(numAccepted.size(), [&](size_t chunk) {
+      partials[chunk].reset(new Partial(visitor));
+      Partial& partial = *(partials[chunk]);
+      size_t base = chunk * CHUNK_SIZE;
+      for (size_t i = base; i < base + numAccepted[chunk]; i++) {
+        partial.Visit(batch[i], *(directory.AllocationAt(batch[i])));
+      }
+    });
+    for (auto& partial : partials) {
+      visitor.Merge(*partial);
+    }
+  }
+
   bool AddReferenceConstraints(
       Commands::Context& context, const std::string& switchName,
       typename ReferenceConstraint<Offset>::BoundaryType boundaryType,
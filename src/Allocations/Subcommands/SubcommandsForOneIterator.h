@@ -33,16 +33,23 @@ class SubcommandsForOneIterator {
         _describeSubcommand(processImage, visitorFactories._describerFactory,
                             iteratorFactory, patternDescriberRegistry),
         _explainSubcommand(processImage, visitorFactories._explainerFactory,
-                           iteratorFactory, patternDescriberRegistry) {}
+                           iteratorFactory, patternDescriberRegistry),
+        _setSubcommand(processImage, visitorFactories._setAssignerFactory,
+                       iteratorFactory, patternDescriberRegistry) {}
 
-  void RegisterSubcommands(Commands::Runner& runner) {
-    RegisterSubcommand(runner, _countSubcommand);
-    RegisterSubcommand(runner, _summarizeSubcommand);
-    RegisterSubcommand(runner, _enumerateSubcommand);
-    RegisterSubcommand(runner, _listSubcommand);
-    RegisterSubcommand(runner, _showSubcommand);
-    RegisterSubcommand(runner, _describeSubcommand);
-    RegisterSubcommand(runner, _explainSubcommand);
+  /*
+   * If asDefault is set, the subcommands are used for any set name that is
+   * not otherwise registered, rather than for the name of the set.
+   */
+  void RegisterSubcommands(Commands::Runner& runner, bool asDefault = false) {
+    RegisterSubcommand(runner, _countSubcommand, asDefault);
+    RegisterSubcommand(runner, _summarizeSubcommand, asDefault);
+    RegisterSubcommand(runner, _enumerateSubcommand, asDefault);
+    RegisterSubcommand(runner, _listSubcommand, asDefault);
+    RegisterSubcommand(runner, _showSubcommand, asDefault);
+    RegisterSubcommand(runner, _describeSubcommand, asDefault);
+    RegisterSubcommand(runner, _explainSubcommand, asDefault);
+    RegisterSubcommand(runner, _setSubcommand, asDefault);
   }
 
  private:
@@ -66,9 +73,12 @@ class SubcommandsForOneIterator {
   Subcommands::Subcommand<Offset, typename Visitors::Explainer<Offset>,
                           Iterator>
       _explainSubcommand;
+  Subcommands::Subcommand<Offset, typename Visitors::SetAssigner<Offset>,
+                          Iterator>
+      _setSubcommand;
 
   void RegisterSubcommand(Commands::Runner& runner,
-                          Commands::Subcommand& subcommand) {
+                          Commands::Subcommand& subcommand, bool asDefault) {
     const std::string& commandName = subcommand.GetCommandName();
     const std::string& setName = subcommand.GetSetName();
     Commands::Command* command = runner.FindCommand(commandName);
@@ -84,7 +94,11 @@ class SubcommandsForOneIterator {
                 << setName << " for command that is\nnot set based.\n";
       return;
     }
-    setBasedCommand->AddSubcommand(subcommand);
+    if (asDefault) {
+      setBasedCommand->SetDefaultSubcommand(subcommand);
+    } else {
+      setBasedCommand->AddSubcommand(subcommand);
+    }
   }
 };
 
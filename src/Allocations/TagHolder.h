@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
 #include <set>
 #include <unordered_map>
 #include "Directory.h"
@@ -13,6 +14,7 @@ class TagHolder {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef size_t TagIndex;
+  typedef uint32_t SubtypeIndex;
 
   /*
    * Note that the sets of tag indices tend to be tiny, usually with just
@@ -27,6 +29,7 @@ class TagHolder {
     _tags.resize(numAllocations, 0);
     _indexToName.push_back("");
     _tagIsStrong.push_back(false);
+    _subtypeNames.push_back("");
   }
 
   TagIndex RegisterTag(const char* name, bool tagIsStrong = true) {
@@ -54,11 +57,74 @@ class TagHolder {
     TagIndex oldTag = _tags[allocationIndex];
     if (oldTag == 0 || (_tagIsStrong[tagIndex] && !_tagIsStrong[oldTag])) {
       _tags[allocationIndex] = tagIndex;
+      if (!_subtypes.empty()) {
+        _subtypes[allocationIndex] = 0;
+      }
       return true;
     }
     return false;
   }
 
+  /*
+   * Register a subtype, such as the name of a python type, that can refine
+   * the tag of an allocation, returning the index already associated with
+   * the name if there is one.  Subtype index 0 means no subtype.
+   */
+  SubtypeIndex RegisterSubtype(const std::string& name) {
+    std::unordered_map<std::string, SubtypeIndex>::const_iterator it =
+        _nameToSubtype.find(name);
+    if (it != _nameToSubtype.end()) {
+      return it->second;
+    }
+    SubtypeIndex newIndex = (SubtypeIndex)(_subtypeNames.size());
+    _subtypeNames.push_back(name);
+    _nameToSubtype[name] = newIndex;
+    return newIndex;
+  }
+
+  /*
+   * Refine the tag of the given allocation by the given subtype.  The
+   * subtypes are kept in a separate column that is allocated only when
+   * the first subtype is set, and any subtype is cleared if the allocation
+   * is later given a different tag.
+   */
+  void SetSubtype(AllocationIndex allocationIndex, SubtypeIndex subtypeIndex) {
+    if (subtypeIndex >= _subtypeNames.size()) {
+      std::cerr << "Invalid allocation subtype index " << subtypeIndex << "\n";
+      abort();
+    }
+    if (allocationIndex >= _numAllocations) {
+      std::cerr << "Invalid allocation index " << allocationIndex << "\n";
+      abort();
+    }
+    if (_subtypes.empty()) {
+      _subtypes.resize(_numAllocations, 0);
+    }
+    _subtypes[allocationIndex] = subtypeIndex;
+  }
+
+  SubtypeIndex GetSubtypeIndex(AllocationIndex allocationIndex) const {
+    if (allocationIndex >= _numAllocations) {
+      std::cerr << "Invalid allocation index " << allocationIndex << "\n";
+      abort();
+    }
+    return _subtypes.empty() ? 0 : _subtypes[allocationIndex];
+  }
+
+  const std::string& GetSubtypeName(AllocationIndex allocationIndex) const {
+    return _subtypeNames[GetSubtypeIndex(allocationIndex)];
+  }
+
+  /*
+   * Return the subtype index associated with the given name, or 0 if no
+   * such subtype was registered.
+   */
+  SubtypeIndex FindSubtype(const std::string& name) const {
+    std::unordered_map<std::string, SubtypeIndex>::const_iterator it =
+        _nameToSubtype.find(name);
+    return (it == _nameToSubtype.end()) ? 0 : it->second;
+  }
+
   TagIndex GetTagIndex(AllocationIndex allocationIndex) const {
     if (allocationIndex >= _numAllocations) {
       std::cerr << "Invalid allocation index " << allocationIndex << "\n";
@@ -75,6 +141,14 @@ class TagHolder {
     return _indexToName[_tags[allocationIndex]];
   }
 
+  const std::string& GetNameOfTag(TagIndex tagIndex) const {
+    return _indexToName[tagIndex];
+  }
+
+  const std::string& GetNameOfSubtype(SubtypeIndex subtypeIndex) const {
+    return _subtypeNames[subtypeIndex];
+  }
+
   const TagIndices* GetTagIndices(std::string tagName) const {
     std::unordered_map<std::string, TagIndices>::const_iterator it =
         _nameToTagIndices.find(tagName);
@@ -94,6 +168,9 @@ class TagHolder {
   std::vector<std::string> _indexToName;
   std::vector<bool> _tagIsStrong;
   std::unordered_map<std::string, TagIndices> _nameToTagIndices;
+  std::vector<SubtypeIndex> _subtypes;
+  std::vector<std::string> _subtypeNames;
+  std::unordered_map<std::string, SubtypeIndex> _nameToSubtype;
 };
 }  // namespace Allocations
 }  // namespace chap
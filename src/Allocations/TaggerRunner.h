@@ -25,6 +25,7 @@ class TaggerRunner {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Directory<Offset>::AllocationPointer AllocationPointer;
   typedef typename Tagger<Offset>::Phase Phase;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
 
@@ -75,7 +76,7 @@ class TaggerRunner {
   void TagFromAllocations() {
     Reader reader(_addressMap);
     for (AllocationIndex i = 0; i < _numAllocations; i++) {
-      const Allocation* allocation = _directory.AllocationAt(i);
+      AllocationPointer allocation = _directory.AllocationAt(i);
       if (!allocation->IsUsed()) {
         continue;
       }
@@ -116,25 +117,32 @@ class TaggerRunner {
     std::vector<AllocationIndex> unresolvedOutgoing;
     unresolvedOutgoing.reserve(_directory.MaxAllocationSize());
     for (AllocationIndex i = 0; i < _numAllocations; i++) {
-      const Allocation* allocation = _directory.AllocationAt(i);
+      AllocationPointer allocation = _directory.AllocationAt(i);
       if (!allocation->IsUsed()) {
         continue;
       }
       _contiguousImage.SetIndex(i);
       unresolvedOutgoing.clear();
       size_t numUnresolved = 0;
+      const Offset* firstOffset = _contiguousImage.FirstOffset();
       const Offset* offsetLimit = _contiguousImage.OffsetLimit();
-      for (const Offset* check = _contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        AllocationIndex targetIndex = _graph.TargetAllocationIndex(i, *check);
-        if (targetIndex != _numAllocations) {
-          if (_tagHolder.IsStronglyTagged(targetIndex)) {
-            targetIndex = _numAllocations;
-          } else {
-            numUnresolved++;
+      if (_graph.HasReferences()) {
+        numUnresolved = FindUnresolvedFromReferences(
+            i, firstOffset, offsetLimit - firstOffset, unresolvedOutgoing);
+      } else {
+        for (const Offset* check = firstOffset; check < offsetLimit;
+             check++) {
+          AllocationIndex targetIndex =
+              _graph.TargetAllocationIndex(i, *check);
+          if (targetIndex != _numAllocations) {
+            if (_tagHolder.IsStronglyTagged(targetIndex)) {
+              targetIndex = _numAllocations;
+            } else {
+              numUnresolved++;
+            }
           }
+          unresolvedOutgoing.push_back(targetIndex);
         }
-        unresolvedOutgoing.push_back(targetIndex);
       }
       if (numUnresolved == 0) {
         continue;
@@ -157,6 +165,38 @@ class TaggerRunner {
     }
   }
 
+  /*
+   * Use the references kept by the graph, rather than a search of the
+   * outgoing edges for each word, to find the allocation, if any, that
+   * each word of the source references.  A reference that the graph found
+   * only by way of the obscured reference checker does not count because
+   * the word does not point into the target.  Return the number of words
+   * that reference allocations that are not yet strongly tagged.
+   */
+  size_t FindUnresolvedFromReferences(
+      AllocationIndex source, const Offset* firstOffset, size_t numWords,
+      std::vector<AllocationIndex>& unresolvedOutgoing) {
+    unresolvedOutgoing.assign(numWords, _numAllocations);
+    size_t numUnresolved = 0;
+    typename Graph<Offset>::References references =
+        _graph.GetReferences(source);
+    for (typename Graph<Offset>::EdgeIndex r = 0; r < references.Size();
+         r++) {
+      size_t wordIndex = references.OffsetAt(r) / sizeof(Offset);
+      AllocationIndex targetIndex = references.TargetAt(r);
+      if (wordIndex >= numWords || _tagHolder.IsStronglyTagged(targetIndex)) {
+        continue;
+      }
+      AllocationPointer target = _directory.AllocationAt(targetIndex);
+      if (firstOffset[wordIndex] - target->Address() >= target->Size()) {
+        continue;
+      }
+      unresolvedOutgoing[wordIndex] = targetIndex;
+      numUnresolved++;
+    }
+    return numUnresolved;
+  }
+
   bool RunTagFromAllocationPhase(Reader& reader, AllocationIndex index,
                                  Phase phase, const Allocation& allocation,
                                  bool isUnsigned) {
@@ -36,11 +36,32 @@ class Counter {
     const std::vector<std::string> _taints;
   };
 
+  /*
+   * This counts part of the set, possibly on a separate thread, for later
+   * merging into the Counter.
+   */
+  class Partial {
+   public:
+    Partial(const Counter& /* counter */) : _numAllocations(0), _numBytes(0) {}
+    void Visit(AllocationIndex /* index */, const Allocation& allocation) {
+      _numAllocations++;
+      _numBytes += allocation.Size();
+    }
+
+   private:
+    friend class Counter;
+    Offset _numAllocations;
+    Offset _numBytes;
+  };
+
   Counter(Commands::Context& context)
       : _context(context), _sizedTally(context, "allocations") {}
   void Visit(AllocationIndex /* index */, const Allocation& allocation) {
     _sizedTally.AdjustTally(allocation.Size());
   }
+  void Merge(Partial& partial) {
+    _sizedTally.AdjustTally(partial._numAllocations, partial._numBytes);
+  }
 
  private:
   Commands::Context& _context;
@@ -7,6 +7,7 @@
 #include "../Visitors/Enumerator.h"
 #include "../Visitors/Explainer.h"
 #include "../Visitors/Lister.h"
+#include "../Visitors/SetAssigner.h"
 #include "../Visitors/Shower.h"
 #include "../Visitors/Summarizer.h"
 #include "../Describer.h"
@@ -16,8 +17,11 @@ namespace Visitors {
 template <class Offset>
 class DefaultVisitorFactories {
  public:
-  DefaultVisitorFactories(const Allocations::Describer<Offset>& describer)
-      : _describerFactory(describer), _explainerFactory(describer) {}
+  DefaultVisitorFactories(const Allocations::Describer<Offset>& describer,
+                          NamedSets<Offset>& namedSets)
+      : _describerFactory(describer),
+        _explainerFactory(describer),
+        _setAssignerFactory(namedSets) {}
   typename Visitors::Counter<Offset>::Factory _counterFactory;
   typename Visitors::Summarizer<Offset>::Factory _summarizerFactory;
   typename Visitors::Enumerator<Offset>::Factory _enumeratorFactory;
@@ -25,6 +29,7 @@ class DefaultVisitorFactories {
   typename Visitors::Shower<Offset>::Factory _showerFactory;
   typename Visitors::Describer<Offset>::Factory _describerFactory;
   typename Visitors::Explainer<Offset>::Factory _explainerFactory;
+  typename Visitors::SetAssigner<Offset>::Factory _setAssignerFactory;
 };
 
 }  // namespace Subcommands
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <sstream>
 #include "../../Commands/Runner.h"
 #include "../../Commands/Subcommand.h"
 #include "../Directory.h"
@@ -34,10 +35,29 @@ class Enumerator {
     const std::vector<std::string> _taints;
   };
 
+  /*
+   * This buffers the addresses for part of the set, possibly on a separate
+   * thread, so that they can be written in order by the Enumerator.
+   */
+  class Partial {
+   public:
+    Partial(const Enumerator& /* enumerator */) {}
+    void Visit(AllocationIndex /* index */, const Allocation& allocation) {
+      _addresses << std::hex << allocation.Address() << "\n";
+    }
+
+   private:
+    friend class Enumerator;
+    std::ostringstream _addresses;
+  };
+
   Enumerator(Commands::Context& context) : _context(context) {}
   void Visit(AllocationIndex /* index */, const Allocation& allocation) {
     _context.GetOutput() << std::hex << allocation.Address() << "\n";
   }
+  void Merge(Partial& partial) {
+    _context.GetOutput() << partial._addresses.str();
+  }
 
  private:
   Commands::Context& _context;
@@ -6,6 +6,7 @@
 #include "../../Commands/Subcommand.h"
 #include "../../SizedTally.h"
 #include "../Directory.h"
+#include "../DominatorTree.h"
 #include "../SignatureDirectory.h"
 namespace chap {
 namespace Allocations {
@@ -20,8 +21,38 @@ class Lister {
     Factory() : _commandName("list") {}
     Lister* MakeVisitor(Commands::Context& context,
                         const ProcessImage<Offset>& processImage) {
+      bool sortByRetained = false;
+      size_t numSortBy = context.GetNumArguments("sortby");
+      if (numSortBy > 0) {
+        if (numSortBy > 1) {
+          context.GetError() << "At most one /sortby switch is allowed.\n";
+          return (Lister*)(0);
+        }
+        const std::string sortBy = context.Argument("sortby", 0);
+        if (sortBy != "retained") {
+          context.GetError() << "Unknown /sortby argument \"" << sortBy
+                             << "\"\n";
+          return (Lister*)(0);
+        }
+        sortByRetained = true;
+      }
+      bool showRetained = sortByRetained;
+      if (!context.ParseBooleanSwitch("retained", showRetained)) {
+        return (Lister*)(0);
+      }
+      const DominatorTree<Offset>* dominatorTree = nullptr;
+      if (showRetained || sortByRetained) {
+        dominatorTree = processImage.GetDominatorTree();
+        if (dominatorTree == nullptr) {
+          context.GetError() << "Retained sizes are not available because "
+                                "the graph is not available.\n";
+          return (Lister*)(0);
+        }
+      }
       return new Lister(context, processImage.GetSignatureDirectory(),
-                        processImage.GetVirtualAddressMap());
+                        processImage.GetVirtualAddressMap(),
+                        processImage.GetAllocationDirectory(), dominatorTree,
+                        sortByRetained);
     }
     const std::string& GetCommandName() const { return _commandName; }
     // TODO: allow adding taints
@@ -30,7 +61,11 @@ class Lister {
       Commands::Output& output = context.GetOutput();
       output << "In this case \"list\" means show the address, size,"
                 " used/free status\n"
-                "and type if known.\n";
+                "and type if known.\n"
+                "Use \"/retained true\" to also show the bytes that would "
+                "no longer be anchored\nif the allocation were freed, or "
+                "\"/sortby retained\" to also list the\nallocations in "
+                "decreasing order of those retained bytes.\n";
     }
 
    private:
@@ -40,14 +75,50 @@ class Lister {
 
   Lister(Commands::Context& context,
          const SignatureDirectory<Offset>& signatureDirectory,
-         const VirtualAddressMap<Offset>& addressMap)
+         const VirtualAddressMap<Offset>& addressMap,
+         const Directory<Offset>& directory,
+         const DominatorTree<Offset>* dominatorTree, bool sortByRetained)
       : _context(context),
         _signatureDirectory(signatureDirectory),
         _addressMap(addressMap),
+        _directory(directory),
+        _dominatorTree(dominatorTree),
+        _sortByRetained(sortByRetained),
         _sizedTally(context, "allocations") {}
-  void Visit(AllocationIndex /* index */, const Allocation& allocation) {
+  ~Lister() {
+    if (_sortByRetained) {
+      std::stable_sort(_toList.begin(), _toList.end(),
+                       [this](AllocationIndex left, AllocationIndex right) {
+                         return _dominatorTree->RetainedBytes(left) >
+                                _dominatorTree->RetainedBytes(right);
+                       });
+      for (AllocationIndex index : _toList) {
+        List(index, *(_directory.AllocationAt(index)));
+      }
+    }
+  }
+  void Visit(AllocationIndex index, const Allocation& allocation) {
+    _sizedTally.AdjustTally(allocation.Size());
+    if (_sortByRetained) {
+      // The allocation will be listed after all have been visited.
+      _toList.push_back(index);
+    } else {
+      List(index, allocation);
+    }
+  }
+
+ private:
+  Commands::Context& _context;
+  const SignatureDirectory<Offset>& _signatureDirectory;
+  const VirtualAddressMap<Offset>& _addressMap;
+  const Directory<Offset>& _directory;
+  const DominatorTree<Offset>* _dominatorTree;
+  bool _sortByRetained;
+  std::vector<AllocationIndex> _toList;
+  SizedTally<Offset> _sizedTally;
+
+  void List(AllocationIndex index, const Allocation& allocation) {
     size_t size = allocation.Size();
-    _sizedTally.AdjustTally(size);
     Commands::Output& output = _context.GetOutput();
     if (allocation.IsUsed()) {
       output << "Used allocation at ";
@@ -69,14 +140,12 @@ class Lister {
         output << "\n";
       }
     }
+    if (_dominatorTree != nullptr) {
+      output << "... retaining 0x" << std::hex
+             << _dominatorTree->RetainedBytes(index) << " bytes\n";
+    }
     output << "\n";
   }
-
- private:
-  Commands::Context& _context;
-  const SignatureDirectory<Offset>& _signatureDirectory;
-  const VirtualAddressMap<Offset>& _addressMap;
-  SizedTally<Offset> _sizedTally;
 };
 }  // namespace Visitors
 }  // namespace Allocations
@@ -0,0 +1,68 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../../SizedTally.h"
+#include "../Directory.h"
+#include "../NamedSets.h"
+namespace chap {
+namespace Allocations {
+namespace Visitors {
+template <class Offset>
+class SetAssigner {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Directory<Offset>::Allocation Allocation;
+  class Factory {
+   public:
+    Factory(NamedSets<Offset>& namedSets)
+        : _commandName("set"), _namedSets(namedSets) {}
+    SetAssigner* MakeVisitor(Commands::Context& context,
+                             const ProcessImage<Offset>& /* processImage */) {
+      return new SetAssigner(context, _namedSets);
+    }
+    const std::string& GetCommandName() const { return _commandName; }
+    // TODO: allow adding taints
+    const std::vector<std::string>& GetTaints() const { return _taints; }
+    void ShowHelpMessage(Commands::Context& context) {
+      Commands::Output& output = context.GetOutput();
+      output << "In this case \"set <name> =\" means save the allocations "
+                "in the set under the\ngiven name, replacing any set already "
+                "saved under that name, and show the\nnumber of allocations "
+                "and the total bytes used by those allocations.\n";
+    }
+
+   private:
+    const std::string _commandName;
+    const std::vector<std::string> _taints;
+    NamedSets<Offset>& _namedSets;
+  };
+
+  SetAssigner(Commands::Context& context, NamedSets<Offset>& namedSets)
+      : _namedSets(namedSets),
+        _name(namedSets.GetPendingName()),
+        _bits(namedSets.MakeEmptyBits()),
+        _sizedTally(context, "allocations in set " + _name) {}
+
+  /*
+   * The new members replace the old ones only after all of them have been
+   * visited, so that the expression for a set may refer to the set itself.
+   */
+  ~SetAssigner() { _namedSets.Define(_name, _bits); }
+
+  void Visit(AllocationIndex index, const Allocation& allocation) {
+    NamedSets<Offset>::Add(_bits, index);
+    _sizedTally.AdjustTally(allocation.Size());
+  }
+
+ private:
+  NamedSets<Offset>& _namedSets;
+  const std::string _name;
+  typename NamedSets<Offset>::Bits _bits;
+  SizedTally<Offset> _sizedTally;
+};
+}  // namespace Visitors
+}  // namespace Allocations
+}  // namespace chap
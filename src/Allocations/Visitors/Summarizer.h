@@ -22,27 +22,48 @@ class Summarizer {
     Factory() : _commandName("summarize") {}
     Summarizer* MakeVisitor(Commands::Context& context,
                             const ProcessImage<Offset>& processImage) {
-      bool sortByCount = true;
+      SortBy sortBy = SORT_BY_COUNT;
       size_t numSortBy = context.GetNumArguments("sortby");
       if (numSortBy > 0) {
         if (numSortBy > 1) {
           context.GetError() << "At most one /sortby switch is allowed.\n";
           return (Summarizer*)(0);
         }
-        const std::string sortBy = context.Argument("sortby", 0);
-        if (sortBy == "bytes") {
-          sortByCount = false;
+        const std::string sortByArgument = context.Argument("sortby", 0);
+        if (sortByArgument == "bytes") {
+          sortBy = SORT_BY_BYTES;
+        } else if (sortByArgument == "retained") {
+          sortBy = SORT_BY_RETAINED;
         } else {
-          if (sortBy != "count") {
-            context.GetError() << "Unknown /sortby argument \"" << sortBy
-                               << "\"\n";
+          if (sortByArgument != "count") {
+            context.GetError() << "Unknown /sortby argument \""
+                               << sortByArgument << "\"\n";
             return (Summarizer*)(0);
           }
         }
       }
+      bool showRetained = (sortBy == SORT_BY_RETAINED);
+      if (!context.ParseBooleanSwitch("retained", showRetained)) {
+        return (Summarizer*)(0);
+      }
+      bool byPythonType = false;
+      if (!context.ParseBooleanSwitch("pythonType", byPythonType)) {
+        return (Summarizer*)(0);
+      }
+      const DominatorTree<Offset>* dominatorTree = nullptr;
+      if (showRetained || sortBy == SORT_BY_RETAINED) {
+        dominatorTree = processImage.GetDominatorTree();
+        if (dominatorTree == nullptr) {
+          context.GetError() << "Retained sizes are not available because "
+                                "the graph is not available.\n";
+          return (Summarizer*)(0);
+        }
+      }
       return new Summarizer(context, processImage.GetSignatureDirectory(),
                             *(processImage.GetAllocationTagHolder()),
-                            processImage.GetVirtualAddressMap(), sortByCount);
+                            processImage.GetAllocationDirectory(),
+                            processImage.GetVirtualAddressMap(), sortBy,
+                            dominatorTree, byPythonType);
     }
     const std::string& GetCommandName() const { return _commandName; }
     // TODO: allow adding taints
@@ -55,6 +76,12 @@ class Summarizer {
                 "separate tally and byte count for unsigned allocations.\n";
       output << "Use \"/sortby bytes\" to sort summary by total bytes "
                 "rather than allocation count\n";
+      output << "Use \"/retained true\" to show, for each type or pattern, "
+                "the bytes that would\nno longer be anchored if all the "
+                "allocations of that type or pattern were\nfreed, or "
+                "\"/sortby retained\" to also sort by those retained bytes.\n";
+      output << "Use \"/pythonType true\" to split the python object patterns "
+                "by python type, as\nin %SimplePythonObject:dict.\n";
     }
 
    private:
@@ -62,21 +89,61 @@ class Summarizer {
     const std::vector<std::string> _taints;
   };
 
+  enum SortBy { SORT_BY_COUNT, SORT_BY_BYTES, SORT_BY_RETAINED };
+
+  /*
+   * This summarizes part of the set, possibly on a separate thread, for
+   * later merging into the Summarizer.
+   */
+  class Partial {
+   public:
+    Partial(const Summarizer& summarizer)
+        : _signatureSummary(summarizer._signatureSummary.MakeEmptyCopy()),
+          _addressMap(summarizer._addressMap),
+          _numAllocations(0),
+          _numBytes(0) {}
+    void Visit(AllocationIndex index, const Allocation& allocation) {
+      Offset size = allocation.Size();
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(allocation.Address(), &image);
+      if (numBytesFound < size) {
+        size = numBytesFound;
+      }
+      _numAllocations++;
+      _numBytes += size;
+      _signatureSummary.AdjustTally(index, size, image);
+    }
+
+   private:
+    friend class Summarizer;
+    SignatureSummary<Offset> _signatureSummary;
+    const VirtualAddressMap<Offset>& _addressMap;
+    Offset _numAllocations;
+    Offset _numBytes;
+  };
+
   Summarizer(Commands::Context& context,
              const SignatureDirectory<Offset>& signatureDirectory,
              const TagHolder<Offset>& tagHolder,
-             const VirtualAddressMap<Offset>& addressMap, bool sortByCount)
+             const Directory<Offset>& allocationDirectory,
+             const VirtualAddressMap<Offset>& addressMap, SortBy sortBy,
+             const DominatorTree<Offset>* dominatorTree, bool byPythonType)
       : _context(context),
-        _signatureSummary(signatureDirectory, tagHolder),
+        _signatureSummary(signatureDirectory, tagHolder, allocationDirectory,
+                          addressMap, dominatorTree, byPythonType),
         _addressMap(addressMap),
         _sizedTally(context, "allocations"),
-        _sortByCount(sortByCount) {}
+        _sortBy(sortBy),
+        _showRetained(dominatorTree != nullptr) {}
   ~Summarizer() {
     std::vector<SummaryItem> items;
-    if (_sortByCount) {
+    if (_sortBy == SORT_BY_COUNT) {
       _signatureSummary.SummarizeByCount(items);
-    } else {
+    } else if (_sortBy == SORT_BY_BYTES) {
       _signatureSummary.SummarizeByBytes(items);
+    } else {
+      _signatureSummary.SummarizeByRetained(items);
     }
     DumpSummaryItems(items);
   }
@@ -92,13 +159,18 @@ class Summarizer {
     _sizedTally.AdjustTally(size);
     _signatureSummary.AdjustTally(index, size, image);
   }
+  void Merge(Partial& partial) {
+    _sizedTally.AdjustTally(partial._numAllocations, partial._numBytes);
+    _signatureSummary.Merge(partial._signatureSummary);
+  }
 
  private:
   Commands::Context& _context;
   SignatureSummary<Offset> _signatureSummary;
   const VirtualAddressMap<Offset>& _addressMap;
   SizedTally<Offset> _sizedTally;
-  bool _sortByCount;
+  SortBy _sortBy;
+  bool _showRetained;
   static std::string InDecimalWithCommas(Offset n) {  // treat as positive
     if (n == 0) {
       return "0";
@@ -119,6 +191,14 @@ class Summarizer {
     }
   }
 
+  void ShowRetained(Commands::Output& output, const SummaryItem& item) {
+    if (_showRetained) {
+      output << "... retaining 0x" << std::hex << item._retained << "("
+             << InDecimalWithCommas(item._retained) << ")"
+             << " bytes.\n";
+    }
+  }
+
   void DumpSummaryItems(const std::vector<SummaryItem>& items) {
     Commands::Output& output = _context.GetOutput();
     for (typename std::vector<SummaryItem>::const_iterator it = items.begin();
@@ -130,6 +210,7 @@ class Summarizer {
                << it->_totals._bytes << "("
                << InDecimalWithCommas(it->_totals._bytes) << ")"
                << " bytes.\n";
+        ShowRetained(output, *it);
       } else {
         if (it->_name[0] == '%') {
           output << "Pattern " << it->_name << " has " << std::dec
@@ -137,6 +218,7 @@ class Summarizer {
                  << it->_totals._bytes << "("
                  << InDecimalWithCommas(it->_totals._bytes) << ")"
                  << " bytes.\n";
+          ShowRetained(output, *it);
           for (typename std::vector<std::pair<
                    Offset, typename SignatureSummary<Offset>::Tally> >::
                    const_iterator itSub = it->_subtotals.begin();
@@ -154,6 +236,7 @@ class Summarizer {
                  << it->_totals._bytes << "("
                  << InDecimalWithCommas(it->_totals._bytes) << ")"
                  << " bytes.\n";
+          ShowRetained(output, *it);
           for (typename std::vector<std::pair<
                    Offset, typename SignatureSummary<Offset>::Tally> >::
                    const_iterator itSub = it->_subtotals.begin();
@@ -173,6 +256,7 @@ class Summarizer {
                  << it->_totals._bytes << "("
                  << InDecimalWithCommas(it->_totals._bytes) << ")"
                  << " bytes.\n";
+          ShowRetained(output, *it);
         } else {
           // Multiple summarized signatures matched the name.
           output << "Multiple signatures for " << it->_name
@@ -180,6 +264,7 @@ class Summarizer {
                  << " instances taking 0x" << std::hex << it->_totals._bytes
                  << "(" << InDecimalWithCommas(it->_totals._bytes) << ")"
                  << " bytes:\n";
+          ShowRetained(output, *it);
           for (typename std::vector<std::pair<
                    Offset, typename SignatureSummary<Offset>::Tally> >::
                    const_iterator itSub = it->_subtotals.begin();
@@ -0,0 +1,268 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdio.h>
+#include <zlib.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Parallel.h"
+
+namespace chap {
+namespace Commands {
+/*
+ * This is an output stream that writes a gzip file.  The output is cut into
+ * blocks, each of which is compressed as a separate gzip member by one of a
+ * set of compression threads, and the members are written to the file in
+ * order.  A sequence of gzip members is itself a valid gzip file, so the
+ * result can be read with zcat or gunzip as usual.  The thread that produces
+ * the output is held up only if all the compression threads fall behind.
+ */
+class GzipOutputStream : public std::ostream {
+ public:
+  GzipOutputStream() : std::ostream(nullptr) { rdbuf(&_streamBuffer); }
+  ~GzipOutputStream() { _streamBuffer.Close(); }
+
+  bool Open(const std::string& path) {
+    if (!_streamBuffer.Open(path)) {
+      setstate(std::ios_base::failbit);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  class StreamBuffer : public std::streambuf {
+   public:
+    StreamBuffer()
+        : _file((FILE*)(0)),
+          _nextToFill(0),
+          _nextToCompress(0),
+          _nextToWrite(0),
+          _isWriting(false),
+          _done(false),
+          _failed(false) {
+      _filling.reserve(BLOCK_SIZE);
+    }
+    ~StreamBuffer() { Close(); }
+
+    bool Open(const std::string& path) {
+      _file = fopen(path.c_str(), "w");
+      if (_file == (FILE*)(0)) {
+        return false;
+      }
+      _path = path;
+      size_t numCompressors = Parallel::NumThreads();
+      _blocks.resize(2 * numCompressors);
+      for (size_t i = 0; i < numCompressors; i++) {
+        _compressors.emplace_back(&StreamBuffer::Compress, this);
+      }
+      return true;
+    }
+
+    void Close() {
+      if (_file == (FILE*)(0)) {
+        return;
+      }
+      /*
+       * Even empty output is written as a gzip member, so that the file can
+       * be decompressed.
+       */
+      HandOff(_nextToFill == 0);
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [this] { return _nextToWrite == _nextToFill; });
+        _done = true;
+      }
+      _changed.notify_all();
+      for (auto& compressor : _compressors) {
+        compressor.join();
+      }
+      _compressors.clear();
+      if (fclose(_file) != 0) {
+        _failed = true;
+      }
+      _file = (FILE*)(0);
+      if (_failed) {
+        std::cerr << "Failed to write compressed output to " << _path
+                  << ".\n";
+      }
+    }
+
+   protected:
+    std::streamsize xsputn(const char* chars, std::streamsize numChars) {
+      if (_file == (FILE*)(0)) {
+        return 0;
+      }
+      std::streamsize numLeft = numChars;
+      while (numLeft > 0) {
+        size_t numToCopy = BLOCK_SIZE - _filling.size();
+        if (numToCopy > (size_t)(numLeft)) {
+          numToCopy = numLeft;
+        }
+        _filling.insert(_filling.end(), chars, chars + numToCopy);
+        chars += numToCopy;
+        numLeft -= numToCopy;
+        if (_filling.size() == BLOCK_SIZE) {
+          HandOff();
+        }
+      }
+      return numChars;
+    }
+
+    int_type overflow(int_type c) {
+      if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+      }
+      char asChar = traits_type::to_char_type(c);
+      return (xsputn(&asChar, 1) == 1) ? c : traits_type::eof();
+    }
+
+    /*
+     * Flushing the stream does not hand off a partial block, because many
+     * small gzip members would hurt the compression.  The output is complete
+     * once the stream is closed.
+     */
+    int sync() { return 0; }
+
+   private:
+    enum { BLOCK_SIZE = 0x100000 };
+    enum BlockState { FREE, FILLED, COMPRESSING, COMPRESSED };
+    struct Block {
+      Block() : _state(FREE) {}
+      BlockState _state;
+      std::vector<char> _image;
+      std::vector<char> _compressed;
+    };
+    FILE* _file;
+    std::string _path;
+    std::vector<char> _filling;
+    /*
+     * The blocks are used in rotation, so that block number n, counting
+     * from the start of the output, is kept at _blocks[n % _blocks.size()].
+     */
+    std::vector<Block> _blocks;
+    size_t _nextToFill;
+    size_t _nextToCompress;
+    size_t _nextToWrite;
+    bool _isWriting;
+    bool _done;
+    bool _failed;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::vector<std::thread> _compressors;
+
+    /*
+     * Pass the collected output to the compression threads, after waiting
+     * for the block that is next in rotation to be written.
+     */
+    void HandOff(bool evenIfEmpty = false) {
+      if (_filling.empty() && !evenIfEmpty) {
+        return;
+      }
+      std::unique_lock<std::mutex> lock(_mutex);
+      Block& block = _blocks[_nextToFill % _blocks.size()];
+      _changed.wait(lock, [&block] { return block._state == FREE; });
+      block._image.swap(_filling);
+      block._state = FILLED;
+      _nextToFill++;
+      lock.unlock();
+      _changed.notify_all();
+      _filling.clear();
+      _filling.reserve(BLOCK_SIZE);
+    }
+
+    void Compress() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (true) {
+        _changed.wait(
+            lock, [this] { return _nextToCompress < _nextToFill || _done; });
+        if (_nextToCompress == _nextToFill) {
+          return;
+        }
+        Block& block = _blocks[_nextToCompress++ % _blocks.size()];
+        block._state = COMPRESSING;
+        lock.unlock();
+        bool compressed = CompressBlock(block);
+        lock.lock();
+        if (!compressed) {
+          _failed = true;
+        }
+        block._state = COMPRESSED;
+        WriteCompressedBlocks(lock);
+        _changed.notify_all();
+      }
+    }
+
+    /*
+     * Compress the image of the given block as a single gzip member.
+     */
+    bool CompressBlock(Block& block) {
+      z_stream stream;
+      stream.zalloc = Z_NULL;
+      stream.zfree = Z_NULL;
+      stream.opaque = Z_NULL;
+      /*
+       * Favor speed over compression ratio because the point is to keep
+       * large output from filling the disk without slowing the commands.
+       * Adding 16 to the window bits requests a gzip header and trailer.
+       */
+      if (deflateInit2(&stream, 1, Z_DEFLATED, 15 + 16, 8,
+                       Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+      }
+      block._compressed.resize(deflateBound(&stream, block._image.size()));
+      stream.next_in = (Bytef*)(block._image.data());
+      stream.avail_in = block._image.size();
+      stream.next_out = (Bytef*)(block._compressed.data());
+      stream.avail_out = block._compressed.size();
+      int status = deflate(&stream, Z_FINISH);
+      block._compressed.resize(stream.total_out);
+      deflateEnd(&stream);
+      return status == Z_STREAM_END;
+    }
+
+    /*
+     * Write, in order, any compressed blocks that are next to be written,
+     * unless some other thread is already doing so.  The lock is held on
+     * entry and exit but not during the writes.
+     */
+    void WriteCompressedBlocks(std::unique_lock<std::mutex>& lock) {
+      if (_isWriting) {
+        return;
+      }
+      _isWriting = true;
+      while (_nextToWrite < _nextToCompress) {
+        Block& block = _blocks[_nextToWrite % _blocks.size()];
+        if (block._state != COMPRESSED) {
+          break;
+        }
+        bool written = _failed;
+        lock.unlock();
+        if (!written) {
+          written = fwrite(block._compressed.data(), 1,
+                           block._compressed.size(),
+                           _file) == block._compressed.size();
+        }
+        lock.lock();
+        if (!written) {
+          _failed = true;
+        }
+        block._image.clear();
+        block._state = FREE;
+        _nextToWrite++;
+        _changed.notify_all();
+      }
+      _isWriting = false;
+    }
+  };
+  StreamBuffer _streamBuffer;
+};
+}  // namespace Commands
+}  // namespace chap
@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -10,7 +13,9 @@
 #include <sstream>
 #include <stack>
 #include <string>
+#include <type_traits>
 #include <vector>
+#include "GzipOutputStream.h"
 #include "LineInfo.h"
 
 #include <replxx.h>
@@ -151,76 +156,187 @@ class Input {
   std::stack<std::istream*> _inputStack;
 };
 
+/*
+ * This holds the stack of output targets, with the standard output at the
+ * bottom and any file used for redirection on top, and formats everything
+ * written to the top target into a large buffer, which is written to the
+ * target only when the buffer is full or the output is flushed.  Integers,
+ * strings and characters, which account for nearly all the output, are
+ * formatted without going through std::ostream, honoring the base set by
+ * std::hex or std::dec and any width set by width().  Anything else is
+ * passed through to the stream after the buffer is flushed.
+ */
 class Output {
  public:
-  Output() { _outputStack.push(&std::cout); }
-  ~Output() {}
-  bool PushTarget(const std::string& outputPath) {
-    std::ofstream* output = new std::ofstream();
-
-    output->open(outputPath.c_str());
+  Output() : _buffer(BUFFER_SIZE), _numBuffered(0), _width(0) {
+    _outputStack.push(&std::cout);
+  }
+  ~Output() { Flush(); }
+  bool PushTarget(const std::string& outputPath, bool compress) {
+    std::ostream* output;
+    if (compress) {
+      GzipOutputStream* gzipOutput = new GzipOutputStream();
+      gzipOutput->Open(outputPath);
+      output = gzipOutput;
+    } else {
+      std::ofstream* fileOutput = new std::ofstream();
+      fileOutput->open(outputPath.c_str());
+      output = fileOutput;
+    }
     if (output->fail()) {
       delete output;
       return false;
     }
+    FlushBuffer();
     _outputStack.push(output);
     return true;
   }
   void PopTarget() {
+    FlushBuffer();
     delete _outputStack.top();
     _outputStack.pop();
   }
-  std::ostream& GetTopOutputStream() { return *(_outputStack.top()); }
+  std::ostream& GetTopOutputStream() {
+    FlushBuffer();
+    return *(_outputStack.top());
+  }
+
+  /*
+   * Write any buffered output to the top target.
+   */
+  void FlushBuffer() {
+    if (_numBuffered != 0) {
+      _outputStack.top()->write(&(_buffer[0]), _numBuffered);
+      _numBuffered = 0;
+    }
+  }
+
+  /*
+   * Write any buffered output to the top target and flush that target, as
+   * is done at the end of each command.
+   */
+  void Flush() {
+    FlushBuffer();
+    _outputStack.top()->flush();
+  }
+
+  void width(int width) { _width = (width < 0) ? 0 : width; }
+
+  void Format(const char* chars) { Write(chars, strlen(chars)); }
+  void Format(const std::string& chars) { Write(chars.data(), chars.size()); }
+  void Format(char c) { Write(&c, 1); }
+  void Format(signed char c) { Write((const char*)(&c), 1); }
+  void Format(unsigned char c) { Write((const char*)(&c), 1); }
+  void Format(std::ios_base& (*manipulator)(std::ios_base&)) {
+    manipulator(*(_outputStack.top()));
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type Format(T v) {
+    bool isHex = (_outputStack.top()->flags() & std::ios_base::basefield) ==
+                 std::ios_base::hex;
+    if (isHex || !std::is_signed<T>::value || v >= 0) {
+      /*
+       * As with std::ostream, a negative value shown in hex is shown as the
+       * unsigned value of the same size.
+       */
+      WriteUnsigned((typename std::make_unsigned<T>::type)(v), isHex, false);
+    } else {
+      WriteUnsigned(-(uint64_t)(int64_t)(v), false, true);
+    }
+  }
 
-  void width(int width) { _outputStack.top()->width(width); }
+  template <typename T>
+  typename std::enable_if<!std::is_integral<T>::value &&
+                          !std::is_convertible<T, const char*>::value>::type
+  Format(T v) {
+    FlushBuffer();
+    std::ostream& topStream = *(_outputStack.top());
+    topStream.width(_width);
+    _width = 0;
+    topStream << v;
+  }
 
   void HexDump(const uint64_t* image, uint64_t numBytes,
                bool showTrailingAscii) {
-    int headerWidth = 0;
-    if (numBytes > 0x20) {
-      headerWidth = 1;
-      for (size_t widthLimit = 0x10; numBytes > widthLimit; widthLimit <<= 4) {
-        headerWidth++;
-      }
+    HexDumpWords(image, numBytes, showTrailingAscii);
+  }
+
+  void HexDump(const uint32_t* image, uint32_t numBytes,
+               bool showTrailingAscii) {
+    HexDumpWords(image, numBytes, showTrailingAscii);
+  }
+
+ private:
+  enum { BUFFER_SIZE = 0x100000 };
+  std::stack<std::ostream*> _outputStack;
+  std::vector<char> _buffer;
+  size_t _numBuffered;
+  size_t _width;
+
+  /*
+   * Make room for at least the given number of characters, which must not
+   * exceed the size of the buffer, returning where they should be placed.
+   * The caller is expected to account for the characters actually placed.
+   */
+  char* Reserve(size_t numChars) {
+    if (numChars > BUFFER_SIZE - _numBuffered) {
+      FlushBuffer();
     }
-    int offset = 0;
-    std::ostream& topStream = *_outputStack.top();
-    topStream << std::hex;
-    for (const uint64_t* limit =
-             image + ((numBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
-         image < limit; image++) {
-      if ((offset & 0x1f) == 0 && headerWidth != 0) {
-        topStream.width(headerWidth);
-        topStream << offset << ": ";
-      }
-      topStream.width(sizeof(uint64_t) * 2);
-      topStream << *image;
-      offset += sizeof(uint64_t);
-      if (offset & 0x1f) {
-        topStream << " ";
-      } else {
-        if (showTrailingAscii) {
-          ShowTrailingAscii(topStream, 3, ((const char*)(image + 1)) - 0x20,
-                            0x20);
-        }
-        topStream << std::endl;
+    return &(_buffer[_numBuffered]);
+  }
+
+  /*
+   * Write the given characters, preceded by any padding required by the
+   * current width, which then no longer applies.
+   */
+  void Write(const char* chars, size_t numChars) {
+    if (_width > numChars) {
+      size_t numBlanks = _width - numChars;
+      while (numBlanks > 0) {
+        size_t numToPlace =
+            (numBlanks < BUFFER_SIZE) ? numBlanks : (size_t)(BUFFER_SIZE);
+        memset(Reserve(numToPlace), ' ', numToPlace);
+        _numBuffered += numToPlace;
+        numBlanks -= numToPlace;
       }
     }
-    size_t trailing = offset & 0x1f;
-    if (trailing != 0) {
-      if (showTrailingAscii) {
-        size_t missing =
-            (0x20 - trailing) / sizeof(uint64_t) * (2 * sizeof(uint64_t) + 1) +
-            2;
-        ShowTrailingAscii(topStream, missing, ((const char*)(image)) - trailing,
-                          trailing);
+    _width = 0;
+    if (numChars > BUFFER_SIZE - _numBuffered) {
+      FlushBuffer();
+      if (numChars >= BUFFER_SIZE) {
+        _outputStack.top()->write(chars, numChars);
+        return;
       }
-      topStream << std::endl;
     }
+    memcpy(&(_buffer[_numBuffered]), chars, numChars);
+    _numBuffered += numChars;
   }
 
-  void HexDump(const uint32_t* image, uint32_t numBytes,
-               bool showTrailingAscii) {
+  void WriteUnsigned(uint64_t v, bool isHex, bool isNegative) {
+    static const char digits[] = "0123456789abcdef";
+    char formatted[24];
+    char* limit = formatted + sizeof(formatted);
+    char* first = limit;
+    if (isHex) {
+      do {
+        *(--first) = digits[v & 0xf];
+        v >>= 4;
+      } while (v != 0);
+    } else {
+      do {
+        *(--first) = digits[v % 10];
+        v /= 10;
+      } while (v != 0);
+    }
+    if (isNegative) {
+      *(--first) = '-';
+    }
+    Write(first, limit - first);
+  }
+
+  template <typename T>
+  void HexDumpWords(const T* image, T numBytes, bool showTrailingAscii) {
     int headerWidth = 0;
     if (numBytes > 0x20) {
       headerWidth = 1;
@@ -229,72 +345,78 @@ class Output {
       }
     }
     int offset = 0;
-    std::ostream& topStream = *_outputStack.top();
-    topStream << std::hex;
-    for (const uint32_t* limit =
-             image + ((numBytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    for (const T* limit = image + ((numBytes + sizeof(T) - 1) / sizeof(T));
          image < limit; image++) {
       if ((offset & 0x1f) == 0 && headerWidth != 0) {
-        topStream.width(headerWidth);
-        topStream << offset << ": ";
+        _width = headerWidth;
+        WriteUnsigned(offset, true, false);
+        Write(": ", 2);
       }
-      topStream.width(sizeof(uint32_t) * 2);
-      topStream << *image;
-      offset += sizeof(uint32_t);
+      _width = sizeof(T) * 2;
+      WriteUnsigned(*image, true, false);
+      offset += sizeof(T);
       if (offset & 0x1f) {
-        topStream << " ";
+        Write(" ", 1);
       } else {
         if (showTrailingAscii) {
-          ShowTrailingAscii(topStream, 3, ((const char*)(image + 1)) - 0x20,
-                            0x20);
+          WriteTrailingAscii(3, ((const char*)(image + 1)) - 0x20, 0x20);
         }
-        topStream << std::endl;
+        Write("\n", 1);
       }
     }
     size_t trailing = offset & 0x1f;
     if (trailing != 0) {
       if (showTrailingAscii) {
         size_t missing =
-            (0x20 - trailing) / sizeof(uint32_t) * (2 * sizeof(uint32_t) + 1) +
-            2;
-        ShowTrailingAscii(topStream, missing, ((const char*)(image)) - trailing,
-                          trailing);
+            (0x20 - trailing) / sizeof(T) * (2 * sizeof(T) + 1) + 2;
+        WriteTrailingAscii(missing, ((const char*)(image)) - trailing,
+                           trailing);
       }
-      topStream << std::endl;
+      Write("\n", 1);
     }
   }
 
- private:
-  std::stack<std::ostream*> _outputStack;
-  void ShowTrailingAscii(std::ostream& topStream, size_t numBlanks,
-                         const char* chars, size_t numBytes) {
-    for (size_t i = 0; i < numBlanks; i++) {
-      topStream << ' ';
-    }
+  void WriteTrailingAscii(size_t numBlanks, const char* chars,
+                          size_t numBytes) {
+    char* next = Reserve(numBlanks + numBytes);
+    memset(next, ' ', numBlanks);
+    next += numBlanks;
     const char* limit = chars + numBytes;
     while (chars < limit) {
       char c = *(chars++);
       if (c < ' ' || c > '~') {
         c = '.';
       }
-      topStream << c;
+      *(next++) = c;
     }
+    _numBuffered += numBlanks + numBytes;
   }
 };
 
 template <typename T>
 Output& operator<<(Output& output, T v) {
-  output.GetTopOutputStream() << v;
+  output.Format(v);
+  return output;
+}
+
+inline Output& operator<<(Output& output, const std::string& v) {
+  output.Format(v);
   return output;
 }
 
 class Error {
  public:
-  Error(const ScriptContext& scriptContext)
-      : _scriptContext(scriptContext), _contextWritePending(false) {}
+  Error(const ScriptContext& scriptContext, Output& output)
+      : _scriptContext(scriptContext),
+        _output(output),
+        _contextWritePending(false) {}
   ~Error() {}
   void SetContextWritePending() { _contextWritePending = true; }
   void FlushPendingErrorContext() {
+    /*
+     * Any output buffered so far precedes the error.
+     */
+    _output.FlushBuffer();
     if (_contextWritePending) {
       if (!_scriptContext.empty()) {
         ScriptContext::const_reverse_iterator itEnd = _scriptContext.rend();
@@ -313,6 +435,7 @@ class Error {
 
  private:
   const ScriptContext& _scriptContext;
+  Output& _output;
   bool _contextWritePending;
 };
 
@@ -327,23 +450,42 @@ Error& operator<<(Error& error, T v) {
   return error;
 }
 
+/*
+ * These control where and how the output of a command is written when it
+ * is redirected to a file.  By default the file is placed next to the
+ * process image and is not compressed.
+ */
+struct RedirectSettings {
+  RedirectSettings(const std::string& prefix)
+      : _prefix(prefix), _compress(false) {}
+  const std::string _prefix;
+  std::string _directory;
+  bool _compress;
+};
+
 class Context {
  public:
   Context(Input& input, Output& output, Error& error,
-          const std::string& redirectPrefix)
+          const RedirectSettings& redirectSettings)
       : _input(input),
         _output(output),
         _error(error),
-        _redirectPrefix(redirectPrefix),
+        _redirectSettings(redirectSettings),
         _hasIllFormedSwitch(false) {
     _input.GetTokens(_tokens);
     _error.SetContextWritePending();
+    /*
+     * The arguments to "redirect" and "source" may be absolute paths, so
+     * for those commands nothing is treated as a switch.
+     */
+    bool allowSwitches = _tokens.empty() ||
+                         !(_tokens[0] == "redirect" || _tokens[0] == "source");
     std::string switchName;
     size_t argNum = 0;
     for (std::vector<std::string>::const_iterator it = _tokens.begin();
          it != _tokens.end(); ++it) {
       const std::string& token = *it;
-      if (token.find('/') == 0) {
+      if (allowSwitches && token.find('/') == 0) {
         if (!switchName.empty()) {
           /*
            * For now all switches are expected to take an
@@ -389,6 +531,7 @@ class Context {
       _output.PopTarget();
       _output << "Wrote results to " << _redirectPath << "\n";
     }
+    _output.Flush();
   }
 
   bool SetRedirectPathBySuffix() {
@@ -423,22 +566,37 @@ class Context {
 
   void StartRedirect() {
     if (_redirectPath.empty()) {
-      _redirectPath = _redirectPrefix;
+      _redirectPath = _redirectSettings._prefix;
+      if (!_redirectSettings._directory.empty()) {
+        std::string::size_type lastSlash = _redirectPath.rfind('/');
+        if (lastSlash != std::string::npos) {
+          _redirectPath.erase(0, lastSlash + 1);
+        }
+        _redirectPath.insert(0, _redirectSettings._directory + "/");
+      }
       if (!SetRedirectPathBySuffix()) {
         SetRedirectPathByArguments();
       }
 
-      if (_redirectPath.size() > 255) {
+      const std::string compressedSuffix(".gz");
+      size_t maxPathSize = 255;
+      if (_redirectSettings._compress) {
+        maxPathSize -= compressedSuffix.size();
+      }
+      if (_redirectPath.size() > maxPathSize) {
         /*
          * Paths that are too long cause an error in the attempt to open them.
          * This is typically exposed using large numbers of switches, as might
          * happen with use of the /extend switch.  For now, just handle this
          * by truncation.
          */
-        _redirectPath.resize(255);
+        _redirectPath.resize(maxPathSize);
+      }
+      if (_redirectSettings._compress) {
+        _redirectPath.append(compressedSuffix);
       }
 
-      if (!_output.PushTarget(_redirectPath)) {
+      if (!_output.PushTarget(_redirectPath, _redirectSettings._compress)) {
         _error << "Failed to open " << _redirectPath << " for writing.\n";
         char* openFailCause = strerror(errno);
         if (openFailCause) {
@@ -493,6 +651,19 @@ class Context {
     }
   }
 
+  /*
+   * Remove the given range of positional arguments, for use by commands
+   * such as "set" that consume some leading arguments before passing the
+   * rest to a subcommand.
+   */
+  void DropPositionals(size_t first, size_t count) {
+    if (first < _positionalArguments.size()) {
+      size_t last = std::min(first + count, _positionalArguments.size());
+      _positionalArguments.erase(_positionalArguments.begin() + first,
+                                 _positionalArguments.begin() + last);
+    }
+  }
+
   bool ParsePositional(size_t index, uint64_t& value) {
     if (index < _positionalArguments.size()) {
       std::istringstream is(_positionalArguments[index]);
@@ -631,7 +802,7 @@ class Context {
   Input& _input;
   Output& _output;
   Error& _error;
-  const std::string& _redirectPrefix;
+  const RedirectSettings& _redirectSettings;
   bool _hasIllFormedSwitch;
   std::vector<std::string> _tokens;
   std::vector<std::string> _positionalArguments;
@@ -666,10 +837,10 @@ typedef std::function<size_t(Context&,  // command context
 class Runner {
  public:
   Runner(const std::string& redirectPrefix)
-      : _redirectPrefix(redirectPrefix),
+      : _redirectSettings(redirectPrefix),
         _redirect(false),
         _input(_scriptContext),
-        _error(_scriptContext),
+        _error(_scriptContext, _output),
         _preCommandCallback(nullptr) {}
 
   void CompletionHook(char const* pref,
@@ -748,6 +919,13 @@ class Runner {
                    " of output to separate files per command.\n";
         _output << "Use \"redirect off\" to disable redirection"
                    " of output to separate files per\ncommand.\n";
+        _output << "Use \"redirect compress on\" to gzip the files, which"
+                   " then have the suffix \".gz\",\nor \"redirect compress"
+                   " off\" to stop compressing them.\n";
+        _output << "Use \"redirect directory <path>\" to put the files in"
+                   " the given directory rather\nthan next to the process"
+                   " image, or \"redirect directory\" to put them next to"
+                   " the\nprocess image again.\n";
       } else if (topic == "source") {
         _output << "Use \"source <path>\" to run commands"
                    " from the specified file.\n";
@@ -775,10 +953,29 @@ class Runner {
     // Request for a token after the last one just returns the
     // empty std::string;
     const std::string& argument = context.TokenAt(1);
-    if (numTokens != 2 || !(argument == "on" || argument == "off")) {
-      _error << "usage:  redirect on|off\n";
-    } else {
+    if (numTokens == 2 && (argument == "on" || argument == "off")) {
       _redirect = (argument == "on");
+    } else if (numTokens == 3 && argument == "compress" &&
+               (context.TokenAt(2) == "on" || context.TokenAt(2) == "off")) {
+      _redirectSettings._compress = (context.TokenAt(2) == "on");
+    } else if (numTokens == 2 && argument == "directory") {
+      _redirectSettings._directory.clear();
+    } else if (numTokens == 3 && argument == "directory") {
+      std::string directory = context.TokenAt(2);
+      while (directory.size() > 1 && directory[directory.size() - 1] == '/') {
+        directory.erase(directory.size() - 1);
+      }
+      struct stat statBuf;
+      if (stat(directory.c_str(), &statBuf) != 0 ||
+          !S_ISDIR(statBuf.st_mode)) {
+        _error << "\"" << directory << "\" is not a directory.\n";
+      } else {
+        _redirectSettings._directory = directory;
+      }
+    } else {
+      _error << "usage:  redirect on|off\n"
+                "        redirect compress on|off\n"
+                "        redirect directory [<path>]\n";
     }
   }
 
@@ -804,7 +1001,7 @@ class Runner {
         this);
     while (true) {
       try {
-        Context context(_input, _output, _error, _redirectPrefix);
+        Context context(_input, _output, _error, _redirectSettings);
         bool hasIllFormedSwitch = context.HasIllFormedSwitch();
         if (context.HasIllFormedSwitch()) {
           if (context.TokenAt(0).find('/') == 0) {
@@ -900,7 +1097,7 @@ class Runner {
   }
 
   ScriptContext _scriptContext;
-  const std::string _redirectPrefix;
+  RedirectSettings _redirectSettings;
   bool _redirect;
   Input _input;
   Output _output;
@@ -9,7 +9,7 @@ namespace chap {
 namespace Commands {
 class SetBasedCommand : public Command {
  public:
-  SetBasedCommand() {}
+  SetBasedCommand() : _defaultSubcommand(0) {}
 
   void AddSubcommand(Subcommand& subcommand) {
     const std::string& commandName = subcommand.GetCommandName();
@@ -25,6 +25,15 @@ class SetBasedCommand : public Command {
     }
   }
 
+  /*
+   * The default subcommand, if any, handles any set name that is not
+   * registered as a subcommand, as well as any expression that combines
+   * sets, such as "big & used".
+   */
+  void SetDefaultSubcommand(Subcommand& subcommand) {
+    _defaultSubcommand = &subcommand;
+  }
+
   void Run(Context& context) override {
     Error& error = context.GetError();
     if (_subcommands.empty()) {
@@ -40,7 +49,11 @@ class SetBasedCommand : public Command {
     const std::string& setName = context.Positional(1);
     std::map<std::string, Subcommand*>::iterator it =
         _subcommands.find(setName);
-    if (it == _subcommands.end()) {
+    if (_defaultSubcommand != 0 &&
+        (it == _subcommands.end() ||
+         (numPositionals > 3 && IsSetOperator(context.Positional(2))))) {
+      _defaultSubcommand->Run(context);
+    } else if (it == _subcommands.end()) {
       error << "It is currently not defined how to " << GetName() << " "
             << setName << ".\n";
     } else {
@@ -60,6 +73,13 @@ class SetBasedCommand : public Command {
            it != _subcommands.end(); ++it) {
         output << it->first << "\n";
       }
+      if (_defaultSubcommand != 0) {
+        output << "It is also possible to " << GetName()
+               << " a set saved by the \"set\" command, or an"
+                  " expression\nthat combines such sets and the above sets"
+                  " that take no arguments using\n\"&\", \"|\" or \"-\","
+                  " such as \"big & used - unreferenced\".\n";
+      }
       output << "Try \"help " << GetName()
              << " <setname>\" for more"
                 " information.\n";
@@ -72,6 +92,10 @@ class SetBasedCommand : public Command {
       const std::string& setName = context.Positional(2);
       std::map<std::string, Subcommand*>::iterator it =
           _subcommands.find(setName);
+      if (it == _subcommands.end() && _defaultSubcommand != 0) {
+        _defaultSubcommand->ShowHelpMessage(context);
+        return;
+      }
       if (it == _subcommands.end()) {
         context.GetOutput() << "No help is available for \"" << GetName() << " "
                             << setName << "\".\n";
@@ -96,6 +120,11 @@ class SetBasedCommand : public Command {
 
  private:
   std::map<std::string, Subcommand*> _subcommands;
+  Subcommand* _defaultSubcommand;
+
+  static bool IsSetOperator(const std::string& token) {
+    return token == "&" || token == "|" || token == "-";
+  }
 };
 
 }  // namespace Commands
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <string>
+#include "../Allocations/NamedSets.h"
+#include "SetBasedCommand.h"
+namespace chap {
+namespace Commands {
+template <class Offset>
+class SetCommand : public SetBasedCommand {
+ public:
+  SetCommand(Allocations::NamedSets<Offset>& namedSets)
+      : _name("set"), _namedSets(namedSets) {}
+  void ShowHelpMessage(Context& context) {
+    Output& output = context.GetOutput();
+    output << "\nThe \"set\" command saves the members of the specified set "
+              "under a name, as in\n\"set big = leaked /minsize 1000\".  "
+              "The name can then be used in place of a\nset name by other "
+              "commands, as in \"count big\" and can be combined with "
+              "other\nnamed sets and with sets that take no arguments, "
+              "using \"&\" for intersection,\n\"|\" for union and \"-\" for "
+              "difference, as in \"list big & used - unreferenced\".\n"
+              "Without arguments, the \"set\" command lists the named "
+              "sets.\n\n";
+    SetBasedCommand::ShowHelpMessage(context);
+  }
+  const std::string& GetName() const { return _name; }
+
+  void Run(Context& context) {
+    size_t numPositionals = context.GetNumPositionals();
+    if (numPositionals == 1) {
+      ListNamedSets(context);
+      return;
+    }
+    Error& error = context.GetError();
+    const std::string& name = context.Positional(1);
+    if (numPositionals < 4 || context.Positional(2) != "=") {
+      error << "Use \"set <name> = <set>\" to save a set under a name.\n";
+      return;
+    }
+    if (!Allocations::NamedSets<Offset>::IsValidName(name)) {
+      error << "\"" << name << "\" is not a valid name for a set.\n";
+      return;
+    }
+    if (_namedSets.IsBuiltInSet(name)) {
+      error << "\"" << name << "\" is already the name of a built-in set.\n";
+      return;
+    }
+    _namedSets.SetPendingName(name);
+    context.DropPositionals(1, 2);
+    SetBasedCommand::Run(context);
+  }
+
+ private:
+  const std::string _name;
+  Allocations::NamedSets<Offset>& _namedSets;
+
+  void ListNamedSets(Context& context) {
+    Output& output = context.GetOutput();
+    const auto& sets = _namedSets.GetSets();
+    if (sets.empty()) {
+      output << "No sets have been named.\n";
+      return;
+    }
+    for (const auto& nameAndBits : sets) {
+      size_t numMembers = 0;
+      for (uint64_t word : nameAndBits.second) {
+        numMembers += __builtin_popcountll(word);
+      }
+      output << nameAndBits.first << " has " << std::dec << numMembers
+             << ((numMembers == 1) ? " allocation.\n" : " allocations.\n");
+    }
+  }
+};
+}  // namespace Commands
+}  // namespace chap
@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
 #include <vector>
 #include "Describer.h"
 
@@ -9,7 +12,7 @@ namespace chap {
 template <typename Offset>
 class CompoundDescriber : public Describer<Offset> {
  public:
-  CompoundDescriber() {}
+  CompoundDescriber() : _describeAnywhere(0), _hasIndex(false) {}
   /*
    * If the address is understood, provide a description for the address,
    * optionally with an additional explanation of why the address matches
@@ -18,9 +21,31 @@ class CompoundDescriber : public Describer<Offset> {
    */
   bool Describe(Commands::Context &context, Offset addressToDescribe,
                 bool explain, bool showAddresses) const {
-    for (auto describer : _describers) {
-      if (describer->Describe(context, addressToDescribe, explain,
-                              showAddresses)) {
+    std::call_once(_indexOnce, [this]() { BuildIndex(); });
+    if (!_hasIndex) {
+      for (auto describer : _describers) {
+        if (describer->Describe(context, addressToDescribe, explain,
+                                showAddresses)) {
+          return true;
+        }
+      }
+      return false;
+    }
+    /*
+     * Only the describers that can describe the address are asked, still
+     * in the order in which they were added.
+     */
+    uint64_t candidates = _describeAnywhere;
+    typename std::vector<Offset>::const_iterator it = std::upper_bound(
+        _intervalStarts.begin(), _intervalStarts.end(), addressToDescribe);
+    if (it != _intervalStarts.begin()) {
+      candidates |= _intervalDescribers[(it - _intervalStarts.begin()) - 1];
+    }
+    while (candidates != 0) {
+      size_t describerIndex = __builtin_ctzll(candidates);
+      candidates &= (candidates - 1);
+      if (_describers[describerIndex]->Describe(context, addressToDescribe,
+                                                explain, showAddresses)) {
         return true;
       }
     }
@@ -33,5 +58,80 @@ class CompoundDescriber : public Describer<Offset> {
 
  private:
   std::vector<const Describer<Offset> *> _describers;
+  /*
+   * The index is built on first use, after all the describers have been
+   * added.  It splits the address space into intervals, each with the set
+   * of describers, as a bit mask by order of addition, that claim to be
+   * able to describe addresses in that interval.  Describers that don't
+   * limit themselves to particular ranges are in _describeAnywhere.
+   */
+  mutable std::once_flag _indexOnce;
+  mutable std::vector<Offset> _intervalStarts;
+  mutable std::vector<uint64_t> _intervalDescribers;
+  mutable uint64_t _describeAnywhere;
+  mutable bool _hasIndex;
+
+  struct RangeEdge {
+    RangeEdge(Offset address, size_t describerIndex, bool isStart)
+        : _address(address),
+          _describerIndex(describerIndex),
+          _isStart(isStart) {}
+    Offset _address;
+    size_t _describerIndex;
+    bool _isStart;
+  };
+
+  void BuildIndex() const {
+    size_t numDescribers = _describers.size();
+    if (numDescribers > 64) {
+      return;
+    }
+    std::vector<RangeEdge> edges;
+    for (size_t i = 0; i < numDescribers; i++) {
+      if (!_describers[i]->VisitRanges([&edges, i](Offset base, Offset limit) {
+            if (base < limit) {
+              edges.emplace_back(base, i, true);
+              edges.emplace_back(limit, i, false);
+            } else if (limit < base) {
+              // The range extends to the end of the address space.
+              edges.emplace_back(base, i, true);
+            }
+          })) {
+        _describeAnywhere |= ((uint64_t)(1)) << i;
+      }
+    }
+    std::sort(edges.begin(), edges.end(),
+              [](const RangeEdge &left, const RangeEdge &right) {
+                return left._address < right._address;
+              });
+
+    /*
+     * Ranges for a single describer may overlap, so keep a count of the
+     * ranges open for each describer at each point.
+     */
+    std::vector<size_t> numOpen(numDescribers, 0);
+    uint64_t open = 0;
+    for (typename std::vector<RangeEdge>::const_iterator it = edges.begin();
+         it != edges.end();) {
+      Offset address = it->_address;
+      for (; it != edges.end() && it->_address == address; ++it) {
+        uint64_t bit = ((uint64_t)(1)) << it->_describerIndex;
+        if (it->_isStart) {
+          if (numOpen[it->_describerIndex]++ == 0) {
+            open |= bit;
+          }
+        } else {
+          if (--numOpen[it->_describerIndex] == 0) {
+            open &= ~bit;
+          }
+        }
+      }
+      if (_intervalDescribers.empty() || _intervalDescribers.back() != open) {
+        _intervalStarts.push_back(address);
+        _intervalDescribers.push_back(open);
+      }
+    }
+    _hasIndex = true;
+  }
 };
 }  // namespace chap
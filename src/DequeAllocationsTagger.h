@@ -19,6 +19,7 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename TagHolder::TagIndex TagIndex;
@@ -195,7 +196,7 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
         if (mapIndex == _numAllocations) {
           continue;
         }
-        const Allocation* mapAllocation = _directory.AllocationAt(mapIndex);
+        AllocationPointer mapAllocation = _directory.AllocationAt(mapIndex);
 
         Offset bucketsAddress = mapAllocation->Address();
         if (asOffsets[-3] == bucketsAddress) {
@@ -318,7 +319,7 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
       if (blockIndex == _numAllocations) {
         return false;
       }
-      const Allocation* blockAllocation = _directory.AllocationAt(blockIndex);
+      AllocationPointer blockAllocation = _directory.AllocationAt(blockIndex);
       if (blockAllocation == nullptr) {
         return false;
       }
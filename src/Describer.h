@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <functional>
 #include "Commands/Runner.h"
 
 namespace chap {
@@ -16,5 +17,14 @@ class Describer {
    */
   virtual bool Describe(Commands::Context& context, Offset addressToDescribe,
                         bool explain, bool showAddresses) const = 0;
+
+  typedef std::function<void(Offset, Offset)> RangeVisitor;
+  /*
+   * If the describer can describe only addresses in certain ranges, call
+   * the visitor with the base and limit of each such range and return true.
+   * Otherwise return false, in which case the describer may be asked about
+   * any address.
+   */
+  virtual bool VisitRanges(RangeVisitor /* visitor */) const { return false; }
 };
 }  // namespace chap
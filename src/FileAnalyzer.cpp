@@ -23,9 +23,15 @@ void FileAnalyzer::AddCommandCallbacks(Commands::Runner & /* r */) {}
 
 void PrintUsageAndExit(int exitCode,
                        const vector<string> supportedFileFormats) {
-  cerr << "Usage: chap [-t] <file>\n\n"
+  cerr << "Usage: chap [-t|-a|-l] <file>\n\n"
           "-t means to just do truncation check then stop\n"
           "   0 exit code means no truncation was found\n\n"
+          "-a means to just find the allocations, show how many are used and "
+          "free, then stop\n"
+          "   3 exit code means corruption was reported for libc malloc\n\n"
+          "-l means to also find and count the leaked allocations, then stop\n"
+          "   2 exit code means leaked allocations were found\n"
+          "   3 exit code means corruption was reported for libc malloc\n\n"
           "Supported file types include the following:\n\n";
   for (vector<string>::const_iterator it = supportedFileFormats.begin();
        it != supportedFileFormats.end(); ++it) {
@@ -51,23 +57,33 @@ int main(int argc, char **argv, char ** /* envp */) {
   }
 
   string path(argv[argc - 1]);
-  if ((argc < 2) || (argc > 3) || ((argc == 3) && (strcmp(argv[1], "-t"))) ||
-      (path[0] == '-')) {
+  AnalysisMode mode = FULL_ANALYSIS;
+  if (argc == 3) {
+    if (!strcmp(argv[1], "-t")) {
+      mode = TRUNCATION_CHECK_ONLY;
+    } else if (!strcmp(argv[1], "-a")) {
+      mode = ALLOCATIONS_CHECK;
+    } else if (!strcmp(argv[1], "-l")) {
+      mode = LEAKS_CHECK;
+    } else {
+      PrintUsageAndExit(1, supportedFileFormats);
+    }
+  }
+  if ((argc < 2) || (argc > 3) || (path[0] == '-')) {
     PrintUsageAndExit(1, supportedFileFormats);
   }
 
-  bool truncationCheckOnly = (argc == 3);
+  bool truncationCheckOnly = (mode == TRUNCATION_CHECK_ONLY);
 
   try {
     FileImage fileImage(path.c_str());
     for (vector<FileAnalyzerFactory *>::iterator it = factories.begin();
          it != factories.end(); ++it) {
       /*
-       * Try to create a file analyzer of the given type, telling it to
-       * find allocations eagerly unless we are only checking for truncation.
+       * Try to create a file analyzer of the given type, telling it how
+       * much of the analysis to do eagerly.
        */
-      FileAnalyzer *analyzer =
-          (*it)->MakeFileAnalyzer(fileImage, truncationCheckOnly);
+      FileAnalyzer *analyzer = (*it)->MakeFileAnalyzer(fileImage, mode);
       if (analyzer == 0) {
         continue;
       }
@@ -80,7 +96,7 @@ int main(int argc, char **argv, char ** /* envp */) {
           cerr << "It has size " << dec << fileSize
                << " which is smaller than minimum expected size "
                << minimumExpectedFileSize << "." << endl;
-          if (!truncationCheckOnly) {
+          if (mode == FULL_ANALYSIS) {
             cerr << "Many commands may be disabled or inaccurate as a "
                  << "result." << endl;
           }
@@ -89,7 +105,8 @@ int main(int argc, char **argv, char ** /* envp */) {
           exit(1);
         }
       }
-      if (!truncationCheckOnly) {
+      int exitCode = 0;
+      if (mode == FULL_ANALYSIS) {
         Commands::Runner commandsRunner(path);
 
         analyzer->AddCommands(commandsRunner);
@@ -97,9 +114,11 @@ int main(int argc, char **argv, char ** /* envp */) {
         analyzer->AddCommandCallbacks(commandsRunner);
 
         commandsRunner.RunCommands();
+      } else if (!truncationCheckOnly) {
+        exitCode = analyzer->ReportCheck();
       }
       delete analyzer;
-      exit(0);
+      exit(exitCode);
     }
 
     cerr << "File \"" << path << "\" is of some unsupported format." << endl;
@@ -2,9 +2,24 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
 #include <string>
+#include "Commands/Runner.h"
 
 namespace chap {
+/*
+ * This determines how much of the analysis of a file is done up front.
+ * Everything but FULL_ANALYSIS is meant for automated checks that need just
+ * one answer, and so skips the stages, such as naming signatures, writing
+ * the .symreqs file and tagging allocations, that the check doesn't use.
+ */
+enum AnalysisMode {
+  TRUNCATION_CHECK_ONLY,  // just check whether the file is truncated
+  ALLOCATIONS_CHECK,      // find the allocations, checking for corruption
+  LEAKS_CHECK,            // also build the graph needed to find leaks
+  FULL_ANALYSIS           // do everything needed to support all commands
+};
+
 class FileAnalyzer {
  public:
   FileAnalyzer();
@@ -52,5 +67,12 @@ class FileAnalyzer {
    */
 
   virtual void AddCommands(Commands::Runner& r) = 0;
+
+  /*
+   * Report the result of the check done for ALLOCATIONS_CHECK or LEAKS_CHECK
+   * and return the exit code for the process.
+   */
+
+  virtual int ReportCheck() { return 0; }
 };
 }  // namespace chap
@@ -24,11 +24,12 @@ class FileAnalyzerFactory {
 
   /*
    * Make a FileAnalyzer to analyze the supported file type on the
-   * given file, returning NULL if  the format is not supported.
+   * given file, doing as much of the analysis as the given mode calls for,
+   * returning NULL if  the format is not supported.
    */
 
   virtual FileAnalyzer* MakeFileAnalyzer(const FileImage& fileImage,
-                                         bool truncationCheckOnly) = 0;
+                                         AnalysisMode mode) = 0;
 
  protected:
   const std::string _supportedFileFormat;
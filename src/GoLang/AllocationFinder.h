@@ -0,0 +1,76 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <vector>
+#include "../Allocations/Directory.h"
+#include "../VirtualAddressMap.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace GoLang {
+/*
+ * This reports the allocations for the GoLang spans, one block per span.
+ * Each object of a span that is in use is an allocation, which is used if
+ * its index is below the free index of the span or its bit is set in the
+ * allocation bitmap of the span.  Objects that have not been marked by the
+ * most recent collection are still reported as used if the span has not yet
+ * been swept.  A free span is a single free allocation.
+ */
+template <class Offset>
+class AllocationFinder : public Allocations::Directory<Offset>::Finder {
+ public:
+  typedef typename Allocations::Directory<Offset>::Record Record;
+  typedef typename InfrastructureFinder<Offset>::Span Span;
+  typedef typename InfrastructureFinder<Offset>::Spans Spans;
+
+  AllocationFinder(const VirtualAddressMap<Offset>& addressMap,
+                   const InfrastructureFinder<Offset>& infrastructureFinder)
+      : _reader(addressMap),
+        _infrastructureFinder(infrastructureFinder),
+        _spans(infrastructureFinder.GetSpans()),
+        _nextSpan(_spans.begin()) {}
+
+  virtual const Record* NextBlock(size_t& numRecords) {
+    _records.clear();
+    if (_nextSpan == _spans.end()) {
+      numRecords = 0;
+      return (const Record*)(0);
+    }
+    const Span& span = *(_nextSpan++);
+    if (span._state == InfrastructureFinder<Offset>::SPAN_FREE) {
+      _records.emplace_back(span._base, span._size, false);
+    } else {
+      _records.reserve(span._numElements);
+      Offset object = span._base;
+      uint8_t bits = 0;
+      for (Offset i = 0; i < span._numElements; i++) {
+        if ((i & 7) == 0) {
+          bits = _reader.ReadU8(span._allocBits + (i >> 3), 0xff);
+        }
+        bool isUsed = (i < span._freeIndex) || ((bits >> (i & 7)) & 1) != 0;
+        _records.emplace_back(object, span._elementSize, isUsed);
+        object += span._elementSize;
+      }
+    }
+    numRecords = _records.size();
+    return _records.data();
+  }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  virtual Offset MinRequestSize(Offset size) {
+    return _infrastructureFinder.MinRequestSize(size);
+  }
+
+ private:
+  typename VirtualAddressMap<Offset>::Reader _reader;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const Spans& _spans;
+  typename Spans::const_iterator _nextSpan;
+  std::vector<Record> _records;
+};
+}  // namespace GoLang
+}  // namespace chap
@@ -2,12 +2,15 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <memory>
 #include "../Allocations/Directory.h"
 #include "../CompoundDescriber.h"
 #include "../ModuleDirectory.h"
+#include "../StackRegistry.h"
 #include "../UnfilledImages.h"
 #include "../VirtualAddressMap.h"
 #include "../VirtualMemoryPartition.h"
+#include "AllocationFinder.h"
 #include "InfrastructureFinder.h"
 
 namespace chap {
@@ -18,20 +21,30 @@ class FinderGroup {
   FinderGroup(VirtualMemoryPartition<Offset>& virtualMemoryPartition,
               const ModuleDirectory<Offset>& moduleDirectory,
               Allocations::Directory<Offset>& allocationDirectory,
-              UnfilledImages<Offset>& unfilledImages)
+              UnfilledImages<Offset>& unfilledImages,
+              StackRegistry<Offset>& stackRegistry)
       : _virtualMemoryPartition(virtualMemoryPartition),
         _virtualAddressMap(virtualMemoryPartition.GetAddressMap()),
         _moduleDirectory(moduleDirectory),
         _allocationDirectory(allocationDirectory),
         _unfilledImages(unfilledImages),
+        _stackRegistry(stackRegistry),
         _infrastructureFinder(moduleDirectory, virtualMemoryPartition) {}
 
   void Resolve() {
     _infrastructureFinder.Resolve();
-    // ??? mheap_ was found
-    //    Create a finder for allocations in spans
-    //    Add that finder to the allocation directory.
-    //    Create any region describers
+    for (const auto& goRoutine : _infrastructureFinder.GetGoRoutines()) {
+      _stackRegistry.RegisterStack(goRoutine._stackBase, goRoutine._stackLimit,
+                                   goRoutine._stackPointer, "goroutine",
+                                   goRoutine._address);
+    }
+    if (_infrastructureFinder.GetSpans().empty()) {
+      return;
+    }
+    _allocationFinder.reset(new AllocationFinder<Offset>(
+        _virtualAddressMap, _infrastructureFinder));
+    _allocationDirectory.AddFinder(_allocationFinder.get());
+    // TODO: Create any region describers
   }
 
   const InfrastructureFinder<Offset>& GetInfrastructureFinder() const {
@@ -51,7 +64,9 @@ class FinderGroup {
   const ModuleDirectory<Offset>& _moduleDirectory;
   Allocations::Directory<Offset>& _allocationDirectory;
   UnfilledImages<Offset>& _unfilledImages;
+  StackRegistry<Offset>& _stackRegistry;
   InfrastructureFinder<Offset> _infrastructureFinder;
+  std::unique_ptr<AllocationFinder<Offset> > _allocationFinder;
 };
 
 }  // namespace GoLang
@@ -2,24 +2,87 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
 #include "../ModuleDirectory.h"
 #include "../VirtualAddressMap.h"
 #include "../VirtualMemoryPartition.h"
 
 namespace chap {
 namespace GoLang {
+/*
+ * This finds the goroutines and the spans of the GoLang heap.  The spans are
+ * found by way of the allspans slice of runtime.mheap_, which is recognized
+ * in the writable part of the main executable as a slice of pointers to
+ * structures that look like mspans.  The mspan layout is the one used by go
+ * 1.11 through 1.14, and only 64-bit processes are supported.
+ */
 template <typename Offset>
 class InfrastructureFinder {
  public:
+  /*
+   * These are the values of the state field of an mspan.  A span that holds
+   * goroutine stacks or other runtime structures is in the MANUAL state.
+   * The FREE state is used only before go 1.14.
+   */
+  enum SpanState {
+    SPAN_DEAD = 0,
+    SPAN_IN_USE = 1,
+    SPAN_MANUAL = 2,
+    SPAN_FREE = 3
+  };
+
+  struct Span {
+    Span(Offset header, Offset base, Offset size, Offset elementSize,
+         Offset numElements, Offset freeIndex, Offset allocBits,
+         SpanState state)
+        : _header(header),
+          _base(base),
+          _size(size),
+          _elementSize(elementSize),
+          _numElements(numElements),
+          _freeIndex(freeIndex),
+          _allocBits(allocBits),
+          _state(state) {}
+    Offset _header;       // address of the mspan structure
+    Offset _base;         // start of the first page of the span
+    Offset _size;         // size of the span, in bytes
+    Offset _elementSize;  // size of each object in the span
+    Offset _numElements;  // number of objects in the span
+    Offset _freeIndex;    // all objects below this index are allocated
+    Offset _allocBits;    // address of the allocation bitmap
+    SpanState _state;
+  };
+  typedef std::vector<Span> Spans;
+
+  struct GoRoutine {
+    GoRoutine(Offset address, Offset stackBase, Offset stackLimit,
+              Offset stackPointer)
+        : _address(address),
+          _stackBase(stackBase),
+          _stackLimit(stackLimit),
+          _stackPointer(stackPointer) {}
+    Offset _address;  // address of the g structure
+    Offset _stackBase;
+    Offset _stackLimit;
+    Offset _stackPointer;  // saved when the goroutine was last descheduled
+  };
+  typedef std::vector<GoRoutine> GoRoutines;
+
   InfrastructureFinder(const ModuleDirectory<Offset>& moduleDirectory,
                        VirtualMemoryPartition<Offset>& partition)
-      : _moduleDirectory(moduleDirectory),
+      : GOLANG_SPAN("GoLang span"),
+        GOLANG_FREE_SPAN("GoLang free span"),
+        GOLANG_GOROUTINE_STACK("GoLang goroutine stack"),
+        _moduleDirectory(moduleDirectory),
         _isResolved(false),
         _virtualMemoryPartition(partition),
         _virtualAddressMap(partition.GetAddressMap()),
         _goRoutines(0),
         _numGoRoutines(0),
-        _mheap(0) {}
+        _allSpans(0) {}
 
   void Resolve() {
     if (_isResolved) {
@@ -39,14 +102,18 @@ class InfrastructureFinder {
       if (_goRoutines == 0) {
         FindGoRoutines(it->second);
       }
-      // TODO: Find mheap_
+      if (_goRoutines != 0 && _allSpans == 0 && sizeof(Offset) == 8) {
+        FindAllSpans(it->second);
+      }
     }
     if (_goRoutines != 0) {
-      // TODO: Register goroutine stacks when the mechanism is a bit more
-      // general.
-      std::cerr << "Warning: This is a core for a GoLang process.\n"
-                   "... GoLang allocations are not found yet.\n"
-                   "... Stacks are not reported correctly yet.\n"
+      GatherGoRoutineStacks();
+      std::cerr << "Warning: This is a core for a GoLang process.\n";
+      if (_allSpans == 0) {
+        std::cerr << "... GoLang allocations were not found.\n";
+      }
+      std::cerr << "... Stacks of threads running goroutines may be reported "
+                   "as too large.\n"
                    "... Native allocations using libc malloc are reported "
                    "correctly.\n";
     }
@@ -55,16 +122,261 @@ class InfrastructureFinder {
 
   bool IsResolved() const { return _isResolved; }
 
+  /*
+   * Return the address of the allspans slice of runtime.mheap_, or 0 if it
+   * was not found.
+   */
+  Offset AllSpans() const { return _allSpans; }
+
+  /*
+   * Return the spans that are in use or free, in increasing order of
+   * address.
+   */
+  const Spans& GetSpans() const { return _spans; }
+
+  /*
+   * Return the goroutines that have stacks, in the order of the allgs array.
+   */
+  const GoRoutines& GetGoRoutines() const { return _goRoutineStacks; }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  Offset MinRequestSize(Offset size) const {
+    typename std::vector<Offset>::const_iterator it =
+        std::lower_bound(_sizes.begin(), _sizes.end(), size);
+    if (it == _sizes.end()) {
+      return size - PAGE_SIZE + 1;
+    }
+    return (it == _sizes.begin()) ? 1 : (*(it - 1) + 1);
+  }
+
  private:
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
+  static constexpr Offset PAGE_SIZE = 0x2000;
+  static constexpr Offset MAX_SPAN_PAGES = 0x100000;
+  static constexpr Offset MAX_SPANS_CHECKED = 0x10;
+  /*
+   * These are the offsets of the fields of an mspan that are used here.
+   */
+  static constexpr Offset SPAN_START_ADDR = 0x18;
+  static constexpr Offset SPAN_NPAGES = 0x20;
+  static constexpr Offset SPAN_FREE_INDEX = 0x30;
+  static constexpr Offset SPAN_NELEMS = 0x38;
+  static constexpr Offset SPAN_ALLOC_BITS = 0x48;
+  static constexpr Offset SPAN_ALLOC_COUNT = 0x60;
+  static constexpr Offset SPAN_STATE = 0x63;
+  static constexpr Offset SPAN_ELEM_SIZE = 0x68;
+  static constexpr Offset SPAN_LIMIT = 0x70;
+
+  const char* GOLANG_SPAN;
+  const char* GOLANG_FREE_SPAN;
+  const char* GOLANG_GOROUTINE_STACK;
   const ModuleDirectory<Offset>& _moduleDirectory;
   bool _isResolved;
   VirtualMemoryPartition<Offset>& _virtualMemoryPartition;
   const VirtualAddressMap<Offset>& _virtualAddressMap;
   Offset _goRoutines;
   Offset _numGoRoutines;
-  Offset _mheap;
+  Offset _allSpans;
+  Spans _spans;
+  std::vector<Offset> _sizes;
+  GoRoutines _goRoutineStacks;
+
+  /*
+   * Gather and claim the stack of each goroutine that has one.  The stack
+   * bounds are the first two fields of the g structure and the stack
+   * pointer is the first field of the saved scheduling context.
+   */
+  void GatherGoRoutineStacks() {
+    Reader reader(_virtualAddressMap);
+    Offset numNotClaimed = 0;
+    for (Offset i = 0; i < _numGoRoutines; i++) {
+      Offset goRoutine =
+          reader.ReadOffset(_goRoutines + i * sizeof(Offset), 0);
+      if (goRoutine == 0) {
+        continue;
+      }
+      Offset stackBase = reader.ReadOffset(goRoutine, 0);
+      Offset stackLimit = reader.ReadOffset(goRoutine + sizeof(Offset), 0);
+      if (stackBase == 0 || stackLimit <= stackBase) {
+        continue;
+      }
+      Offset stackPointer =
+          reader.ReadOffset(goRoutine + 7 * sizeof(Offset), 0);
+      if (stackPointer < stackBase || stackPointer > stackLimit) {
+        stackPointer = stackBase;
+      }
+      _goRoutineStacks.emplace_back(goRoutine, stackBase, stackLimit,
+                                    stackPointer);
+      if (!_virtualMemoryPartition.ClaimRange(stackBase,
+                                              stackLimit - stackBase,
+                                              GOLANG_GOROUTINE_STACK, false)) {
+        numNotClaimed++;
+      }
+    }
+    if (numNotClaimed != 0) {
+      std::cerr << "Warning: " << std::dec << numNotClaimed
+                << " goroutine stacks overlap other claimed ranges.\n";
+    }
+  }
+
+  /*
+   * Return true if the given address appears to be that of an mspan.  Only
+   * the address of a dead span is checked, because the fields of a dead span
+   * are left over from when it was last used.
+   */
+  bool IsApparentSpan(Reader& reader, Offset span) {
+    if (span == 0 || (span & (sizeof(Offset) - 1)) != 0) {
+      return false;
+    }
+    uint8_t state = reader.ReadU8(span + SPAN_STATE, 0xff);
+    if (state == SPAN_DEAD) {
+      return true;
+    }
+    if (state > SPAN_FREE) {
+      return false;
+    }
+    Offset base = reader.ReadOffset(span + SPAN_START_ADDR, 0xbad);
+    Offset numPages = reader.ReadOffset(span + SPAN_NPAGES, 0);
+    if ((base & (PAGE_SIZE - 1)) != 0 || base == 0 || numPages == 0 ||
+        numPages > MAX_SPAN_PAGES) {
+      return false;
+    }
+    if (state != SPAN_IN_USE) {
+      return true;
+    }
+    Offset size = numPages * PAGE_SIZE;
+    Offset numElements = reader.ReadOffset(span + SPAN_NELEMS, 0);
+    Offset elementSize = reader.ReadOffset(span + SPAN_ELEM_SIZE, 0);
+    Offset freeIndex =
+        reader.ReadOffset(span + SPAN_FREE_INDEX, ~((Offset)(0)));
+    Offset limit = reader.ReadOffset(span + SPAN_LIMIT, 0);
+    return numElements != 0 && elementSize != 0 &&
+           numElements <= size / elementSize && freeIndex <= numElements &&
+           reader.ReadU16(span + SPAN_ALLOC_COUNT, 0xffff) <= numElements &&
+           reader.ReadOffset(span + SPAN_ALLOC_BITS, 0) != 0 && limit > base &&
+           limit <= base + size;
+  }
+
+  /*
+   * Look for the allspans slice, which consists of a pointer to an array of
+   * pointers to mspans, followed by the length and capacity of the slice.
+   */
+  void FindAllSpans(
+      const typename ModuleDirectory<Offset>::RangeToFlags& rangeToFlags) {
+    Reader moduleReader(_virtualAddressMap);
+    Reader reader(_virtualAddressMap);
+    for (typename ModuleDirectory<Offset>::RangeToFlags::const_iterator
+             itRange = rangeToFlags.begin();
+         itRange != rangeToFlags.end(); ++itRange) {
+      if ((itRange->_value & RangeAttributes::IS_WRITABLE) == 0) {
+        continue;
+      }
+      Offset base = itRange->_base;
+      Offset limit = _virtualAddressMap.find(itRange->_limit - 1).Limit();
+      for (Offset moduleAddr = base; moduleAddr < limit;
+           moduleAddr += sizeof(Offset)) {
+        Offset array = moduleReader.ReadOffset(moduleAddr, 0xbad);
+        if (array == 0 || (array & (sizeof(Offset) - 1)) != 0) {
+          continue;
+        }
+        Offset size = moduleReader.ReadOffset(moduleAddr + sizeof(Offset), 0);
+        Offset capacity =
+            moduleReader.ReadOffset(moduleAddr + 2 * sizeof(Offset), 0);
+        if (size == 0 || size > capacity) {
+          continue;
+        }
+        if (IsApparentSpanArray(reader, array, size)) {
+          _allSpans = moduleAddr;
+          GatherSpans(reader, array, size);
+          ClaimSpans();
+          return;
+        }
+      }
+    }
+  }
+
+  /*
+   * Check the first few entries and the last entry of a possible allspans
+   * array, requiring at least one of them to be in use.
+   */
+  bool IsApparentSpanArray(Reader& reader, Offset array, Offset size) {
+    bool foundInUse = false;
+    Offset numToCheck = std::min(size, MAX_SPANS_CHECKED);
+    for (Offset i = 0; i <= numToCheck; i++) {
+      Offset span = reader.ReadOffset(
+          array + ((i < numToCheck) ? i : (size - 1)) * sizeof(Offset), 0);
+      if (!IsApparentSpan(reader, span)) {
+        return false;
+      }
+      if (reader.ReadU8(span + SPAN_STATE, 0) == SPAN_IN_USE) {
+        foundInUse = true;
+      }
+    }
+    return foundInUse;
+  }
+
+  void GatherSpans(Reader& reader, Offset array, Offset numSpans) {
+    for (Offset i = 0; i < numSpans; i++) {
+      Offset span = reader.ReadOffset(array + i * sizeof(Offset), 0);
+      if (!IsApparentSpan(reader, span)) {
+        std::cerr << "Warning: unexpected value 0x" << std::hex << span
+                  << " found in GoLang allspans array at 0x" << array << ".\n";
+        continue;
+      }
+      SpanState state = (SpanState)(reader.ReadU8(span + SPAN_STATE, 0));
+      if (state != SPAN_IN_USE && state != SPAN_FREE) {
+        continue;
+      }
+      Offset base = reader.ReadOffset(span + SPAN_START_ADDR, 0);
+      Offset size = reader.ReadOffset(span + SPAN_NPAGES, 0) * PAGE_SIZE;
+      if (state == SPAN_FREE) {
+        _spans.emplace_back(span, base, size, size, 1, 0, 0, state);
+        continue;
+      }
+      Offset elementSize = reader.ReadOffset(span + SPAN_ELEM_SIZE, 0);
+      _spans.emplace_back(span, base, size, elementSize,
+                          reader.ReadOffset(span + SPAN_NELEMS, 0),
+                          reader.ReadOffset(span + SPAN_FREE_INDEX, 0),
+                          reader.ReadOffset(span + SPAN_ALLOC_BITS, 0), state);
+      if (elementSize < size) {
+        _sizes.push_back(elementSize);
+      }
+    }
+    std::sort(_sizes.begin(), _sizes.end());
+    _sizes.erase(std::unique(_sizes.begin(), _sizes.end()), _sizes.end());
+    std::sort(_spans.begin(), _spans.end(),
+              [](const Span& left, const Span& right) {
+                return left._base < right._base;
+              });
+    Offset limit = 0;
+    size_t numKept = 0;
+    for (const auto& span : _spans) {
+      if (span._base < limit) {
+        std::cerr << "Warning: GoLang span at 0x" << std::hex << span._header
+                  << " overlaps a previous span.\n";
+        continue;
+      }
+      _spans[numKept++] = span;
+      limit = span._base + span._size;
+    }
+    _spans.erase(_spans.begin() + numKept, _spans.end());
+  }
+
+  void ClaimSpans() {
+    for (const auto& span : _spans) {
+      if (!_virtualMemoryPartition.ClaimRange(
+              span._base, span._size,
+              (span._state == SPAN_FREE) ? GOLANG_FREE_SPAN : GOLANG_SPAN,
+              false)) {
+        std::cerr << "Warning: unexpected overlap for GoLang span at 0x"
+                  << std::hex << span._base << "\n";
+      }
+    }
+  }
 
   bool HasApparentGoRoutinePointer(Reader& reader, Offset pointerAddress) {
     Offset goRoutine = reader.ReadOffset(pointerAddress, 0xbad);
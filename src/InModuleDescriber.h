@@ -58,6 +58,15 @@ class InModuleDescriber : public Describer<Offset> {
     return false;
   }
 
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const auto &nameAndRanges : _moduleDirectory) {
+      for (const auto &range : nameAndRanges.second) {
+        visitor(range._base, range._limit);
+      }
+    }
+    return true;
+  }
+
  protected:
   const KnownAddressDescriber<Offset> &_knownAddressDescriber;
   const ModuleDirectory<Offset> &_moduleDirectory;
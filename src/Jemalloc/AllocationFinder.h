@@ -0,0 +1,71 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <vector>
+#include "../Allocations/Directory.h"
+#include "../VirtualAddressMap.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Jemalloc {
+/*
+ * This reports the allocations for the jemalloc extents, one block per
+ * extent.  Each region of a slab is an allocation, used or free according
+ * to the slab bitmap, and each large extent holds one used allocation.
+ */
+template <class Offset>
+class AllocationFinder : public Allocations::Directory<Offset>::Finder {
+ public:
+  typedef typename Allocations::Directory<Offset>::Record Record;
+  typedef typename InfrastructureFinder<Offset>::Extent Extent;
+  typedef typename InfrastructureFinder<Offset>::Extents Extents;
+
+  AllocationFinder(const VirtualAddressMap<Offset>& addressMap,
+                   const InfrastructureFinder<Offset>& infrastructureFinder)
+      : _addressMap(addressMap),
+        _infrastructureFinder(infrastructureFinder),
+        _extents(infrastructureFinder.GetExtents()),
+        _nextExtent(_extents.begin()) {}
+
+  virtual const Record* NextBlock(size_t& numRecords) {
+    _records.clear();
+    if (_nextExtent == _extents.end()) {
+      numRecords = 0;
+      return (const Record*)(0);
+    }
+    const Extent& extent = *(_nextExtent++);
+    Offset size = _infrastructureFinder.SizeOfClass(extent._sizeIndex);
+    if (extent._isSlab) {
+      typename VirtualAddressMap<Offset>::Reader reader(_addressMap);
+      Offset numRegions = extent._size / size;
+      _records.reserve(numRegions);
+      for (Offset i = 0; i < numRegions; i++) {
+        _records.emplace_back(
+            extent._address + i * size, size,
+            _infrastructureFinder.IsRegionUsed(reader, extent, i));
+      }
+    } else {
+      _records.emplace_back(extent._address, size, true);
+    }
+    numRecords = _records.size();
+    return _records.data();
+  }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  virtual Offset MinRequestSize(Offset size) {
+    return _infrastructureFinder.MinRequestSize(size);
+  }
+
+ private:
+  const VirtualAddressMap<Offset>& _addressMap;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const Extents& _extents;
+  typename Extents::const_iterator _nextExtent;
+  std::vector<Record> _records;
+};
+}  // namespace Jemalloc
+}  // namespace chap
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include "../Describer.h"
+#include "../VirtualAddressMap.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Jemalloc {
+/*
+ * This describes the parts of jemalloc slabs and large extents that are not
+ * covered by allocations, such as the unused tail of a slab or the padding
+ * before and after a large allocation.
+ */
+template <typename Offset>
+class ExtentDescriber : public Describer<Offset> {
+ public:
+  typedef typename InfrastructureFinder<Offset>::Extent Extent;
+
+  ExtentDescriber(const InfrastructureFinder<Offset>& infrastructureFinder,
+                  const VirtualAddressMap<Offset>& virtualAddressMap)
+      : _infrastructureFinder(infrastructureFinder),
+        _virtualAddressMap(virtualAddressMap) {}
+
+  /*
+   * If the address is understood, provide a description for the address,
+   * optionally with an additional explanation of why the address matches
+   * the description, and return true.  Otherwise don't write anything
+   * and return false.  Show addresses only if requested.
+   */
+  bool Describe(Commands::Context& context, Offset address, bool explain,
+                bool showAddresses) const {
+    const Extent* extent = _infrastructureFinder.ExtentContaining(address);
+    if (extent == (const Extent*)(0)) {
+      return false;
+    }
+    const char* kind = extent->_isSlab ? "slab" : "large extent";
+    Offset size = _infrastructureFinder.SizeOfClass(extent->_sizeIndex);
+    Commands::Output& output = context.GetOutput();
+    if (showAddresses) {
+      output << "Address 0x" << std::hex << address << " is at offset 0x"
+             << (address - extent->_base) << " of a jemalloc " << kind
+             << " at 0x" << extent->_base << " for arena " << std::dec
+             << extent->_arenaIndex << ".\n";
+    } else {
+      output << "This is part of a jemalloc " << kind << ".\n";
+    }
+    if (explain) {
+      if (showAddresses) {
+        output << "The extent is described by the header at 0x" << std::hex
+               << extent->_header << ".\n";
+      }
+      if (extent->_isSlab) {
+        output << "The slab holds " << std::dec << (extent->_size / size)
+               << " regions of size 0x" << std::hex << size << ", of which "
+               << std::dec << extent->_numFree << " are free.\n";
+        if (address >= extent->_address + (extent->_size / size) * size) {
+          output << "This is in the tail of the slab, which is too small "
+                    "to hold a region.\n";
+        }
+      } else {
+        if (address < extent->_address) {
+          output << "This is in the padding before the large allocation.\n";
+        } else {
+          output << "This is in the padding after the large allocation.\n";
+        }
+      }
+      Offset numSlabs = 0;
+      Offset numLargeExtents = 0;
+      for (const auto& other : _infrastructureFinder.GetExtents()) {
+        if (other._arenaIndex == extent->_arenaIndex) {
+          if (other._isSlab) {
+            numSlabs++;
+          } else {
+            numLargeExtents++;
+          }
+        }
+      }
+      output << "Arena " << std::dec << extent->_arenaIndex << " has "
+             << numSlabs << " slabs and " << numLargeExtents
+             << " large extents.\n";
+    }
+    return true;
+  }
+
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const Extent& extent : _infrastructureFinder.GetExtents()) {
+      visitor(extent._base, extent._base + extent._size);
+    }
+    return true;
+  }
+
+ private:
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const VirtualAddressMap<Offset>& _virtualAddressMap;
+};
+}  // namespace Jemalloc
+}  // namespace chap
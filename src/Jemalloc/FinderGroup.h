@@ -0,0 +1,55 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <memory>
+#include "../Allocations/Directory.h"
+#include "../CompoundDescriber.h"
+#include "../VirtualAddressMap.h"
+#include "../VirtualMemoryPartition.h"
+#include "AllocationFinder.h"
+#include "ExtentDescriber.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Jemalloc {
+template <class Offset>
+class FinderGroup {
+ public:
+  FinderGroup(VirtualMemoryPartition<Offset>& virtualMemoryPartition,
+              Allocations::Directory<Offset>& allocationDirectory)
+      : _virtualAddressMap(virtualMemoryPartition.GetAddressMap()),
+        _allocationDirectory(allocationDirectory),
+        _infrastructureFinder(virtualMemoryPartition) {}
+
+  void Resolve() {
+    _infrastructureFinder.Resolve();
+    if (!_infrastructureFinder.GetExtents().empty()) {
+      _allocationFinder.reset(new AllocationFinder<Offset>(
+          _virtualAddressMap, _infrastructureFinder));
+      _allocationDirectory.AddFinder(_allocationFinder.get());
+      _extentDescriber.reset(new ExtentDescriber<Offset>(
+          _infrastructureFinder, _virtualAddressMap));
+    }
+  }
+
+  const InfrastructureFinder<Offset>& GetInfrastructureFinder() const {
+    return _infrastructureFinder;
+  }
+
+  void AddDescribers(CompoundDescriber<Offset>& compoundDescriber) const {
+    if (!(_extentDescriber == nullptr)) {
+      compoundDescriber.AddDescriber(*(_extentDescriber.get()));
+    }
+  }
+
+ private:
+  const VirtualAddressMap<Offset>& _virtualAddressMap;
+  Allocations::Directory<Offset>& _allocationDirectory;
+  InfrastructureFinder<Offset> _infrastructureFinder;
+  std::unique_ptr<AllocationFinder<Offset> > _allocationFinder;
+  std::unique_ptr<ExtentDescriber<Offset> > _extentDescriber;
+};
+
+}  // namespace Jemalloc
+}  // namespace chap
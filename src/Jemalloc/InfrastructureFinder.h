@@ -0,0 +1,428 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "../VirtualAddressMap.h"
+#include "../VirtualMemoryPartition.h"
+
+namespace chap {
+namespace Jemalloc {
+/*
+ * This finds the extents used by jemalloc 5.x, both the slabs that are
+ * divided into regions of a single small size class and the extents that
+ * each hold a single large allocation.  The extent headers (extent_t in
+ * jemalloc 5.0 to 5.2, edata_t in 5.3) are found by scanning writable memory
+ * for structures that describe an active extent in a self-consistent way,
+ * and each candidate is accepted only if some leaf of the radix tree that
+ * jemalloc uses to map pages to extents refers to it with the same size
+ * class and slab flag.  Only 64-bit processes with 4K pages and the default
+ * size classes are supported.
+ */
+template <class Offset>
+class InfrastructureFinder {
+ public:
+  typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
+
+  struct Extent {
+    Extent(Offset header, Offset base, Offset size, Offset address,
+           Offset arenaIndex, Offset sizeIndex, Offset numFree, bool isSlab)
+        : _header(header),
+          _base(base),
+          _size(size),
+          _address(address),
+          _arenaIndex(arenaIndex),
+          _sizeIndex(sizeIndex),
+          _numFree(numFree),
+          _isSlab(isSlab) {}
+    Offset _header;      // address of the extent_t or edata_t
+    Offset _base;        // page aligned start of the extent
+    Offset _size;        // size of the extent, in bytes
+    Offset _address;     // start of the first region or large allocation
+    Offset _arenaIndex;  // index of the owning arena
+    Offset _sizeIndex;   // size class of the regions or large allocation
+    Offset _numFree;     // number of free regions, for a slab
+    bool _isSlab;
+  };
+  typedef std::vector<Extent> Extents;
+
+  static constexpr Offset PAGE_SIZE = 0x1000;
+  static constexpr Offset SLAB_BITMAP_OFFSET = 0x40;
+  static constexpr Offset MAX_REGIONS_PER_SLAB = 0x200;
+
+  InfrastructureFinder(VirtualMemoryPartition<Offset>& virtualMemoryPartition)
+      : JEMALLOC_SLAB("jemalloc slab"),
+        JEMALLOC_LARGE_EXTENT("jemalloc large extent"),
+        JEMALLOC_EXTENT_HEADER("jemalloc extent header"),
+        _virtualMemoryPartition(virtualMemoryPartition),
+        _addressMap(virtualMemoryPartition.GetAddressMap()),
+        _numSmallSizes(0) {}
+
+  void Resolve() {
+    if (sizeof(Offset) != 8) {
+      return;
+    }
+    ComputeSizeClasses();
+    std::vector<Candidate> candidates;
+    FindCandidates(candidates);
+    if (candidates.empty()) {
+      return;
+    }
+    ConfirmCandidates(candidates);
+    AcceptConfirmedCandidates(candidates);
+    ClaimExtents();
+  }
+
+  const Extents& GetExtents() const { return _extents; }
+
+  /*
+   * Return the extent that contains the given address, or null if there
+   * is none.
+   */
+  const Extent* ExtentContaining(Offset address) const {
+    typename Extents::const_iterator it = std::upper_bound(
+        _extents.begin(), _extents.end(), address,
+        [](Offset address, const Extent& extent) {
+          return address < extent._base;
+        });
+    if (it == _extents.begin()) {
+      return (const Extent*)(0);
+    }
+    --it;
+    return (address < it->_base + it->_size) ? &(*it) : (const Extent*)(0);
+  }
+
+  /*
+   * Return the size associated with the given size class.
+   */
+  Offset SizeOfClass(Offset sizeIndex) const { return _sizes[sizeIndex]; }
+
+  /*
+   * Return the number of regions in a slab for the given small size class.
+   */
+  Offset RegionsPerSlab(Offset sizeIndex) const {
+    return SlabSize(_sizes[sizeIndex]) / _sizes[sizeIndex];
+  }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  Offset MinRequestSize(Offset size) const {
+    typename std::vector<Offset>::const_iterator it =
+        std::lower_bound(_sizes.begin(), _sizes.end(), size);
+    return (it == _sizes.begin()) ? 1 : (*(it - 1) + 1);
+  }
+
+  /*
+   * Return true if the given region of the given slab is in use, based on
+   * the bitmap in the extent header.
+   */
+  bool IsRegionUsed(Reader& reader, const Extent& extent,
+                    Offset regionIndex) const {
+    uint64_t bits = reader.ReadU64(extent._header + SLAB_BITMAP_OFFSET +
+                                   (regionIndex / 64) * sizeof(uint64_t),
+                                   ~((uint64_t)0));
+    return ((bits >> (regionIndex % 64)) & 1) != 0;
+  }
+
+ private:
+  /*
+   * These describe where the fields are packed in e_bits for the supported
+   * versions.  Only the fields needed to recognize an active extent are
+   * listed.
+   */
+  struct BitsLayout {
+    unsigned _stateShift;
+    uint64_t _stateMask;
+    unsigned _sizeIndexShift;
+    unsigned _numFreeShift;
+  };
+  static constexpr unsigned ARENA_INDEX_BITS = 12;
+  static constexpr unsigned SLAB_SHIFT = 12;
+  static constexpr unsigned COMMITTED_SHIFT = 13;
+  static constexpr unsigned NUM_LAYOUTS = 2;
+  static constexpr unsigned LG_VADDR = 48;
+
+  struct Candidate {
+    Candidate(const Extent& extent, unsigned layout)
+        : _extent(extent), _layout(layout), _confirmed(false) {}
+    Extent _extent;
+    unsigned _layout;
+    bool _confirmed;
+  };
+
+  const char* JEMALLOC_SLAB;
+  const char* JEMALLOC_LARGE_EXTENT;
+  const char* JEMALLOC_EXTENT_HEADER;
+  VirtualMemoryPartition<Offset>& _virtualMemoryPartition;
+  const VirtualAddressMap<Offset>& _addressMap;
+  std::vector<Offset> _sizes;
+  Offset _numSmallSizes;
+  Extents _extents;
+
+  static const BitsLayout& Layout(unsigned layout) {
+    /*
+     * The first is for jemalloc 5.0 to 5.2, where the state takes 2 bits
+     * after the zeroed bit, and the second is for 5.3, where there are also
+     * pai and guarded bits and the state takes 3 bits.
+     */
+    static const BitsLayout layouts[NUM_LAYOUTS] = {{16, 3, 18, 26},
+                                                     {17, 7, 20, 28}};
+    return layouts[layout];
+  }
+
+  /*
+   * Compute the default size classes, as used with a 16 byte quantum and 4
+   * size classes per doubling.  Classes smaller than 4 pages are the small
+   * classes, which are allocated from slabs.
+   */
+  void ComputeSizeClasses() {
+    _sizes.push_back(8);
+    for (Offset size = 16; size <= 64; size += 16) {
+      _sizes.push_back(size);
+    }
+    uint64_t size = 64;
+    for (uint64_t delta = 16; size < ((uint64_t)(1) << (LG_VADDR - 1));
+         delta *= 2) {
+      for (int i = 0; i < 4; i++) {
+        size += delta;
+        _sizes.push_back(size);
+      }
+    }
+    while (_sizes[_numSmallSizes] < 4 * PAGE_SIZE) {
+      _numSmallSizes++;
+    }
+  }
+
+  /*
+   * Return the size of a slab for regions of the given size, which is the
+   * smallest multiple of the page size that holds a whole number of regions.
+   */
+  static Offset SlabSize(Offset regionSize) {
+    Offset slabSize = PAGE_SIZE;
+    while ((slabSize % regionSize) != 0) {
+      slabSize += PAGE_SIZE;
+    }
+    return slabSize;
+  }
+
+  void FindCandidates(std::vector<Candidate>& candidates) {
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      Offset first = (range._base + SLAB_BITMAP_OFFSET - 1) &
+                     ~(SLAB_BITMAP_OFFSET - 1);
+      for (Offset header = first;
+           header + SLAB_BITMAP_OFFSET + MAX_REGIONS_PER_SLAB / 8 <=
+           range._limit;
+           header += SLAB_BITMAP_OFFSET) {
+        const uint64_t* fields =
+            (const uint64_t*)(image + (header - range._base));
+        for (unsigned layout = 0; layout < NUM_LAYOUTS; layout++) {
+          if (CheckCandidate(header, fields, layout, candidates)) {
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  /*
+   * Check whether the given fields describe an active extent for the given
+   * layout, and if so add a candidate.  The first three fields are e_bits,
+   * e_addr and e_size_esn, and the slab bitmap follows at a fixed offset.
+   */
+  bool CheckCandidate(Offset header, const uint64_t* fields, unsigned layout,
+                      std::vector<Candidate>& candidates) {
+    const BitsLayout& bitsLayout = Layout(layout);
+    uint64_t bits = fields[0];
+    uint64_t address = fields[1];
+    uint64_t size = fields[2] & ~((uint64_t)(PAGE_SIZE - 1));
+    if (((bits >> bitsLayout._stateShift) & bitsLayout._stateMask) != 0 ||
+        ((bits >> COMMITTED_SHIFT) & 1) == 0 || address == 0 ||
+        (address & (SLAB_BITMAP_OFFSET - 1)) != 0 || size == 0 ||
+        (address >> LG_VADDR) != 0 || (size >> LG_VADDR) != 0) {
+      return false;
+    }
+    Offset arenaIndex = bits & ((1 << ARENA_INDEX_BITS) - 1);
+    bool isSlab = ((bits >> SLAB_SHIFT) & 1) != 0;
+    Offset sizeIndex = (bits >> bitsLayout._sizeIndexShift) & 0xff;
+    if (sizeIndex >= _sizes.size()) {
+      return false;
+    }
+    Offset classSize = _sizes[sizeIndex];
+    Offset base = address & ~(PAGE_SIZE - 1);
+    Offset numFree = 0;
+    if (isSlab) {
+      if (sizeIndex >= _numSmallSizes || base != address ||
+          size != SlabSize(classSize)) {
+        return false;
+      }
+      Offset numRegions = size / classSize;
+      numFree = (bits >> bitsLayout._numFreeShift) & (2 * MAX_REGIONS_PER_SLAB -
+                                                      1);
+      if (numFree > numRegions) {
+        return false;
+      }
+      Offset numUsed = 0;
+      const uint64_t* bitmap = fields + SLAB_BITMAP_OFFSET / sizeof(uint64_t);
+      for (Offset i = 0; i < numRegions; i += 64) {
+        uint64_t word = bitmap[i / 64];
+        if (numRegions - i < 64) {
+          word &= (((uint64_t)(1)) << (numRegions - i)) - 1;
+        }
+        numUsed += __builtin_popcountll(word);
+      }
+      if (numUsed + numFree != numRegions) {
+        return false;
+      }
+    } else {
+      /*
+       * A large extent may have an extra page so that the start of the
+       * allocation can be offset by some number of cache lines.
+       */
+      if (sizeIndex < _numSmallSizes ||
+          !(size == classSize ||
+            (size == classSize + PAGE_SIZE && address < base + PAGE_SIZE))) {
+        return false;
+      }
+      if (size == classSize && address != base) {
+        return false;
+      }
+    }
+    if (base + size <= base) {
+      return false;
+    }
+    const char* image;
+    if (_addressMap.FindMappedMemoryImage(base, &image) < size) {
+      return false;
+    }
+    candidates.emplace_back(Extent(header, base, size, address, arenaIndex,
+                                   sizeIndex, numFree, isSlab),
+                            layout);
+    return true;
+  }
+
+  /*
+   * Look for radix tree leaf entries that refer to the candidates.  On
+   * x86_64 each such entry holds the size class in the upper 16 bits, the
+   * address of the extent header in the lower 48 bits, with the low bits
+   * reused for the slab flag and, in 5.3, the head flag and state.
+   */
+  void ConfirmCandidates(std::vector<Candidate>& candidates) {
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& left, const Candidate& right) {
+                return left._extent._header < right._extent._header;
+              });
+    Offset minHeader = candidates.front()._extent._header;
+    Offset maxHeader = candidates.back()._extent._header;
+    const uint64_t headerMask =
+        (((uint64_t)(1) << LG_VADDR) - 1) & ~(SLAB_BITMAP_OFFSET - 1);
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      const uint64_t* words = (const uint64_t*)(image);
+      const uint64_t* limit = words + range._size / sizeof(uint64_t);
+      for (; words < limit; words++) {
+        uint64_t word = *words;
+        Offset header = word & headerMask;
+        if (header < minHeader || header > maxHeader) {
+          continue;
+        }
+        typename std::vector<Candidate>::iterator it = std::lower_bound(
+            candidates.begin(), candidates.end(), header,
+            [](const Candidate& candidate, Offset header) {
+              return candidate._extent._header < header;
+            });
+        if (it == candidates.end() || it->_extent._header != header) {
+          continue;
+        }
+        if ((word >> LG_VADDR) == it->_extent._sizeIndex &&
+            ((word & 1) != 0) == it->_extent._isSlab) {
+          it->_confirmed = true;
+        }
+      }
+    }
+  }
+
+  /*
+   * Keep the confirmed candidates for the layout that was confirmed most
+   * often, dropping any that overlap an extent already accepted.
+   */
+  void AcceptConfirmedCandidates(const std::vector<Candidate>& candidates) {
+    size_t numConfirmed[NUM_LAYOUTS] = {0};
+    for (const auto& candidate : candidates) {
+      if (candidate._confirmed) {
+        numConfirmed[candidate._layout]++;
+      }
+    }
+    unsigned layout = (numConfirmed[1] > numConfirmed[0]) ? 1 : 0;
+    if (numConfirmed[layout] == 0) {
+      return;
+    }
+    for (const auto& candidate : candidates) {
+      if (candidate._confirmed && candidate._layout == layout) {
+        _extents.push_back(candidate._extent);
+      }
+    }
+    std::sort(_extents.begin(), _extents.end(),
+              [](const Extent& left, const Extent& right) {
+                return left._base < right._base;
+              });
+    Offset limit = 0;
+    size_t numKept = 0;
+    for (const auto& extent : _extents) {
+      if (extent._base < limit) {
+        std::cerr << "Warning: jemalloc extent header at 0x" << std::hex
+                  << extent._header << " overlaps a previous extent.\n";
+        continue;
+      }
+      _extents[numKept++] = extent;
+      limit = extent._base + extent._size;
+    }
+    _extents.erase(_extents.begin() + numKept, _extents.end());
+  }
+
+  /*
+   * Claim the extents and the part of each header that precedes the slab
+   * bitmap.  The header holds the address of the first region or of the
+   * large allocation, so leaving it unclaimed would make it a static anchor
+   * for that allocation.
+   */
+  void ClaimExtents() {
+    for (const auto& extent : _extents) {
+      if (!_virtualMemoryPartition.ClaimRange(extent._header,
+                                              SLAB_BITMAP_OFFSET,
+                                              JEMALLOC_EXTENT_HEADER, false)) {
+        std::cerr << "Warning: unexpected overlap for jemalloc extent header "
+                     "at 0x"
+                  << std::hex << extent._header << "\n";
+      }
+      if (!_virtualMemoryPartition.ClaimRange(
+              extent._base, extent._size,
+              extent._isSlab ? JEMALLOC_SLAB : JEMALLOC_LARGE_EXTENT,
+              false)) {
+        std::cerr << "Warning: unexpected overlap for jemalloc extent at 0x"
+                  << std::hex << extent._base << "\n";
+      }
+    }
+  }
+};
+}  // namespace Jemalloc
+}  // namespace chap
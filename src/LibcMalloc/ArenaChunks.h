@@ -0,0 +1,84 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <vector>
+#include "../Allocations/Directory.h"
+
+namespace chap {
+namespace LibcMalloc {
+/*
+ * This holds the allocations found by walking the main arena runs and the
+ * heaps for the non-main arenas, before they are reported to the allocation
+ * directory, so that the used/free status can still be corrected based on
+ * the fast bin lists.  Each allocation is described by the address and size
+ * as seen by the caller of malloc, rather than the chunk header, in the form
+ * in which the finders hand the allocations to the directory.  The
+ * allocations are kept in one sorted buffer per main arena run or heap,
+ * with the buffers in increasing order of address, so that each buffer can
+ * be handed to the directory as its own block and released once the
+ * directory has moved past it.  Regions without allocations have no buffer.
+ */
+template <class Offset>
+class ArenaChunks {
+ public:
+  typedef typename Allocations::Directory<Offset>::Record Chunk;
+  typedef std::vector<Chunk> ChunkVector;
+  typedef std::vector<ChunkVector> ChunkVectors;
+
+  ChunkVectors& GetMainArenaChunks() { return _mainArenaChunks; }
+  const ChunkVectors& GetMainArenaChunks() const { return _mainArenaChunks; }
+  ChunkVectors& GetHeapChunks() { return _heapChunks; }
+  const ChunkVectors& GetHeapChunks() const { return _heapChunks; }
+
+  /*
+   * Return the allocation that contains the given address, or null if there
+   * is none.
+   */
+  Chunk* ChunkContaining(Offset address) {
+    Chunk* chunk = ChunkContaining(_heapChunks, address);
+    return (chunk != (Chunk*)(0)) ? chunk
+                                  : ChunkContaining(_mainArenaChunks, address);
+  }
+
+ private:
+  ChunkVectors _mainArenaChunks;
+  ChunkVectors _heapChunks;
+
+  static Chunk* ChunkContaining(ChunkVectors& regions, Offset address) {
+    size_t base = 0;
+    size_t limit = regions.size();
+    while (base < limit) {
+      size_t mid = (base + limit) / 2;
+      if (address >= regions[mid].front()._address) {
+        base = mid + 1;
+      } else {
+        limit = mid;
+      }
+    }
+    return (base > 0) ? ChunkContaining(regions[base - 1], address)
+                      : (Chunk*)(0);
+  }
+
+  static Chunk* ChunkContaining(ChunkVector& chunks, Offset address) {
+    size_t base = 0;
+    size_t limit = chunks.size();
+    while (base < limit) {
+      size_t mid = (base + limit) / 2;
+      if (address >= chunks[mid]._address) {
+        base = mid + 1;
+      } else {
+        limit = mid;
+      }
+    }
+    if (base > 0) {
+      Chunk& chunk = chunks[base - 1];
+      if (address < chunk._address + chunk._size) {
+        return &chunk;
+      }
+    }
+    return (Chunk*)(0);
+  }
+};
+}  // namespace LibcMalloc
+}  // namespace chap
@@ -0,0 +1,355 @@
+// Copyright (c) 2017-2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include "../Parallel.h"
+#include "../VirtualAddressMap.h"
+#include "ArenaChunks.h"
+#include "CorruptionSkipper.h"
+#include "DoublyLinkedListCorruptionChecker.h"
+#include "FastBinFreeStatusFixer.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace LibcMalloc {
+/*
+ * This finds all the allocations in the main arena runs and in the heaps
+ * for the non-main arenas.  Each run and each heap is independent of the
+ * others, so they are walked concurrently, each into its own sorted buffer,
+ * which is kept as is rather than copied into a combined vector, and then
+ * the fast bin lists and doubly linked free lists are checked for
+ * each arena, again concurrently.  Any corruption messages are gathered
+ * per run, heap or arena and reported in address order afterwards, so the
+ * output doesn't depend on the number of threads.
+ */
+template <class Offset>
+class ArenaWalker {
+ public:
+  typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename ArenaChunks<Offset>::Chunk Chunk;
+  typedef typename ArenaChunks<Offset>::ChunkVector ChunkVector;
+  typedef typename ArenaChunks<Offset>::ChunkVectors ChunkVectors;
+  typedef typename InfrastructureFinder<Offset>::Arena Arena;
+  typedef typename InfrastructureFinder<Offset>::Heap Heap;
+
+  ArenaWalker(const VirtualAddressMap<Offset>& addressMap,
+              const InfrastructureFinder<Offset>& infrastructureFinder,
+              CorruptionSkipper<Offset>& corruptionSkipper,
+              FastBinFreeStatusFixer<Offset>& fastBinFreeStatusFixer,
+              DoublyLinkedListCorruptionChecker<Offset>&
+                  doublyLinkedListCorruptionChecker)
+      : _addressMap(addressMap),
+        _infrastructureFinder(infrastructureFinder),
+        _arenas(_infrastructureFinder.GetArenas()),
+        _mainArenaAddress(_infrastructureFinder.GetMainArenaAddress()),
+        _arenaStructSize(_infrastructureFinder.GetArenaStructSize()),
+        _maxHeapSize(_infrastructureFinder.GetMaxHeapSize()),
+        _corruptionSkipper(corruptionSkipper),
+        _corruptionReported(false) {
+    WalkRunsAndHeaps();
+    CheckArenas(fastBinFreeStatusFixer, doublyLinkedListCorruptionChecker);
+  }
+
+  /*
+   * Return the buffers for the main arena runs or the heaps, which the
+   * caller may take over once the walker is done.
+   */
+  ChunkVectors& GetMainArenaChunks() {
+    return _arenaChunks.GetMainArenaChunks();
+  }
+  ChunkVectors& GetHeapChunks() { return _arenaChunks.GetHeapChunks(); }
+
+  /*
+   * Return true if any problem was reported while walking the runs and
+   * heaps or checking the free lists of the arenas.
+   */
+  bool CorruptionReported() const { return _corruptionReported; }
+
+ private:
+  /*
+   * This is either a main arena run or a heap for a non-main arena.
+   */
+  struct Region {
+    Region(Offset base, Offset size, const Heap* heap)
+        : _base(base), _size(size), _heap(heap) {}
+    Offset _base;
+    Offset _size;
+    const Heap* _heap;  // null for a main arena run
+    ChunkVector _chunks;
+    std::string _errors;
+  };
+
+  const VirtualAddressMap<Offset>& _addressMap;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const typename InfrastructureFinder<Offset>::ArenaMap& _arenas;
+  const Offset _mainArenaAddress;
+  const Offset _arenaStructSize;
+  const Offset _maxHeapSize;
+  CorruptionSkipper<Offset>& _corruptionSkipper;
+  ArenaChunks<Offset> _arenaChunks;
+  bool _corruptionReported;
+
+  void WalkRunsAndHeaps() {
+    std::vector<Region> regions;
+    for (const auto& runStartAndSize :
+         _infrastructureFinder.GetMainArenaRuns()) {
+      regions.emplace_back(runStartAndSize.first, runStartAndSize.second,
+                           (const Heap*)(0));
+    }
+    size_t numMainArenaRuns = regions.size();
+    for (const auto& heapAddressAndHeap : _infrastructureFinder.GetHeaps()) {
+      const Heap& heap = heapAddressAndHeap.second;
+      regions.emplace_back(heap._address, heap._size, &heap);
+    }
+
+    Parallel::VisitChunks(regions.size(), [this, &regions](size_t i) {
+      Region& region = regions[i];
+      std::ostringstream errors;
+      try {
+        if (region._heap == (const Heap*)(0)) {
+          WalkMainArenaRun(region._base, region._size, region._chunks,
+                           errors);
+        } else {
+          WalkHeap(*(region._heap), region._chunks, errors);
+        }
+      } catch (typename VirtualAddressMap<Offset>::NotMapped& e) {
+        errors << "The walk of the " << ((region._heap == (const Heap*)(0))
+                                             ? "main arena run"
+                                             : "heap")
+               << " at 0x" << std::hex << region._base
+               << " stopped at unmapped address 0x" << e._address << ".\n";
+      }
+      region._errors = errors.str();
+    });
+
+    /*
+     * The main arena runs are in increasing order, as are the heaps, and
+     * none of them overlap, so the buffers are already in order.
+     */
+    ChunkVectors& mainArenaChunks = _arenaChunks.GetMainArenaChunks();
+    ChunkVectors& heapChunks = _arenaChunks.GetHeapChunks();
+    for (size_t i = 0; i < regions.size(); i++) {
+      Region& region = regions[i];
+      if (!region._errors.empty()) {
+        _corruptionReported = true;
+        std::cerr << region._errors;
+      }
+      if (!region._chunks.empty()) {
+        ((i < numMainArenaRuns) ? mainArenaChunks : heapChunks)
+            .push_back(std::move(region._chunks));
+      }
+    }
+  }
+
+  void CheckArenas(FastBinFreeStatusFixer<Offset>& fastBinFreeStatusFixer,
+                   DoublyLinkedListCorruptionChecker<Offset>&
+                       doublyLinkedListCorruptionChecker) {
+    /*
+     * The main arena is checked first, followed by the others in order of
+     * address.
+     */
+    std::vector<const Arena*> arenas;
+    typename InfrastructureFinder<Offset>::ArenaMap::const_iterator itMain =
+        _arenas.find(_mainArenaAddress);
+    if (itMain != _arenas.end()) {
+      arenas.push_back(&(itMain->second));
+    }
+    for (const auto& addressAndArena : _arenas) {
+      if (addressAndArena.first != _mainArenaAddress) {
+        arenas.push_back(&(addressAndArena.second));
+      }
+    }
+    std::vector<std::string> errors(arenas.size());
+    Parallel::VisitChunks(arenas.size(), [&](size_t i) {
+      std::ostringstream arenaErrors;
+      fastBinFreeStatusFixer.MarkFastBinItemsAsFree(*(arenas[i]),
+                                                    _arenaChunks, arenaErrors);
+      doublyLinkedListCorruptionChecker.CheckDoublyLinkedListCorruption(
+          *(arenas[i]), _arenaChunks, arenaErrors);
+      errors[i] = arenaErrors.str();
+    });
+    for (const std::string& arenaErrors : errors) {
+      if (!arenaErrors.empty()) {
+        _corruptionReported = true;
+        std::cerr << arenaErrors;
+      }
+    }
+  }
+
+  void WalkMainArenaRun(Offset base, Offset size, ChunkVector& chunks,
+                        std::ostream& errors) {
+    Reader reader(_addressMap);
+    Offset limit = base + size;
+    Offset sizeAndFlags = reader.ReadOffset(base + sizeof(Offset));
+    Offset chunkSize = 0;
+    Offset prevCheck = base;
+    Offset check = base;
+    while (check < limit) {
+      if ((sizeAndFlags & (sizeof(Offset) | 6)) != 0) {
+        check = HandleMainArenaCorruption(prevCheck, limit, errors);
+        if (check != 0) {
+          chunkSize = 0;
+          prevCheck = check;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset));
+          continue;
+        }
+        break;
+      }
+      chunkSize = sizeAndFlags & ~7;
+
+      if ((chunkSize == 0) || (chunkSize > (limit - check))) {
+        check = HandleMainArenaCorruption(prevCheck, limit, errors);
+        if (check != 0) {
+          chunkSize = 0;
+          prevCheck = check;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset));
+          continue;
+        }
+        break;
+      }
+      Offset allocationSize = chunkSize - sizeof(Offset);
+      bool isUsed = false;
+      if (check + chunkSize == limit) {
+        allocationSize -= sizeof(Offset);
+      } else {
+        sizeAndFlags = reader.ReadOffset(check + sizeof(Offset) + chunkSize);
+        isUsed = ((sizeAndFlags & 1) != 0);
+      }
+      chunks.emplace_back(check + 2 * sizeof(Offset), allocationSize, isUsed);
+      prevCheck = check;
+      check += chunkSize;
+    }
+  }
+
+  void WalkHeap(const Heap& heap, ChunkVector& chunks, std::ostream& errors) {
+    Reader reader(_addressMap);
+    Offset base = heap._address;
+    Offset size = heap._size;
+    const char* heapImage;
+    Offset numBytesFound = _addressMap.FindMappedMemoryImage(base, &heapImage);
+    if (numBytesFound < size) {
+      errors << "Heap at 0x" << std::hex << base
+             << " is not fully mapped in the core.\n";
+      size = numBytesFound;
+    }
+    Offset limit = base + size;
+
+    if ((heap._arenaAddress & ~(_maxHeapSize - 1)) == base) {
+      base += 4 * sizeof(Offset) + _arenaStructSize;
+    } else {
+      base += 4 * sizeof(Offset);
+    }
+
+    typename InfrastructureFinder<Offset>::ArenaMap::const_iterator itArena =
+        _arenas.find(heap._arenaAddress);
+    if (itArena == _arenas.end()) {
+      abort();
+    }
+    Offset top = itArena->second._top;
+
+    Offset sizeAndFlags = reader.ReadOffset(base + sizeof(Offset));
+    Offset chunkSize = 0;
+    Offset prevCheck = base;
+    Offset check = base;
+    Offset checkLimit = limit - 4 * sizeof(Offset);
+    while (check < checkLimit) {
+      if (((sizeAndFlags & 2) != 0) ||
+          ((sizeof(Offset) == 8) && ((sizeAndFlags & sizeof(Offset)) != 0))) {
+        check = HandleNonMainArenaCorruption(heap, prevCheck, errors);
+        if (check != 0) {
+          chunkSize = 0;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset), 0xbadbad);
+          if (sizeAndFlags != 0xbadbad) {
+            prevCheck = check;
+            continue;
+          }
+        }
+        return;
+      }
+      chunkSize = sizeAndFlags & ~7;
+      if ((chunkSize == 0) || (chunkSize >= 0x10000000) ||
+          (chunkSize > (limit - check))) {
+        check = HandleNonMainArenaCorruption(heap, prevCheck, errors);
+        if (check != 0) {
+          chunkSize = 0;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset), 0xbadbad);
+          if (sizeAndFlags != 0xbadbad) {
+            prevCheck = check;
+            continue;
+          }
+        }
+        return;
+      }
+      Offset allocationSize = chunkSize - sizeof(Offset);
+      bool isFree = true;
+      if (check + chunkSize == limit) {
+        allocationSize -= sizeof(Offset);
+      } else {
+        sizeAndFlags =
+            reader.ReadOffset(check + sizeof(Offset) + chunkSize, 0xbadbad);
+        if (sizeAndFlags == 0xbadbad) {
+          return;
+        }
+        isFree = ((sizeAndFlags & 1) == 0) ||
+                 (allocationSize < 3 * sizeof(Offset));
+      }
+      if ((check + allocationSize + 3 * sizeof(Offset) == limit) &&
+          ((sizeAndFlags & ~7) == 0)) {
+        return;
+      }
+      if (isFree && check == top) {
+        /*
+         * If the entry is the top value for an arena, we want the size of the
+         * allocation to include any writable bytes in the heap that follow
+         * the top allocation so that the results of "count free" reflect
+         * the bytes that are actually available for allocation.  Otherwise,
+         * if the end of the top allocation has shifted to a lower address
+         * without a corresponding shift in the end of the writable region for
+         * the heap, the total free count will be misleading.
+         */
+        typename VirtualAddressMap<Offset>::const_iterator itMap =
+            _addressMap.find(top);
+        Offset endWritableInHeap = itMap.Limit();
+        Offset endHeapRange = base + _maxHeapSize;
+        if (endWritableInHeap > endHeapRange) {
+          endWritableInHeap = endHeapRange;
+        }
+        allocationSize = endWritableInHeap - (check + 2 * sizeof(Offset));
+      }
+      chunks.emplace_back(check + 2 * sizeof(Offset), allocationSize, !isFree);
+      prevCheck = check;
+      check += chunkSize;
+    }
+  }
+
+  Offset HandleMainArenaCorruption(Offset corruptionPoint, Offset limit,
+                                   std::ostream& errors) {
+    errors << "Corruption was found in main arena run near 0x" << std::hex
+           << corruptionPoint << "\n";
+    errors << "The main arena is at 0x" << std::hex << _mainArenaAddress
+           << "\n";
+    return _corruptionSkipper.SkipArenaCorruption(_mainArenaAddress,
+                                                  corruptionPoint, limit);
+  }
+
+  Offset HandleNonMainArenaCorruption(const Heap& heap, Offset corruptionPoint,
+                                      std::ostream& errors) {
+    errors << "Corruption was found in non-main arena run near 0x" << std::hex
+           << corruptionPoint << "\n";
+    Offset arenaAddress = heap._arenaAddress;
+    Offset heapAddress = heap._address;
+    errors << "Corrupt heap is at 0x" << std::hex << heapAddress << "\n";
+    errors << "Corrupt arena is at 0x" << std::hex << arenaAddress << "\n";
+    Offset heapLimit = heapAddress + heap._size;
+    return _corruptionSkipper.SkipArenaCorruption(arenaAddress, corruptionPoint,
+                                                  heapLimit);
+  }
+};
+
+}  // namespace LibcMalloc
+}  // namespace chap
@@ -3,8 +3,9 @@
 
 #pragma once
 
-#include "../Allocations/Directory.h"
+#include <ostream>
 #include "../VirtualAddressMap.h"
+#include "ArenaChunks.h"
 #include "InfrastructureFinder.h"
 
 namespace chap {
@@ -14,26 +15,30 @@ class DoublyLinkedListCorruptionChecker {
  public:
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
 
+  typedef typename ArenaChunks<Offset>::Chunk Chunk;
+
   DoublyLinkedListCorruptionChecker(
       const VirtualAddressMap<Offset>& addressMap,
-      const InfrastructureFinder<Offset>& infrastructureFinder,
-      const Allocations::Directory<Offset>& allocationDirectory)
+      const InfrastructureFinder<Offset>& infrastructureFinder)
       : _addressMap(addressMap),
         _infrastructureFinder(infrastructureFinder),
         _arenaDoublyLinkedFreeListOffset(
             infrastructureFinder.GetArenaDoublyLinkedFreeListOffset()),
         _arenaLastDoublyLinkedFreeListOffset(
-            infrastructureFinder.GetArenaLastDoublyLinkedFreeListOffset()),
-        _allocationDirectory(allocationDirectory) {}
+            infrastructureFinder.GetArenaLastDoublyLinkedFreeListOffset()) {}
 
+  /*
+   * Check the doubly linked free lists for the given arena, reporting any
+   * corruption to the given stream.  This doesn't change anything, so it
+   * can be called for different arenas at the same time.
+   */
   void CheckDoublyLinkedListCorruption(
-      const typename InfrastructureFinder<Offset>::Arena& arena) {
+      const typename InfrastructureFinder<Offset>::Arena& arena,
+      ArenaChunks<Offset>& arenaChunks, std::ostream& errors) {
     if (arena._missingOrUnfilledHeader) {
       return;
     }
     bool corruptionReported = false;
-    typename Allocations::Directory<Offset>::AllocationIndex noAllocation =
-        _allocationDirectory.NumAllocations();
     typename VirtualAddressMap<Offset>::Reader reader(_addressMap);
     Offset arenaAddress = arena._address;
     Offset firstList =
@@ -49,58 +54,58 @@ class DoublyLinkedListCorruptionChecker {
           if (lastNode != list) {
             ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), lastNode,
                                      "at end of list with empty start",
-                                     corruptionReported);
+                                     corruptionReported, errors);
           }
         } else {
           if (lastNode == list) {
             ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), lastNode,
                                      "at start of list with empty end",
-                                     corruptionReported);
+                                     corruptionReported, errors);
           } else {
             Offset prevNode = list;
             for (Offset node = firstNode; node != list;
                  node = reader.ReadOffset(node + 2 * sizeof(Offset))) {
               Offset allocationAddr = node + 2 * sizeof(Offset);
-              typename Allocations::Directory<Offset>::AllocationIndex index =
-                  _allocationDirectory.AllocationIndexOf(allocationAddr);
-              if (index == noAllocation) {
+              const Chunk* allocation =
+                  arenaChunks.ChunkContaining(allocationAddr);
+              if (allocation == (const Chunk*)(0)) {
                 ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), node,
                                          "not matching an allocation",
-                                         corruptionReported);
+                                         corruptionReported, errors);
                 break;
               }
-              const typename Allocations::Directory<Offset>::Allocation*
-                  allocation = _allocationDirectory.AllocationAt(index);
-              if (allocation->Address() != allocationAddr) {
+              if (allocation->_address != allocationAddr) {
                 if (prevNode == list) {
                   ReportFreeListCorruption(
                       arena, list + 2 * sizeof(Offset), node,
-                      "with wrong offset from allocation", corruptionReported);
+                      "with wrong offset from allocation", corruptionReported,
+                      errors);
                 } else {
                   ReportFreeListCorruption(
                       arena, list + 2 * sizeof(Offset), prevNode,
-                      "with an unexpected forward link", corruptionReported);
+                      "with an unexpected forward link", corruptionReported,
+                      errors);
                 }
                 break;
               }
-              Offset allocationSize = allocation->Size();
+              Offset allocationSize = allocation->_size;
               if ((reader.ReadOffset(allocationAddr + allocationSize) & 1) !=
                   0) {
                 ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), node,
                                          "with a wrong used/free status bit",
-                                         corruptionReported);
+                                         corruptionReported, errors);
                 break;
               }
               if (_infrastructureFinder.ArenaAddressFor(node) != arenaAddress) {
                 ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), node,
                                          "in the wrong arena",
-                                         corruptionReported);
+                                         corruptionReported, errors);
                 break;
               }
               if (reader.ReadOffset(node + 3 * sizeof(Offset)) != prevNode) {
                 ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), node,
                                          "with an unexpected back pointer",
-                                         corruptionReported);
+                                         corruptionReported, errors);
                 break;
               }
               if (reader.ReadOffset(allocationAddr + allocationSize -
@@ -108,7 +113,7 @@ class DoublyLinkedListCorruptionChecker {
                   allocationSize + sizeof(Offset)) {
                 ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), node,
                                          "with a wrong prev size at end",
-                                         corruptionReported);
+                                         corruptionReported, errors);
                 break;
               }
               prevNode = node;
@@ -117,7 +122,7 @@ class DoublyLinkedListCorruptionChecker {
         }
       } catch (const typename VirtualAddressMap<Offset>::NotMapped& e) {
         ReportFreeListCorruption(arena, list + 2 * sizeof(Offset), e._address,
-                                 "not in the core", corruptionReported);
+                                 "not in the core", corruptionReported, errors);
       }
     }
   }
@@ -127,18 +132,17 @@ class DoublyLinkedListCorruptionChecker {
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const Offset _arenaDoublyLinkedFreeListOffset;
   const Offset _arenaLastDoublyLinkedFreeListOffset;
-  const Allocations::Directory<Offset>& _allocationDirectory;
   void ReportFreeListCorruption(
       const typename InfrastructureFinder<Offset>::Arena& arena,
       Offset freeListHeader, Offset node, const char* specificError,
-      bool& corruptionReported) {
+      bool& corruptionReported, std::ostream& errors) {
     if (!corruptionReported) {
       corruptionReported = true;
-      std::cerr << "Doubly linked free list corruption was "
-                   "found for the arena"
-                   " at 0x"
-                << std::hex << arena._address << "\n";
-      std::cerr << "  Leak analysis may not be accurate.\n";
+      errors << "Doubly linked free list corruption was "
+                "found for the arena"
+                " at 0x"
+             << std::hex << arena._address << "\n";
+      errors << "  Leak analysis may not be accurate.\n";
       /*
        * Unlike the fast bin case, the chunks on the doubly linked free
        * lists are actually marked as free, so a cut in a doubly linked
@@ -146,8 +150,8 @@ class DoublyLinkedListCorruptionChecker {
        * nodes on the list are free or not.
        */
     }
-    std::cerr << "  The free list headed at 0x" << std::hex << freeListHeader
-              << " has a node\n  0x" << node << " " << specificError << ".\n";
+    errors << "  The free list headed at 0x" << std::hex << freeListHeader
+           << " has a node\n  0x" << node << " " << specificError << ".\n";
   }
 };
 
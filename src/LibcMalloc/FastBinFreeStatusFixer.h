@@ -3,8 +3,9 @@
 
 #pragma once
 
-#include "../Allocations/Directory.h"
+#include <ostream>
 #include "../VirtualAddressMap.h"
+#include "ArenaChunks.h"
 #include "InfrastructureFinder.h"
 
 namespace chap {
@@ -14,18 +15,28 @@ class FastBinFreeStatusFixer {
  public:
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
 
+  typedef typename ArenaChunks<Offset>::Chunk Chunk;
+
   FastBinFreeStatusFixer(
       const VirtualAddressMap<Offset>& addressMap,
-      const InfrastructureFinder<Offset>& infrastructureFinder,
-      Allocations::Directory<Offset>& allocationDirectory)
+      const InfrastructureFinder<Offset>& infrastructureFinder)
       : _addressMap(addressMap),
         _infrastructureFinder(infrastructureFinder),
         _fastBinStartOffset(infrastructureFinder.GetFastBinStartOffset()),
-        _fastBinLimitOffset(infrastructureFinder.GetFastBinLimitOffset()),
-        _allocationDirectory(allocationDirectory) {}
+        _fastBinLimitOffset(infrastructureFinder.GetFastBinLimitOffset()) {}
 
+  /*
+   * Mark as free any allocations on the fast bin lists for the given arena,
+   * reporting any corruption to the given stream.  This changes only
+   * allocations that belong to the given arena, so it can be called for
+   * different arenas at the same time.  Starting with glibc 2.32 the link
+   * in each node is mangled by an exclusive or with the address of the link
+   * shifted right by 12 bits, so each list is checked to see which form it
+   * uses.
+   */
   void MarkFastBinItemsAsFree(
-      const typename InfrastructureFinder<Offset>::Arena& arena) {
+      const typename InfrastructureFinder<Offset>::Arena& arena,
+      ArenaChunks<Offset>& arenaChunks, std::ostream& errors) {
     bool corruptionReported = false;
     Offset arenaAddress = arena._address;
     Offset fastBinLimit = arenaAddress + _fastBinLimitOffset;
@@ -33,17 +44,18 @@ class FastBinFreeStatusFixer {
     for (Offset fastBinCheck = arenaAddress + _fastBinStartOffset;
          fastBinCheck < fastBinLimit; fastBinCheck += sizeof(Offset)) {
       try {
-        for (Offset nextNode = reader.ReadOffset(fastBinCheck); nextNode != 0;
-             nextNode = reader.ReadOffset(nextNode + sizeof(Offset) * 2)) {
+        Offset nextNode = reader.ReadOffset(fastBinCheck);
+        bool mangled = IsMangled(reader, nextNode, arenaChunks);
+        for (; nextNode != 0;
+             nextNode = Unmangle(
+                 reader.ReadOffset(nextNode + sizeof(Offset) * 2),
+                 nextNode + sizeof(Offset) * 2, mangled)) {
           Offset allocation = nextNode + sizeof(Offset) * 2;
-          typename Allocations::Directory<Offset>::AllocationIndex index =
-              _allocationDirectory.AllocationIndexOf(allocation);
-          if (index == _allocationDirectory.NumAllocations() ||
-              _allocationDirectory.AllocationAt(index)->Address() !=
-                  allocation) {
+          Chunk* chunk = arenaChunks.ChunkContaining(allocation);
+          if (chunk == (Chunk*)(0) || chunk->_address != allocation) {
             ReportFastBinCorruption(arena, fastBinCheck, nextNode,
                                     "not matching an allocation",
-                                    corruptionReported);
+                                    corruptionReported, errors);
             // It is not possible to process the rest of this
             // fast bin list because there is a break in the
             // chain.
@@ -58,7 +70,8 @@ class FastBinFreeStatusFixer {
           }
           if (_infrastructureFinder.ArenaAddressFor(nextNode) != arenaAddress) {
             ReportFastBinCorruption(arena, fastBinCheck, nextNode,
-                                    "in the wrong arena", corruptionReported);
+                                    "in the wrong arena", corruptionReported,
+                                    errors);
             // It is not possible to process the rest of this
             // fast bin list because there is a break in the
             // chain.
@@ -71,7 +84,7 @@ class FastBinFreeStatusFixer {
             // particular fast bin list.
             break;
           }
-          _allocationDirectory.MarkAsFree(index);
+          chunk->_isUsed = false;
         }
       } catch (typename VirtualAddressMap<Offset>::NotMapped& e) {
         // It is not possible to process the rest of this
@@ -85,12 +98,12 @@ class FastBinFreeStatusFixer {
         // will be wrong for remaining entries on that
         // particular fast bin list.
         if (e._address == fastBinCheck) {
-          std::cerr << "The arena header at 0x" << std::hex << arenaAddress
-                    << " is not in the core.\n";
+          errors << "The arena header at 0x" << std::hex << arenaAddress
+                 << " is not in the core.\n";
           return;
         }
         ReportFastBinCorruption(arena, fastBinCheck, e._address,
-                                "not in the core", corruptionReported);
+                                "not in the core", corruptionReported, errors);
       }
     }
   }
@@ -100,22 +113,55 @@ class FastBinFreeStatusFixer {
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const Offset _fastBinStartOffset;
   const Offset _fastBinLimitOffset;
-  Allocations::Directory<Offset>& _allocationDirectory;
+
+  static Offset Unmangle(Offset link, Offset linkAddress, bool mangled) {
+    return mangled ? (link ^ (linkAddress >> 12)) : link;
+  }
+
+  /*
+   * Return true if the link in the given first node of a fast bin list
+   * makes sense only if it is mangled, either because it is the mangled
+   * form of the null link at the end of a list or because only the
+   * unmangled value refers to an allocation.
+   */
+  bool IsMangled(Reader& reader, Offset firstNode,
+                 ArenaChunks<Offset>& arenaChunks) {
+    if (firstNode == 0) {
+      return false;
+    }
+    Offset linkAddress = firstNode + sizeof(Offset) * 2;
+    Offset link = reader.ReadOffset(linkAddress, 0);
+    if (link == 0) {
+      return false;
+    }
+    Offset unmangled = Unmangle(link, linkAddress, true);
+    if (unmangled == 0) {
+      return true;
+    }
+    Chunk* chunk = arenaChunks.ChunkContaining(link + sizeof(Offset) * 2);
+    if (chunk != (Chunk*)(0) && chunk->_address == link + sizeof(Offset) * 2) {
+      return false;
+    }
+    chunk = arenaChunks.ChunkContaining(unmangled + sizeof(Offset) * 2);
+    return chunk != (Chunk*)(0) &&
+           chunk->_address == unmangled + sizeof(Offset) * 2;
+  }
+
   void ReportFastBinCorruption(
       const typename InfrastructureFinder<Offset>::Arena& arena,
       Offset fastBinHeader, Offset node, const char* specificError,
-      bool& corruptionReported) {
+      bool& corruptionReported, std::ostream& errors) {
     if (!corruptionReported) {
       corruptionReported = true;
-      std::cerr << "Fast bin corruption was found for the arena"
-                   " at 0x"
-                << std::hex << arena._address << "\n";
-      std::cerr << "  Leak analysis will not be accurate.\n";
-      std::cerr << "  Used/free analysis will not be accurate "
-                   "for the arena.\n";
+      errors << "Fast bin corruption was found for the arena"
+                " at 0x"
+             << std::hex << arena._address << "\n";
+      errors << "  Leak analysis will not be accurate.\n";
+      errors << "  Used/free analysis will not be accurate "
+                "for the arena.\n";
     }
-    std::cerr << "  The fast bin list headed at 0x" << std::hex << fastBinHeader
-              << " has a node\n  0x" << node << " " << specificError << ".\n";
+    errors << "  The fast bin list headed at 0x" << std::hex << fastBinHeader
+           << " has a node\n  0x" << node << " " << specificError << ".\n";
   }
 };
 
@@ -2,12 +2,15 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <utility>
 #include "../Allocations/Directory.h"
 #include "../CompoundDescriber.h"
 #include "../ModuleDirectory.h"
+#include "../ThreadMap.h"
 #include "../UnfilledImages.h"
 #include "../VirtualAddressMap.h"
 #include "../VirtualMemoryPartition.h"
+#include "ArenaWalker.h"
 #include "CorruptionSkipper.h"
 #include "DoublyLinkedListCorruptionChecker.h"
 #include "FastBinFreeStatusFixer.h"
@@ -18,7 +21,7 @@
 #include "MainArenaRunDescriber.h"
 #include "MmappedAllocationDescriber.h"
 #include "MmappedAllocationFinder.h"
-// ??? logic for detecting thread cacheing
+#include "ThreadCacheFinder.h"
 
 namespace chap {
 namespace LibcMalloc {
@@ -33,7 +36,8 @@ class FinderGroup {
   FinderGroup(VirtualMemoryPartition<Offset>& virtualMemoryPartition,
               const ModuleDirectory<Offset>& moduleDirectory,
               Allocations::Directory<Offset>& allocationDirectory,
-              UnfilledImages<Offset>& unfilledImages)
+              UnfilledImages<Offset>& unfilledImages,
+              const ThreadMap<Offset>& threadMap)
       : _virtualMemoryPartition(virtualMemoryPartition),
         _virtualAddressMap(virtualMemoryPartition.GetAddressMap()),
         _moduleDirectory(moduleDirectory),
@@ -42,23 +46,39 @@ class FinderGroup {
         _infrastructureFinder(virtualMemoryPartition, moduleDirectory,
                               unfilledImages),
         _corruptionSkipper(_virtualAddressMap, _infrastructureFinder),
-        _fastBinFreeStatusFixer(_virtualAddressMap, _infrastructureFinder,
-                                allocationDirectory),
-        _doublyLinkedListCorruptionChecker(
-            _virtualAddressMap, _infrastructureFinder, allocationDirectory) {
+        _fastBinFreeStatusFixer(_virtualAddressMap, _infrastructureFinder),
+        _doublyLinkedListCorruptionChecker(_virtualAddressMap,
+                                           _infrastructureFinder),
+        _threadCacheFinder(_virtualAddressMap, _infrastructureFinder,
+                           threadMap),
+        _corruptionReported(false) {
     if (!(_infrastructureFinder.GetArenas().empty())) {
       // Add the finders that depend on arenas.
 
-      _mainArenaAllocationFinder.reset(new MainArenaAllocationFinder<Offset>(
+      /*
+       * The walker is needed only to find the allocations and check the
+       * free lists.  The finders take over the buffers of allocations, so
+       * only the corruption status outlives it.
+       */
+      ArenaWalker<Offset> arenaWalker(
           _virtualAddressMap, _infrastructureFinder, _corruptionSkipper,
-          _fastBinFreeStatusFixer, _doublyLinkedListCorruptionChecker));
+          _fastBinFreeStatusFixer, _doublyLinkedListCorruptionChecker);
+      _corruptionReported = arenaWalker.CorruptionReported();
+      _mainArenaAllocationFinder.reset(new MainArenaAllocationFinder<Offset>(
+          std::move(arenaWalker.GetMainArenaChunks())));
       _allocationDirectory.AddFinder(_mainArenaAllocationFinder.get());
       if (!(_infrastructureFinder.GetHeaps().empty())) {
         _heapAllocationFinder.reset(new HeapAllocationFinder<Offset>(
-            _virtualAddressMap, _infrastructureFinder, _corruptionSkipper,
-            _fastBinFreeStatusFixer, _doublyLinkedListCorruptionChecker));
+            std::move(arenaWalker.GetHeapChunks())));
         _allocationDirectory.AddFinder(_heapAllocationFinder.get());
       }
+      /*
+       * Allocations on the tcache bins can be recognized only after all
+       * the allocations are known.
+       */
+      _allocationDirectory.AddResolutionDoneCallback([this]() {
+        _threadCacheFinder.Resolve(_allocationDirectory);
+      });
     }
     /*
      * Finding mmapped() allocations used for libc does not depend
@@ -77,6 +97,12 @@ class FinderGroup {
     return _infrastructureFinder;
   }
 
+  const ThreadCacheFinder<Offset>& GetThreadCacheFinder() const {
+    return _threadCacheFinder;
+  }
+
+  bool CorruptionReported() const { return _corruptionReported; }
+
   void AddDescribers(CompoundDescriber<Offset>& compoundDescriber) {
     _heapDescriber.reset(
         new HeapDescriber<Offset>(_infrastructureFinder, _virtualAddressMap));
@@ -99,6 +125,8 @@ class FinderGroup {
   CorruptionSkipper<Offset> _corruptionSkipper;
   FastBinFreeStatusFixer<Offset> _fastBinFreeStatusFixer;
   DoublyLinkedListCorruptionChecker<Offset> _doublyLinkedListCorruptionChecker;
+  ThreadCacheFinder<Offset> _threadCacheFinder;
+  bool _corruptionReported;
   std::unique_ptr<MmappedAllocationFinder<Offset> > _mmappedAllocationFinder;
   std::unique_ptr<HeapAllocationFinder<Offset> > _heapAllocationFinder;
   std::unique_ptr<MainArenaAllocationFinder<Offset> >
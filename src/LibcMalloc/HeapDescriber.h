@@ -134,6 +134,17 @@ class HeapDescriber : public Describer<Offset> {
     return true;
   }
 
+  /*
+   * Any address in the range reserved for a heap, including the tail, can
+   * be described.
+   */
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const auto &heapStartAndHeap : _heaps) {
+      visitor(heapStartAndHeap.first, heapStartAndHeap.first + _maxHeapSize);
+    }
+    return true;
+  }
+
  protected:
   const VirtualAddressMap<Offset> &_addressMap;
   Offset _maxHeapSize;
@@ -76,6 +76,14 @@ class MainArenaRunDescriber : public Describer<Offset> {
     return true;
   }
 
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const auto &runStartAndSize : _mainArenaRuns) {
+      visitor(runStartAndSize.first,
+              runStartAndSize.first + runStartAndSize.second);
+    }
+    return true;
+  }
+
  private:
   const typename InfrastructureFinder<Offset>::MainArenaRuns &_mainArenaRuns;
 };
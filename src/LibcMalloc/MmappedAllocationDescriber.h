@@ -76,6 +76,14 @@ class MmappedAllocationDescriber : public Describer<Offset> {
     return true;
   }
 
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const auto& chunkStartAndSize : _mmappedChunks) {
+      visitor(chunkStartAndSize.first,
+              chunkStartAndSize.first + chunkStartAndSize.second);
+    }
+    return true;
+  }
+
  private:
   const std::map<Offset, Offset>& _mmappedChunks;
 };
@@ -9,48 +9,33 @@ namespace LibcMalloc {
 template <class Offset>
 class MmappedAllocationFinder : public Allocations::Directory<Offset>::Finder {
  public:
+  typedef typename Allocations::Directory<Offset>::Record Record;
+
   MmappedAllocationFinder(
       VirtualMemoryPartition<Offset>& virtualMemoryPartition)
       : LIBC_MALLOC_MMAPPED_ALLOCATION("libc malloc mmapped allocation"),
         _virtualMemoryPartition(virtualMemoryPartition),
-        _addressMap(virtualMemoryPartition.GetAddressMap()) {
+        _addressMap(virtualMemoryPartition.GetAddressMap()),
+        _reported(false) {
     ScanForMmappedChunks();
-    _itNext = _mmappedChunks.begin();
+    _records.reserve(_mmappedChunks.size());
+    for (const auto& startAndSize : _mmappedChunks) {
+      _records.emplace_back(startAndSize.first + 2 * sizeof(Offset),
+                            startAndSize.second - 2 * sizeof(Offset), true);
+    }
   }
 
   /*
-   * Return true if there are no more allocations available.
-   */
-  virtual bool Finished() { return _itNext == _mmappedChunks.end(); }
-  /*
-   * Return the address of the next allocation (in increasing order of
-   * address) to be reported by this finder, without advancing to the next
-   * allocation.  The return value is undefined if there are no more
-   * allocations available.  Note that at the time this function is called
-   * any allocations already reported by this allocation finder have already
-   * been assigned allocation indices in the Directory.
-   */
-  virtual Offset NextAddress() { return _itNext->first + 2 * sizeof(Offset); }
-  /*
-   * Return the size of the next allocation (in increasing order of
-   * address) to be reported by this finder, without advancing to the next
-   * allocation.  The return value is undefined if there are no more
-   * allocations available.
-   */
-  virtual Offset NextSize() { return _itNext->second - 2 * sizeof(Offset); }
-  /*
-   * Return true if the next allocation (in increasing order of address) to
-   * address) to be reported by this finder is considered used, without
-   * advancing to the next allocation.
-   */
-  virtual bool NextIsUsed() { return true; }
-  /*
-   * Advance to the next allocation.
+   * Return all the allocations as a single block.
    */
-  virtual void Advance() {
-    if (_itNext != _mmappedChunks.end()) {
-      ++_itNext;
+  virtual const Record* NextBlock(size_t& numRecords) {
+    if (_reported || _records.empty()) {
+      numRecords = 0;
+      return (const Record*)(0);
     }
+    _reported = true;
+    numRecords = _records.size();
+    return _records.data();
   }
   /*
    * Return the smallest request size that might reasonably have resulted
@@ -67,7 +52,8 @@ class MmappedAllocationFinder : public Allocations::Directory<Offset>::Finder {
   VirtualMemoryPartition<Offset>& _virtualMemoryPartition;
   const VirtualAddressMap<Offset>& _addressMap;
   std::map<Offset, Offset> _mmappedChunks;  // start -> size
-  typename std::map<Offset, Offset>::const_iterator _itNext;
+  std::vector<Record> _records;
+  bool _reported;
 
   void ScanForMmappedChunksInRange(Offset base, Offset limit) {
     typename VirtualAddressMap<Offset>::Reader reader(_addressMap);
@@ -67,7 +67,7 @@ class DescribeArenas : public Commands::Subcommand {
         _directory.NumAllocations();
     for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
          i < numAllocations; ++i) {
-      const typename Allocations::Directory<Offset>::Allocation* allocation =
+      typename Allocations::Directory<Offset>::AllocationPointer allocation =
           _directory.AllocationAt(i);
       Offset arenaAddress =
           _infrastructureFinder.ArenaAddressFor(allocation->Address());
@@ -0,0 +1,51 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../ThreadCacheFinder.h"
+namespace chap {
+namespace LibcMalloc {
+namespace Subcommands {
+template <class Offset>
+class DescribeThreadCaches : public Commands::Subcommand {
+ public:
+  DescribeThreadCaches(const ThreadCacheFinder<Offset>& threadCacheFinder)
+      : Commands::Subcommand("describe", "tcaches"),
+        _threadCaches(threadCacheFinder.GetThreadCaches()) {}
+
+  void ShowHelpMessage(Commands::Context& context) {
+    context.GetOutput()
+        << "This subcommand describes the per-thread caches (tcache) used by "
+           "libc malloc,\nincluding how many free allocations each one holds "
+           "and how many bytes those\nallocations take.\n";
+  }
+
+  void Run(Commands::Context& context) {
+    Commands::Output& output = context.GetOutput();
+    Offset totalEntries = 0;
+    Offset totalBytes = 0;
+    for (const auto& threadCache : _threadCaches) {
+      output << "Thread cache at 0x" << std::hex << threadCache._address;
+      if (threadCache._hasThread) {
+        output << " for thread " << std::dec << threadCache._threadNum;
+      }
+      output << " holds " << std::dec << threadCache._numEntries
+             << " free allocations taking 0x" << std::hex
+             << threadCache._numBytes << " (" << std::dec
+             << threadCache._numBytes << ") bytes.\n";
+      totalEntries += threadCache._numEntries;
+      totalBytes += threadCache._numBytes;
+    }
+    output << std::dec << _threadCaches.size() << " thread caches hold "
+           << totalEntries << " free allocations taking 0x" << std::hex
+           << totalBytes << " (" << std::dec << totalBytes << ") bytes.\n";
+  }
+
+ private:
+  const typename ThreadCacheFinder<Offset>::ThreadCaches& _threadCaches;
+};
+}  // namespace Subcommands
+}  // namespace LibcMalloc
+}  // namespace chap
@@ -0,0 +1,261 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "../../Allocations/Directory.h"
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../InfrastructureFinder.h"
+namespace chap {
+namespace LibcMalloc {
+namespace Subcommands {
+template <class Offset>
+class SummarizeArenas : public Commands::Subcommand {
+ public:
+  typedef typename Allocations::Directory<Offset> Directory;
+  typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
+
+  SummarizeArenas(const InfrastructureFinder<Offset>& infrastructureFinder,
+                  const Directory& directory)
+      : Commands::Subcommand("summarize", "arenas"),
+        _infrastructureFinder(infrastructureFinder),
+        _directory(directory) {}
+
+  void ShowHelpMessage(Commands::Context& context) {
+    context.GetOutput()
+        << "This subcommand summarizes, for each main arena run and each "
+           "heap used by a\nnon-main arena, how the memory is split between "
+           "used and free allocations,\nhow large the top chunk and the "
+           "largest run of free allocations are, how\nmany bytes follow the "
+           "last used allocation and how many bytes of free\nallocations are "
+           "in whole pages, which is what malloc_trim() can give back.\nIt "
+           "also reports the free bytes in heaps that cannot shrink because "
+           "the last\npage of the heap holds a used allocation.\n";
+  }
+
+  void Run(Commands::Context& context) {
+    std::vector<Region> regions;
+    GatherRegions(regions);
+    TallyAllocations(regions);
+    Commands::Output& output = context.GetOutput();
+    Offset numPinnedHeaps = 0;
+    Offset pinnedBytes = 0;
+    Offset wholePageBytes = 0;
+    for (const auto& addressAndArena : _infrastructureFinder.GetArenas()) {
+      Offset arenaAddress = addressAndArena.first;
+      const typename InfrastructureFinder<Offset>::Arena& arena =
+          addressAndArena.second;
+      Region arenaTotal(0, 0, arenaAddress, false);
+      output << "Arena at 0x" << std::hex << arenaAddress;
+      if (arenaAddress == _infrastructureFinder.GetMainArenaAddress()) {
+        output << " (main arena)";
+      }
+      output << " has \"top\" address 0x" << arena._top << ".\n";
+      for (const auto& region : regions) {
+        if (region._arenaAddress != arenaAddress) {
+          continue;
+        }
+        ShowRegion(output, region);
+        arenaTotal.Add(region);
+        if (region._isHeap && region._isPinned) {
+          numPinnedHeaps++;
+          pinnedBytes += region._freeBytes;
+        }
+      }
+      output << "In total for the arena, " << std::dec
+             << arenaTotal._usedCount << " used allocations take 0x"
+             << std::hex << arenaTotal._usedBytes << " (" << std::dec
+             << arenaTotal._usedBytes << ") bytes and " << arenaTotal._freeCount
+             << " free allocations take 0x" << std::hex
+             << arenaTotal._freeBytes << " (" << std::dec
+             << arenaTotal._freeBytes << ") bytes.\n\n";
+      wholePageBytes += arenaTotal._wholePageBytes;
+    }
+    output << std::dec << numPinnedHeaps
+           << " heaps cannot shrink because the last page holds a used "
+              "allocation, leaving 0x"
+           << std::hex << pinnedBytes << " (" << std::dec << pinnedBytes
+           << ") free bytes in place.\n"
+           << "malloc_trim() could give back at most 0x" << std::hex
+           << wholePageBytes << " (" << std::dec << wholePageBytes
+           << ") bytes in whole pages of free allocations.\n";
+  }
+
+ private:
+  static constexpr Offset PAGE_SIZE = 0x1000;
+  struct Region {
+    Region(Offset base, Offset limit, Offset arenaAddress, bool isHeap)
+        : _base(base),
+          _limit(limit),
+          _arenaAddress(arenaAddress),
+          _isHeap(isHeap),
+          _isPinned(false),
+          _usedCount(0),
+          _usedBytes(0),
+          _freeCount(0),
+          _freeBytes(0),
+          _topChunk(0),
+          _topBytes(0),
+          _largestFreeRun(0),
+          _afterLastUsed(0),
+          _wholePageBytes(0) {}
+    void Add(const Region& other) {
+      _usedCount += other._usedCount;
+      _usedBytes += other._usedBytes;
+      _freeCount += other._freeCount;
+      _freeBytes += other._freeBytes;
+      _wholePageBytes += other._wholePageBytes;
+    }
+    Offset _base;
+    Offset _limit;
+    Offset _arenaAddress;
+    bool _isHeap;
+    bool _isPinned;  // less than a page follows the last used allocation
+    Offset _usedCount;
+    Offset _usedBytes;
+    Offset _freeCount;
+    Offset _freeBytes;
+    Offset _topChunk;
+    Offset _topBytes;
+    Offset _largestFreeRun;
+    Offset _afterLastUsed;
+    Offset _wholePageBytes;
+  };
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const Directory& _directory;
+
+  void GatherRegions(std::vector<Region>& regions) const {
+    Offset mainArenaAddress = _infrastructureFinder.GetMainArenaAddress();
+    for (const auto& startAndSize : _infrastructureFinder.GetMainArenaRuns()) {
+      regions.emplace_back(startAndSize.first,
+                           startAndSize.first + startAndSize.second,
+                           mainArenaAddress, false);
+    }
+    for (const auto& addressAndHeap : _infrastructureFinder.GetHeaps()) {
+      const typename InfrastructureFinder<Offset>::Heap& heap =
+          addressAndHeap.second;
+      regions.emplace_back(heap._address, heap._address + heap._size,
+                           heap._arenaAddress, true);
+    }
+    std::sort(regions.begin(), regions.end(),
+              [](const Region& left, const Region& right) {
+                return left._base < right._base;
+              });
+  }
+
+  /*
+   * Visit the allocations in increasing order of address, keeping track of
+   * the region that contains each one.
+   */
+  void TallyAllocations(std::vector<Region>& regions) const {
+    const typename InfrastructureFinder<Offset>::ArenaMap& arenas =
+        _infrastructureFinder.GetArenas();
+    typename std::vector<Region>::iterator itRegion = regions.begin();
+    Offset freeRun = 0;
+    Offset freeRunLimit = 0;
+    Offset lastUsedLimit = 0;
+    AllocationIndex numAllocations = _directory.NumAllocations();
+    for (AllocationIndex i = 0; i < numAllocations; i++) {
+      AllocationPointer allocation = _directory.AllocationAt(i);
+      if (allocation->IsWrapped()) {
+        continue;
+      }
+      Offset address = allocation->Address();
+      Offset size = allocation->Size();
+      while (itRegion != regions.end() && address >= itRegion->_limit) {
+        FinishRegion(*itRegion, lastUsedLimit);
+        freeRun = 0;
+        lastUsedLimit = 0;
+        ++itRegion;
+      }
+      if (itRegion == regions.end()) {
+        break;
+      }
+      Region& region = *itRegion;
+      if (address < region._base) {
+        continue;
+      }
+      typename InfrastructureFinder<Offset>::ArenaMapConstIterator itArena =
+          arenas.find(region._arenaAddress);
+      if (itArena != arenas.end() &&
+          address == itArena->second._top + 2 * sizeof(Offset)) {
+        region._topChunk = itArena->second._top;
+        region._topBytes = size;
+      }
+      if (allocation->IsUsed()) {
+        region._usedCount++;
+        region._usedBytes += size;
+        lastUsedLimit = address + size;
+        freeRun = 0;
+      } else {
+        region._freeCount++;
+        region._freeBytes += size;
+        Offset firstPage = (address + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        Offset pagesLimit = (address + size) & ~(PAGE_SIZE - 1);
+        if (pagesLimit > firstPage) {
+          region._wholePageBytes += pagesLimit - firstPage;
+        }
+        if (address > freeRunLimit + sizeof(Offset)) {
+          freeRun = 0;
+        }
+        freeRun += size;
+        freeRunLimit = address + size;
+        if (freeRun > region._largestFreeRun) {
+          region._largestFreeRun = freeRun;
+        }
+      }
+    }
+    for (; itRegion != regions.end(); ++itRegion) {
+      FinishRegion(*itRegion, lastUsedLimit);
+      lastUsedLimit = 0;
+    }
+  }
+
+  /*
+   * A heap can shrink only from its end, so it is pinned if less than a
+   * page follows the last used allocation.
+   */
+  void FinishRegion(Region& region, Offset lastUsedLimit) const {
+    region._afterLastUsed =
+        region._limit - ((lastUsedLimit == 0) ? region._base : lastUsedLimit);
+    region._isPinned = (region._afterLastUsed < PAGE_SIZE);
+  }
+
+  void ShowRegion(Commands::Output& output, const Region& region) const {
+    output << (region._isHeap ? "Heap" : "Main arena run") << " at 0x"
+           << std::hex << region._base << " has size 0x"
+           << (region._limit - region._base) << " (" << std::dec
+           << (region._limit - region._base) << ").\n"
+           << region._usedCount << " used allocations take 0x" << std::hex
+           << region._usedBytes << " (" << std::dec << region._usedBytes
+           << ") bytes.\n"
+           << region._freeCount << " free allocations take 0x" << std::hex
+           << region._freeBytes << " (" << std::dec << region._freeBytes
+           << ") bytes.\n";
+    if (region._topChunk != 0) {
+      output << "The top chunk at 0x" << std::hex << region._topChunk
+             << " takes 0x" << region._topBytes << " (" << std::dec
+             << region._topBytes << ") bytes.\n";
+    }
+    output << "The largest run of free allocations takes 0x" << std::hex
+           << region._largestFreeRun << " (" << std::dec
+           << region._largestFreeRun << ") bytes.\n"
+           << "0x" << std::hex << region._afterLastUsed << " (" << std::dec
+           << region._afterLastUsed
+           << ") bytes follow the last used allocation.\n"
+           << "0x" << std::hex << region._wholePageBytes << " (" << std::dec
+           << region._wholePageBytes
+           << ") bytes of free allocations are in whole pages.\n";
+    if (region._isHeap && region._isPinned) {
+      output << "The heap cannot shrink because the last page holds a used "
+                "allocation.\n";
+    }
+  }
+};
+}  // namespace Subcommands
+}  // namespace LibcMalloc
+}  // namespace chap
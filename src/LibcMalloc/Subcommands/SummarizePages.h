@@ -0,0 +1,268 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../Allocations/Directory.h"
+#include "../../Allocations/SignatureDirectory.h"
+#include "../../Allocations/TagHolder.h"
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../../ProcessImage.h"
+#include "../InfrastructureFinder.h"
+namespace chap {
+namespace LibcMalloc {
+namespace Subcommands {
+template <class Offset>
+class SummarizePages : public Commands::Subcommand {
+ public:
+  typedef typename Allocations::Directory<Offset> Directory;
+  typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
+
+  SummarizePages(const InfrastructureFinder<Offset>& infrastructureFinder,
+                 const ProcessImage<Offset>& processImage)
+      : Commands::Subcommand("summarize", "pages"),
+        _infrastructureFinder(infrastructureFinder),
+        _processImage(processImage),
+        _directory(processImage.GetAllocationDirectory()),
+        _addressMap(processImage.GetVirtualAddressMap()) {}
+
+  void ShowHelpMessage(Commands::Context& context) {
+    context.GetOutput()
+        << "This subcommand shows, for each libc malloc arena, a histogram of "
+           "the 4K pages\nused by the arena according to how many bytes of "
+           "used allocations each page\nholds, and the number of pages that "
+           "hold no used allocations at all.\n"
+           "Use \"/showPages true\" to also get one line per page with the "
+           "page address and\nthe number of used and free bytes on the page, "
+           "in decimal, suitable for\nplotting.\n"
+           "Use \"/bySignature true\" to also see which signatures or patterns "
+           "the used\nallocations have that keep mostly free pages, where at "
+           "most a quarter of the\npage is used, from being given back.\n";
+  }
+
+  void Run(Commands::Context& context) {
+    bool showPages = false;
+    bool bySignature = false;
+    if (!context.ParseBooleanSwitch("showPages", showPages) ||
+        !context.ParseBooleanSwitch("bySignature", bySignature)) {
+      return;
+    }
+    PageTally tally(context.GetOutput(), showPages, bySignature);
+    TallyPages(tally);
+    Commands::Output& output = context.GetOutput();
+    for (const auto& arenaAndHistogram : tally._histograms) {
+      const Histogram& histogram = arenaAndHistogram.second;
+      Offset numPages = 0;
+      for (Offset count : histogram) {
+        numPages += count;
+      }
+      output << "Arena at 0x" << std::hex << arenaAndHistogram.first
+             << " uses " << std::dec << numPages << " pages, of which "
+             << histogram[0] << " hold no used allocations.\n";
+      for (size_t bucket = 1; bucket < NUM_BUCKETS; bucket++) {
+        output << std::dec << histogram[bucket]
+               << " pages hold 0x" << std::hex
+               << ((bucket - 1) * BUCKET_SIZE + 1) << " to 0x"
+               << (bucket * BUCKET_SIZE) << " bytes of used allocations.\n";
+      }
+      output << "\n";
+    }
+    if (bySignature) {
+      ShowPinningNames(output, tally);
+    }
+  }
+
+ private:
+  static constexpr Offset PAGE_SIZE = 0x1000;
+  static constexpr size_t NUM_BUCKETS = 9;
+  static constexpr Offset BUCKET_SIZE = PAGE_SIZE / (NUM_BUCKETS - 1);
+  typedef std::vector<Offset> Histogram;
+
+  /*
+   * This accumulates the used and free bytes for one page at a time, as
+   * the allocations are visited in increasing order of address.
+   */
+  struct PageTally {
+    PageTally(Commands::Output& output, bool showPages, bool bySignature)
+        : _output(output),
+          _showPages(showPages),
+          _bySignature(bySignature),
+          _page(0),
+          _arena(0),
+          _usedBytes(0),
+          _freeBytes(0) {}
+    Commands::Output& _output;
+    bool _showPages;
+    bool _bySignature;
+    Offset _page;
+    Offset _arena;
+    Offset _usedBytes;
+    Offset _freeBytes;
+    std::vector<AllocationIndex> _used;
+    std::map<Offset, Histogram> _histograms;
+    std::map<std::string, std::pair<Offset, Offset> > _pinningNames;
+  };
+
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const ProcessImage<Offset>& _processImage;
+  const Directory& _directory;
+  const VirtualAddressMap<Offset>& _addressMap;
+
+  void TallyPages(PageTally& tally) const {
+    if (tally._showPages) {
+      tally._output << "page usedBytes freeBytes\n";
+    }
+    AllocationIndex numAllocations = _directory.NumAllocations();
+    for (AllocationIndex i = 0; i < numAllocations; i++) {
+      AllocationPointer allocation = _directory.AllocationAt(i);
+      if (allocation->IsWrapped()) {
+        continue;
+      }
+      Offset address = allocation->Address();
+      Offset arena = _infrastructureFinder.ArenaAddressFor(address);
+      if (arena == 0) {
+        continue;
+      }
+      Offset limit = address + allocation->Size();
+      bool isUsed = allocation->IsUsed();
+      Offset page = address & ~(PAGE_SIZE - 1);
+      Offset pageLimit = page + PAGE_SIZE;
+      AddToPage(tally, page, arena, i, isUsed,
+                std::min(limit, pageLimit) - address);
+      if (limit <= pageLimit) {
+        continue;
+      }
+      /*
+       * The pages strictly between the first and the last page touched by
+       * the allocation are entirely covered by it.
+       */
+      Offset lastPage = (limit - 1) & ~(PAGE_SIZE - 1);
+      for (page = pageLimit; page < lastPage; page += PAGE_SIZE) {
+        AddToPage(tally, page, arena, i, isUsed, PAGE_SIZE);
+      }
+      AddToPage(tally, lastPage, arena, i, isUsed, limit - lastPage);
+    }
+    FlushPage(tally);
+  }
+
+  void AddToPage(PageTally& tally, Offset page, Offset arena,
+                 AllocationIndex index, bool isUsed, Offset numBytes) const {
+    if (page != tally._page) {
+      FlushPage(tally);
+      tally._page = page;
+      tally._arena = arena;
+    }
+    if (isUsed) {
+      tally._usedBytes += numBytes;
+      if (tally._bySignature) {
+        tally._used.push_back(index);
+      }
+    } else {
+      tally._freeBytes += numBytes;
+    }
+  }
+
+  void FlushPage(PageTally& tally) const {
+    if (tally._page == 0) {
+      return;
+    }
+    Histogram& histogram = tally._histograms[tally._arena];
+    if (histogram.empty()) {
+      histogram.resize(NUM_BUCKETS, 0);
+    }
+    size_t bucket = (tally._usedBytes == 0)
+                        ? 0
+                        : ((tally._usedBytes - 1) / BUCKET_SIZE + 1);
+    histogram[std::min(bucket, NUM_BUCKETS - 1)]++;
+    if (tally._showPages) {
+      tally._output << "0x" << std::hex << tally._page << " " << std::dec
+                    << tally._usedBytes << " " << tally._freeBytes << "\n";
+    }
+    if (tally._bySignature && tally._usedBytes != 0 &&
+        tally._usedBytes <= PAGE_SIZE / 4) {
+      std::set<std::string> names;
+      for (AllocationIndex index : tally._used) {
+        std::string name = NameFor(index);
+        tally._pinningNames[name].second++;
+        if (names.insert(name).second) {
+          tally._pinningNames[name].first++;
+        }
+      }
+    }
+    tally._page = 0;
+    tally._usedBytes = 0;
+    tally._freeBytes = 0;
+    tally._used.clear();
+  }
+
+  /*
+   * Return the tag name for the allocation if it has one, otherwise the
+   * name or value of the signature, or "?" for an unrecognized allocation.
+   */
+  std::string NameFor(AllocationIndex index) const {
+    const Allocations::TagHolder<Offset>* tagHolder =
+        _processImage.GetAllocationTagHolder();
+    if (tagHolder != nullptr) {
+      const std::string& tagName = tagHolder->GetTagName(index);
+      if (!tagName.empty()) {
+        return tagName;
+      }
+    }
+    AllocationPointer allocation = _directory.AllocationAt(index);
+    const char* image;
+    if (allocation->Size() >= sizeof(Offset) &&
+        _addressMap.FindMappedMemoryImage(allocation->Address(), &image) >=
+            sizeof(Offset)) {
+      Offset signature = *((const Offset*)(image));
+      const Allocations::SignatureDirectory<Offset>& signatureDirectory =
+          _processImage.GetSignatureDirectory();
+      if (signatureDirectory.IsMapped(signature)) {
+        const std::string& name = signatureDirectory.Name(signature);
+        if (!name.empty()) {
+          return name;
+        }
+        std::stringstream stream;
+        stream << std::hex << signature;
+        return stream.str();
+      }
+    }
+    return "?";
+  }
+
+  void ShowPinningNames(Commands::Output& output,
+                        const PageTally& tally) const {
+    std::vector<std::pair<std::string, std::pair<Offset, Offset> > > entries(
+        tally._pinningNames.begin(), tally._pinningNames.end());
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair<std::string, std::pair<Offset, Offset> >& left,
+                 const std::pair<std::string, std::pair<Offset, Offset> >&
+                     right) {
+                return left.second.first > right.second.first ||
+                       (left.second.first == right.second.first &&
+                        left.first < right.first);
+              });
+    for (const auto& entry : entries) {
+      if (entry.first == "?") {
+        output << "Unrecognized allocations";
+      } else if (entry.first[0] == '%') {
+        output << "Pattern " << entry.first;
+      } else {
+        output << "Signature " << entry.first;
+      }
+      output << " pins " << std::dec << entry.second.first
+             << " mostly free pages with " << entry.second.second
+             << " allocations.\n";
+    }
+  }
+};
+}  // namespace Subcommands
+}  // namespace LibcMalloc
+}  // namespace chap
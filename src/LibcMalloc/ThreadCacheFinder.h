@@ -0,0 +1,228 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "../Allocations/Directory.h"
+#include "../ThreadMap.h"
+#include "../VirtualAddressMap.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace LibcMalloc {
+/*
+ * This finds the tcache_perthread_struct for each thread, as used by glibc
+ * 2.26 and later to cache freed allocations of small sizes per thread, and
+ * marks the allocations on the tcache bins as thread cached, so that they
+ * are treated as free.  The caches are found by checking each used arena
+ * allocation of the right size for counts and singly linked lists that
+ * agree with the allocation directory.  Both the layout with one byte per
+ * count (glibc 2.26 to 2.29) and the one with two bytes per count (glibc
+ * 2.30 and later) are accepted, as are lists with or without the pointer
+ * mangling used by glibc 2.32 and later.  The owning thread is found, where
+ * possible, by looking for the thread local pointer to the cache just below
+ * the thread pointer (fs base) of each thread.
+ */
+template <class Offset>
+class ThreadCacheFinder {
+ public:
+  typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
+  typedef typename Allocations::Directory<Offset> Directory;
+  typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
+
+  struct ThreadCache {
+    ThreadCache(Offset address)
+        : _address(address),
+          _threadNum(0),
+          _hasThread(false),
+          _numEntries(0),
+          _numBytes(0) {}
+    Offset _address;
+    size_t _threadNum;
+    bool _hasThread;
+    Offset _numEntries;
+    Offset _numBytes;
+  };
+  typedef std::vector<ThreadCache> ThreadCaches;
+
+  ThreadCacheFinder(const VirtualAddressMap<Offset>& addressMap,
+                    const InfrastructureFinder<Offset>& infrastructureFinder,
+                    const ThreadMap<Offset>& threadMap)
+      : _addressMap(addressMap),
+        _infrastructureFinder(infrastructureFinder),
+        _threadMap(threadMap) {}
+
+  /*
+   * Find the thread caches and mark their entries as thread cached.  This
+   * must be called after the allocation boundaries have been resolved but
+   * before the graph is built.
+   */
+  void Resolve(Directory& directory) {
+    Reader reader(_addressMap);
+    std::vector<AllocationIndex> entries;
+    AllocationIndex numAllocations = directory.NumAllocations();
+    for (AllocationIndex i = 0; i < numAllocations; i++) {
+      AllocationPointer allocation = directory.AllocationAt(i);
+      if (!allocation->IsUsed()) {
+        continue;
+      }
+      Offset address = allocation->Address();
+      Offset size = allocation->Size();
+      for (Offset countSize = 2; countSize > 0; countSize--) {
+        Offset structSize = NUM_BINS * (countSize + sizeof(Offset));
+        if (size < structSize || size >= structSize + 2 * ALIGNMENT ||
+            _infrastructureFinder.ArenaAddressFor(address) == 0) {
+          continue;
+        }
+        size_t numEntriesBefore = entries.size();
+        if (CheckThreadCache(reader, directory, address, countSize, false,
+                             entries) ||
+            CheckThreadCache(reader, directory, address, countSize, true,
+                             entries)) {
+          _threadCaches.emplace_back(address);
+          ThreadCache& threadCache = _threadCaches.back();
+          threadCache._numEntries = entries.size() - numEntriesBefore;
+          for (size_t j = numEntriesBefore; j < entries.size(); j++) {
+            threadCache._numBytes +=
+                directory.AllocationAt(entries[j])->Size();
+          }
+          break;
+        }
+      }
+    }
+    for (AllocationIndex index : entries) {
+      directory.MarkAsThreadCached(index);
+    }
+    FindOwningThreads(reader);
+    /*
+     * A cache with no entries can't be distinguished from any other
+     * allocation of the same size that happens to be zero filled, so it is
+     * kept only if a thread refers to it.
+     */
+    _threadCaches.erase(
+        std::remove_if(_threadCaches.begin(), _threadCaches.end(),
+                       [](const ThreadCache& threadCache) {
+                         return threadCache._numEntries == 0 &&
+                                !threadCache._hasThread;
+                       }),
+        _threadCaches.end());
+  }
+
+  const ThreadCaches& GetThreadCaches() const { return _threadCaches; }
+
+ private:
+  static constexpr Offset NUM_BINS = 64;
+  static constexpr Offset ALIGNMENT = 0x10;
+  static constexpr Offset MIN_CHUNK_SIZE =
+      (4 * sizeof(Offset) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  /*
+   * This is how far below the thread pointer to look for the thread local
+   * pointer to the cache.
+   */
+  static constexpr Offset TLS_SEARCH_RANGE = 0x10000;
+  const VirtualAddressMap<Offset>& _addressMap;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const ThreadMap<Offset>& _threadMap;
+  ThreadCaches _threadCaches;
+
+  /*
+   * Return true if the allocation at the given address has a consistent
+   * count and list for every bin, in which case the indices of all the
+   * allocations on the lists are appended to entries.
+   */
+  bool CheckThreadCache(Reader& reader, const Directory& directory,
+                        Offset address, Offset countSize, bool mangled,
+                        std::vector<AllocationIndex>& entries) {
+    size_t numEntriesBefore = entries.size();
+    if (CheckBins(reader, directory, address, countSize, mangled, entries)) {
+      return true;
+    }
+    entries.resize(numEntriesBefore);
+    return false;
+  }
+
+  bool CheckBins(Reader& reader, const Directory& directory, Offset address,
+                 Offset countSize, bool mangled,
+                 std::vector<AllocationIndex>& entries) {
+    try {
+      Offset listHeads = address + NUM_BINS * countSize;
+      for (Offset bin = 0; bin < NUM_BINS; bin++) {
+        Offset count = (countSize == 1)
+                           ? reader.ReadU8(address + bin)
+                           : reader.ReadU16(address + 2 * bin);
+        Offset node = reader.ReadOffset(listHeads + bin * sizeof(Offset));
+        if ((count == 0) != (node == 0)) {
+          return false;
+        }
+        Offset entrySize = MIN_CHUNK_SIZE + bin * ALIGNMENT - sizeof(Offset);
+        for (; count > 0; count--) {
+          if ((node & (ALIGNMENT - 1)) != 0) {
+            return false;
+          }
+          AllocationIndex index = directory.AllocationIndexOf(node);
+          AllocationPointer entry = directory.AllocationAt(index);
+          if (entry == (const Allocation*)(0) || entry->Address() != node ||
+              entry->Size() != entrySize) {
+            return false;
+          }
+          entries.push_back(index);
+          Offset next = reader.ReadOffset(node);
+          node = mangled ? (next ^ (node >> 12)) : next;
+        }
+        if (node != 0) {
+          return false;
+        }
+      }
+    } catch (NotMapped&) {
+      return false;
+    }
+    return true;
+  }
+
+  void FindOwningThreads(Reader& reader) {
+    if (_threadCaches.empty()) {
+      return;
+    }
+    size_t threadPointerIndex = _threadMap.GetNumRegisters();
+    for (size_t i = 0; i < _threadMap.GetNumRegisters(); i++) {
+      if (strcmp(_threadMap.GetRegisterName(i), "*fs-base*") == 0) {
+        threadPointerIndex = i;
+      }
+    }
+    if (threadPointerIndex == _threadMap.GetNumRegisters()) {
+      return;
+    }
+    std::map<Offset, size_t> cacheToIndex;
+    for (size_t i = 0; i < _threadCaches.size(); i++) {
+      cacheToIndex[_threadCaches[i]._address] = i;
+    }
+    for (const auto& threadInfo : _threadMap) {
+      Offset threadPointer = threadInfo._registers[threadPointerIndex];
+      if (threadPointer < TLS_SEARCH_RANGE) {
+        continue;
+      }
+      for (Offset check = threadPointer - sizeof(Offset);
+           check >= threadPointer - TLS_SEARCH_RANGE;
+           check -= sizeof(Offset)) {
+        typename std::map<Offset, size_t>::const_iterator it =
+            cacheToIndex.find(reader.ReadOffset(check, 0));
+        if (it != cacheToIndex.end()) {
+          ThreadCache& threadCache = _threadCaches[it->second];
+          if (!threadCache._hasThread) {
+            threadCache._hasThread = true;
+            threadCache._threadNum = threadInfo._threadNum;
+          }
+          break;
+        }
+      }
+    }
+  }
+};
+}  // namespace LibcMalloc
+}  // namespace chap
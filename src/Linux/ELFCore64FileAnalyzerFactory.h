@@ -19,9 +19,9 @@ class ELFCore64FileAnalyzerFactory : public FileAnalyzerFactory {
    */
 
   virtual FileAnalyzer* MakeFileAnalyzer(const FileImage& fileImage,
-                                         bool truncationCheckOnly) {
+                                         AnalysisMode mode) {
     try {
-      return new ELFCoreFileAnalyzer<Elf64>(fileImage, truncationCheckOnly);
+      return new ELFCoreFileAnalyzer<Elf64>(fileImage, mode);
     } catch (std::bad_alloc&) {
       std::cerr << "There is not enough memory on this server to process"
                    " this ELF file.\n";
@@ -14,14 +14,13 @@ template <class ElfImage>
 class ELFCoreFileAnalyzer : public FileAnalyzer {
  public:
   typedef typename ElfImage::Offset Offset;
-  ELFCoreFileAnalyzer(const FileImage& fileImage, bool truncationCheckOnly)
+  ELFCoreFileAnalyzer(const FileImage& fileImage, AnalysisMode mode)
       : _elfImage(fileImage),
         _virtualAddressMap(_elfImage.GetVirtualAddressMap()),
         _virtualAddressMapCommandHandler(_virtualAddressMap) {
     if (_elfImage.GetELFType() == ET_CORE) {
-      _processImage.reset(
-          new LinuxProcessImage<ElfImage>(_elfImage, truncationCheckOnly));
-      if (!truncationCheckOnly) {
+      _processImage.reset(new LinuxProcessImage<ElfImage>(_elfImage, mode));
+      if (mode == FULL_ANALYSIS) {
         _processImageCommandHandler.reset(
             new ProcessImageCommandHandler<ElfImage>(*(_processImage.get())));
       }
@@ -82,6 +81,50 @@ class ELFCoreFileAnalyzer : public FileAnalyzer {
     });
   }
 
+  /*
+   * Show the number and total size of the used and free allocations and,
+   * for LEAKS_CHECK, of the leaked allocations.  The exit code is 3 if
+   * corruption was reported while the libc malloc arenas were walked, 2 if
+   * leaked allocations were found and 0 otherwise.
+   */
+
+  virtual int ReportCheck() {
+    if (_processImage.get() == 0) {
+      return 1;
+    }
+    const Allocations::Directory<Offset>& directory =
+        _processImage->GetAllocationDirectory();
+    const Allocations::Graph<Offset>* graph =
+        _processImage->GetAllocationGraph();
+    Offset counts[3] = {0, 0, 0};
+    Offset bytes[3] = {0, 0, 0};
+    typename Allocations::Directory<Offset>::AllocationIndex numAllocations =
+        directory.NumAllocations();
+    for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
+         i < numAllocations; i++) {
+      typename Allocations::Directory<Offset>::AllocationPointer allocation =
+          directory.AllocationAt(i);
+      size_t kind = allocation->IsUsed() ? 0 : 1;
+      counts[kind]++;
+      bytes[kind] += allocation->Size();
+      if (graph != nullptr && graph->IsLeaked(i)) {
+        counts[2]++;
+        bytes[2] += allocation->Size();
+      }
+    }
+    const char* kinds[3] = {"used", "free", "leaked"};
+    for (size_t kind = 0; kind < ((graph != nullptr) ? 3 : 2); kind++) {
+      std::cout << std::dec << counts[kind] << " " << kinds[kind]
+                << " allocations use 0x" << std::hex << bytes[kind] << " ("
+                << std::dec << bytes[kind] << ") bytes.\n";
+    }
+    if (_processImage->GetLibcMallocFinderGroup().CorruptionReported()) {
+      std::cout << "Corruption was reported for libc malloc.\n";
+      return 3;
+    }
+    return (counts[2] != 0) ? 2 : 0;
+  }
+
  private:
   ElfImage _elfImage;
   const VirtualAddressMap<Offset>& _virtualAddressMap;
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <map>
 #include "../Allocations/TaggerRunner.h"
+#include "../FileAnalyzer.h"
 #include "../LibcMalloc/FinderGroup.h"
 #include "../ProcessImage.h"
 #include "../RangeMapper.h"
@@ -22,7 +23,7 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
   typedef typename AddressMap::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename Allocations::SignatureDirectory<Offset> SignatureDirectory;
-  LinuxProcessImage(ElfImage& elfImage, bool truncationCheckOnly)
+  LinuxProcessImage(ElfImage& elfImage, AnalysisMode mode)
       : ProcessImage<Offset>(elfImage.GetVirtualAddressMap(),
                              elfImage.GetThreadMap()),
         _elfImage(elfImage),
@@ -35,7 +36,7 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
       abort();
     }
-    if (!truncationCheckOnly) {
+    if (mode != TRUNCATION_CHECK_ONLY) {
       /*
        * Try to find the modules in the quick way.
        */
@@ -64,7 +65,8 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
       _libcMallocFinderGroup.reset(new LibcMalloc::FinderGroup<Offset>(
           Base::_virtualMemoryPartition, Base::_moduleDirectory,
-          Base::_allocationDirectory, Base::_unfilledImages));
+          Base::_allocationDirectory, Base::_unfilledImages,
+          Base::_threadMap));
 
       /*
        * If we haven't yet found the modules, now is a good time to do so
@@ -88,11 +90,46 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
         Base::_goLangFinderGroup.Resolve();
       }
 
+      /*
+       * The jemalloc extents and the tcmalloc spans are found by full scans
+       * of the writable memory not yet claimed, so each is done only if there
+       * is some evidence that the allocator is in use, either because libc
+       * malloc has no arenas or because some module is named for the
+       * allocator.  Doing this after libc malloc has claimed its heaps keeps
+       * any false extents or spans out of them.
+       */
+      bool libcMallocHasArenas =
+          !_libcMallocFinderGroup->GetInfrastructureFinder()
+               .GetArenas()
+               .empty();
+      if (!libcMallocHasArenas || HasModuleNamed("jemalloc")) {
+        Base::_jemallocFinderGroup.Resolve();
+      }
+      if (!libcMallocHasArenas || HasModuleNamed("tcmalloc")) {
+        Base::_tcmallocFinderGroup.Resolve();
+      }
+
+      /*
+       * Any stacks that are not thread stacks have been registered by now.
+       * A thread may be running on one of them, in which case the stack
+       * pointer for the thread is more current than the saved one.
+       */
+      Base::_stackRegistry.Resolve();
+      for (const auto& threadInfo : Base::_threadMap) {
+        Base::_stackRegistry.AdjustStackPointer(threadInfo._stackPointer);
+      }
+
       /*
        * Now that any allocation finders have been registered with the
        * allocaion directory, find out where all the allocations are.
        */
       Base::_allocationDirectory.ResolveAllocationBoundaries();
+      if (mode == ALLOCATIONS_CHECK) {
+        /*
+         * Any corruption of the libc malloc arenas has been reported by now.
+         */
+        return;
+      }
 
       /*
        * Static anchor ranges should be found after the allocations and modules,
@@ -110,7 +147,15 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
       Base::_allocationGraph = new Allocations::Graph<Offset>(
           Base::_virtualAddressMap, Base::_allocationDirectory,
-          Base::_threadMap, _staticAnchorLimits, nullptr, nullptr);
+          Base::_threadMap, Base::_stackRegistry, _staticAnchorLimits,
+          nullptr, nullptr);
+      if (mode == LEAKS_CHECK) {
+        /*
+         * Which allocations are leaked depends only on the graph, not on
+         * the signatures or the tags.
+         */
+        return;
+      }
 
       /*
        * In Linux processes the current approach is to wait until the
@@ -1132,6 +1177,20 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
     }
   }
 
+  /*
+   * Return true if the path of any module contains the given string.
+   */
+  bool HasModuleNamed(const char* namePart) const {
+    for (typename ModuleDirectory<Offset>::const_iterator it =
+             Base::_moduleDirectory.begin();
+         it != Base::_moduleDirectory.end(); ++it) {
+      if (it->first.find(namePart) != std::string::npos) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   void ResolveModuleAlignmentGapsAndModuleDirectory() {
     for (typename ModuleDirectory<Offset>::const_iterator it =
              Base::_moduleDirectory.begin();
@@ -1345,7 +1404,7 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
         Base::_virtualAddressMap.end();
     for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
          i < numAllocations; ++i) {
-      const typename Allocations::Directory<Offset>::Allocation* allocation =
+      typename Allocations::Directory<Offset>::AllocationPointer allocation =
           directory.AllocationAt(i);
       if (!allocation->IsUsed() || (allocation->Size() < sizeof(Offset))) {
         continue;
@@ -1567,7 +1626,7 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
         directory.NumAllocations();
     for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
          i < numAllocations; ++i) {
-      const typename Allocations::Directory<Offset>::Allocation* allocation =
+      typename Allocations::Directory<Offset>::AllocationPointer allocation =
           directory.AllocationAt(i);
       if (!allocation->IsUsed() || !graph.IsStaticAnchorPoint(i)) {
         continue;
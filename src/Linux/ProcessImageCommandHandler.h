@@ -4,7 +4,11 @@
 #pragma once
 #include "../LibcMalloc/FinderGroup.h"
 #include "../LibcMalloc/Subcommands/DescribeArenas.h"
+#include "../LibcMalloc/Subcommands/DescribeThreadCaches.h"
+#include "../LibcMalloc/Subcommands/SummarizeArenas.h"
+#include "../LibcMalloc/Subcommands/SummarizePages.h"
 #include "../ProcessImageCommandHandler.h"
+#include "../Python/Subcommands/SummarizePythonArenas.h"
 #include "LinuxProcessImage.h"
 
 namespace chap {
@@ -19,9 +23,18 @@ class ProcessImageCommandHandler
       : Base(processImage),
         _libcMallocFinderGroup(processImage.GetLibcMallocFinderGroup()),
         _pythonFinderGroup(processImage.GetPythonFinderGroup()),
+        _jemallocFinderGroup(processImage.GetJemallocFinderGroup()),
         _describeArenasSubcommand(
             _libcMallocFinderGroup.GetInfrastructureFinder(),
-            processImage.GetAllocationDirectory()) {
+            processImage.GetAllocationDirectory()),
+        _describeThreadCachesSubcommand(
+            _libcMallocFinderGroup.GetThreadCacheFinder()),
+        _summarizeArenasSubcommand(
+            _libcMallocFinderGroup.GetInfrastructureFinder(),
+            processImage.GetAllocationDirectory()),
+        _summarizePagesSubcommand(
+            _libcMallocFinderGroup.GetInfrastructureFinder(), processImage),
+        _summarizePythonArenasSubcommand(_pythonFinderGroup) {
     Base::_compoundDescriber.AddDescriber(Base::_allocationDescriber);
     Base::_compoundDescriber.AddDescriber(Base::_stackDescriber);
 
@@ -49,6 +62,7 @@ class ProcessImageCommandHandler
      */
     _libcMallocFinderGroup.AddDescribers(Base::_compoundDescriber);
     _pythonFinderGroup.AddDescribers(Base::_compoundDescriber);
+    _jemallocFinderGroup.AddDescribers(Base::_compoundDescriber);
 
     Base::_compoundDescriber.AddDescriber(Base::_stackOverflowGuardDescriber);
     /*
@@ -61,12 +75,23 @@ class ProcessImageCommandHandler
   virtual void AddCommands(Commands::Runner& r) {
     Base::AddCommands(r);
     Base::RegisterSubcommand(r, _describeArenasSubcommand);
+    Base::RegisterSubcommand(r, _describeThreadCachesSubcommand);
+    Base::RegisterSubcommand(r, _summarizeArenasSubcommand);
+    Base::RegisterSubcommand(r, _summarizePagesSubcommand);
+    Base::RegisterSubcommand(r, _summarizePythonArenasSubcommand);
   }
 
  private:
   LibcMalloc::FinderGroup<Offset>& _libcMallocFinderGroup;
   const Python::FinderGroup<Offset>& _pythonFinderGroup;
+  const Jemalloc::FinderGroup<Offset>& _jemallocFinderGroup;
   LibcMalloc::Subcommands::DescribeArenas<Offset> _describeArenasSubcommand;
+  LibcMalloc::Subcommands::DescribeThreadCaches<Offset>
+      _describeThreadCachesSubcommand;
+  LibcMalloc::Subcommands::SummarizeArenas<Offset> _summarizeArenasSubcommand;
+  LibcMalloc::Subcommands::SummarizePages<Offset> _summarizePagesSubcommand;
+  Python::Subcommands::SummarizePythonArenas<Offset>
+      _summarizePythonArenasSubcommand;
 };
 
 }  // namespace Linux
@@ -18,7 +18,9 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::EdgeIterator EdgeIterator;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename TagHolder::TagIndex TagIndex;
@@ -100,7 +102,7 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
           AllocationIndex nextIndex =
               _graph.TargetAllocationIndex(index, _next);
           if (nextIndex != _numAllocations) {
-            const Allocation* nextAllocation =
+            AllocationPointer nextAllocation =
                 _directory.AllocationAt(nextIndex);
             if (nextAllocation->Address() == _next &&
                 _tagHolder.GetTagIndex(nextIndex) == _nodeTagIndex) {
@@ -148,7 +150,7 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
         }
         listHead = node;
       } else {
-        const Allocation* allocation = _directory.AllocationAt(nodeIndex);
+        AllocationPointer allocation = _directory.AllocationAt(nodeIndex);
         if (allocation->Address() != node) {
           if (listHead != 0) {
             return;
@@ -275,7 +277,7 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
     Offset node = _address;
     AllocationIndex nodeIndex = index;
     do {
-      const Allocation* allocation = _directory.AllocationAt(nodeIndex);
+      AllocationPointer allocation = _directory.AllocationAt(nodeIndex);
       totalSize += allocation->Size();
       totalCount++;
       node = _nodeReader.ReadOffset(node, 0xbad);
@@ -289,7 +291,7 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
     node = _address;
     nodeIndex = index;
     do {
-      const Allocation* allocation = _directory.AllocationAt(nodeIndex);
+      AllocationPointer allocation = _directory.AllocationAt(nodeIndex);
       Offset nodeSize = allocation->Size();
       if (minSize > nodeSize || nodeSize > maxSize) {
         if (listHead != 0) {
@@ -320,12 +322,12 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
   bool HasExtraPointerToStartFromAllocation(AllocationIndex index, Offset node,
                                             Offset next, Offset prev,
                                             Reader& refReader) {
-    const AllocationIndex* pFirstIncoming;
-    const AllocationIndex* pPastIncoming;
+    EdgeIterator pFirstIncoming;
+    EdgeIterator pPastIncoming;
     _graph.GetIncoming(index, &pFirstIncoming, &pPastIncoming);
-    for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+    for (EdgeIterator pNextIncoming = pFirstIncoming;
          pNextIncoming != pPastIncoming; ++pNextIncoming) {
-      const Allocation* incomingAllocation =
+      AllocationPointer incomingAllocation =
           _directory.AllocationAt(*pNextIncoming);
       Offset incomingAddress = incomingAllocation->Address();
       if (incomingAddress == next || incomingAddress == prev) {
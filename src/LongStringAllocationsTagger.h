@@ -20,6 +20,7 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename TagHolder::TagIndex TagIndex;
@@ -279,7 +280,7 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
         continue;
       }
 
-      const Allocation* charsAllocation = _directory.AllocationAt(charsIndex);
+      AllocationPointer charsAllocation = _directory.AllocationAt(charsIndex);
       if (charsAllocation->Address() != charsAddress) {
         continue;
       }
@@ -18,6 +18,7 @@ class MapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
@@ -174,7 +175,7 @@ class MapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
       if (index == _numAllocations) {
         return;
       }
-      const Allocation* allocation = _directory.AllocationAt(index);
+      AllocationPointer allocation = _directory.AllocationAt(index);
       if (allocation == nullptr) {
         return;
       }
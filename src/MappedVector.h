@@ -0,0 +1,261 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+extern "C" {
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+};
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+
+namespace chap {
+/*
+ * This keeps track of how much memory is used by the large tables built
+ * during analysis, such as the allocation directory and the graph, to allow
+ * those tables to be moved to temporary files once they would exceed the
+ * memory budget.  The budget is half of physical memory, which leaves room
+ * for the parts of the core that are being read and for everything else.
+ * The environment variable CHAP_MEMORY_BUDGET, if set, gives the budget in
+ * bytes instead, which allows the file-backed tables to be tested on small
+ * cores.
+ */
+class MemoryBudget {
+ public:
+  /*
+   * Reserve the given number of bytes of the budget, returning false if
+   * doing so would exceed the budget.
+   */
+  static bool Reserve(size_t numBytes) {
+    std::atomic<size_t>& inMemory = InMemory();
+    size_t current = inMemory.load();
+    do {
+      if (numBytes > Limit() || current > Limit() - numBytes) {
+        return false;
+      }
+    } while (!inMemory.compare_exchange_weak(current, current + numBytes));
+    return true;
+  }
+
+  static void Release(size_t numBytes) { InMemory() -= numBytes; }
+
+  static size_t Limit() {
+    static const size_t limit = ComputeLimit();
+    return limit;
+  }
+
+  /*
+   * Return the descriptor for a new temporary file of the given size,
+   * already unlinked so that it goes away when chap exits, or -1 on failure.
+   */
+  static int CreateTemporaryFile(size_t numBytes) {
+    const char* directory = getenv("TMPDIR");
+    if (directory == (const char*)(0) || directory[0] == '\000') {
+      directory = "/tmp";
+    }
+    std::string path(directory);
+    path.append("/chap.XXXXXX");
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+      std::cerr << "Failed to create a temporary file in " << directory
+                << ".\n";
+      return -1;
+    }
+    (void)unlink(path.c_str());
+    if (ftruncate(fd, (off_t)numBytes) != 0) {
+      std::cerr << "Failed to extend a temporary file in " << directory
+                << " to 0x" << std::hex << numBytes << " bytes.\n";
+      close(fd);
+      return -1;
+    }
+    static std::atomic<bool> warned(false);
+    if (!warned.exchange(true)) {
+      std::cerr << "Warning: the memory budget of 0x" << std::hex << Limit()
+                << " bytes was exceeded, so some tables are being kept in "
+                   "temporary files in "
+                << directory << ".\n";
+    }
+    return fd;
+  }
+
+ private:
+  static std::atomic<size_t>& InMemory() {
+    static std::atomic<size_t> inMemory(0);
+    return inMemory;
+  }
+
+  static size_t ComputeLimit() {
+    const char* budget = getenv("CHAP_MEMORY_BUDGET");
+    if (budget != (const char*)(0) && budget[0] != '\000') {
+      char* end;
+      unsigned long long limit = strtoull(budget, &end, 0);
+      if (*end == '\000') {
+        return (size_t)limit;
+      }
+      std::cerr << "Ignoring CHAP_MEMORY_BUDGET=\"" << budget
+                << "\" because it is not a number.\n";
+    }
+    long numPages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (numPages <= 0 || pageSize <= 0) {
+      return ~((size_t)0);
+    }
+    return ((size_t)numPages / 2) * (size_t)pageSize;
+  }
+};
+
+/*
+ * This is a simplified replacement for std::vector, for trivially copyable
+ * types, used for the largest tables.  The storage is mapped directly, from
+ * anonymous memory while the memory budget allows it and otherwise from an
+ * unlinked temporary file, so that a core with more allocations or edges
+ * than fit in memory can still be analyzed, at the cost of paging.  New
+ * elements beyond the old size are value-initialized, as for std::vector,
+ * and growth doubles the capacity.
+ */
+template <typename T>
+class MappedVector {
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  MappedVector()
+      : _data((T*)(0)),
+        _size(0),
+        _capacity(0),
+        _mappedBytes(0),
+        _isFileBacked(false) {}
+  MappedVector(const MappedVector&) = delete;
+  MappedVector& operator=(const MappedVector&) = delete;
+  ~MappedVector() { Unmap(); }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  size_t capacity() const { return _capacity; }
+  T* data() { return _data; }
+  const T* data() const { return _data; }
+  iterator begin() { return _data; }
+  iterator end() { return _data + _size; }
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+  T& operator[](size_t index) { return _data[index]; }
+  const T& operator[](size_t index) const { return _data[index]; }
+  T& back() { return _data[_size - 1]; }
+  const T& back() const { return _data[_size - 1]; }
+
+  /*
+   * Return true if the elements are kept in a temporary file.
+   */
+  bool IsFileBacked() const { return _isFileBacked; }
+
+  void reserve(size_t capacity) {
+    if (capacity > _capacity) {
+      Remap(capacity);
+    }
+  }
+
+  void resize(size_t size, const T& value = T()) {
+    reserve(size);
+    for (size_t i = _size; i < size; i++) {
+      new (_data + i) T(value);
+    }
+    _size = size;
+  }
+
+  void assign(size_t size, const T& value) {
+    _size = 0;
+    resize(size, value);
+  }
+
+  void push_back(const T& value) {
+    Grow();
+    new (_data + _size) T(value);
+    _size++;
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    Grow();
+    new (_data + _size) T(std::forward<Args>(args)...);
+    _size++;
+  }
+
+  void clear() { _size = 0; }
+
+  void swap(MappedVector& other) {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_capacity, other._capacity);
+    std::swap(_mappedBytes, other._mappedBytes);
+    std::swap(_isFileBacked, other._isFileBacked);
+  }
+
+ private:
+  T* _data;
+  size_t _size;
+  size_t _capacity;
+  size_t _mappedBytes;
+  bool _isFileBacked;
+
+  void Grow() {
+    if (_size == _capacity) {
+      Remap((_capacity == 0) ? (0x1000 / sizeof(T) + 1) : (2 * _capacity));
+    }
+  }
+
+  void Remap(size_t capacity) {
+    size_t pageSize = sysconf(_SC_PAGE_SIZE);
+    size_t numBytes = capacity * sizeof(T);
+    numBytes = ((numBytes + pageSize - 1) / pageSize) * pageSize;
+    bool isFileBacked = !MemoryBudget::Reserve(numBytes);
+    void* mapped = MAP_FAILED;
+    if (isFileBacked) {
+      int fd = MemoryBudget::CreateTemporaryFile(numBytes);
+      if (fd >= 0) {
+        mapped = mmap((void*)0, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, (off_t)0);
+        close(fd);
+      }
+    } else {
+      mapped = mmap((void*)0, numBytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, (off_t)0);
+      if (mapped == MAP_FAILED) {
+        MemoryBudget::Release(numBytes);
+      }
+    }
+    if (mapped == MAP_FAILED) {
+      std::cerr << "Failed to map 0x" << std::hex << numBytes
+                << " bytes for a table.\n";
+      throw std::bad_alloc();
+    }
+    if (_size != 0) {
+      memcpy(mapped, _data, _size * sizeof(T));
+    }
+    Unmap();
+    _data = (T*)(mapped);
+    _capacity = numBytes / sizeof(T);
+    _mappedBytes = numBytes;
+    _isFileBacked = isFileBacked;
+  }
+
+  void Unmap() {
+    if (_mappedBytes != 0) {
+      (void)munmap(_data, _mappedBytes);
+      if (!_isFileBacked) {
+        MemoryBudget::Release(_mappedBytes);
+      }
+      _data = (T*)(0);
+      _capacity = 0;
+      _mappedBytes = 0;
+      _isFileBacked = false;
+    }
+  }
+};
+}  // namespace chap
@@ -74,6 +74,19 @@ class ModuleAlignmentGapDescriber : public Describer<Offset> {
     return true;
   }
 
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    const ClaimedRanges *rangesToCheck[] = {&_inaccessibleRanges,
+                                            &_readOnlyRanges};
+    for (const ClaimedRanges *ranges : rangesToCheck) {
+      for (const auto &range : *ranges) {
+        if (range._value == _moduleDirectory.MODULE_ALIGNMENT_GAP) {
+          visitor(range._base, range._limit);
+        }
+      }
+    }
+    return true;
+  }
+
  private:
   const ModuleDirectory<Offset> &_moduleDirectory;
   const VirtualAddressMap<Offset> &_virtualAddressMap;
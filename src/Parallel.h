@@ -0,0 +1,58 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+namespace chap {
+/*
+ * This provides a very simple way to split work across threads.  The caller
+ * divides the work into numbered chunks, each of which is handled by exactly
+ * one thread, so any results can be kept per chunk and combined in chunk
+ * order afterwards.  This makes the combined results independent of the
+ * number of threads.
+ */
+class Parallel {
+ public:
+  static size_t NumThreads() {
+    static const size_t numThreads =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    return numThreads;
+  }
+
+  /*
+   * Call the visitor once for each chunk number in [0, numChunks), using up
+   * to NumThreads() threads, including the calling thread, and return only
+   * after all the chunks have been visited.  If there is only one chunk, no
+   * threads are started.  The visitor must not throw.
+   */
+  template <typename ChunkVisitor>
+  static void VisitChunks(size_t numChunks, ChunkVisitor visitor) {
+    size_t numThreads = std::min(NumThreads(), numChunks);
+    if (numThreads <= 1) {
+      for (size_t chunk = 0; chunk < numChunks; chunk++) {
+        visitor(chunk);
+      }
+      return;
+    }
+    std::atomic<size_t> nextChunk(0);
+    auto worker = [&nextChunk, numChunks, &visitor]() {
+      for (size_t chunk = nextChunk++; chunk < numChunks;
+           chunk = nextChunk++) {
+        visitor(chunk);
+      }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t i = 1; i < numThreads; i++) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+};
+}  // namespace chap
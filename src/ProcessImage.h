@@ -4,12 +4,14 @@
 #pragma once
 #include "Allocations/AnchorDirectory.h"
 #include "Allocations/Directory.h"
+#include "Allocations/DominatorTree.h"
 #include "Allocations/Graph.h"
 #include "Allocations/SignatureDirectory.h"
 #include "Allocations/TagHolder.h"
 #include "COWStringAllocationsTagger.h"
 #include "DequeAllocationsTagger.h"
 #include "GoLang/FinderGroup.h"
+#include "Jemalloc/FinderGroup.h"
 #include "ListAllocationsTagger.h"
 #include "LongStringAllocationsTagger.h"
 #include "MapOrSetAllocationsTagger.h"
@@ -18,6 +20,8 @@
 #include "Python/AllocationsTagger.h"
 #include "Python/FinderGroup.h"
 #include "Python/InfrastructureFinder.h"
+#include "StackRegistry.h"
+#include "Tcmalloc/FinderGroup.h"
 #include "ThreadMap.h"
 #include "UnfilledImages.h"
 #include "UnorderedMapOrSetAllocationsTagger.h"
@@ -44,10 +48,14 @@ class ProcessImage {
         _unfilledImages(virtualAddressMap),
         _allocationTagHolder(nullptr),
         _allocationGraph(nullptr),
+        _dominatorTree(nullptr),
         _pythonFinderGroup(_virtualMemoryPartition, _moduleDirectory,
                            _allocationDirectory, _unfilledImages),
         _goLangFinderGroup(_virtualMemoryPartition, _moduleDirectory,
-                           _allocationDirectory, _unfilledImages) {
+                           _allocationDirectory, _unfilledImages,
+                           _stackRegistry),
+        _jemallocFinderGroup(_virtualMemoryPartition, _allocationDirectory),
+        _tcmallocFinderGroup(_virtualMemoryPartition, _allocationDirectory) {
     for (typename ThreadMap<Offset>::const_iterator it = _threadMap.begin();
          it != _threadMap.end(); ++it) {
       if (!_virtualMemoryPartition.ClaimRange(
@@ -59,6 +67,9 @@ class ProcessImage {
   }
 
   virtual ~ProcessImage() {
+    if (_dominatorTree != nullptr) {
+      delete _dominatorTree;
+    }
     if (_allocationGraph != nullptr) {
       delete _allocationGraph;
     }
@@ -75,6 +86,13 @@ class ProcessImage {
 
   const ThreadMap<Offset> &GetThreadMap() const { return _threadMap; }
 
+  /*
+   * Return the registry for stacks that are not thread stacks.
+   */
+  const StackRegistry<Offset> &GetStackRegistry() const {
+    return _stackRegistry;
+  }
+
   const ModuleDirectory<Offset> &GetModuleDirectory() const {
     return _moduleDirectory;
   }
@@ -111,6 +129,19 @@ class ProcessImage {
     return _allocationGraph;
   }
 
+  /*
+   * Return the dominator tree for the anchored allocations, or null if the
+   * graph is not available.  This is done lazily because it is an expensive
+   * calculation that most commands don't need.
+   */
+  const Allocations::DominatorTree<Offset> *GetDominatorTree() const {
+    if (_dominatorTree == nullptr && _allocationGraph != nullptr) {
+      _dominatorTree =
+          new Allocations::DominatorTree<Offset>(*_allocationGraph);
+    }
+    return _dominatorTree;
+  }
+
   const Python::InfrastructureFinder<Offset> &GetPythonInfrastructureFinder()
       const {
     return _pythonFinderGroup.GetInfrastructureFinder();
@@ -120,6 +151,14 @@ class ProcessImage {
     return _pythonFinderGroup;
   }
 
+  const Jemalloc::FinderGroup<Offset> &GetJemallocFinderGroup() const {
+    return _jemallocFinderGroup;
+  }
+
+  const Tcmalloc::FinderGroup<Offset> &GetTcmallocFinderGroup() const {
+    return _tcmallocFinderGroup;
+  }
+
   const char *STACK;
   const char *STACK_OVERFLOW_GUARD;
 
@@ -132,10 +171,14 @@ class ProcessImage {
   UnfilledImages<Offset> _unfilledImages;
   Allocations::TagHolder<Offset> *_allocationTagHolder;
   Allocations::Graph<Offset> *_allocationGraph;
+  mutable Allocations::DominatorTree<Offset> *_dominatorTree;
   Allocations::SignatureDirectory<Offset> _signatureDirectory;
   Allocations::AnchorDirectory<Offset> _anchorDirectory;
+  StackRegistry<Offset> _stackRegistry;
   Python::FinderGroup<Offset> _pythonFinderGroup;
   GoLang::FinderGroup<Offset> _goLangFinderGroup;
+  Jemalloc::FinderGroup<Offset> _jemallocFinderGroup;
+  Tcmalloc::FinderGroup<Offset> _tcmallocFinderGroup;
 
   /*
    * Pre-tag all allocations.  This should be done just once, at the end
@@ -13,6 +13,7 @@
 #include "Commands/ExplainCommand.h"
 #include "Commands/ListCommand.h"
 #include "Commands/Runner.h"
+#include "Commands/SetCommand.h"
 #include "Commands/ShowCommand.h"
 #include "Commands/SummarizeCommand.h"
 #include "CompoundDescriber.h"
@@ -67,8 +68,10 @@ class ProcessImageCommandHandler {
         _stackOverflowGuardDescriber(processImage),
         _allocationDescriber(_inModuleDescriber, _stackDescriber,
                              _patternDescriberRegistry, processImage),
+        _namedSets(processImage.GetAllocationDirectory()),
         _describeCommand(_compoundDescriber),
         _explainCommand(_compoundDescriber),
+        _setCommand(_namedSets),
         _dumpCommand(processImage.GetVirtualAddressMap()),
         _countStacksSubcommand(processImage),
         _listStacksSubcommand(processImage),
@@ -183,7 +186,7 @@ class ProcessImageCommandHandler {
         _enumerateRelRefsSubcommand(processImage.GetVirtualAddressMap()),
         _summarizeSignaturesSubcommand(processImage),
         _defaultAllocationsSubcommands(processImage, _allocationDescriber,
-                                       _patternDescriberRegistry),
+                                       _patternDescriberRegistry, _namedSets),
         _dequeMapDescriber(processImage),
         _dequeBlockDescriber(processImage),
         _unorderedMapOrSetBucketsDescriber(processImage),
@@ -229,6 +232,7 @@ class ProcessImageCommandHandler {
     r.AddCommand(_showCommand);
     r.AddCommand(_describeCommand);
     r.AddCommand(_explainCommand);
+    r.AddCommand(_setCommand);
     r.AddCommand(_dumpCommand);
     RegisterSubcommand(r, _countStacksSubcommand);
     RegisterSubcommand(r, _listStacksSubcommand);
@@ -268,6 +272,7 @@ class ProcessImageCommandHandler {
   StackOverflowGuardDescriber<Offset> _stackOverflowGuardDescriber;
   Allocations::Describer<Offset> _allocationDescriber;
   CompoundDescriber<Offset> _compoundDescriber;
+  Allocations::NamedSets<Offset> _namedSets;
   Commands::CountCommand _countCommand;
   Commands::SummarizeCommand _summarizeCommand;
   Commands::EnumerateCommand _enumerateCommand;
@@ -275,6 +280,7 @@ class ProcessImageCommandHandler {
   Commands::ShowCommand _showCommand;
   Commands::DescribeCommand<Offset> _describeCommand;
   Commands::ExplainCommand<Offset> _explainCommand;
+  Commands::SetCommand<Offset> _setCommand;
   VirtualAddressMapCommands::DumpCommand<Offset> _dumpCommand;
   ThreadMapCommands::CountStacks<Offset> _countStacksSubcommand;
   ThreadMapCommands::ListStacks<Offset> _listStacksSubcommand;
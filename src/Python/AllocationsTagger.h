@@ -3,6 +3,8 @@
 
 #pragma once
 #include <string.h>
+#include <sstream>
+#include <unordered_map>
 #include "../Allocations/Graph.h"
 #include "../Allocations/TagHolder.h"
 #include "../Allocations/Tagger.h"
@@ -19,12 +21,14 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::Tagger<Offset> Tagger;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename TagHolder::TagIndex TagIndex;
+  typedef typename TagHolder::SubtypeIndex SubtypeIndex;
   AllocationsTagger(const Allocations::Graph<Offset>& graph,
                     TagHolder& tagHolder,
                     const InfrastructureFinder<Offset>& infrastructureFinder,
@@ -122,6 +126,40 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
   TagIndex _arenaStructArrayTagIndex;
   TagIndex _mallocedArenaTagIndex;
   bool _enabled;
+  std::unordered_map<Offset, SubtypeIndex> _typeToSubtype;
+
+  /*
+   * Record the python type of an allocation just tagged as a python object,
+   * so that summaries and sets can be refined by type without revisiting
+   * the object.  The type name comes from the type directory if the type is
+   * known there, otherwise from tp_name of the type object.
+   */
+  void SetPythonType(AllocationIndex index, Offset typeObject) {
+    typename std::unordered_map<Offset, SubtypeIndex>::const_iterator it =
+        _typeToSubtype.find(typeObject);
+    if (it != _typeToSubtype.end()) {
+      _tagHolder.SetSubtype(index, it->second);
+      return;
+    }
+    std::string typeName = _infrastructureFinder.GetTypeName(typeObject);
+    if (typeName.empty()) {
+      const char* nameImage;
+      Offset numBytesFound = _virtualAddressMap.FindMappedMemoryImage(
+          _reader.ReadOffset(typeObject + 3 * sizeof(Offset), 0), &nameImage);
+      if (numBytesFound >= 2 &&
+          strnlen(nameImage, numBytesFound) < numBytesFound) {
+        typeName.assign(nameImage);
+      }
+    }
+    if (typeName.empty()) {
+      std::stringstream stream;
+      stream << std::hex << typeObject;
+      typeName = stream.str();
+    }
+    SubtypeIndex subtypeIndex = _tagHolder.RegisterSubtype(typeName);
+    _typeToSubtype[typeObject] = subtypeIndex;
+    _tagHolder.SetSubtype(index, subtypeIndex);
+  }
 
   /*
    * Check if the given allocation contains the ArenaStructArray, returning
@@ -132,8 +170,8 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
                              const Allocation& allocation) {
     if (allocation.Address() == _arenaStructArray) {
       _tagHolder.TagAllocation(index, _arenaStructArrayTagIndex);
-      const AllocationIndex* pFirstOutgoing;
-      const AllocationIndex* pPastOutgoing;
+      EdgeIterator pFirstOutgoing;
+      EdgeIterator pPastOutgoing;
       _graph.GetOutgoing(index, &pFirstOutgoing, &pPastOutgoing);
       /*
        * The most common case is that the python arenas are all
@@ -143,7 +181,7 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
        * arenas are malloced, there will not be any outgoing references
        * from the array of arena structures.
        */
-      for (const AllocationIndex* pNextOutgoing = pFirstOutgoing;
+      for (EdgeIterator pNextOutgoing = pFirstOutgoing;
            pNextOutgoing != pPastOutgoing; pNextOutgoing++) {
         AllocationIndex arenaCandidateIndex = *pNextOutgoing;
         Offset arenaCandidate =
@@ -193,7 +231,10 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
                       << std::hex << node << "\n";
             break;
           } else {
-            _tagHolder.TagAllocation(index, _containerPythonObjectTagIndex);
+            if (_tagHolder.TagAllocation(index,
+                                         _containerPythonObjectTagIndex)) {
+              SetPythonType(index, typeCandidate);
+            }
             if (typeCandidate == _dictType) {
               Offset keysAddr = reader.ReadOffset(
                   node + _garbageCollectionHeaderSize + _keysInDict, ~0);
@@ -241,7 +282,9 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
         _reader.ReadOffset(
             offsets[1] + InfrastructureFinder<Offset>::TYPE_IN_PYOBJECT, ~0) ==
             _typeType) {
-      _tagHolder.TagAllocation(index, _simplePythonObjectTagIndex);
+      if (_tagHolder.TagAllocation(index, _simplePythonObjectTagIndex)) {
+        SetPythonType(index, offsets[1]);
+      }
       return true;
     }
     return false;
@@ -266,7 +309,9 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
       if (typeCandidate == _dictType ||
           (*((Offset*)(firstChar)) == 0 &&
            _infrastructureFinder.HasType(typeCandidate))) {
-        _tagHolder.TagAllocation(index, _containerPythonObjectTagIndex);
+        if (_tagHolder.TagAllocation(index, _containerPythonObjectTagIndex)) {
+          SetPythonType(index, typeCandidate);
+        }
         if (typeCandidate == _dictType &&
             size >=
                 _garbageCollectionHeaderSize + _keysInDict + sizeof(Offset)) {
@@ -65,6 +65,25 @@ class ArenaDescriber : public Describer<Offset> {
     return false;
   }
 
+  /*
+   * The arenas are found the same way as by ArenaStructFor, which reads the
+   * start of each active arena from the start of the corresponding arena
+   * struct.
+   */
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    Reader reader(_virtualAddressMap);
+    Offset arenaStructArray = _infrastructureFinder.ArenaStructArray();
+    Offset arenaStructSize = _infrastructureFinder.ArenaStructSize();
+    for (uint32_t index : _infrastructureFinder.ActiveIndices()) {
+      Offset arena =
+          reader.ReadOffset(arenaStructArray + index * arenaStructSize, 0);
+      if (arena != 0) {
+        visitor(arena, arena + _arenaSize);
+      }
+    }
+    return true;
+  }
+
  private:
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
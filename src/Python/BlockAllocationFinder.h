@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <map>
 #include "../Allocations/Directory.h"
 #include "../VirtualAddressMap.h"
 #include "InfrastructureFinder.h"
@@ -16,6 +17,40 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename std::set<Offset> OffsetSet;
 
+  typedef typename Allocations::Directory<Offset>::Record Record;
+
+  /*
+   * These are gathered as the pools are walked, to show how the memory
+   * held by pymalloc is used.
+   */
+  struct SizeClassTally {
+    SizeClassTally()
+        : _usedBlocks(0), _freeBlocks(0), _fullPools(0), _partlyUsedPools(0) {}
+    Offset _usedBlocks;
+    Offset _freeBlocks;
+    Offset _fullPools;
+    Offset _partlyUsedPools;
+  };
+  typedef std::map<Offset, SizeClassTally> SizeClassTallies;  // by block size
+  struct PoolTally {
+    PoolTally()
+        : _numArenas(0),
+          _numPools(0),
+          _poolsInUse(0),
+          _arenasWithPoolsInUse(0),
+          _arenasWithOnePoolInUse(0),
+          _poolOverheadBytes(0),
+          _alignmentBytes(0) {}
+    Offset _numArenas;
+    Offset _numPools;
+    Offset _poolsInUse;
+    Offset _arenasWithPoolsInUse;
+    Offset _arenasWithOnePoolInUse;
+    Offset _poolOverheadBytes;  // pool headers and space after the last block
+    Offset _alignmentBytes;     // arena space before the first or after the
+                                // last whole pool
+  };
+
   BlockAllocationFinder(
       const VirtualAddressMap<Offset>& addressMap,
       const InfrastructureFinder<Offset>& infrastructureFinder)
@@ -28,65 +63,44 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
         _poolSize(infrastructureFinder.PoolSize()),
         _activeIndices(infrastructureFinder.ActiveIndices()),
         _itActiveIndices(_activeIndices.begin()) {
-    if (_itActiveIndices != _activeIndices.end()) {
-      Offset maxBlocksInPool = (_poolSize - 0x30) / sizeof(Offset);
-      _blockUsedInPool.reserve(maxBlocksInPool);
-      _blockUsedInPool.resize(maxBlocksInPool, true);
-      _arena = _reader.ReadOffset(_arenaStructArray +
-                                  _arenaStructSize * (*_itActiveIndices));
-      while (!AdvanceToFirstAllocationOfArena()) {
-        if (++_itActiveIndices == _activeIndices.end()) {
-          break;
-        }
-      }
-    }
+    Offset maxBlocksInPool = (_poolSize - 0x30) / sizeof(Offset);
+    _blockUsedInPool.reserve(maxBlocksInPool);
+    _blockUsedInPool.resize(maxBlocksInPool, true);
   }
 
   virtual ~BlockAllocationFinder() {}
 
   /*
-   * Return true if there are no more allocations available.
+   * Return the allocations for the next arena that has any, as a single
+   * block.
    */
-  virtual bool Finished() { return _itActiveIndices == _activeIndices.end(); }
-
-  /*
-   * Return the address of the next allocation (in increasing order of
-   * address) to be reported by this finder, without advancing to the next
-   * allocation.  The return value is undefined if there are no more
-   * allocations available.  Note that at the time this function is called
-   * any allocations already reported by this allocation finder have already
-   * been assigned allocation indices in the Directory.
-   */
-  virtual Offset NextAddress() { return _allocationAddress; }
-  /*
-   * Return the size of the next allocation (in increasing order of
-   * address) to be reported by this finder, without advancing to the next
-   * allocation.  The return value is undefined if there are no more
-   * allocations available.
-   */
-  virtual Offset NextSize() { return _allocationSize; }
-  /*
-   * Return true if the next allocation (in increasing order of address) to
-   * address) to be reported by this finder is considered used, without
-   * advancing to the next allocation.
-   */
-  virtual bool NextIsUsed() { return _allocationIsUsed; }
-  /*
-   * Advance to the next allocation.
-   */
-  virtual void Advance() {
-    if (_itActiveIndices != _activeIndices.end()) {
-      if (!AdvanceToNextAllocationOfArena()) {
-        do {
-          if (++_itActiveIndices == _activeIndices.end()) {
-            // ?? any finalization needed now that all are numbered
-            return;
-          }
-          _arena = _reader.ReadOffset(_arenaStructArray +
-                                      _arenaStructSize * (*_itActiveIndices));
-        } while (!AdvanceToFirstAllocationOfArena());
+  virtual const Record* NextBlock(size_t& numRecords) {
+    _records.clear();
+    while (_records.empty() && _itActiveIndices != _activeIndices.end()) {
+      Offset arena = _reader.ReadOffset(_arenaStructArray +
+                                        _arenaStructSize * (*_itActiveIndices));
+      ++_itActiveIndices;
+      Offset firstPool = (arena + (_poolSize - 1)) & ~(_poolSize - 1);
+      Offset poolsLimit = (arena + _arenaSize) & ~(_poolSize - 1);
+      Offset poolsInUse = 0;
+      for (Offset pool = firstPool; pool < poolsLimit; pool += _poolSize) {
+        if (AppendAllocationsOfPool(pool)) {
+          poolsInUse++;
+        }
       }
+      _poolTally._numArenas++;
+      _poolTally._numPools += (poolsLimit - firstPool) / _poolSize;
+      _poolTally._poolsInUse += poolsInUse;
+      if (poolsInUse != 0) {
+        _poolTally._arenasWithPoolsInUse++;
+        if (poolsInUse == 1) {
+          _poolTally._arenasWithOnePoolInUse++;
+        }
+      }
+      _poolTally._alignmentBytes += _arenaSize - (poolsLimit - firstPool);
     }
+    numRecords = _records.size();
+    return _records.empty() ? (const Record*)(0) : _records.data();
   }
   /*
    * Return the smallest request size that might reasonably have resulted
@@ -96,6 +110,16 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
     return size - sizeof(Offset) + 1;
   }
 
+  /*
+   * These are complete only after all the blocks have been returned.
+   */
+  const SizeClassTallies& GetSizeClassTallies() const {
+    return _sizeClassTallies;
+  }
+  const PoolTally& GetPoolTally() const { return _poolTally; }
+  Offset ArenaSize() const { return _arenaSize; }
+  Offset PoolSize() const { return _poolSize; }
+
  private:
   const VirtualAddressMap<Offset>& _addressMap;
   typename VirtualAddressMap<Offset>::Reader _reader;
@@ -107,49 +131,33 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
   const std::vector<uint32_t>& _activeIndices;
   std::vector<uint32_t>::const_iterator _itActiveIndices;
   std::vector<bool> _blockUsedInPool;
+  std::vector<Record> _records;
+  SizeClassTallies _sizeClassTallies;
+  PoolTally _poolTally;
 
-  Offset _arena;
-  Offset _firstPool;
-  Offset _poolsLimit;
-  Offset _pool;
-  Offset _blockSize;
-  Offset _block;
-  size_t _blockIndex;
-  Offset _blocksLimit;
-  Offset _allocationAddress;
-  Offset _allocationSize;
-  bool _allocationIsUsed;
-
-  bool AdvanceToFirstAllocationOfArena() {
-    _firstPool = (_arena + (_poolSize - 1)) & ~(_poolSize - 1);
-    _poolsLimit = (_arena + _arenaSize) & ~(_poolSize - 1);
-    for (_pool = _firstPool; _pool < _poolsLimit; _pool += _poolSize) {
-      if (AdvanceToFirstAllocationOfPool()) {
-        return true;
-      }
-    }
-    return false;
-  }
-  bool AdvanceToFirstAllocationOfPool() {
-    if (_reader.ReadU32(_pool, 0) == 0) {
+  /*
+   * Append the blocks of the given pool, returning true if the pool is in
+   * use.
+   */
+  bool AppendAllocationsOfPool(Offset pool) {
+    if (_reader.ReadU32(pool, 0) == 0) {
       return false;
     }
-    _blockSize = _poolSize - ((Offset)(_reader.ReadU32(_pool + 0x2c, 0)));
-    if (_blockSize == _poolSize) {
+    Offset blockSize = _poolSize - ((Offset)(_reader.ReadU32(pool + 0x2c, 0)));
+    if (blockSize == _poolSize) {
       return false;
     }
-    _blockIndex = 0;
-    _block = _pool + 0x30;
-    Offset numBlocks = (_poolSize - 0x30) / _blockSize;
-    _blocksLimit = _block + (_blockSize * numBlocks);
+    Offset firstBlock = pool + 0x30;
+    Offset numBlocks = (_poolSize - 0x30) / blockSize;
+    Offset blocksLimit = firstBlock + (blockSize * numBlocks);
     Offset nextInPool = (Offset)(_reader.ReadU32(
-        _pool + ((4 * sizeof(Offset)) + (2 * sizeof(uint32_t))), 0));
-    Offset numBlocksEverUsed = (nextInPool - 0x30) / _blockSize;
+        pool + ((4 * sizeof(Offset)) + (2 * sizeof(uint32_t))), 0));
+    Offset numBlocksEverUsed = (nextInPool - 0x30) / blockSize;
     if (nextInPool < 0x30 || numBlocksEverUsed > numBlocks ||
-        nextInPool != (0x30 + numBlocksEverUsed * _blockSize)) {
+        nextInPool != (0x30 + numBlocksEverUsed * blockSize)) {
       std::cerr
           << "Warning: Probable corruption in header for python pool at 0x"
-          << std::hex << _pool << "\n";
+          << std::hex << pool << "\n";
       /*
        * In such a case, act as if the pool is all used, because we need
        * to pick some value in range and the check at the start of the
@@ -165,36 +173,35 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
     for (size_t i = numBlocksEverUsed; i < numBlocks; i++) {
       _blockUsedInPool[i] = false;
     }
-    for (Offset freeBlock = _reader.ReadOffset(_pool + 8, 0); freeBlock != 0;
+    for (Offset freeBlock = _reader.ReadOffset(pool + 8, 0); freeBlock != 0;
          freeBlock = _reader.ReadOffset(freeBlock, 0)) {
-      if (freeBlock < _block || freeBlock >= _blocksLimit) {
+      if (freeBlock < firstBlock || freeBlock >= blocksLimit) {
         std::cerr << "Warning: probable corrupt free list found for pool at 0x"
-                  << std::hex << _pool
+                  << std::hex << pool
                   << ".\nFree status cannot be trusted for this pool.\n";
         break;
       }
-      _blockUsedInPool[(freeBlock - _block) / _blockSize] = false;
-    }
-    _allocationAddress = _block;
-    _allocationSize = _blockSize;
-    _allocationIsUsed = _blockUsedInPool[0];
-    return true;
-  }
-  bool AdvanceToNextAllocationOfArena() {
-    _block += _blockSize;
-    ++_blockIndex;
-    if (_block < _blocksLimit) {
-      _allocationAddress = _block;
-      _allocationSize = _blockSize;
-      _allocationIsUsed = _blockUsedInPool[_blockIndex];
-      return true;
+      _blockUsedInPool[(freeBlock - firstBlock) / blockSize] = false;
     }
-    for (_pool += _poolSize; _pool < _poolsLimit; _pool += _poolSize) {
-      if (AdvanceToFirstAllocationOfPool()) {
-        return true;
+    size_t blockIndex = 0;
+    Offset usedBlocks = 0;
+    for (Offset block = firstBlock; block < blocksLimit; block += blockSize) {
+      bool isUsed = _blockUsedInPool[blockIndex++];
+      if (isUsed) {
+        usedBlocks++;
       }
+      _records.emplace_back(block, blockSize, isUsed);
     }
-    return false;
+    SizeClassTally& tally = _sizeClassTallies[blockSize];
+    tally._usedBlocks += usedBlocks;
+    tally._freeBlocks += numBlocks - usedBlocks;
+    if (usedBlocks == numBlocks) {
+      tally._fullPools++;
+    } else {
+      tally._partlyUsedPools++;
+    }
+    _poolTally._poolOverheadBytes += _poolSize - numBlocks * blockSize;
+    return true;
   }
 };
 
@@ -52,6 +52,14 @@ class FinderGroup {
     return _infrastructureFinder;
   }
 
+  /*
+   * Return the finder for the blocks in the pymalloc pools, or null if no
+   * python arenas were found.
+   */
+  const BlockAllocationFinder<Offset>* GetBlockAllocationFinder() const {
+    return _blockAllocationFinder.get();
+  }
+
   void AddDescribers(CompoundDescriber<Offset>& compoundDescriber) const {
     if (!(_arenaDescriber == nullptr)) {
       compoundDescriber.AddDescriber(*(_arenaDescriber.get()));
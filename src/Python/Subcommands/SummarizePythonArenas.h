@@ -0,0 +1,97 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include "../../Commands/Runner.h"
+#include "../../Commands/Subcommand.h"
+#include "../BlockAllocationFinder.h"
+#include "../FinderGroup.h"
+namespace chap {
+namespace Python {
+namespace Subcommands {
+template <class Offset>
+class SummarizePythonArenas : public Commands::Subcommand {
+ public:
+  SummarizePythonArenas(const FinderGroup<Offset>& finderGroup)
+      : Commands::Subcommand("summarize", "pythonarenas"),
+        _finderGroup(finderGroup) {}
+
+  void ShowHelpMessage(Commands::Context& context) {
+    context.GetOutput()
+        << "This subcommand summarizes how the memory held by the python "
+           "small object\nallocator (pymalloc) is used.  For each block size "
+           "it shows the number of used\nand free blocks and how many pools "
+           "of that block size are full or only partly\nused.  It then shows "
+           "how many arenas cannot be given back because at least\none pool "
+           "is in use, and how many of those are held by a single pool, and\n"
+           "how the bytes held by pymalloc beyond the used blocks are split "
+           "between free\nblocks, empty pools, pool overhead and arena "
+           "alignment.\n";
+  }
+
+  void Run(Commands::Context& context) {
+    Commands::Output& output = context.GetOutput();
+    const BlockAllocationFinder<Offset>* finder =
+        _finderGroup.GetBlockAllocationFinder();
+    if (finder == nullptr) {
+      output << "No python arenas were found.\n";
+      return;
+    }
+    Offset poolSize = finder->PoolSize();
+    Offset usedBytes = 0;
+    Offset freeBytes = 0;
+    for (const auto& sizeAndTally : finder->GetSizeClassTallies()) {
+      Offset blockSize = sizeAndTally.first;
+      const typename BlockAllocationFinder<Offset>::SizeClassTally&
+          tally = sizeAndTally.second;
+      output << "Block size 0x" << std::hex << blockSize << ": " << std::dec
+             << tally._usedBlocks << " used blocks take 0x" << std::hex
+             << (tally._usedBlocks * blockSize) << " bytes, " << std::dec
+             << tally._freeBlocks << " free blocks take 0x" << std::hex
+             << (tally._freeBlocks * blockSize) << " bytes, " << std::dec
+             << tally._fullPools << " pools are full and "
+             << tally._partlyUsedPools << " are partly used.\n";
+      usedBytes += tally._usedBlocks * blockSize;
+      freeBytes += tally._freeBlocks * blockSize;
+    }
+    const typename BlockAllocationFinder<Offset>::PoolTally&
+        poolTally = finder->GetPoolTally();
+    Offset arenaBytes = poolTally._numArenas * finder->ArenaSize();
+    Offset emptyPoolBytes =
+        (poolTally._numPools - poolTally._poolsInUse) * poolSize;
+    Offset heldBytes = arenaBytes - usedBytes;
+    output << "\n"
+           << std::dec << poolTally._numArenas
+           << " active python arenas of size 0x" << std::hex
+           << finder->ArenaSize() << " hold " << std::dec
+           << poolTally._numPools << " pools of size 0x" << std::hex
+           << poolSize << ", of which " << std::dec << poolTally._poolsInUse
+           << " are in use.\n"
+           << poolTally._arenasWithPoolsInUse
+           << " arenas cannot be given back because at least one pool is in "
+              "use.\n"
+           << poolTally._arenasWithOnePoolInUse
+           << " arenas cannot be given back only because a single pool is in "
+              "use.\n"
+           << "Used blocks take 0x" << std::hex << usedBytes << " ("
+           << std::dec << usedBytes << ") bytes.\n"
+           << "pymalloc holds 0x" << std::hex << heldBytes << " (" << std::dec
+           << heldBytes << ") bytes beyond the used blocks:\n"
+           << "0x" << std::hex << freeBytes << " (" << std::dec << freeBytes
+           << ") bytes are in free blocks of pools in use.\n"
+           << "0x" << std::hex << emptyPoolBytes << " (" << std::dec
+           << emptyPoolBytes << ") bytes are in empty pools.\n"
+           << "0x" << std::hex << poolTally._poolOverheadBytes << " ("
+           << std::dec << poolTally._poolOverheadBytes
+           << ") bytes are in pool headers and pool tails.\n"
+           << "0x" << std::hex << poolTally._alignmentBytes << " ("
+           << std::dec << poolTally._alignmentBytes
+           << ") bytes are lost to arena alignment.\n";
+  }
+
+ private:
+  const FinderGroup<Offset>& _finderGroup;
+};
+}  // namespace Subcommands
+}  // namespace Python
+}  // namespace chap
@@ -25,6 +25,14 @@ class SizedTally {
     return false;
   }
 
+  /*
+   * Add totals gathered separately, for example on another thread.
+   */
+  void AdjustTally(Offset numItems, Offset numBytes) {
+    _totalItems += numItems;
+    _totalBytes += numBytes;
+  }
+
  private:
   Commands::Context& _context;
   const std::string _itemsLabel;
@@ -10,7 +10,8 @@ template <typename Offset>
 class StackDescriber : public Describer<Offset> {
  public:
   StackDescriber(const ProcessImage<Offset> &processImage)
-      : _threadMap(processImage.GetThreadMap()) {}
+      : _threadMap(processImage.GetThreadMap()),
+        _stackRegistry(processImage.GetStackRegistry()) {}
 
   /*
    * If the address is understood, provide a description for the address,
@@ -23,7 +24,7 @@ class StackDescriber : public Describer<Offset> {
     const typename ThreadMap<Offset>::ThreadInfo *threadInfo =
         _threadMap.find(address);
     if (threadInfo == NULL) {
-      return false;
+      return DescribeRegisteredStack(context, address, showAddresses);
     }
     // TODO: There should be no assumption that the stack is currently
     // associated with a thread.
@@ -54,7 +55,41 @@ class StackDescriber : public Describer<Offset> {
     return true;
   }
 
+  /*
+   * Both the stacks for threads and any registered stacks can be described.
+   */
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    for (const auto &threadInfo : _threadMap) {
+      visitor(threadInfo._stackBase, threadInfo._stackLimit);
+    }
+    for (const auto &stack : _stackRegistry) {
+      visitor(stack._base, stack._limit);
+    }
+    return true;
+  }
+
  protected:
   const ThreadMap<Offset> &_threadMap;
+  const StackRegistry<Offset> &_stackRegistry;
+
+  bool DescribeRegisteredStack(Commands::Context &context, Offset address,
+                               bool showAddresses) const {
+    const typename StackRegistry<Offset>::StackInfo *stack =
+        _stackRegistry.find(address);
+    if (stack == nullptr) {
+      return false;
+    }
+    Commands::Output &output = context.GetOutput();
+    if (showAddresses) {
+      output << "Address 0x" << std::hex << address << " is on the "
+             << ((address >= stack->_stackPointer) ? "live" : "dead")
+             << " part of the stack for " << stack->_stackType << " at 0x"
+             << stack->_owner << ".\n";
+    } else {
+      output << "This stack is used for " << stack->_stackType << " at 0x"
+             << std::hex << stack->_owner << ".\n";
+    }
+    return true;
+  }
 };
 }  // namespace chap
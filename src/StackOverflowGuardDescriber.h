@@ -78,6 +78,19 @@ class StackOverflowGuardDescriber : public Describer<Offset> {
     return true;
   }
 
+  bool VisitRanges(typename Describer<Offset>::RangeVisitor visitor) const {
+    const ClaimedRanges *rangesToCheck[] = {&_inaccessibleRanges,
+                                            &_readOnlyRanges};
+    for (const ClaimedRanges *ranges : rangesToCheck) {
+      for (const auto &range : *ranges) {
+        if (range._value == _processImage.STACK_OVERFLOW_GUARD) {
+          visitor(range._base, range._limit);
+        }
+      }
+    }
+    return true;
+  }
+
  private:
   const ProcessImage<Offset> &_processImage;
   const ThreadMap<Offset> &_threadMap;
@@ -0,0 +1,113 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+namespace chap {
+/*
+ * This keeps track of stacks that are not the stack of any thread in the
+ * process image, such as the stacks of GoLang goroutines.  The stacks are
+ * gathered in a single vector that is sorted just once, when the registry
+ * is resolved, so that registering very many stacks stays cheap.
+ */
+template <typename Offset>
+class StackRegistry {
+ public:
+  struct StackInfo {
+    StackInfo(Offset base, Offset limit, Offset stackPointer,
+              const char *stackType, Offset owner)
+        : _base(base),
+          _limit(limit),
+          _stackPointer(stackPointer),
+          _stackType(stackType),
+          _owner(owner) {}
+    Offset _base;
+    Offset _limit;
+    Offset _stackPointer;    // the live part is [_stackPointer, _limit)
+    const char *_stackType;  // for example, "goroutine"
+    Offset _owner;           // address of the structure that owns the stack
+  };
+  typedef std::vector<StackInfo> Stacks;
+  typedef typename Stacks::const_iterator const_iterator;
+
+  StackRegistry() : _isResolved(false) {}
+
+  void RegisterStack(Offset base, Offset limit, Offset stackPointer,
+                     const char *stackType, Offset owner) {
+    if (_isResolved) {
+      abort();
+    }
+    _stacks.emplace_back(base, limit, stackPointer, stackType, owner);
+  }
+
+  /*
+   * Sort the stacks by address, dropping any that overlap a stack with a
+   * lower address.  No stacks may be registered after this.
+   */
+  void Resolve() {
+    if (_isResolved) {
+      abort();
+    }
+    std::sort(_stacks.begin(), _stacks.end(),
+              [](const StackInfo &left, const StackInfo &right) {
+                return left._base < right._base;
+              });
+    Offset limit = 0;
+    size_t numKept = 0;
+    for (const auto &stack : _stacks) {
+      if (stack._base < limit) {
+        std::cerr << "Warning: " << stack._stackType << " stack at 0x"
+                  << std::hex << stack._base
+                  << " overlaps a previous stack.\n";
+        continue;
+      }
+      _stacks[numKept++] = stack;
+      limit = stack._limit;
+    }
+    _stacks.erase(_stacks.begin() + numKept, _stacks.end());
+    _isResolved = true;
+  }
+
+  bool IsResolved() const { return _isResolved; }
+
+  /*
+   * If the given stack pointer, taken from a thread that is currently
+   * running on one of the registered stacks, is below the saved stack
+   * pointer for that stack, extend the live part of the stack to it.
+   */
+  void AdjustStackPointer(Offset stackPointer) {
+    StackInfo *stack = const_cast<StackInfo *>(find(stackPointer));
+    if (stack != nullptr && stackPointer < stack->_stackPointer) {
+      stack->_stackPointer = stackPointer;
+    }
+  }
+
+  /*
+   * Return the stack that contains the given address, or null if there is
+   * none.
+   */
+  const StackInfo *find(Offset address) const {
+    const_iterator it = std::upper_bound(
+        _stacks.begin(), _stacks.end(), address,
+        [](Offset address, const StackInfo &stack) {
+          return address < stack._base;
+        });
+    if (it == _stacks.begin()) {
+      return nullptr;
+    }
+    --it;
+    return (address < it->_limit) ? &(*it) : nullptr;
+  }
+
+  const_iterator begin() const { return _stacks.begin(); }
+  const_iterator end() const { return _stacks.end(); }
+  size_t NumStacks() const { return _stacks.size(); }
+
+ private:
+  bool _isResolved;
+  Stacks _stacks;
+};
+}  // namespace chap
@@ -0,0 +1,98 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "../Allocations/Directory.h"
+#include "CacheFinder.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Tcmalloc {
+/*
+ * This reports the allocations for the tcmalloc spans, one block per span.
+ * Each object of a span of small objects is an allocation, which is free if
+ * it is on the free list of the span or held by a central free list.
+ * Objects held by thread caches or per-CPU slabs are reported as used, to
+ * be marked as thread cached once the allocation boundaries are resolved.
+ * A span that is not split into objects is a single allocation, used unless
+ * the span is on a free list of the page heap.
+ */
+template <class Offset>
+class AllocationFinder : public Allocations::Directory<Offset>::Finder {
+ public:
+  typedef typename Allocations::Directory<Offset>::Record Record;
+  typedef typename InfrastructureFinder<Offset>::Span Span;
+  typedef typename InfrastructureFinder<Offset>::Spans Spans;
+
+  AllocationFinder(const InfrastructureFinder<Offset>& infrastructureFinder,
+                   const CacheFinder<Offset>& cacheFinder)
+      : _infrastructureFinder(infrastructureFinder),
+        _spans(infrastructureFinder.GetSpans()),
+        _nextSpan(_spans.begin()),
+        _freeInSpans(infrastructureFinder.GetObjectsFreeInSpans()),
+        _nextFreeInSpans(_freeInSpans.begin()),
+        _centralCached(cacheFinder.GetCentralCachedObjects()),
+        _nextCentralCached(_centralCached.begin()) {}
+
+  virtual const Record* NextBlock(size_t& numRecords) {
+    _records.clear();
+    if (_nextSpan == _spans.end()) {
+      numRecords = 0;
+      return (const Record*)(0);
+    }
+    const Span& span = *(_nextSpan++);
+    if (span._sizeClass == 0) {
+      _records.emplace_back(span._base, span._size, !span._isFree);
+    } else {
+      Offset size = _infrastructureFinder.SizeOfClass(span._sizeClass);
+      Offset limit = span._base + (span._size / size) * size;
+      _records.reserve(span._size / size);
+      for (Offset object = span._base; object < limit; object += size) {
+        bool isFree = IsNext(_freeInSpans, _nextFreeInSpans, object);
+        isFree = IsNext(_centralCached, _nextCentralCached, object) || isFree;
+        _records.emplace_back(object, size, !isFree);
+      }
+    }
+    numRecords = _records.size();
+    return _records.data();
+  }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  virtual Offset MinRequestSize(Offset size) {
+    return _infrastructureFinder.MinRequestSize(size);
+  }
+
+ private:
+  typedef typename std::vector<Offset>::const_iterator OffsetIterator;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  const Spans& _spans;
+  typename Spans::const_iterator _nextSpan;
+  const std::vector<Offset>& _freeInSpans;
+  OffsetIterator _nextFreeInSpans;
+  const std::vector<Offset>& _centralCached;
+  OffsetIterator _nextCentralCached;
+  std::vector<Record> _records;
+
+  /*
+   * Return true if the given object is the next one in the given sorted
+   * vector, skipping past it and anything before it.
+   */
+  static bool IsNext(const std::vector<Offset>& objects, OffsetIterator& next,
+                     Offset object) {
+    while (next != objects.end() && *next < object) {
+      ++next;
+    }
+    if (next != objects.end() && *next == object) {
+      ++next;
+      return true;
+    }
+    return false;
+  }
+};
+}  // namespace Tcmalloc
+}  // namespace chap
@@ -0,0 +1,374 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+#include "../VirtualAddressMap.h"
+#include "../VirtualMemoryPartition.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Tcmalloc {
+/*
+ * This finds the small objects that have been handed out of their spans but
+ * are held by tcmalloc rather than by the caller, either on the free lists
+ * of a per-thread cache, in the per-CPU slabs or in the transfer cache slots
+ * of a central free list.  The central free lists of the gperftools version
+ * are found by way of the dummy list heads that the spans of each size class
+ * are linked to.  The thread caches are found by scanning writable memory
+ * for arrays of per-class free lists in which every list holds exactly the
+ * advertised number of objects of the right size class.  The per-CPU slabs
+ * are found by scanning writable memory for slab headers that refer to
+ * objects of the right size class.  The transfer caches of the per-CPU
+ * version are not found, so objects held there are reported as used.
+ */
+template <class Offset>
+class CacheFinder {
+ public:
+  typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename InfrastructureFinder<Offset>::Span Span;
+
+  enum CacheKind { CENTRAL_FREE_LIST, THREAD_CACHE, PER_CPU_SLAB };
+
+  struct Cache {
+    Cache(Offset address, CacheKind kind)
+        : _address(address), _kind(kind), _numEntries(0), _numBytes(0) {}
+    Offset _address;
+    CacheKind _kind;
+    Offset _numEntries;
+    Offset _numBytes;
+  };
+  typedef std::vector<Cache> Caches;
+
+  CacheFinder(VirtualMemoryPartition<Offset>& virtualMemoryPartition,
+              const InfrastructureFinder<Offset>& infrastructureFinder)
+      : _virtualMemoryPartition(virtualMemoryPartition),
+        _addressMap(virtualMemoryPartition.GetAddressMap()),
+        _infrastructureFinder(infrastructureFinder) {}
+
+  void Resolve() {
+    if (_infrastructureFinder.GetSpans().empty()) {
+      return;
+    }
+    Reader reader(_addressMap);
+    if (_infrastructureFinder.GetLayout() ==
+        InfrastructureFinder<Offset>::GPERFTOOLS_LAYOUT) {
+      FindCentralFreeLists(reader);
+    } else {
+      FindPerCpuSlabs(reader);
+    }
+    FindThreadCaches(reader);
+    std::sort(_threadCachedObjects.begin(), _threadCachedObjects.end());
+    std::sort(_centralCachedObjects.begin(), _centralCachedObjects.end());
+  }
+
+  const Caches& GetCaches() const { return _caches; }
+
+  /*
+   * Return the objects held by the thread caches or the per-CPU slabs, in
+   * increasing order of address.
+   */
+  const std::vector<Offset>& GetThreadCachedObjects() const {
+    return _threadCachedObjects;
+  }
+
+  /*
+   * Return the objects held by the central free lists, in increasing order
+   * of address.
+   */
+  const std::vector<Offset>& GetCentralCachedObjects() const {
+    return _centralCachedObjects;
+  }
+
+ private:
+  /*
+   * These describe a CentralFreeList, which starts with a lock and the size
+   * class, followed by the empty and non-empty dummy span list heads, two
+   * counters and the transfer cache slots, each holding the head and tail
+   * of a list of objects, then the number of slots in use.
+   */
+  static constexpr Offset CENTRAL_SIZE_CLASS = 0x8;
+  static constexpr Offset CENTRAL_EMPTY = 0x10;
+  static constexpr Offset CENTRAL_NON_EMPTY = 0x40;
+  static constexpr Offset CENTRAL_SLOTS = 0x80;
+  static constexpr Offset NUM_TRANSFER_SLOTS = 0x40;
+  static constexpr Offset CENTRAL_USED_SLOTS =
+      CENTRAL_SLOTS + NUM_TRANSFER_SLOTS * 2 * sizeof(Offset);
+  /*
+   * Each FreeList in a ThreadCache holds the head of the list, the length of
+   * the list and three other 32-bit counters.
+   */
+  static constexpr Offset FREE_LIST_SIZE = 3 * sizeof(Offset);
+  static constexpr Offset SPAN_NEXT = 2 * sizeof(Offset);
+  static constexpr Offset SPAN_PREV = 3 * sizeof(Offset);
+  static constexpr Offset MAX_LIST_LENGTH = 0x10000;
+  /*
+   * The slab for each CPU starts with a 64-bit header per size class,
+   * holding 16-bit current, end_copy, begin and end fields, each of which
+   * is the index of a word in the slab.  The objects cached for the size
+   * class are in the words from begin up to but not including current.
+   * The header for size class 0 is not used.
+   */
+  static constexpr Offset SLAB_HEADER_SIZE = sizeof(uint64_t);
+
+  VirtualMemoryPartition<Offset>& _virtualMemoryPartition;
+  const VirtualAddressMap<Offset>& _addressMap;
+  const InfrastructureFinder<Offset>& _infrastructureFinder;
+  Caches _caches;
+  std::vector<Offset> _threadCachedObjects;
+  std::vector<Offset> _centralCachedObjects;
+
+  /*
+   * Return true if the object at the given address is a small object of
+   * the given size class that is not on the free list of its span.
+   */
+  bool IsHandedOut(Offset object, Offset sizeClass) const {
+    if (_infrastructureFinder.SizeClassOfObjectAt(object) != sizeClass) {
+      return false;
+    }
+    const std::vector<Offset>& freeInSpans =
+        _infrastructureFinder.GetObjectsFreeInSpans();
+    return !std::binary_search(freeInSpans.begin(), freeInSpans.end(),
+                               object);
+  }
+
+  /*
+   * Follow the list that starts at the given object, appending the objects
+   * to the given vector, for exactly the given number of objects if
+   * numObjects is non-zero or until the given tail otherwise.  Return false,
+   * leaving the vector as it was, if the list is not a null terminated list
+   * of handed out objects of the given size class.
+   */
+  bool FollowList(Reader& reader, Offset object, Offset sizeClass,
+                  Offset numObjects, Offset tail,
+                  std::vector<Offset>& objects) const {
+    size_t numObjectsBefore = objects.size();
+    Offset limit = (numObjects != 0) ? numObjects : MAX_LIST_LENGTH;
+    for (Offset i = 0; i < limit; i++) {
+      if (object == 0 || !IsHandedOut(object, sizeClass)) {
+        break;
+      }
+      objects.push_back(object);
+      Offset next = reader.ReadOffset(object, 1);
+      if (numObjects == 0 && object == tail) {
+        if (next == 0) {
+          return true;
+        }
+        break;
+      }
+      object = next;
+      if (numObjects != 0 && i + 1 == numObjects && object == 0) {
+        return true;
+      }
+    }
+    objects.resize(numObjectsBefore);
+    return false;
+  }
+
+  void FindCentralFreeLists(Reader& reader) {
+    const typename InfrastructureFinder<Offset>::Spans& spans =
+        _infrastructureFinder.GetSpans();
+    std::set<Offset> headers;
+    for (const auto& span : spans) {
+      headers.insert(span._header);
+    }
+    std::set<Offset> checked;
+    for (const auto& span : spans) {
+      if (span._sizeClass == 0) {
+        continue;
+      }
+      for (Offset link : {reader.ReadOffset(span._header + SPAN_NEXT, 0),
+                          reader.ReadOffset(span._header + SPAN_PREV, 0)}) {
+        /*
+         * A dummy list head is a span with no pages.
+         */
+        if (link == 0 || headers.find(link) != headers.end() ||
+            reader.ReadOffset(link, 1) != 0 ||
+            reader.ReadOffset(link + sizeof(Offset), 1) != 0) {
+          continue;
+        }
+        for (Offset listHead :
+             {link - CENTRAL_EMPTY, link - CENTRAL_NON_EMPTY}) {
+          if (checked.insert(listHead).second &&
+              reader.ReadOffset(listHead + CENTRAL_SIZE_CLASS, 0) ==
+                  span._sizeClass) {
+            CheckCentralFreeList(reader, listHead, span._sizeClass);
+          }
+        }
+      }
+    }
+  }
+
+  void CheckCentralFreeList(Reader& reader, Offset centralFreeList,
+                            Offset sizeClass) {
+    uint32_t numUsedSlots =
+        reader.ReadU32(centralFreeList + CENTRAL_USED_SLOTS, 0xffffffff);
+    if (numUsedSlots > NUM_TRANSFER_SLOTS) {
+      return;
+    }
+    Cache cache(centralFreeList, CENTRAL_FREE_LIST);
+    size_t numObjectsBefore = _centralCachedObjects.size();
+    for (Offset slot = 0; slot < numUsedSlots; slot++) {
+      Offset entry =
+          centralFreeList + CENTRAL_SLOTS + slot * 2 * sizeof(Offset);
+      FollowList(reader, reader.ReadOffset(entry, 0), sizeClass, 0,
+                 reader.ReadOffset(entry + sizeof(Offset), 0),
+                 _centralCachedObjects);
+    }
+    cache._numEntries = _centralCachedObjects.size() - numObjectsBefore;
+    cache._numBytes =
+        cache._numEntries * _infrastructureFinder.SizeOfClass(sizeClass);
+    _caches.push_back(cache);
+  }
+
+  void FindThreadCaches(Reader& reader) {
+    const typename InfrastructureFinder<Offset>::Spans& spans =
+        _infrastructureFinder.GetSpans();
+    Offset minObject = spans.front()._base;
+    Offset maxObject = spans.back()._base + spans.back()._size;
+    Offset numSizeClasses = _infrastructureFinder.NumSizeClasses();
+    std::set<Offset> checked;
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      const Offset* words = (const Offset*)(image);
+      Offset numWords = range._size / sizeof(Offset);
+      for (Offset i = 0; i + 1 < numWords; i++) {
+        Offset object = words[i];
+        if (object < minObject || object >= maxObject ||
+            (uint32_t)(words[i + 1]) == 0) {
+          continue;
+        }
+        Offset sizeClass = _infrastructureFinder.SizeClassOfObjectAt(object);
+        if (sizeClass == 0) {
+          continue;
+        }
+        Offset freeListOffset = sizeClass * FREE_LIST_SIZE;
+        Offset offset = i * sizeof(Offset);
+        if (offset < freeListOffset ||
+            offset - freeListOffset + numSizeClasses * FREE_LIST_SIZE >
+                range._size) {
+          continue;
+        }
+        Offset freeLists = range._base + offset - freeListOffset;
+        if (words[i - freeListOffset / sizeof(Offset)] == 0 &&
+            (uint32_t)(words[i - freeListOffset / sizeof(Offset) + 1]) == 0 &&
+            checked.insert(freeLists).second) {
+          CheckThreadCache(reader, freeLists, numSizeClasses);
+        }
+      }
+    }
+  }
+
+  void CheckThreadCache(Reader& reader, Offset freeLists,
+                        Offset numSizeClasses) {
+    std::vector<Offset> objects;
+    for (Offset sizeClass = 1; sizeClass < numSizeClasses; sizeClass++) {
+      Offset freeList = freeLists + sizeClass * FREE_LIST_SIZE;
+      Offset head = reader.ReadOffset(freeList, 1);
+      Offset length = reader.ReadU32(freeList + sizeof(Offset), 0xffffffff);
+      if (head == 0 && length == 0) {
+        continue;
+      }
+      if (length > MAX_LIST_LENGTH ||
+          !FollowList(reader, head, sizeClass, length, 0, objects)) {
+        return;
+      }
+    }
+    Cache cache(freeLists, THREAD_CACHE);
+    cache._numEntries = objects.size();
+    for (Offset object : objects) {
+      cache._numBytes += _infrastructureFinder.SizeOfClass(
+          _infrastructureFinder.SizeClassOfObjectAt(object));
+    }
+    _caches.push_back(cache);
+    _threadCachedObjects.insert(_threadCachedObjects.end(), objects.begin(),
+                                objects.end());
+  }
+
+  /*
+   * Look for headers of non-empty per-CPU lists.  The position of such a
+   * header in the slab is given by the size class, which is not known, so
+   * each size class is tried for which the first cached object would be of
+   * that size class.
+   */
+  void FindPerCpuSlabs(Reader& reader) {
+    Offset numSizeClasses = _infrastructureFinder.NumSizeClasses();
+    std::set<Offset> checked;
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      const uint64_t* headers = (const uint64_t*)(image);
+      Offset numHeaders = range._size / SLAB_HEADER_SIZE;
+      for (Offset i = 1; i < numHeaders; i++) {
+        Offset current = headers[i] & 0xffff;
+        Offset begin = (headers[i] >> 32) & 0xffff;
+        Offset end = headers[i] >> 48;
+        if (begin < numSizeClasses || current <= begin || current > end) {
+          continue;
+        }
+        for (Offset sizeClass = 1; sizeClass < numSizeClasses && sizeClass <= i;
+             sizeClass++) {
+          Offset slab = range._base + (i - sizeClass) * SLAB_HEADER_SIZE;
+          if (IsHandedOut(reader.ReadOffset(slab + begin * sizeof(Offset), 0),
+                          sizeClass) &&
+              checked.insert(slab).second) {
+            CheckPerCpuSlab(reader, slab, numSizeClasses);
+          }
+        }
+      }
+    }
+  }
+
+  void CheckPerCpuSlab(Reader& reader, Offset slab, Offset numSizeClasses) {
+    if (reader.ReadU64(slab, 1) != 0) {
+      return;
+    }
+    std::vector<Offset> objects;
+    Offset limit = numSizeClasses;
+    for (Offset sizeClass = 1; sizeClass < numSizeClasses; sizeClass++) {
+      uint64_t header = reader.ReadU64(slab + sizeClass * SLAB_HEADER_SIZE, 1);
+      if (header == 0) {
+        continue;
+      }
+      Offset current = header & 0xffff;
+      Offset begin = (header >> 32) & 0xffff;
+      Offset end = header >> 48;
+      if (begin < limit || current < begin || current > end) {
+        return;
+      }
+      for (Offset slot = begin; slot < current; slot++) {
+        Offset object = reader.ReadOffset(slab + slot * sizeof(Offset), 0);
+        if (!IsHandedOut(object, sizeClass)) {
+          return;
+        }
+        objects.push_back(object);
+      }
+      limit = end;
+    }
+    Cache cache(slab, PER_CPU_SLAB);
+    cache._numEntries = objects.size();
+    for (Offset object : objects) {
+      cache._numBytes += _infrastructureFinder.SizeOfClass(
+          _infrastructureFinder.SizeClassOfObjectAt(object));
+    }
+    _caches.push_back(cache);
+    _threadCachedObjects.insert(_threadCachedObjects.end(), objects.begin(),
+                                objects.end());
+  }
+};
+}  // namespace Tcmalloc
+}  // namespace chap
@@ -0,0 +1,71 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <memory>
+#include "../Allocations/Directory.h"
+#include "../VirtualMemoryPartition.h"
+#include "AllocationFinder.h"
+#include "CacheFinder.h"
+#include "InfrastructureFinder.h"
+
+namespace chap {
+namespace Tcmalloc {
+template <class Offset>
+class FinderGroup {
+ public:
+  typedef typename Allocations::Directory<Offset>::AllocationIndex
+      AllocationIndex;
+  typedef typename Allocations::Directory<Offset>::Allocation Allocation;
+  typedef typename Allocations::Directory<Offset>::AllocationPointer
+      AllocationPointer;
+
+  FinderGroup(VirtualMemoryPartition<Offset>& virtualMemoryPartition,
+              Allocations::Directory<Offset>& allocationDirectory)
+      : _allocationDirectory(allocationDirectory),
+        _infrastructureFinder(virtualMemoryPartition),
+        _cacheFinder(virtualMemoryPartition, _infrastructureFinder) {}
+
+  void Resolve() {
+    _infrastructureFinder.Resolve();
+    if (_infrastructureFinder.GetSpans().empty()) {
+      return;
+    }
+    _cacheFinder.Resolve();
+    _allocationFinder.reset(
+        new AllocationFinder<Offset>(_infrastructureFinder, _cacheFinder));
+    _allocationDirectory.AddFinder(_allocationFinder.get());
+    if (!_cacheFinder.GetThreadCachedObjects().empty()) {
+      /*
+       * Objects held by thread caches or per-CPU slabs can be marked only
+       * after all the allocations are known.
+       */
+      _allocationDirectory.AddResolutionDoneCallback([this]() {
+        for (Offset object : _cacheFinder.GetThreadCachedObjects()) {
+          AllocationIndex index =
+              _allocationDirectory.AllocationIndexOf(object);
+          AllocationPointer allocation =
+              _allocationDirectory.AllocationAt(index);
+          if (allocation != nullptr && allocation->Address() == object) {
+            _allocationDirectory.MarkAsThreadCached(index);
+          }
+        }
+      });
+    }
+  }
+
+  const InfrastructureFinder<Offset>& GetInfrastructureFinder() const {
+    return _infrastructureFinder;
+  }
+
+  const CacheFinder<Offset>& GetCacheFinder() const { return _cacheFinder; }
+
+ private:
+  Allocations::Directory<Offset>& _allocationDirectory;
+  InfrastructureFinder<Offset> _infrastructureFinder;
+  CacheFinder<Offset> _cacheFinder;
+  std::unique_ptr<AllocationFinder<Offset> > _allocationFinder;
+};
+
+}  // namespace Tcmalloc
+}  // namespace chap
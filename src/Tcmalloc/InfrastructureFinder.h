@@ -0,0 +1,682 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "../VirtualAddressMap.h"
+#include "../VirtualMemoryPartition.h"
+
+namespace chap {
+namespace Tcmalloc {
+/*
+ * This finds the size classes and the spans used by tcmalloc, either the
+ * gperftools version or the newer version with per-CPU caches.  The size
+ * classes are read from the class_to_size_ array of the static SizeMap,
+ * which is recognized by its first few entries and by reaching the largest
+ * small size, and which may have 32-bit or 64-bit entries.  The spans are
+ * found by scanning writable memory for Span structures that describe either
+ * an in-use span or a span on the normal free list of the page heap, and each
+ * candidate is accepted only if the page map refers to it for its first and
+ * last pages.  Neither the layout nor the page size is known in advance, so
+ * the common choices are all tried and the one that yields the most spans
+ * wins.  For a span of small objects, the objects on the free list of the
+ * span are checked against the count of objects handed out of the span so
+ * that random data is unlikely to be taken as a span.  Only 64-bit processes
+ * are supported.
+ */
+template <class Offset>
+class InfrastructureFinder {
+ public:
+  typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
+
+  enum Layout {
+    /*
+     * The Span of the gperftools version holds the page number and count
+     * first, followed by the links and a free list of objects linked through
+     * their first words.  The size class is in the Span.
+     */
+    GPERFTOOLS_LAYOUT,
+    /*
+     * The Span of the per-CPU version holds the links first and the page
+     * number and count last, and the free objects are kept as 16-bit object
+     * indices.  The size class is only in the page map.
+     */
+    PER_CPU_LAYOUT
+  };
+
+  struct Span {
+    Span(Offset header, Offset base, Offset size, Offset sizeClass,
+         Offset numUsed, Offset freeList, bool isFree, bool isSampled)
+        : _header(header),
+          _base(base),
+          _size(size),
+          _sizeClass(sizeClass),
+          _numUsed(numUsed),
+          _freeList(freeList),
+          _isFree(isFree),
+          _isSampled(isSampled) {}
+    Offset _header;     // address of the Span structure
+    Offset _base;       // start of the first page of the span
+    Offset _size;       // size of the span, in bytes
+    Offset _sizeClass;  // 0 for a span that is not split into objects
+    Offset _numUsed;    // objects handed out of the span to the caches
+    Offset _freeList;   // first free object, for the gperftools layout
+    bool _isFree;       // on the normal free list of the page heap
+    bool _isSampled;    // holds a single sampled allocation
+  };
+  typedef std::vector<Span> Spans;
+
+  InfrastructureFinder(VirtualMemoryPartition<Offset>& virtualMemoryPartition)
+      : TCMALLOC_SPAN("tcmalloc span"),
+        TCMALLOC_FREE_SPAN("tcmalloc free span"),
+        _virtualMemoryPartition(virtualMemoryPartition),
+        _addressMap(virtualMemoryPartition.GetAddressMap()),
+        _classToSize(0),
+        _layout(GPERFTOOLS_LAYOUT),
+        _pageShift(0) {}
+
+  void Resolve() {
+    if (sizeof(Offset) != 8) {
+      return;
+    }
+    FindSizeClasses();
+    if (_sizes.empty()) {
+      return;
+    }
+    std::vector<Candidate> candidates;
+    FindCandidates(candidates);
+    if (candidates.empty()) {
+      return;
+    }
+    ConfirmCandidates(candidates);
+    AcceptConfirmedCandidates(candidates);
+    FindObjectsFreeInSpans();
+    ClaimSpans();
+  }
+
+  /*
+   * Return the address of the class_to_size_ array, or 0 if it was not
+   * found.
+   */
+  Offset ClassToSize() const { return _classToSize; }
+  Layout GetLayout() const { return _layout; }
+  Offset PageShift() const { return _pageShift; }
+  Offset NumSizeClasses() const { return _sizes.size(); }
+  Offset SizeOfClass(Offset sizeClass) const { return _sizes[sizeClass]; }
+  const Spans& GetSpans() const { return _spans; }
+
+  /*
+   * Return the objects that are on the free lists of the spans, in
+   * increasing order of address.
+   */
+  const std::vector<Offset>& GetObjectsFreeInSpans() const {
+    return _objectsFreeInSpans;
+  }
+
+  /*
+   * Return the span that contains the given address, or null if there is
+   * none.
+   */
+  const Span* SpanContaining(Offset address) const {
+    typename Spans::const_iterator it = std::upper_bound(
+        _spans.begin(), _spans.end(), address,
+        [](Offset address, const Span& span) { return address < span._base; });
+    if (it == _spans.begin()) {
+      return (const Span*)(0);
+    }
+    --it;
+    return (address < it->_base + it->_size) ? &(*it) : (const Span*)(0);
+  }
+
+  /*
+   * Return the size class of the small object that starts at the given
+   * address, or 0 if the address is not the start of such an object.
+   */
+  Offset SizeClassOfObjectAt(Offset address) const {
+    const Span* span = SpanContaining(address);
+    if (span == (const Span*)(0) || span->_sizeClass == 0) {
+      return 0;
+    }
+    Offset size = _sizes[span->_sizeClass];
+    Offset offset = address - span->_base;
+    if ((offset % size) != 0 || offset + size > span->_size) {
+      return 0;
+    }
+    return span->_sizeClass;
+  }
+
+  /*
+   * Return the smallest request size that might reasonably have resulted
+   * in an allocation of the given size.
+   */
+  Offset MinRequestSize(Offset size) const {
+    typename std::vector<Offset>::const_iterator it =
+        std::lower_bound(_sizes.begin(), _sizes.end(), size);
+    if (it == _sizes.end()) {
+      return size - (((Offset)(1)) << _pageShift) + 1;
+    }
+    return (it == _sizes.begin()) ? 1 : (*(it - 1) + 1);
+  }
+
+ private:
+  static constexpr Offset MIN_LARGEST_SMALL_SIZE = 0x8000;
+  static constexpr Offset MAX_LARGEST_SMALL_SIZE = 0x40000;
+  static constexpr Offset MIN_SIZE_CLASSES = 20;
+  static constexpr Offset MAX_SPAN_PAGES = 0x100000;
+  static constexpr Offset SPAN_FIELDS = 6;
+  static constexpr unsigned NUM_VARIANTS = 8;
+  static constexpr unsigned LG_VADDR = 48;
+  /*
+   * These describe the Span of the per-CPU version, which starts with the
+   * next and prev links.  Then come allocated_, embed_count_ and freelist_
+   * as 16-bit fields, cache_size_ as an 8-bit field and a byte with 2 bits
+   * of location and a bit that is set for a sampled allocation.  Then comes
+   * a union that holds the embedded cache of 16-bit object indices for a
+   * span of small objects, followed by first_page_ and num_pages_.
+   */
+  static constexpr Offset PER_CPU_SPAN_BITS = 0x10;
+  static constexpr Offset PER_CPU_SPAN_CACHE = 0x18;
+  static constexpr Offset PER_CPU_SPAN_FIRST_PAGE = 4;
+  static constexpr Offset PER_CPU_SPAN_NUM_PAGES = 5;
+  static constexpr Offset PER_CPU_CACHE_SIZE = 4;
+  static constexpr uint16_t PER_CPU_LIST_END = 0xffff;
+  /*
+   * An object index is the offset in the span divided by 8 for objects
+   * smaller than 512 bytes and by 64 for larger ones.
+   */
+  static constexpr Offset PER_CPU_MIN_COARSE_SIZE = 0x200;
+  /*
+   * Each leaf of the page map of the per-CPU version covers 2^15 pages,
+   * with an array of one byte size classes followed by an array of span
+   * pointers.
+   */
+  static constexpr Offset PER_CPU_LEAF_LENGTH = 0x8000;
+
+  struct Variant {
+    Layout _layout;
+    Offset _pageShift;
+  };
+
+  struct Candidate {
+    Candidate(const Span& span, unsigned variantIndex)
+        : _span(span), _variantIndex(variantIndex), _confirmed(false) {}
+    Span _span;
+    unsigned _variantIndex;
+    bool _confirmed;
+  };
+
+  const char* TCMALLOC_SPAN;
+  const char* TCMALLOC_FREE_SPAN;
+  VirtualMemoryPartition<Offset>& _virtualMemoryPartition;
+  const VirtualAddressMap<Offset>& _addressMap;
+  Offset _classToSize;
+  Layout _layout;
+  Offset _pageShift;
+  std::vector<Offset> _sizes;
+  Spans _spans;
+  std::vector<Offset> _objectsFreeInSpans;
+
+  static const Variant& VariantFor(unsigned variantIndex) {
+    static const Variant variants[NUM_VARIANTS] = {
+        {GPERFTOOLS_LAYOUT, 13}, {GPERFTOOLS_LAYOUT, 15},
+        {GPERFTOOLS_LAYOUT, 16}, {GPERFTOOLS_LAYOUT, 12},
+        {PER_CPU_LAYOUT, 13},    {PER_CPU_LAYOUT, 12},
+        {PER_CPU_LAYOUT, 15},    {PER_CPU_LAYOUT, 18}};
+    return variants[variantIndex];
+  }
+
+  /*
+   * Look for class_to_size_, which starts with 0 for the unused class 0,
+   * followed by 8 and 16 and then strictly increasing multiples of 8 up to
+   * the largest small size.  Depending on the version the entries are 32 or
+   * 64 bits.
+   */
+  void FindSizeClasses() {
+    typename VirtualAddressMap<Offset>::const_iterator itEnd =
+        _addressMap.end();
+    for (typename VirtualAddressMap<Offset>::const_iterator it =
+             _addressMap.begin();
+         it != itEnd; ++it) {
+      if ((it.Flags() & RangeAttributes::IS_WRITABLE) == 0) {
+        continue;
+      }
+      const char* image = it.GetImage();
+      if (image == (const char*)(0)) {
+        continue;
+      }
+      if (FindSizeClasses((const uint64_t*)(image), it.Size() / 8,
+                          it.Base()) ||
+          FindSizeClasses((const uint32_t*)(image), it.Size() / 4,
+                          it.Base())) {
+        return;
+      }
+    }
+  }
+
+  template <typename Entry>
+  bool FindSizeClasses(const Entry* entries, Offset numEntries, Offset base) {
+    for (Offset i = 0; i + MIN_SIZE_CLASSES < numEntries; i++) {
+      if (entries[i] != 0 || entries[i + 1] != 8 || entries[i + 2] != 16) {
+        continue;
+      }
+      Offset limit = i + 2;
+      while (limit + 1 < numEntries && entries[limit + 1] > entries[limit] &&
+             (entries[limit + 1] & 7) == 0 &&
+             entries[limit + 1] <= MAX_LARGEST_SMALL_SIZE) {
+        limit++;
+      }
+      if (limit - i + 1 < MIN_SIZE_CLASSES ||
+          entries[limit] < MIN_LARGEST_SMALL_SIZE) {
+        continue;
+      }
+      _classToSize = base + i * sizeof(Entry);
+      _sizes.assign(entries + i, entries + limit + 1);
+      return true;
+    }
+    return false;
+  }
+
+  void FindCandidates(std::vector<Candidate>& candidates) {
+    Reader reader(_addressMap);
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      const Offset* words = (const Offset*)(image);
+      Offset numWords = range._size / sizeof(Offset);
+      for (Offset i = 0; i + SPAN_FIELDS <= numWords; i++) {
+        bool mightBeGperftools = MightBeGperftoolsSpan(words + i);
+        bool mightBePerCpu = MightBePerCpuSpan(words + i);
+        if (!mightBeGperftools && !mightBePerCpu) {
+          continue;
+        }
+        Offset header = range._base + i * sizeof(Offset);
+        for (unsigned variantIndex = 0; variantIndex < NUM_VARIANTS;
+             variantIndex++) {
+          if (VariantFor(variantIndex)._layout == GPERFTOOLS_LAYOUT) {
+            if (mightBeGperftools) {
+              CheckGperftoolsCandidate(reader, header, words + i,
+                                       variantIndex, candidates);
+            }
+          } else if (mightBePerCpu) {
+            CheckPerCpuCandidate(header, words + i, variantIndex, candidates);
+          }
+        }
+      }
+    }
+  }
+
+  bool MightBeGperftoolsSpan(const Offset* fields) const {
+    uint32_t bits = (uint32_t)(fields[5]);
+    return fields[0] != 0 && fields[1] != 0 && fields[1] < MAX_SPAN_PAGES &&
+           ((bits >> 24) & 3) <= 1 && ((bits >> 16) & 0xff) < _sizes.size();
+  }
+
+  bool MightBePerCpuSpan(const Offset* fields) const {
+    uint64_t bits = fields[PER_CPU_SPAN_BITS / sizeof(Offset)];
+    Offset cacheSize = (bits >> 48) & 0xff;
+    Offset flags = bits >> 56;
+    return fields[PER_CPU_SPAN_FIRST_PAGE] != 0 &&
+           fields[PER_CPU_SPAN_NUM_PAGES] != 0 &&
+           fields[PER_CPU_SPAN_NUM_PAGES] < MAX_SPAN_PAGES &&
+           cacheSize <= PER_CPU_CACHE_SIZE && (flags & 3) <= 1 &&
+           (flags >> 3) == 0;
+  }
+
+  /*
+   * Return true if the given page number and count describe mapped memory
+   * for the given page size.
+   */
+  bool IsMappedSpan(Offset startPage, Offset numPages, Offset pageShift) const {
+    if ((startPage >> (LG_VADDR - pageShift)) != 0) {
+      return false;
+    }
+    Offset base = startPage << pageShift;
+    Offset size = numPages << pageShift;
+    return _addressMap.find(base) != _addressMap.end() &&
+           _addressMap.find(base + size - 1) != _addressMap.end();
+  }
+
+  /*
+   * Check whether the given fields describe a span with the gperftools
+   * layout for the page size given by the variant index and if so add a
+   * candidate.  The fields are start, length, next, prev and objects,
+   * followed by a word with refcount in the low 16 bits, the size class in
+   * the next 8 bits, then 2 bits of location and a bit that is set for a
+   * sampled allocation.
+   */
+  void CheckGperftoolsCandidate(Reader& reader, Offset header,
+                                const Offset* fields, unsigned variantIndex,
+                                std::vector<Candidate>& candidates) {
+    Offset pageShift = VariantFor(variantIndex)._pageShift;
+    Offset startPage = fields[0];
+    Offset numPages = fields[1];
+    Offset freeList = fields[4];
+    uint32_t bits = (uint32_t)(fields[5]);
+    Offset numUsed = bits & 0xffff;
+    Offset sizeClass = (bits >> 16) & 0xff;
+    bool isFree = ((bits >> 24) & 3) != 0;
+    bool isSampled = ((bits >> 26) & 1) != 0;
+    if (!IsMappedSpan(startPage, numPages, pageShift)) {
+      return;
+    }
+    Offset base = startPage << pageShift;
+    Offset size = numPages << pageShift;
+    if (isFree || sizeClass == 0) {
+      /*
+       * The objects field of a sampled span refers to the stack trace
+       * rather than to a free list.
+       */
+      if (sizeClass != 0 || numUsed != 0 || (isFree && isSampled) ||
+          (freeList != 0 && !isSampled)) {
+        return;
+      }
+      freeList = 0;
+    } else {
+      if (isSampled) {
+        return;
+      }
+      Offset objectSize = _sizes[sizeClass];
+      Offset numObjects = size / objectSize;
+      if (numObjects == 0 || numUsed > numObjects) {
+        return;
+      }
+      Offset numFree = 0;
+      for (Offset object = freeList; object != 0;
+           object = reader.ReadOffset(object, 1)) {
+        if (object < base || object >= base + numObjects * objectSize ||
+            ((object - base) % objectSize) != 0 ||
+            ++numFree > numObjects - numUsed) {
+          return;
+        }
+      }
+      if (numFree != numObjects - numUsed) {
+        return;
+      }
+    }
+    candidates.emplace_back(Span(header, base, size, sizeClass, numUsed,
+                                 freeList, isFree, isSampled),
+                            variantIndex);
+  }
+
+  /*
+   * Check whether the given fields describe a span with the per-CPU layout
+   * for the page size given by the variant index and if so add a candidate.
+   * The size class is known only once the page map entry is found, so the
+   * free list is checked when the candidate is confirmed.
+   */
+  void CheckPerCpuCandidate(Offset header, const Offset* fields,
+                            unsigned variantIndex,
+                            std::vector<Candidate>& candidates) {
+    Offset pageShift = VariantFor(variantIndex)._pageShift;
+    Offset startPage = fields[PER_CPU_SPAN_FIRST_PAGE];
+    Offset numPages = fields[PER_CPU_SPAN_NUM_PAGES];
+    uint64_t bits = fields[PER_CPU_SPAN_BITS / sizeof(Offset)];
+    Offset numUsed = bits & 0xffff;
+    bool isFree = ((bits >> 56) & 3) != 0;
+    bool isSampled = ((bits >> 58) & 1) != 0;
+    if ((isFree && isSampled) ||
+        !IsMappedSpan(startPage, numPages, pageShift)) {
+      return;
+    }
+    candidates.emplace_back(
+        Span(header, startPage << pageShift, numPages << pageShift, 0, numUsed,
+             0, isFree, isSampled),
+        variantIndex);
+  }
+
+  /*
+   * Find the free objects of a span with the per-CPU layout, given the size
+   * class from the page map, returning false if they are not consistent with
+   * the span.  Up to 4 free objects are in the cache embedded in the span.
+   * The rest are on a list of free objects, linked by the object index in
+   * the first 16 bits of each, where each object also holds object indices
+   * of other free objects.  The first object on the list holds embed_count_
+   * of them and each of the others is full.
+   */
+  bool FindPerCpuFreeObjects(Reader& reader, const Span& span,
+                             Offset sizeClass,
+                             std::vector<Offset>& freeObjects) const {
+    freeObjects.clear();
+    Offset objectSize = _sizes[sizeClass];
+    Offset numObjects = span._size / objectSize;
+    if (numObjects == 0 || span._numUsed > numObjects) {
+      return false;
+    }
+    Offset numFree = numObjects - span._numUsed;
+    uint64_t bits = reader.ReadU64(span._header + PER_CPU_SPAN_BITS, 0);
+    Offset numCached = (bits >> 48) & 0xff;
+    Offset numIndices = (bits >> 16) & 0xffff;
+    uint16_t index = (bits >> 32) & 0xffff;
+    if (numCached > numFree) {
+      return false;
+    }
+    for (Offset i = 0; i < numCached; i++) {
+      if (!AddPerCpuFreeObject(
+              reader.ReadU16(span._header + PER_CPU_SPAN_CACHE + i * 2,
+                             PER_CPU_LIST_END),
+              span, objectSize, numObjects, freeObjects)) {
+        return false;
+      }
+    }
+    while (index != PER_CPU_LIST_END) {
+      if (freeObjects.size() >= numFree ||
+          numIndices > objectSize / 2 - 1 ||
+          !AddPerCpuFreeObject(index, span, objectSize, numObjects,
+                               freeObjects)) {
+        return false;
+      }
+      Offset holder = freeObjects.back();
+      for (Offset i = 1; i <= numIndices; i++) {
+        if (!AddPerCpuFreeObject(
+                reader.ReadU16(holder + i * 2, PER_CPU_LIST_END), span,
+                objectSize, numObjects, freeObjects)) {
+          return false;
+        }
+      }
+      index = reader.ReadU16(holder, PER_CPU_LIST_END);
+      numIndices = objectSize / 2 - 1;
+    }
+    if (freeObjects.size() != numFree) {
+      return false;
+    }
+    std::vector<Offset> sorted(freeObjects);
+    std::sort(sorted.begin(), sorted.end());
+    return std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+  }
+
+  bool AddPerCpuFreeObject(uint16_t index, const Span& span, Offset objectSize,
+                           Offset numObjects,
+                           std::vector<Offset>& freeObjects) const {
+    Offset offset =
+        index * ((objectSize < PER_CPU_MIN_COARSE_SIZE) ? 8 : 0x40);
+    if (index == PER_CPU_LIST_END || (offset % objectSize) != 0 ||
+        offset / objectSize >= numObjects) {
+      return false;
+    }
+    freeObjects.push_back(span._base + offset);
+    return true;
+  }
+
+  /*
+   * Look for page map entries that refer to the candidates.  The page map
+   * is a radix tree with leaves that hold one pointer to a span per page,
+   * so the entries for the first and last pages of a span are separated
+   * by one pointer per page.
+   */
+  void ConfirmCandidates(std::vector<Candidate>& candidates) {
+    Reader reader(_addressMap);
+    std::vector<Offset> freeObjects;
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& left, const Candidate& right) {
+                return left._span._header < right._span._header;
+              });
+    Offset minHeader = candidates.front()._span._header;
+    Offset maxHeader = candidates.back()._span._header;
+    for (const auto& range :
+         _virtualMemoryPartition.GetUnclaimedWritableRangesWithImages()) {
+      const char* image;
+      Offset numBytesFound =
+          _addressMap.FindMappedMemoryImage(range._base, &image);
+      if (numBytesFound < range._size) {
+        continue;
+      }
+      const Offset* words = (const Offset*)(image);
+      Offset numWords = range._size / sizeof(Offset);
+      for (Offset i = 0; i < numWords; i++) {
+        Offset header = words[i];
+        if (header < minHeader || header > maxHeader) {
+          continue;
+        }
+        typename std::vector<Candidate>::iterator it = std::lower_bound(
+            candidates.begin(), candidates.end(), header,
+            [](const Candidate& candidate, Offset header) {
+              return candidate._span._header < header;
+            });
+        for (; it != candidates.end() && it->_span._header == header; ++it) {
+          if (it->_confirmed) {
+            continue;
+          }
+          if (VariantFor(it->_variantIndex)._layout == GPERFTOOLS_LAYOUT) {
+            Offset lastPage =
+                (it->_span._size >> VariantFor(it->_variantIndex)._pageShift) -
+                1;
+            if (i + lastPage < numWords && words[i + lastPage] == header) {
+              it->_confirmed = true;
+            }
+          } else {
+            it->_confirmed =
+                ConfirmPerCpuCandidate(reader, range._base, words, i, numWords,
+                                       *it, freeObjects);
+          }
+        }
+      }
+    }
+  }
+
+  /*
+   * Check whether the given word, which refers to a candidate with the
+   * per-CPU layout, is the page map entry for the first page of the span.
+   * The position of the entry in the leaf is given by the page number, and
+   * the size class is in the byte array that precedes the span pointers.
+   */
+  bool ConfirmPerCpuCandidate(Reader& reader, Offset rangeBase,
+                              const Offset* words, Offset i, Offset numWords,
+                              Candidate& candidate,
+                              std::vector<Offset>& freeObjects) const {
+    Span& span = candidate._span;
+    Offset pageShift = VariantFor(candidate._variantIndex)._pageShift;
+    Offset numPages = span._size >> pageShift;
+    Offset indexInLeaf = (span._base >> pageShift) & (PER_CPU_LEAF_LENGTH - 1);
+    if (indexInLeaf > 0 && i > 0 && words[i - 1] == span._header) {
+      return false;
+    }
+    if (indexInLeaf + numPages <= PER_CPU_LEAF_LENGTH &&
+        (i + numPages - 1 >= numWords ||
+         words[i + numPages - 1] != span._header)) {
+      return false;
+    }
+    Offset spans = rangeBase + (i - indexInLeaf) * sizeof(Offset);
+    Offset sizeClass =
+        reader.ReadU8(spans - PER_CPU_LEAF_LENGTH + indexInLeaf, 0xff);
+    if (sizeClass >= _sizes.size()) {
+      return false;
+    }
+    if (sizeClass == 0) {
+      return true;
+    }
+    if (span._isFree || span._isSampled ||
+        !FindPerCpuFreeObjects(reader, span, sizeClass, freeObjects)) {
+      return false;
+    }
+    span._sizeClass = sizeClass;
+    return true;
+  }
+
+  /*
+   * Keep the confirmed candidates for the layout and page size that were
+   * confirmed most often, dropping any that overlap a span already accepted.
+   */
+  void AcceptConfirmedCandidates(const std::vector<Candidate>& candidates) {
+    size_t numConfirmed[NUM_VARIANTS] = {0};
+    for (const auto& candidate : candidates) {
+      if (candidate._confirmed) {
+        numConfirmed[candidate._variantIndex]++;
+      }
+    }
+    unsigned variantIndex = 0;
+    for (unsigned i = 1; i < NUM_VARIANTS; i++) {
+      if (numConfirmed[i] > numConfirmed[variantIndex]) {
+        variantIndex = i;
+      }
+    }
+    if (numConfirmed[variantIndex] == 0) {
+      return;
+    }
+    _layout = VariantFor(variantIndex)._layout;
+    _pageShift = VariantFor(variantIndex)._pageShift;
+    for (const auto& candidate : candidates) {
+      if (candidate._confirmed && candidate._variantIndex == variantIndex) {
+        _spans.push_back(candidate._span);
+      }
+    }
+    std::sort(_spans.begin(), _spans.end(),
+              [](const Span& left, const Span& right) {
+                return left._base < right._base;
+              });
+    Offset limit = 0;
+    size_t numKept = 0;
+    for (const auto& span : _spans) {
+      if (span._base < limit) {
+        std::cerr << "Warning: tcmalloc span at 0x" << std::hex
+                  << span._header << " overlaps a previous span.\n";
+        continue;
+      }
+      _spans[numKept++] = span;
+      limit = span._base + span._size;
+    }
+    _spans.erase(_spans.begin() + numKept, _spans.end());
+  }
+
+  void FindObjectsFreeInSpans() {
+    Reader reader(_addressMap);
+    std::vector<Offset> freeObjects;
+    for (const auto& span : _spans) {
+      if (_layout == PER_CPU_LAYOUT) {
+        if (span._sizeClass != 0 &&
+            FindPerCpuFreeObjects(reader, span, span._sizeClass,
+                                  freeObjects)) {
+          _objectsFreeInSpans.insert(_objectsFreeInSpans.end(),
+                                     freeObjects.begin(), freeObjects.end());
+        }
+        continue;
+      }
+      for (Offset object = span._freeList; object != 0;
+           object = reader.ReadOffset(object, 0)) {
+        _objectsFreeInSpans.push_back(object);
+      }
+    }
+    std::sort(_objectsFreeInSpans.begin(), _objectsFreeInSpans.end());
+  }
+
+  void ClaimSpans() {
+    for (const auto& span : _spans) {
+      if (!_virtualMemoryPartition.ClaimRange(
+              span._base, span._size,
+              span._isFree ? TCMALLOC_FREE_SPAN : TCMALLOC_SPAN, false)) {
+        std::cerr << "Warning: unexpected overlap for tcmalloc span at 0x"
+                  << std::hex << span._base << "\n";
+      }
+    }
+  }
+};
+}  // namespace Tcmalloc
+}  // namespace chap
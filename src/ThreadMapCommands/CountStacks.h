@@ -5,6 +5,7 @@
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
 #include "../SizedTally.h"
+#include "../StackRegistry.h"
 #include "../ThreadMap.h"
 namespace chap {
 namespace ThreadMapCommands {
@@ -14,12 +15,15 @@ class CountStacks : public Commands::Subcommand {
   CountStacks(const ProcessImage<Offset>& processImage)
       : Commands::Subcommand("count", "stacks"),
         _processImage(processImage),
-        _threadMap(processImage.GetThreadMap()) {}
+        _threadMap(processImage.GetThreadMap()),
+        _stackRegistry(processImage.GetStackRegistry()) {}
 
   void ShowHelpMessage(Commands::Context& context) {
     context.GetOutput()
         << "This command provides "
-           "totals of the number of threads and the space they occupy.\n";
+           "totals of the number of stacks and the space they occupy,\n"
+           "including both thread stacks and other stacks such as those of "
+           "goroutines.\n";
   }
 
   void Run(Commands::Context& context) {
@@ -27,11 +31,15 @@ class CountStacks : public Commands::Subcommand {
     for (const auto& threadInfo : _threadMap) {
       tally.AdjustTally(threadInfo._stackLimit - threadInfo._stackBase);
     }
+    for (const auto& stack : _stackRegistry) {
+      tally.AdjustTally(stack._limit - stack._base);
+    }
   }
 
  private:
   const ProcessImage<Offset>& _processImage;
   const ThreadMap<Offset>& _threadMap;
+  const StackRegistry<Offset>& _stackRegistry;
 };
 }  // namespace ThreadMapCommands
 }  // namespace chap
@@ -5,6 +5,7 @@
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
 #include "../SizedTally.h"
+#include "../StackRegistry.h"
 #include "../ThreadMap.h"
 namespace chap {
 namespace ThreadMapCommands {
@@ -15,12 +16,16 @@ class DescribeStacks : public Commands::Subcommand {
       : Commands::Subcommand("describe", "stacks"),
         _processImage(processImage),
         _threadMap(processImage.GetThreadMap()),
+        _stackRegistry(processImage.GetStackRegistry()),
         _addressMap(processImage.GetVirtualAddressMap()) {}
 
   void ShowHelpMessage(Commands::Context& context) {
     context.GetOutput()
-        << "This command describes the stacks for every thread and provides "
-           "totals of the\nnumber of threads and the space they occupy.\n";
+        << "This command describes the stacks for every thread, followed by "
+           "any other\nstacks such as those of goroutines, and provides "
+           "totals of the number of stacks\nand the space they occupy.  For "
+           "a stack that is not a thread stack it also\nshows how much of "
+           "the stack is currently live.\n";
   }
 
   void Run(Commands::Context& context) {
@@ -42,11 +47,27 @@ class DescribeStacks : public Commands::Subcommand {
              << " bytes out of 0x" << (limit - base) << " total.\n\n";
       tally.AdjustTally(limit - base);
     }
+    for (const auto& stack : _stackRegistry) {
+      Offset base = stack._base;
+      Offset limit = stack._limit;
+      Offset check0 = base;
+      while (check0 < limit && reader.ReadOffset(check0, 0xbad) == 0) {
+        check0 += sizeof(Offset);
+      }
+      output << "Stack for " << stack._stackType << " at 0x" << std::hex
+             << stack._owner << " uses stack block [0x" << base << ", "
+             << limit << ")\n current sp: 0x" << stack._stackPointer << "\n";
+      output << "Live stack usage is 0x" << (limit - stack._stackPointer)
+             << " bytes and peak stack usage was 0x" << (limit - check0)
+             << " bytes out of 0x" << (limit - base) << " total.\n\n";
+      tally.AdjustTally(limit - base);
+    }
   }
 
  private:
   const ProcessImage<Offset>& _processImage;
   const ThreadMap<Offset>& _threadMap;
+  const StackRegistry<Offset>& _stackRegistry;
   const VirtualAddressMap<Offset>& _addressMap;
 };
 }  // namespace ThreadMapCommands
@@ -5,6 +5,7 @@
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
 #include "../SizedTally.h"
+#include "../StackRegistry.h"
 #include "../ThreadMap.h"
 namespace chap {
 namespace ThreadMapCommands {
@@ -14,12 +15,14 @@ class ListStacks : public Commands::Subcommand {
   ListStacks(const ProcessImage<Offset>& processImage)
       : Commands::Subcommand("list", "stacks"),
         _processImage(processImage),
-        _threadMap(processImage.GetThreadMap()) {}
+        _threadMap(processImage.GetThreadMap()),
+        _stackRegistry(processImage.GetStackRegistry()) {}
 
   void ShowHelpMessage(Commands::Context& context) {
     context.GetOutput()
-        << "This command lists the stacks for every thread and provides "
-           "totals of the\nnumber of threads and the space they occupy.\n";
+        << "This command lists the stacks for every thread, followed by any "
+           "other stacks\nsuch as those of goroutines, and provides totals "
+           "of the number of stacks and\nthe space they occupy.\n";
   }
 
   void Run(Commands::Context& context) {
@@ -32,11 +35,19 @@ class ListStacks : public Commands::Subcommand {
              << threadInfo._stackPointer << "\n";
       tally.AdjustTally(threadInfo._stackLimit - threadInfo._stackBase);
     }
+    for (const auto& stack : _stackRegistry) {
+      output << "Stack for " << stack._stackType << " at 0x" << std::hex
+             << stack._owner << " uses stack block [0x" << stack._base << ", "
+             << stack._limit << ") current sp: 0x" << stack._stackPointer
+             << "\n";
+      tally.AdjustTally(stack._limit - stack._base);
+    }
   }
 
  private:
   const ProcessImage<Offset>& _processImage;
   const ThreadMap<Offset>& _threadMap;
+  const StackRegistry<Offset>& _stackRegistry;
 };
 }  // namespace ThreadMapCommands
 }  // namespace chap
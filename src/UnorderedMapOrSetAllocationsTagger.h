@@ -19,6 +19,7 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename TagHolder::TagIndex TagIndex;
@@ -348,7 +349,7 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
         if (_tagHolder.GetTagIndex(bucketsIndex) != 0) {
           continue;
         }
-        const Allocation* bucketsAllocation =
+        AllocationPointer bucketsAllocation =
             _directory.AllocationAt(bucketsIndex);
         if (bucketsAllocation->Address() != bucketsAddress) {
           continue;
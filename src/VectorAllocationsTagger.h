@@ -19,6 +19,7 @@ class VectorAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
   typedef typename Directory::Allocation Allocation;
+  typedef typename Directory::AllocationPointer AllocationPointer;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
   typedef typename TagHolder::TagIndex TagIndex;
@@ -174,7 +175,7 @@ class VectorAllocationsTagger : public Allocations::Tagger<Offset> {
       if (_tagHolder.GetTagIndex(bodyIndex) != 0) {
         continue;
       }
-      const Allocation* allocation = _directory.AllocationAt(bodyIndex);
+      AllocationPointer allocation = _directory.AllocationAt(bodyIndex);
 
       Offset address = allocation->Address();
       Offset bodyLimit = address + allocation->Size();
@@ -13,8 +13,11 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
  public:
   typedef
       typename Allocations::Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Allocations::PatternDescriber<Offset> Base;
   typedef typename Allocations::Directory<Offset>::Allocation Allocation;
+  typedef typename Allocations::Directory<Offset>::AllocationPointer
+      AllocationPointer;
   VectorBodyDescriber(const ProcessImage<Offset>& processImage)
       : Allocations::PatternDescriber<Offset>(processImage, "VectorBody") {}
 
@@ -28,14 +31,14 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
     Offset allocationAddress = allocation.Address();
     Offset allocationLimit = allocationAddress + allocationSize;
 
-    const AllocationIndex* pFirstIncoming;
-    const AllocationIndex* pPastIncoming;
+    EdgeIterator pFirstIncoming;
+    EdgeIterator pPastIncoming;
     Base::_graph->GetIncoming(index, &pFirstIncoming, &pPastIncoming);
 
     std::vector<VectorInfo> vectors;
-    for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+    for (EdgeIterator pNextIncoming = pFirstIncoming;
          pNextIncoming < pPastIncoming; pNextIncoming++) {
-      const Allocation* incoming =
+      AllocationPointer incoming =
           Base::_directory.AllocationAt(*pNextIncoming);
       if (incoming == 0) {
         abort();
@@ -0,0 +1,22 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * This crashes after building, in libjemalloc_layout.so, extents laid out
+ * the way jemalloc 5.0 to 5.2 lays them out.  Some of the allocations are
+ * kept by this program and some are leaked.  To build and run it:
+ *
+ * gcc -shared -fPIC -o libjemalloc_layout.so jemalloc_layout.c
+ * gcc -o ExtentLayoutTest ExtentLayoutTest.c -L. -ljemalloc_layout
+ * LD_LIBRARY_PATH=. ./ExtentLayoutTest
+ */
+
+extern int BuildHeap(void **kept);
+
+void *kept[32];
+
+int main(int argc, char **argv) {
+  BuildHeap(kept);
+  *((int *)0) = 92;
+  return 0;
+}
@@ -0,0 +1,177 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * This lays out a few extents the way jemalloc 5.0 to 5.2 does, with 4K
+ * pages and the default size classes.  The extent headers and the radix
+ * tree leaf that refers to them are in anonymous memory, as they would be
+ * for jemalloc.  Only one entry of the leaf is filled in for each extent.
+ */
+
+#define PAGE_SIZE 0x1000
+#define HEAP_PAGES 16
+#define MAX_EXTENTS 8
+#define CACHE_LINE 0x40
+#define MAX_SIZES 64
+
+/*
+ * The fields of e_bits are the arena index in the low 12 bits, then the
+ * slab, committed, dumpable and zeroed bits, 2 bits of state, which is 0
+ * for an active extent, 8 bits of size class and 10 bits of free count.
+ */
+#define SLAB_SHIFT 12
+#define COMMITTED_SHIFT 13
+#define SIZE_INDEX_SHIFT 18
+#define NUM_FREE_SHIFT 26
+
+struct Extent {
+  uint64_t bits;
+  void *address;
+  uint64_t sizeAndSerialNumber;
+  void *listLink[2];
+  void *heapLink[3];
+  uint64_t slabBitmap[8];
+};
+
+uint64_t *radixTreeLeaf;
+static char *heap;
+static uintptr_t nextPage;
+static struct Extent *extents;
+static int numExtents;
+static uint64_t sizes[MAX_SIZES];
+
+static void *Map(size_t size) {
+  void *mapped = mmap(0, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    abort();
+  }
+  return mapped;
+}
+
+static void ComputeSizes() {
+  int numSizes = 0;
+  sizes[numSizes++] = 8;
+  for (uint64_t size = 16; size <= 64; size += 16) {
+    sizes[numSizes++] = size;
+  }
+  uint64_t size = 64;
+  for (uint64_t delta = 16; numSizes + 4 <= MAX_SIZES; delta *= 2) {
+    for (int i = 0; i < 4; i++) {
+      size += delta;
+      sizes[numSizes++] = size;
+    }
+  }
+}
+
+static uint64_t IndexOfSize(uint64_t size) {
+  for (uint64_t sizeIndex = 0; sizeIndex < MAX_SIZES; sizeIndex++) {
+    if (sizes[sizeIndex] == size) {
+      return sizeIndex;
+    }
+  }
+  abort();
+}
+
+static struct Extent *NewExtent(uint64_t numPages, uint64_t size, int isSlab,
+                                uint64_t offset) {
+  struct Extent *extent = &extents[numExtents++];
+  uint64_t sizeIndex = IndexOfSize(size);
+  extent->address = heap + nextPage * PAGE_SIZE + offset;
+  extent->sizeAndSerialNumber = numPages * PAGE_SIZE;
+  extent->bits = ((uint64_t)(isSlab) << SLAB_SHIFT) |
+                 ((uint64_t)(1) << COMMITTED_SHIFT) |
+                 (sizeIndex << SIZE_INDEX_SHIFT);
+  radixTreeLeaf[nextPage] = (sizeIndex << 48) | (uint64_t)(extent) | isSlab;
+  nextPage += numPages;
+  return extent;
+}
+
+/*
+ * Create a slab for regions of the given size, with the given regions in
+ * use.
+ */
+static struct Extent *NewSlab(uint64_t numPages, uint64_t size,
+                              const int *used, int numUsed) {
+  struct Extent *extent = NewExtent(numPages, size, 1, 0);
+  uint64_t numRegions = numPages * PAGE_SIZE / size;
+  for (int i = 0; i < numUsed; i++) {
+    extent->slabBitmap[used[i] / 64] |= ((uint64_t)(1)) << (used[i] % 64);
+  }
+  extent->bits |= (numRegions - numUsed) << NUM_FREE_SHIFT;
+  return extent;
+}
+
+static void *RegionOf(struct Extent *extent, int regionIndex) {
+  return (char *)(extent->address) +
+         regionIndex * sizes[(extent->bits >> SIZE_INDEX_SHIFT) & 0xff];
+}
+
+/*
+ * Build the extents, filling the given array with the allocations that the
+ * program should keep and returning how many there are.
+ */
+int BuildHeap(void **kept) {
+  int numKept = 0;
+  int used[32];
+  ComputeSizes();
+  heap = Map(HEAP_PAGES * PAGE_SIZE);
+  extents = Map(MAX_EXTENTS * sizeof(struct Extent));
+  radixTreeLeaf = Map(HEAP_PAGES * sizeof(uint64_t));
+
+  /*
+   * Of the 25 regions in use in the slab of 16 byte regions, 20 are kept
+   * and 5 are leaked.
+   */
+  for (int i = 0; i < 25; i++) {
+    used[i] = i;
+  }
+  struct Extent *slab16 = NewSlab(1, 16, used, 25);
+  for (int i = 0; i < 25; i++) {
+    memset(RegionOf(slab16, i), 0x20 + i, 16);
+    if (i < 20) {
+      kept[numKept++] = RegionOf(slab16, i);
+    }
+  }
+
+  /*
+   * The 8 regions in use in the slab of 48 byte regions form a list.
+   */
+  struct Extent *slab48 = NewSlab(3, 48, used, 8);
+  for (int i = 0; i < 8; i++) {
+    memset(RegionOf(slab48, i), 0x40 + i, 48);
+    *(void **)(RegionOf(slab48, i)) = (i < 7) ? RegionOf(slab48, i + 1) : 0;
+  }
+  kept[numKept++] = RegionOf(slab48, 0);
+
+  /*
+   * The regions in use in the slab of 64 byte regions are not adjacent.
+   */
+  for (int i = 0; i < 3; i++) {
+    used[i] = 2 * i;
+  }
+  struct Extent *slab64 = NewSlab(1, 64, used, 3);
+  for (int i = 0; i < 3; i++) {
+    memset(RegionOf(slab64, 2 * i), 0x60 + i, 64);
+    kept[numKept++] = RegionOf(slab64, 2 * i);
+  }
+
+  /*
+   * One large allocation is kept.  Another, which starts a few cache lines
+   * into an extent with an extra page, is leaked but refers to one of the
+   * leaked small regions.
+   */
+  struct Extent *keptLarge = NewExtent(4, 4 * PAGE_SIZE, 0, 0);
+  memset(keptLarge->address, 0x70, 4 * PAGE_SIZE);
+  kept[numKept++] = keptLarge->address;
+  struct Extent *leakedLarge =
+      NewExtent(6, 5 * PAGE_SIZE, 0, 3 * CACHE_LINE);
+  memset(leakedLarge->address, 0x71, 5 * PAGE_SIZE);
+  *(void **)(leakedLarge->address) = RegionOf(slab16, 22);
+  return numKept;
+}
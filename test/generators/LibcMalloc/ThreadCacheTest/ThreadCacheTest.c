@@ -0,0 +1,40 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#include <malloc.h>
+#include <string.h>
+
+/*
+ * This leaves allocations on the tcache bins of the main thread.  With glibc
+ * 2.32 and later the tcache lists are mangled.  A few allocations of each of
+ * a few sizes are freed, and for one size more are freed than fit on one
+ * tcache bin, so that the rest go to a fast bin.  Some allocations of the
+ * same sizes are kept and referenced from a static array, so that used and
+ * thread cached allocations are interleaved.
+ */
+
+void *kept[8];
+
+static void AllocateAndFree(void **keep, size_t size, int numToFree) {
+  void *toFree[16];
+  for (int i = 0; i < numToFree; i++) {
+    toFree[i] = malloc(size);
+    memset(toFree[i], 0x40 + i, size);
+    if (i < 2) {
+      keep[i] = malloc(size);
+      memset(keep[i], 0x60 + i, size);
+    }
+  }
+  for (int i = 0; i < numToFree; i++) {
+    free(toFree[i]);
+  }
+}
+
+int main(int argc, const char **argv) {
+  AllocateAndFree(kept, 0x18, 3);
+  AllocateAndFree(kept + 2, 0x28, 1);
+  AllocateAndFree(kept + 4, 0x48, 10);
+  AllocateAndFree(kept + 6, 0x98, 2);
+  *((int *)0) = 92;  // crash
+  return 0;
+}
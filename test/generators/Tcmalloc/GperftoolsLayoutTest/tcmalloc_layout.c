@@ -0,0 +1,275 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * This lays out a small page heap the way the gperftools version of
+ * tcmalloc does, with 8K pages.  The spans, the leaf of the page map that
+ * covers the page heap and the thread cache are in anonymous memory, as
+ * they would be for tcmalloc, and the size classes and central free lists
+ * are static.  Only the one leaf of the page map is built.
+ */
+
+#define PAGE_SHIFT 13
+#define PAGE_SIZE (((uintptr_t)1) << PAGE_SHIFT)
+#define HEAP_PAGES 32
+#define LEAF_LENGTH 0x1000
+#define NUM_TRANSFER_SLOTS 64
+#define CLASS_ARRAY_SIZE 2169
+#define MAX_SPANS 16
+
+static const int32_t sizes[] = {
+    0,    8,    16,   24,   32,   48,   64,   80,   96,   112,  128,  144,
+    160,  176,  192,  208,  224,  240,  256,  288,  320,  352,  384,  416,
+    448,  480,  512,  576,  640,  704,  768,  896,  1024, 1152, 1280, 1408,
+    1536, 1792, 2048, 2304, 2560, 2816, 3072, 3328, 4096, 4608, 5120, 6144,
+    6528, 8192, 9344, 10880, 12288, 13568, 16384, 20480, 24576, 28672, 32768};
+#define NUM_CLASSES (sizeof(sizes) / sizeof(sizes[0]))
+
+struct SizeMap {
+  int numObjectsToMove[NUM_CLASSES];
+  unsigned char classArray[CLASS_ARRAY_SIZE];
+  int32_t classToSize[NUM_CLASSES];
+  size_t classToPages[NUM_CLASSES];
+};
+struct SizeMap sizeMap;
+
+struct Span {
+  uintptr_t start;
+  uintptr_t length;
+  struct Span *next;
+  struct Span *prev;
+  void *objects;
+  unsigned int refcount : 16;
+  unsigned int sizeclass : 8;
+  unsigned int location : 2;
+  unsigned int sample : 1;
+};
+
+struct TCEntry {
+  void *head;
+  void *tail;
+};
+
+struct CentralFreeList {
+  int lock;
+  size_t sizeClass;
+  struct Span empty;
+  struct Span nonEmpty;
+  size_t numSpans;
+  size_t counter;
+  struct TCEntry tcSlots[NUM_TRANSFER_SLOTS];
+  int32_t usedSlots;
+  int32_t cacheSize;
+  int32_t maxCacheSize;
+};
+struct CentralFreeList centralCache[NUM_CLASSES];
+
+struct FreeList {
+  void *list;
+  uint32_t length;
+  uint32_t lowater;
+  uint32_t maxLength;
+  uint32_t lengthOverages;
+};
+
+struct ThreadCache {
+  struct FreeList list[NUM_CLASSES];
+  int32_t size;
+  int32_t maxSize;
+};
+
+void **pageMapLeaf;
+struct ThreadCache *threadCache;
+static char *heap;
+static uintptr_t nextPage;
+static struct Span *spans;
+static int numSpans;
+static void *sampledStack[4];
+
+static void *Map(size_t size, size_t alignment) {
+  char *mapped = mmap(0, size + alignment, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    abort();
+  }
+  return (void *)(((uintptr_t)(mapped) + alignment - 1) & ~(alignment - 1));
+}
+
+static int ClassOfSize(int32_t size) {
+  for (int sizeClass = 1; sizeClass < NUM_CLASSES; sizeClass++) {
+    if (sizeMap.classToSize[sizeClass] == size) {
+      return sizeClass;
+    }
+  }
+  abort();
+}
+
+static char *SpanStart(struct Span *span) {
+  return (char *)(span->start << PAGE_SHIFT);
+}
+
+static void InsertAfter(struct Span *listHead, struct Span *span) {
+  span->prev = listHead;
+  span->next = listHead->next;
+  listHead->next->prev = span;
+  listHead->next = span;
+}
+
+static struct Span *NewSpan(uintptr_t numPages) {
+  struct Span *span = &spans[numSpans++];
+  span->start = ((uintptr_t)(heap) >> PAGE_SHIFT) + nextPage;
+  span->length = numPages;
+  nextPage += numPages;
+  for (uintptr_t i = 0; i < numPages; i++) {
+    pageMapLeaf[(span->start & (LEAF_LENGTH - 1)) + i] = span;
+  }
+  return span;
+}
+
+static void *ObjectOf(struct Span *span, int objectIndex) {
+  return SpanStart(span) + objectIndex * sizeMap.classToSize[span->sizeclass];
+}
+
+/*
+ * Hand out the given number of objects from the start of the span, putting
+ * the rest on the free list of the span, and link the span to the list of
+ * spans with free objects or of full spans of its central free list.
+ */
+static struct Span *NewSmallSpan(int32_t size, uintptr_t numPages,
+                                 int numHandedOut) {
+  struct Span *span = NewSpan(numPages);
+  int numObjects = (numPages << PAGE_SHIFT) / size;
+  span->sizeclass = ClassOfSize(size);
+  span->refcount = numHandedOut;
+  for (int i = numObjects - 1; i >= numHandedOut; i--) {
+    *(void **)(ObjectOf(span, i)) = span->objects;
+    span->objects = ObjectOf(span, i);
+  }
+  struct CentralFreeList *central = &centralCache[span->sizeclass];
+  InsertAfter((numHandedOut < numObjects) ? &central->nonEmpty
+                                          : &central->empty,
+              span);
+  return span;
+}
+
+/*
+ * Link the given objects of the span, which must be handed out, and return
+ * the first one.
+ */
+static void *LinkObjects(struct Span *span, int first, int numObjects) {
+  for (int i = first; i < first + numObjects; i++) {
+    *(void **)(ObjectOf(span, i)) =
+        (i + 1 < first + numObjects) ? ObjectOf(span, i + 1) : 0;
+  }
+  return ObjectOf(span, first);
+}
+
+static void CacheInThread(struct Span *span, int first, int numObjects) {
+  struct FreeList *freeList = &threadCache->list[span->sizeclass];
+  freeList->list = LinkObjects(span, first, numObjects);
+  freeList->length = numObjects;
+  freeList->lowater = numObjects;
+  freeList->maxLength = 64;
+}
+
+static void CacheInTransferSlot(struct Span *span, int first,
+                                int numObjects) {
+  struct CentralFreeList *central = &centralCache[span->sizeclass];
+  struct TCEntry *slot = &central->tcSlots[central->usedSlots++];
+  slot->head = LinkObjects(span, first, numObjects);
+  slot->tail = ObjectOf(span, first + numObjects - 1);
+}
+
+/*
+ * Build the page heap, filling the given array with the objects that the
+ * program should keep and returning how many there are.
+ */
+int BuildHeap(void **kept) {
+  int numKept = 0;
+  for (int sizeClass = 0; sizeClass < NUM_CLASSES; sizeClass++) {
+    struct CentralFreeList *central = &centralCache[sizeClass];
+    sizeMap.classToSize[sizeClass] = sizes[sizeClass];
+    sizeMap.classToPages[sizeClass] = 1;
+    sizeMap.numObjectsToMove[sizeClass] = 32;
+    central->sizeClass = sizeClass;
+    central->empty.next = central->empty.prev = &central->empty;
+    central->nonEmpty.next = central->nonEmpty.prev = &central->nonEmpty;
+  }
+  heap = Map(HEAP_PAGES * PAGE_SIZE, HEAP_PAGES * PAGE_SIZE);
+  spans = Map(MAX_SPANS * sizeof(struct Span), PAGE_SIZE);
+  pageMapLeaf = Map(LEAF_LENGTH * sizeof(void *), PAGE_SIZE);
+  threadCache = Map(sizeof(struct ThreadCache), PAGE_SIZE);
+
+  /*
+   * Of the 20 objects handed out of the span of 32 byte objects, 10 are
+   * kept, 4 are leaked, 4 are cached by the thread and 2 are in a transfer
+   * slot of the central free list.
+   */
+  struct Span *span32 = NewSmallSpan(32, 1, 20);
+  for (int i = 0; i < 14; i++) {
+    memset(ObjectOf(span32, i), 0x20 + i, 32);
+  }
+  for (int i = 0; i < 10; i++) {
+    kept[numKept++] = ObjectOf(span32, i);
+  }
+  CacheInThread(span32, 14, 4);
+  CacheInTransferSlot(span32, 18, 2);
+
+  /*
+   * Of the 10 objects handed out of the span of 256 byte objects, 4 are
+   * kept, in a list, 4 are cached by the thread and 2 are in a transfer
+   * slot of the central free list.
+   */
+  struct Span *span256 = NewSmallSpan(256, 2, 10);
+  for (int i = 0; i < 4; i++) {
+    memset(ObjectOf(span256, i), 0x40 + i, 256);
+  }
+  kept[numKept++] = LinkObjects(span256, 0, 4);
+  CacheInThread(span256, 4, 4);
+  CacheInTransferSlot(span256, 8, 2);
+
+  /*
+   * Both objects of the span of 4096 byte objects are handed out, so the
+   * span is on the list of full spans.  One is kept and the other is cached
+   * by the thread.
+   */
+  struct Span *span4096 = NewSmallSpan(4096, 1, 2);
+  memset(ObjectOf(span4096, 0), 0x60, 4096);
+  kept[numKept++] = ObjectOf(span4096, 0);
+  CacheInThread(span4096, 1, 1);
+
+  /*
+   * One large allocation is kept and another is leaked, but refers to one
+   * of the leaked small objects.
+   */
+  struct Span *keptLarge = NewSpan(3);
+  memset(SpanStart(keptLarge), 0x70, 3 * PAGE_SIZE);
+  kept[numKept++] = SpanStart(keptLarge);
+  struct Span *leakedLarge = NewSpan(2);
+  memset(SpanStart(leakedLarge), 0x71, 2 * PAGE_SIZE);
+  *(void **)(SpanStart(leakedLarge)) = ObjectOf(span32, 12);
+
+  /*
+   * A free span has page map entries only for its first and last pages.
+   */
+  struct Span *freeSpan = NewSpan(4);
+  freeSpan->location = 1;
+  pageMapLeaf[(freeSpan->start & (LEAF_LENGTH - 1)) + 1] = 0;
+  pageMapLeaf[(freeSpan->start & (LEAF_LENGTH - 1)) + 2] = 0;
+
+  /*
+   * A sampled allocation has its own span, which refers to the stack.
+   */
+  struct Span *sampledSpan = NewSpan(1);
+  sampledSpan->sample = 1;
+  sampledSpan->objects = sampledStack;
+  memset(SpanStart(sampledSpan), 0x72, PAGE_SIZE);
+  kept[numKept++] = SpanStart(sampledSpan);
+  return numKept;
+}
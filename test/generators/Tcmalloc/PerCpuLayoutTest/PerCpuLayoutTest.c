@@ -0,0 +1,23 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * This crashes after building, in libtcmalloc_layout.so, a page heap laid
+ * out the way the version of tcmalloc with per-CPU caches lays it out.  Some
+ * of the objects are kept by this program, some are leaked and some are
+ * held by the per-CPU slabs.  To build and run it:
+ *
+ * gcc -shared -fPIC -o libtcmalloc_layout.so tcmalloc_layout.c
+ * gcc -o PerCpuLayoutTest PerCpuLayoutTest.c -L. -ltcmalloc_layout
+ * LD_LIBRARY_PATH=. ./PerCpuLayoutTest
+ */
+
+extern int BuildHeap(void **kept);
+
+void *kept[32];
+
+int main(int argc, char **argv) {
+  BuildHeap(kept);
+  *((int *)0) = 92;
+  return 0;
+}
@@ -0,0 +1,253 @@
+// Copyright (c) 2020 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * This lays out a small page heap the way the version of tcmalloc with
+ * per-CPU caches does, with 8K pages.  The spans, the leaf of the page map
+ * that covers the page heap and the per-CPU slabs are in anonymous memory,
+ * as they would be for tcmalloc, and the size classes are in the static
+ * size map.  Only the one leaf of the page map is built.
+ */
+
+#define PAGE_SHIFT 13
+#define PAGE_SIZE (((uintptr_t)1) << PAGE_SHIFT)
+#define HEAP_PAGES 32
+#define LEAF_LENGTH 0x8000
+#define NUM_HUGE_PAGES (LEAF_LENGTH * PAGE_SIZE / 0x200000)
+#define LIST_END 0xffff
+#define CACHE_SIZE 4
+#define NUM_CPUS 2
+#define SLAB_SHIFT 18
+#define SLOTS_PER_CLASS 16
+#define MAX_SPANS 16
+
+static const uint32_t sizes[] = {
+    0,    8,    16,   24,   32,   40,   48,   56,   64,    72,
+    80,   88,   96,   104,  112,  120,  128,  144,  160,   176,
+    192,  208,  224,  240,  256,  288,  320,  352,  384,   448,
+    512,  640,  768,  1024, 1536, 2048, 4096, 8192, 16384, 32768};
+#define NUM_CLASSES (sizeof(sizes) / sizeof(sizes[0]))
+
+struct SizeMap {
+  unsigned char classToPages[NUM_CLASSES];
+  unsigned char numObjectsToMove[NUM_CLASSES];
+  uint32_t classToSize[NUM_CLASSES];
+};
+struct SizeMap sizeMap;
+
+struct Span {
+  struct Span *next;
+  struct Span *prev;
+  uint16_t allocated;
+  uint16_t embedCount;
+  uint16_t freeList;
+  uint8_t cacheSize;
+  uint8_t location : 2;
+  uint8_t sampled : 1;
+  union {
+    uint16_t cache[CACHE_SIZE];
+    void *sampledStack;
+  };
+  uintptr_t firstPage;
+  uintptr_t numPages;
+};
+
+struct Leaf {
+  uint8_t sizeClass[LEAF_LENGTH];
+  struct Span *span[LEAF_LENGTH];
+  void *hugePage[NUM_HUGE_PAGES];
+};
+
+struct Leaf *pageMapLeaf;
+uint64_t *slabs;
+static char *heap;
+static uintptr_t nextPage;
+static struct Span *spans;
+static int numSpans;
+static void *sampledStack[4];
+
+static void *Map(size_t size, size_t alignment) {
+  char *mapped = mmap(0, size + alignment, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    abort();
+  }
+  return (void *)(((uintptr_t)(mapped) + alignment - 1) & ~(alignment - 1));
+}
+
+static int ClassOfSize(uint32_t size) {
+  for (int sizeClass = 1; sizeClass < NUM_CLASSES; sizeClass++) {
+    if (sizeMap.classToSize[sizeClass] == size) {
+      return sizeClass;
+    }
+  }
+  abort();
+}
+
+static char *SpanStart(struct Span *span) {
+  return (char *)(span->firstPage << PAGE_SHIFT);
+}
+
+static struct Span *NewSpan(uintptr_t numPages, int sizeClass) {
+  struct Span *span = &spans[numSpans++];
+  span->firstPage = ((uintptr_t)(heap) >> PAGE_SHIFT) + nextPage;
+  span->numPages = numPages;
+  nextPage += numPages;
+  uintptr_t index = span->firstPage & (LEAF_LENGTH - 1);
+  for (uintptr_t i = 0; i < numPages; i++) {
+    pageMapLeaf->span[index + i] = span;
+    pageMapLeaf->sizeClass[index + i] = sizeClass;
+  }
+  return span;
+}
+
+static uint16_t IndexOf(struct Span *span, char *object, uint32_t size) {
+  return (object - SpanStart(span)) / (size < 512 ? 8 : 64);
+}
+
+/*
+ * Hand out the given number of objects from the start of the span, putting
+ * up to the given number of the rest in the cache embedded in the span and
+ * the others on the free list of the span.  Each object on that list holds
+ * the index of the next one, followed by as many indices of other free
+ * objects as fit, except that the first one holds only embedCount of them.
+ */
+static struct Span *NewSmallSpan(uint32_t size, uintptr_t numPages,
+                                 int numHandedOut, int numInCache) {
+  int sizeClass = ClassOfSize(size);
+  struct Span *span = NewSpan(numPages, sizeClass);
+  char *start = SpanStart(span);
+  int numObjects = (numPages << PAGE_SHIFT) / size;
+  int capacity = size / 2 - 1;
+  int next = numHandedOut;
+  span->allocated = numHandedOut;
+  span->freeList = LIST_END;
+  while (span->cacheSize < numInCache && next < numObjects) {
+    span->cache[span->cacheSize++] = IndexOf(span, start + next++ * size, size);
+  }
+  while (next < numObjects) {
+    char *holder = start + next++ * size;
+    uint16_t *indices = (uint16_t *)(holder);
+    int numIndices = 0;
+    indices[0] = span->freeList;
+    span->freeList = IndexOf(span, holder, size);
+    while (numIndices < capacity && next < numObjects) {
+      indices[++numIndices] = IndexOf(span, start + next++ * size, size);
+    }
+    span->embedCount = numIndices;
+  }
+  return span;
+}
+
+static void *ObjectOf(struct Span *span, int objectIndex) {
+  uint32_t size = sizeMap.classToSize[pageMapLeaf->sizeClass[
+      span->firstPage & (LEAF_LENGTH - 1)]];
+  return SpanStart(span) + objectIndex * size;
+}
+
+static void CacheOnCpu(int cpu, struct Span *span, int objectIndex) {
+  int sizeClass = pageMapLeaf->sizeClass[span->firstPage & (LEAF_LENGTH - 1)];
+  uint64_t *slab = slabs + (((uintptr_t)(cpu)) << SLAB_SHIFT) / 8;
+  uint16_t current = slab[sizeClass] & 0xffff;
+  slab[current] = (uint64_t)(ObjectOf(span, objectIndex));
+  slab[sizeClass]++;
+}
+
+/*
+ * Build the page heap, filling the given array with the objects that the
+ * program should keep and returning how many there are.
+ */
+int BuildHeap(void **kept) {
+  int numKept = 0;
+  for (int sizeClass = 0; sizeClass < NUM_CLASSES; sizeClass++) {
+    sizeMap.classToSize[sizeClass] = sizes[sizeClass];
+    sizeMap.classToPages[sizeClass] = 1;
+    sizeMap.numObjectsToMove[sizeClass] = 32;
+  }
+  heap = Map(HEAP_PAGES * PAGE_SIZE, HEAP_PAGES * PAGE_SIZE);
+  spans = Map(MAX_SPANS * sizeof(struct Span), PAGE_SIZE);
+  pageMapLeaf = Map(sizeof(struct Leaf), PAGE_SIZE);
+  slabs = Map(NUM_CPUS << SLAB_SHIFT, 1 << SLAB_SHIFT);
+  for (int cpu = 0; cpu < NUM_CPUS; cpu++) {
+    uint64_t *slab = slabs + (((uintptr_t)(cpu)) << SLAB_SHIFT) / 8;
+    for (int sizeClass = 1; sizeClass < NUM_CLASSES; sizeClass++) {
+      uint64_t begin = NUM_CLASSES + (sizeClass - 1) * SLOTS_PER_CLASS;
+      uint64_t end = begin + SLOTS_PER_CLASS;
+      slab[sizeClass] = begin | (end << 16) | (begin << 32) | (end << 48);
+    }
+  }
+
+  /*
+   * Of the 20 objects handed out of the span of 32 byte objects, 10 are
+   * kept, 4 are leaked and 6 are cached for the first CPU.
+   */
+  struct Span *span32 = NewSmallSpan(32, 1, 20, 3);
+  for (int i = 0; i < 14; i++) {
+    memset(ObjectOf(span32, i), 0x20 + i, 32);
+  }
+  for (int i = 0; i < 10; i++) {
+    kept[numKept++] = ObjectOf(span32, i);
+  }
+  for (int i = 14; i < 20; i++) {
+    CacheOnCpu(0, span32, i);
+  }
+
+  /*
+   * Of the 8 objects handed out of the span of 256 byte objects, 4 are
+   * kept, in a list, and 4 are cached for the second CPU.
+   */
+  struct Span *span256 = NewSmallSpan(256, 2, 8, 4);
+  for (int i = 0; i < 4; i++) {
+    memset(ObjectOf(span256, i), 0x40 + i, 256);
+    *(void **)(ObjectOf(span256, i)) = (i < 3) ? ObjectOf(span256, i + 1) : 0;
+  }
+  kept[numKept++] = ObjectOf(span256, 0);
+  for (int i = 4; i < 8; i++) {
+    CacheOnCpu(1, span256, i);
+  }
+
+  /*
+   * Of the 3 objects handed out of the span of 1024 byte objects, 2 are
+   * kept and 1 is cached for the first CPU.
+   */
+  struct Span *span1024 = NewSmallSpan(1024, 1, 3, 1);
+  for (int i = 0; i < 2; i++) {
+    memset(ObjectOf(span1024, i), 0x60 + i, 1024);
+    kept[numKept++] = ObjectOf(span1024, i);
+  }
+  CacheOnCpu(0, span1024, 2);
+
+  /*
+   * One large allocation is kept and another is leaked, but refers to one
+   * of the leaked small objects.
+   */
+  struct Span *keptLarge = NewSpan(3, 0);
+  memset(SpanStart(keptLarge), 0x70, 3 * PAGE_SIZE);
+  kept[numKept++] = SpanStart(keptLarge);
+  struct Span *leakedLarge = NewSpan(2, 0);
+  memset(SpanStart(leakedLarge), 0x71, 2 * PAGE_SIZE);
+  *(void **)(SpanStart(leakedLarge)) = ObjectOf(span32, 12);
+
+  /*
+   * A free span has page map entries only for its first and last pages.
+   */
+  struct Span *freeSpan = NewSpan(4, 0);
+  freeSpan->location = 1;
+  pageMapLeaf->span[(freeSpan->firstPage & (LEAF_LENGTH - 1)) + 1] = 0;
+  pageMapLeaf->span[(freeSpan->firstPage & (LEAF_LENGTH - 1)) + 2] = 0;
+
+  /*
+   * A sampled allocation has its own span, which refers to the stack.
+   */
+  struct Span *sampledSpan = NewSpan(1, 0);
+  sampledSpan->sampled = 1;
+  sampledSpan->sampledStack = sampledStack;
+  memset(SpanStart(sampledSpan), 0x72, PAGE_SIZE);
+  kept[numKept++] = SpanStart(sampledSpan);
+  return numKept;
+}